@@ -0,0 +1,157 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemoryMirror.h"
+#include "checkpoint/MemArea.h"
+#include "logging.h"
+#include "GlobalState.h"
+#include "../shared/MemoryMirror.h"
+#include "../shared/messages.h"
+#include "../shared/sockethelpers.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace libtas {
+
+/* The mirror is created before any savestate, so these values are identical
+ * in all savestates */
+static char* mirror = nullptr;
+static int mirror_fd = -1;
+
+static MirrorHeader* header()
+{
+    return reinterpret_cast<MirrorHeader*>(mirror);
+}
+
+static char* page(int index)
+{
+    return mirror + MIRROR_HEADER_SIZE + static_cast<size_t>(index) * MIRROR_PAGE_SIZE;
+}
+
+void MemoryMirror::init()
+{
+    if (mirror)
+        return;
+
+#ifdef __linux__
+    mirror_fd = syscall(SYS_memfd_create, "libtas_mirror", 0);
+    if (mirror_fd < 0) {
+        debuglogstdio(LCF_SOCKET | LCF_ERROR, "Could not create the memory mirror");
+        return;
+    }
+
+    /* The memfd is sparse, so this only uses memory for mirrored pages */
+    if (ftruncate(mirror_fd, MIRROR_SIZE) != 0) {
+        debuglogstdio(LCF_SOCKET | LCF_ERROR, "Could not resize the memory mirror");
+        NATIVECALL(close(mirror_fd));
+        mirror_fd = -1;
+        return;
+    }
+
+    void* addr = mmap(nullptr, MIRROR_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_NORESERVE, mirror_fd, 0);
+    if (addr == MAP_FAILED) {
+        debuglogstdio(LCF_SOCKET | LCF_ERROR, "Could not map the memory mirror");
+        NATIVECALL(close(mirror_fd));
+        mirror_fd = -1;
+        return;
+    }
+
+    mirror = static_cast<char*>(addr);
+    debuglogstdio(LCF_SOCKET, "Created memory mirror of %d pages at %p", MIRROR_MAX_PAGES, mirror);
+#endif
+}
+
+int MemoryMirror::fd()
+{
+    return mirror_fd;
+}
+
+bool MemoryMirror::isMirror(const Area *area)
+{
+    return mirror && (area->addr == mirror) && (area->size == MIRROR_SIZE);
+}
+
+void MemoryMirror::receive()
+{
+    int count;
+    receiveData(&count, sizeof(int));
+
+    uint64_t addr;
+    int stored = 0;
+    for (int i = 0; i < count; i++) {
+        receiveData(&addr, sizeof(uint64_t));
+        if (mirror && (stored < MIRROR_MAX_PAGES))
+            header()->addresses[stored++] = addr;
+    }
+
+    if (mirror) {
+        header()->count = stored;
+        update();
+    }
+
+    sendMessage(MSGB_MEMORY_MIRROR);
+    sendData(&stored, sizeof(int));
+}
+
+void MemoryMirror::update()
+{
+    if (!mirror)
+        return;
+
+    MirrorHeader* h = header();
+    int count = h->count;
+    if (count == 0)
+        return;
+
+    /* We copy the pages using the syscall on our own process instead of
+     * memcpy, so that unmapped or protected pages don't crash the game */
+    static struct iovec local[MIRROR_MAX_PAGES];
+    static struct iovec remote[MIRROR_MAX_PAGES];
+    for (int i = 0; i < count; i++) {
+        local[i].iov_base = page(i);
+        local[i].iov_len = MIRROR_PAGE_SIZE;
+        remote[i].iov_base = reinterpret_cast<void*>(h->addresses[i]);
+        remote[i].iov_len = MIRROR_PAGE_SIZE;
+        h->valid[i] = 0;
+    }
+
+    pid_t pid;
+    NATIVECALL(pid = getpid());
+
+    /* The syscall stops at the first page that cannot be read, so we
+     * continue after it */
+    int i = 0;
+    while (i < count) {
+        ssize_t ret = process_vm_readv(pid, &local[i], count - i, &remote[i], count - i, 0);
+        int read_pages = (ret > 0) ? (ret / MIRROR_PAGE_SIZE) : 0;
+        for (int p = 0; p < read_pages; p++)
+            h->valid[i+p] = 1;
+        i += read_pages + 1;
+    }
+}
+
+}
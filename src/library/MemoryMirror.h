@@ -0,0 +1,53 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMORYMIRROR_H
+#define LIBTAS_MEMORYMIRROR_H
+
+namespace libtas {
+
+struct Area;
+
+/* Copy of selected game memory pages into a memfd shared with the program
+ * (see shared/MemoryMirror.h). The mirror is mapped once at startup, so that
+ * its mapping is identical in all savestates and can be skipped by them.
+ * The list of mirrored pages is stored inside the mirror, so that it is not
+ * modified when loading a savestate. */
+namespace MemoryMirror {
+
+/* Create the mirror. Must be called before any savestate. */
+void init();
+
+/* File descriptor of the mirror, or -1 */
+int fd();
+
+/* Returns if a memory area is the mirror mapping */
+bool isMirror(const Area *area);
+
+/* Receive the list of pages to mirror from the program, copy them and
+ * send back the number of pages that could be copied */
+void receive();
+
+/* Copy all mirrored pages from game memory */
+void update();
+
+}
+}
+
+#endif
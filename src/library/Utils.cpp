@@ -21,6 +21,7 @@
 
 #include "Utils.h"
 #include "logging.h"
+#include "checkpoint/PageKernels.h"
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -87,19 +88,12 @@ ssize_t Utils::readAll(int fd, void *buf, size_t count)
  */
 bool Utils::isZeroPage(void *addr)
 {
-    static const size_t page_size = 4096;
-    long long *buf = (long long *)addr;
-    size_t end = page_size / sizeof(*buf);
-    long long res = 0;
+    return PageKernels::isZero(PageKernels::best(), addr);
+}
 
-    for (size_t i = 0; i + 7 < end; i += 8) {
-        res = buf[i + 0] | buf[i + 1] | buf[i + 2] | buf[i + 3] |
-        buf[i + 4] | buf[i + 5] | buf[i + 6] | buf[i + 7];
-        if (res != 0) {
-            break;
-        }
-    }
-    return res == 0;
+bool Utils::isEqualPage(const void *addr1, const void *addr2)
+{
+    return PageKernels::isEqual(PageKernels::best(), addr1, addr2);
 }
 
 }
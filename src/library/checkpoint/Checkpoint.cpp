@@ -44,10 +44,19 @@
 #include <csignal>
 #include <stdint.h>
 #include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <time.h>
 #include "errno.h"
 #include "../renderhud/RenderHUD.h"
 #include "ReservedMemory.h"
 #include "SaveState.h"
+#include "StateIndex.h"
+#include "CheckpointStats.h"
+#include "CheckpointWorkers.h"
+#include "Codec.h"
+#include "PageStore.h"
+#include "../MemoryMirror.h"
+#include "LazyLoad.h"
 #include "../../external/lz4.h"
 #include "../../shared/sockethelpers.h"
 
@@ -81,15 +90,30 @@ static int ss_index = -1;
 static int parent_ss_index = -1;
 static int base_ss_index = -1;
 
+/* Savestate settings when the parent state was set */
+static int parent_settings = 0;
+
 static bool skipArea(const Area *area);
 
 static void readAllAreas();
 static int reallocateArea(Area *saved_area, Area *current_area);
-static void readAnArea(SaveState &saved_area, int spmfd, SaveState &parent_state, SaveState &base_state);
+static void readAnArea(SaveState &saved_area, int spmfd, SaveState &parent_state, SaveState &base_state, bool lazy, SavestateStats::Area* area_stats, size_t &restored_pages, size_t &skipped_pages);
 
 static void writeAllAreas(bool base);
 static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &parent_state, bool base);
 
+struct ForkedSave;
+static void resetParent();
+static bool isParentPending(const ForkedSave* own_save);
+
+static void resetJobs();
+static size_t queuePage(int pfd, char* ss_pagemaps, int ss_pagemap_i, char* addr);
+static size_t flushAllJobs(int pfd, char* ss_pagemaps);
+
+static size_t storePage(int pfd, char* ss_pagemaps, int ss_pagemap_i, char* addr, uint32_t* stored_indexes, int &stored_i);
+static size_t flushStoredIndexes(int pfd, uint32_t* stored_indexes, int &stored_i);
+static void releaseStoredPages(int index);
+
 void Checkpoint::setSavestatePath(std::string path)
 {
     std::string pmpath = path + ".pm";
@@ -118,12 +142,99 @@ void Checkpoint::setBaseSavestateIndex(int index)
     base_ss_index = index;
 }
 
+static int getPagemapFd(int index)
+{
+    if (index < 0) return 0;
+    int* pagemaps = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGEMAPS_ADDR));
+    return pagemaps[index];
+}
+
+static int getPagesFd(int index)
+{
+    if (index < 0) return 0;
+    int* pages = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGES_ADDR));
+    return pages[index];
+}
+
+static void setPagemapFd(int index, int fd)
+{
+    int* pagemaps = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGEMAPS_ADDR));
+    pagemaps[index] = fd;
+}
+static void setPagesFd(int index, int fd)
+{
+    int* pages = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGES_ADDR));
+    pages[index] = fd;
+}
+
+/* A savestate being written by a forked process. The state is written into
+ * new memfds or into temporary files, and is only installed in its slot when
+ * the process has finished, so that several states can be saved at once. */
+struct ForkedSave {
+    bool used;
+    pid_t pid;
+    int index;
+
+    /* Incremented for each save of a slot, so that an older save never
+     * replaces a more recent one */
+    unsigned int generation;
+
+    /* Memfds when storing savestates in RAM, or 0 */
+    int pmfd;
+    int pfd;
+
+    char pagemappath[1024];
+    char pagespath[1024];
+    char temppagemappath[1024];
+    char temppagespath[1024];
+};
+
+#define MAX_FORKED_SAVES 16
+
+/* Forked saves are stored in our reserved memory, so that they are not lost
+ * when loading a state */
+struct ForkedSaves {
+    /* Generation of the last started save of each slot */
+    unsigned int started[11];
+
+    /* Generation of the state currently stored in each slot */
+    unsigned int installed[11];
+
+    /* Forked save that will become the parent state once installed, or 0 */
+    int parent_index;
+    unsigned int parent_generation;
+
+    ForkedSave saves[MAX_FORKED_SAVES];
+};
+
+static_assert(sizeof(ForkedSaves) <= ReservedMemory::FORK_SIZE, "Forked saves do not fit in reserved memory");
+
+static ForkedSaves* getForkedSaves()
+{
+    return static_cast<ForkedSaves*>(ReservedMemory::getAddr(ReservedMemory::FORK_ADDR));
+}
+
 void Checkpoint::setCurrentToParent()
 {
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_SKIP_UNCHANGED)) {
+        if (isForkedSavePending(ss_index)) {
+            /* The state is still being written by a forked process. Our
+             * soft-dirty bits were cleared, so the previous parent is no
+             * longer valid, and the state will only become the parent when
+             * it is installed in its slot. */
+            resetParent();
+            parent_settings = Global::shared_config.savestate_settings;
+            ForkedSaves* fs = getForkedSaves();
+            fs->parent_index = ss_index;
+            fs->parent_generation = fs->started[ss_index];
+            return;
+        }
+
         strcpy(parentpagemappath, pagemappath);
         strcpy(parentpagespath, pagespath);
         parent_ss_index = ss_index;
+        parent_settings = Global::shared_config.savestate_settings;
+        getForkedSaves()->parent_generation = 0;
     }
 }
 
@@ -132,31 +243,180 @@ static void resetParent()
     parentpagemappath[0] = '\0';
     parentpagespath[0] = '\0';
     parent_ss_index = -1;
+    getForkedSaves()->parent_generation = 0;
 }
 
-static int getPagemapFd(int index)
+/* Reserve a new forked save for a slot. If too many saves are running, wait
+ * for one to finish. */
+static ForkedSave* startForkedSave(int index, const char* pmpath, const char* ppath)
 {
-    if (index < 0) return 0;
-    int* pagemaps = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGEMAPS_ADDR));
-    return pagemaps[index];
+    ForkedSaves* fs = getForkedSaves();
+
+    while (true) {
+        for (int i = 0; i < MAX_FORKED_SAVES; i++) {
+            ForkedSave* save = &fs->saves[i];
+            if (save->used)
+                continue;
+
+            save->used = true;
+            save->pid = 0;
+            save->index = index;
+            save->generation = ++fs->started[index];
+            save->pmfd = 0;
+            save->pfd = 0;
+
+#ifdef __linux__
+            if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
+                /* Memfds are shared with the forked process */
+                save->pmfd = syscall(SYS_memfd_create, "pagemapstate", 0);
+                save->pfd = syscall(SYS_memfd_create, "pagesstate", 0);
+                MYASSERT(save->pmfd != -1)
+                MYASSERT(save->pfd != -1)
+                return save;
+            }
+#endif
+            strncpy(save->pagemappath, pmpath, 1023);
+            strncpy(save->pagespath, ppath, 1023);
+            snprintf(save->temppagemappath, 1024, "%s.%u.temp", pmpath, save->generation);
+            snprintf(save->temppagespath, 1024, "%s.%u.temp", ppath, save->generation);
+            return save;
+        }
+
+        debuglogstdio(LCF_CHECKPOINT, "Too many states being saved, waiting for one to finish");
+
+        /* We cannot block on a set of processes, so check them regularly */
+        while (Checkpoint::forkedSaveCount() == MAX_FORKED_SAVES) {
+            Checkpoint::waitForkedSaves();
+            struct timespec tim = {0, 1000000};
+            NATIVECALL(nanosleep(&tim, nullptr));
+        }
+    }
 }
 
-static int getPagesFd(int index)
+int Checkpoint::waitForkedSaves()
 {
-    if (index < 0) return 0;
-    int* pages = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGES_ADDR));
-    return pages[index];
+    ForkedSaves* fs = getForkedSaves();
+
+    for (int i = 0; i < MAX_FORKED_SAVES; i++) {
+        ForkedSave* save = &fs->saves[i];
+        if (!save->used || (save->pid <= 0))
+            continue;
+
+        int status;
+        pid_t pid;
+        NATIVECALL(pid = waitpid(save->pid, &status, WNOHANG));
+        if ((pid == 0) || ((pid < 0) && (errno == EINTR)))
+            continue;
+
+        /* If the process was reaped by someone else, we cannot know if the
+         * state was saved */
+        bool success = (pid == save->pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+        int slot = finishForkedSave(save->pid, success);
+        if (slot >= 0)
+            return slot;
+    }
+    return -1;
 }
 
-static void setPagemapFd(int index, int fd)
+int Checkpoint::finishForkedSave(pid_t pid, bool success)
 {
-    int* pagemaps = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGEMAPS_ADDR));
-    pagemaps[index] = fd;
+    ForkedSaves* fs = getForkedSaves();
+
+    ForkedSave* save = nullptr;
+    for (int i = 0; i < MAX_FORKED_SAVES; i++) {
+        if (fs->saves[i].used && (fs->saves[i].pid == pid)) {
+            save = &fs->saves[i];
+            break;
+        }
+    }
+    if (!save)
+        return -1;
+
+    save->used = false;
+    int index = save->index;
+
+    if (!success) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Saving state %d in a forked process failed", index);
+
+        /* The state will not become the parent */
+        if ((index == fs->parent_index) && (save->generation == fs->parent_generation))
+            fs->parent_generation = 0;
+    }
+
+    if (!success || (save->generation < fs->installed[index])) {
+        /* Discard the state */
+        if (save->pmfd) {
+            NATIVECALL(close(save->pmfd));
+            NATIVECALL(close(save->pfd));
+        }
+        else {
+            NATIVECALL(unlink(save->temppagemappath));
+            NATIVECALL(unlink(save->temppagespath));
+        }
+        return -1;
+    }
+
+    if (save->pmfd) {
+        if (getPagemapFd(index)) {
+            NATIVECALL(close(getPagemapFd(index)));
+            NATIVECALL(close(getPagesFd(index)));
+        }
+        setPagemapFd(index, save->pmfd);
+        setPagesFd(index, save->pfd);
+    }
+    else {
+        NATIVECALL(rename(save->temppagemappath, save->pagemappath));
+        NATIVECALL(rename(save->temppagespath, save->pagespath));
+    }
+
+    fs->installed[index] = save->generation;
+
+    /* The state is now the parent, if no state was saved or loaded since */
+    if ((index == fs->parent_index) && (save->generation == fs->parent_generation)) {
+        strcpy(parentpagemappath, save->pagemappath);
+        strcpy(parentpagespath, save->pagespath);
+        parent_ss_index = index;
+        fs->parent_generation = 0;
+    }
+    return index;
 }
-static void setPagesFd(int index, int fd)
+
+bool Checkpoint::isForkedSavePending(int slot)
 {
-    int* pages = static_cast<int*>(ReservedMemory::getAddr(ReservedMemory::PAGES_ADDR));
-    pages[index] = fd;
+    ForkedSaves* fs = getForkedSaves();
+    for (int i = 0; i < MAX_FORKED_SAVES; i++) {
+        const ForkedSave& save = fs->saves[i];
+        if (save.used && (save.index == slot) && (save.generation > fs->installed[slot]))
+            return true;
+    }
+    return false;
+}
+
+/* Check if the slot of the parent state is being replaced by a forked save
+ * other than ours, in which case it may not contain the parent state */
+static bool isParentPending(const ForkedSave* own_save)
+{
+    if (parent_ss_index < 0)
+        return false;
+
+    ForkedSaves* fs = getForkedSaves();
+    for (int i = 0; i < MAX_FORKED_SAVES; i++) {
+        const ForkedSave* save = &fs->saves[i];
+        if ((save != own_save) && save->used && (save->index == parent_ss_index) &&
+            (save->generation > fs->installed[parent_ss_index]))
+            return true;
+    }
+    return false;
+}
+
+int Checkpoint::forkedSaveCount()
+{
+    ForkedSaves* fs = getForkedSaves();
+    int count = 0;
+    for (int i = 0; i < MAX_FORKED_SAVES; i++)
+        if (fs->saves[i].used)
+            count++;
+    return count;
 }
 
 int Checkpoint::checkCheckpoint()
@@ -291,6 +551,11 @@ void Checkpoint::handler(int signum)
     }
 #endif
 
+    /* The parent state cannot be used if it was saved or loaded with other
+     * savestate settings */
+    if (Global::shared_config.savestate_settings != parent_settings)
+        resetParent();
+
     if (SaveStateManager::isLoading()) {
 #ifdef __unix__
         /* Before reading from the savestate, we must keep some values from
@@ -322,6 +587,7 @@ void Checkpoint::handler(int signum)
         TimeHolder old_time, new_time, delta_time;
         NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &old_time));
         readAllAreas();
+        CheckpointStats::end();
         NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &new_time));
         delta_time = new_time - old_time;
         debuglogstdio(LCF_CHECKPOINT | LCF_INFO, "Loaded state %d in %f seconds", ss_index, delta_time.tv_sec + ((double)delta_time.tv_nsec) / 1000000000.0);
@@ -352,8 +618,10 @@ void Checkpoint::handler(int signum)
         AltStack::restoreStackFrame();
     }
     else {
-        /* Check that base savestate exists, otherwise save it */
-        if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+        /* Check that base savestate exists, otherwise save it. Forked
+         * processes always save complete states. */
+        if ((Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) &&
+            !(Global::shared_config.savestate_settings & SharedConfig::SS_FORK)) {
             if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
                 int fd = getPagemapFd(base_ss_index);
                 if (!fd) {
@@ -372,6 +640,7 @@ void Checkpoint::handler(int signum)
         AltStack::saveStackFrame();
 
         writeAllAreas(false);
+        CheckpointStats::end();
     }
 }
 
@@ -412,6 +681,16 @@ static bool skipArea(const Area *area)
         return true;
     }
 
+    /* Don't save the page store */
+    if (PageStore::isArena(area)) {
+        return true;
+    }
+
+    /* Don't save the memory mirror */
+    if (MemoryMirror::isMirror(area)) {
+        return true;
+    }
+
     /* Don't save area that cannot be promoted to read/write */
     if ((area->max_prot & (PROT_WRITE|PROT_READ)) != (PROT_WRITE|PROT_READ)) {
         return false;
@@ -435,15 +714,16 @@ static bool skipArea(const Area *area)
 static void readAllAreas()
 {
     SaveState saved_state(pagemappath, pagespath, getPagemapFd(ss_index), getPagesFd(ss_index));
+    saved_state.loadIndex(StateIndex::SLOT_STATE);
 
     int spmfd = -1;
-    if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_PRESENT)) {
+    if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_PRESENT | SharedConfig::SS_SKIP_UNCHANGED)) {
         NATIVECALL(spmfd = open("/proc/self/pagemap", O_RDONLY));
         MYASSERT(spmfd != -1);
     }
 
     int crfd = -1;
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_SKIP_UNCHANGED)) {
         NATIVECALL(crfd = open("/proc/self/clear_refs", O_WRONLY));
         MYASSERT(crfd != -1);
     }
@@ -457,6 +737,9 @@ static void readAllAreas()
 
     debuglogstdio(LCF_CHECKPOINT, "Performing restore.");
 
+    TimeHolder maps_time;
+    CheckpointStats::startTimer(maps_time);
+
     /* Read the memory mapping */
 #ifdef __unix__
     ProcSelfMaps memMapLayout;
@@ -487,23 +770,69 @@ static void readAllAreas()
         }
     }
 
+    SavestateStats* stats = CheckpointStats::get();
+    if (stats)
+        stats->maps_time = CheckpointStats::elapsed(maps_time);
+
     /* Now that the memory layout matches the savestate, we load savestate into memory */
     saved_state.restart();
     saved_area = saved_state.nextArea();
+
+    /* Large areas may be filled on demand after the load */
+    bool lazy = LazyLoad::prepare(pagemappath, pagespath, getPagemapFd(ss_index), getPagesFd(ss_index),
+        basepagemappath, basepagespath, getPagemapFd(base_ss_index), getPagesFd(base_ss_index));
+    Area prev_area;
+    prev_area.flags = 0;
+    prev_area.endAddr = nullptr;
     
-    /* Load base and parent savestates */
-    SaveState parent_state(parentpagemappath, parentpagespath, getPagemapFd(parent_ss_index), getPagesFd(parent_ss_index));
+    /* Load base and parent savestates. The slot of the parent may not contain
+     * the parent state while a forked process is saving into it. */
+    int parent_index = isParentPending(nullptr) ? -1 : parent_ss_index;
+    SaveState parent_state((parent_index < 0) ? "" : parentpagemappath, (parent_index < 0) ? "" : parentpagespath,
+        getPagemapFd(parent_index), getPagesFd(parent_index));
     SaveState base_state(basepagemappath, basepagespath, getPagemapFd(base_ss_index), getPagesFd(base_ss_index));
 
     /* If the loading savestate and the parent savestate are the same, pass the
      * same SaveState object to readAnArea because two SaveState objects
      * handling the same file descriptor will mess up the file offset. */
-    bool same_state = (ss_index == parent_ss_index);
+    bool same_state = (ss_index == parent_index);
+
+    /* Parent and base states are queried at random addresses */
+    parent_state.setReader(SaveState::PARENT_READER);
+    base_state.setReader(SaveState::BASE_READER);
+    if (!same_state)
+        parent_state.loadIndex(StateIndex::SLOT_PARENT);
+    base_state.loadIndex(StateIndex::SLOT_BASE);
+
+    /* Count the restored pages and the pages that were skipped because they
+     * were not modified. These must be located on our stack, because the
+     * library memory is being overwritten. */
+    size_t restored_pages = 0;
+    size_t skipped_pages = 0;
+
     while (saved_area.addr != nullptr) {
-        readAnArea(saved_state, spmfd, same_state?saved_state:parent_state, base_state);
+        bool lazy_area = lazy && LazyLoad::isCandidate(saved_area, prev_area) && LazyLoad::addArea(saved_area);
+
+        SavestateStats::Area* area_stats = saved_area.skip ? nullptr : CheckpointStats::addArea(saved_area);
+        TimeHolder area_time;
+        double codec_time = saved_state.getCodecTime() + base_state.getCodecTime();
+        if (area_stats)
+            NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &area_time));
+
+        readAnArea(saved_state, spmfd, same_state?saved_state:parent_state, base_state, lazy_area, area_stats, restored_pages, skipped_pages);
+
+        if (area_stats) {
+            area_stats->time = CheckpointStats::elapsed(area_time);
+            area_stats->codec_time = saved_state.getCodecTime() + base_state.getCodecTime() - codec_time;
+        }
+        prev_area = saved_area;
         saved_area = saved_state.nextArea();
     }
 
+    size_t unchanged_pages = saved_state.getUnchangedPages() + base_state.getUnchangedPages();
+    debuglogstdio(LCF_CHECKPOINT | LCF_INFO, "Restored %zu pages (%zu were identical), skipped %zu unmodified pages",
+        restored_pages, unchanged_pages, skipped_pages);
+
     if (crfd != -1) {
         /* Clear soft-dirty bits */
         Utils::writeAll(crfd, "4\n", 2);
@@ -513,6 +842,10 @@ static void readAllAreas()
     if (spmfd != -1) {
         NATIVECALL(close(spmfd));
     }
+
+    /* Discard the deferred pages and let the thread fill them */
+    if (lazy)
+        LazyLoad::start();
 }
 
 static int reallocateArea(Area *saved_area, Area *current_area)
@@ -520,6 +853,20 @@ static int reallocateArea(Area *saved_area, Area *current_area)
     saved_area->print("Restore");
     current_area->print("Current");
 
+    /* Keep the page store if the savestate was made before it was created,
+     * unless the savestate has memory at its location */
+    if ((current_area->addr != nullptr) && PageStore::isArena(current_area) &&
+        (saved_area->addr != current_area->addr)) {
+        if ((saved_area->addr != nullptr) && PageStore::overlapsArena(saved_area)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Savestate memory overlaps the page store, which must be discarded");
+            PageStore::discard();
+            return 1;
+        }
+
+        if ((saved_area->addr == nullptr) || (saved_area->addr > current_area->addr))
+            return 1;
+    }
+
     /* Do Areas start on the same address? */
     if ((saved_area->addr != nullptr) && (current_area->addr != nullptr) &&
         (saved_area->addr == current_area->addr)) {
@@ -683,7 +1030,7 @@ static int reallocateArea(Area *saved_area, Area *current_area)
     return 0;
 }
 
-static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_state, SaveState &base_state)
+static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_state, SaveState &base_state, bool lazy, SavestateStats::Area* area_stats, size_t &restored_pages, size_t &skipped_pages)
 {
     const Area& saved_area = saved_state.getArea();
 
@@ -711,10 +1058,18 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
     /* Current index in the pagemaps array */
     int pagemap_i = 512;
 
+    /* The parent savestate is the loading savestate */
+    bool same_state = (&parent_state == &saved_state);
+
+    /* Pages that were not modified since the last save or load of the parent
+     * savestate may not need to be restored, if there is a parent */
+    bool skip_unchanged = (spmfd != -1) && (same_state || parent_state) &&
+        (Global::shared_config.savestate_settings & SharedConfig::SS_SKIP_UNCHANGED);
+
     char* endAddr = static_cast<char*>(saved_area.endAddr);
     for (char* curAddr = static_cast<char*>(saved_area.addr);
     curAddr < endAddr;
-    curAddr += 4096, page_i++, pagemap_i++) {
+    curAddr += 4096, page_i++) {
 
         /* We read pagemap flags in chunks to avoid too many read syscalls. */
         if ((spmfd != -1) && (pagemap_i >= 512)) {
@@ -724,12 +1079,20 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
         }
 
         char flag = saved_state.getNextPageFlag();
+        if (area_stats)
+            area_stats->pages[static_cast<int>(flag)]++;
 
         /* Gather the flag for the page map */
         uint64_t page = (spmfd != -1)?pagemaps[pagemap_i++]:-1;
         bool soft_dirty = page & (0x1ull << 55);
+        bool page_swapped = page & (0x1ull << 62);
         bool page_present = page & (0x1ull << 63);
 
+        /* The page contains the same values as when the parent savestate was
+         * saved or loaded. A page that is neither present nor swapped may have
+         * been discarded, and has lost its soft-dirty bit. */
+        bool unmodified = skip_unchanged && !soft_dirty && (page_present || page_swapped);
+
         /* It seems that static memory is both zero and unmapped, so we still
          * need to memset the region if it was mapped.
          *
@@ -741,13 +1104,24 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
                 memset(static_cast<void*>(curAddr), 0, 4096);
         }
         else if (flag == Area::ZERO_PAGE) {
-            if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+            if (unmodified && same_state) {
+                skipped_pages++;
+            }
+            else if (unmodified && (parent_state.getPageFlag(curAddr) == Area::ZERO_PAGE)) {
+                /* The page was zero in the parent savestate */
+                skipped_pages++;
+            }
+            else if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
                 /* In case incremental savestates is enabled, we can guess that
                  * the page is already zero if the parent page is zero and the
                  * page was not modified since. In that case, we can skip the memset. */
                 if (soft_dirty ||
                     parent_state.getPageFlag(curAddr) != Area::ZERO_PAGE) {
                     memset(static_cast<void*>(curAddr), 0, 4096);
+                    restored_pages++;
+                }
+                else {
+                    skipped_pages++;
                 }
             }
             else {
@@ -755,6 +1129,7 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
                  * allocation if the page was allocated but never used. */
                 if (!Utils::isZeroPage(static_cast<void*>(curAddr))) {
                     memset(static_cast<void*>(curAddr), 0, 4096);
+                    restored_pages++;
                 }
             }
         }
@@ -770,21 +1145,43 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
                 /* Memory page has been modified between the two savestates.
                  * We must read from the base savestate.
                  */
-                base_state.getPageFlag(curAddr);
-                base_state.queuePageLoad(curAddr);
+                if (!lazy || !LazyLoad::addPage(curAddr)) {
+                    base_state.getPageFlag(curAddr);
+                    base_state.queuePageLoad(curAddr);
+                    restored_pages++;
+                }
             }
             else {
                 if (soft_dirty) {
                     /* Memory page has been modified after parent state.
                      * We must read from the base savestate.
                      */
-                    base_state.getPageFlag(curAddr);
-                    base_state.queuePageLoad(curAddr);
+                    if (!lazy || !LazyLoad::addPage(curAddr)) {
+                        base_state.getPageFlag(curAddr);
+                        base_state.queuePageLoad(curAddr);
+                        restored_pages++;
+                    }
+                }
+                else {
+                    skipped_pages++;
                 }
             }
         }
-        else {
+        else if (unmodified && same_state) {
+            /* We are loading the same savestate that was last saved or loaded,
+             * and the page was not modified since. */
+            skipped_pages++;
+        }
+        else if (unmodified && (flag == Area::STORED_PAGE) &&
+                 (parent_state.getPageFlag(curAddr) == Area::STORED_PAGE) &&
+                 (parent_state.getStoredIndex() == saved_state.getStoredIndex())) {
+            /* Both savestates share the same stored page, and the page was
+             * not modified since the parent savestate. */
+            skipped_pages++;
+        }
+        else if (!lazy || !LazyLoad::addPage(curAddr)) {
             saved_state.queuePageLoad(curAddr);
+            restored_pages++;
         }
     }
     base_state.finishLoad();
@@ -799,15 +1196,52 @@ static void readAnArea(SaveState &saved_state, int spmfd, SaveState &parent_stat
 
 static void writeAllAreas(bool base)
 {
+    ForkedSave* forked_save = nullptr;
+
     if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK) {
+        forked_save = startForkedSave(base ? base_ss_index : ss_index,
+            base ? basepagemappath : pagemappath, base ? basepagespath : pagespath);
+
         pid_t pid;
         NATIVECALL(pid = fork());
-        if (pid != 0)
+        if (pid < 0) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not fork to save the state");
+            forked_save->pid = 0;
+            Checkpoint::finishForkedSave(0, false);
+            return;
+        }
+        if (pid != 0) {
+            /* The memory of the forked process is a copy-on-write snapshot of
+             * ours, so we can resume the game while it is being saved. */
+            forked_save->pid = pid;
+
+            if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_SKIP_UNCHANGED)) {
+                /* Clear our soft-dirty bits, as the forked process can only
+                 * clear its own */
+                int crfd;
+                NATIVECALL(crfd = open("/proc/self/clear_refs", O_WRONLY));
+                if (crfd != -1) {
+                    Utils::writeAll(crfd, "4\n", 2);
+                    NATIVECALL(close(crfd));
+                }
+            }
             return;
+        }
 
         ThreadManager::restoreThreadTids();
+
+        /* Worker threads are not duplicated in the forked process */
+        CheckpointWorkers::disableThreads();
+
+        /* Our soft-dirty bits are not shared with the game process, so
+         * we save a complete state */
+        Global::shared_config.savestate_settings &= ~SharedConfig::SS_INCREMENTAL;
     }
 
+    /* The job indexes depend on the number of workers, which is different in
+     * the forked process */
+    resetJobs();
+
     TimeHolder old_time, new_time, delta_time;
     NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &old_time));
 
@@ -825,11 +1259,31 @@ static void writeAllAreas(bool base)
     char temppagemappath[1024];
     char temppagespath[1024];
 
+    if (forked_save) {
+        if (forked_save->pmfd) {
+            debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in slot %d", forked_save->index);
+            pmfd = forked_save->pmfd;
+            pfd = forked_save->pfd;
+        }
+        else {
+            debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in %s and %s", forked_save->temppagemappath, forked_save->temppagespath);
+
+            NATIVECALL(unlink(forked_save->temppagemappath));
+            NATIVECALL(pmfd = creat(forked_save->temppagemappath, 0644));
+
+            NATIVECALL(unlink(forked_save->temppagespath));
+            NATIVECALL(pfd = creat(forked_save->temppagespath, 0644));
+        }
+    }
+    else
 #ifdef __linux__
     if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
         if (!(Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL)) {
             debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in slot %d", ss_index);
 
+            /* Release the pages of the previous state in this slot */
+            releaseStoredPages(ss_index);
+
             pmfd = getPagemapFd(ss_index);
             if (pmfd) {
                 ftruncate(pmfd, 0);
@@ -855,6 +1309,9 @@ static void writeAllAreas(bool base)
         else if (base) {
             debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in slot %d", base_ss_index);
 
+            /* Release the pages of the previous base state */
+            releaseStoredPages(base_ss_index);
+
             /* Create new memfds */
             pmfd = syscall(SYS_memfd_create, "pagemapstate", 0);
             setPagemapFd(base_ss_index, pmfd);
@@ -915,7 +1372,7 @@ static void writeAllAreas(bool base)
     }
 
     int crfd = -1;
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    if (Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_SKIP_UNCHANGED)) {
         NATIVECALL(crfd = open("/proc/self/clear_refs", O_WRONLY));
         MYASSERT(crfd != -1);
     }
@@ -935,11 +1392,17 @@ static void writeAllAreas(bool base)
         }
     }
     sh.thread_count = n;
+    sh.codec = Codec::resolve(Global::shared_config.savestate_codec);
     Utils::writeAll(pmfd, &sh, sizeof(sh));
     savestate_size += sizeof(sh);
 
-    /* Load the parent savestate if any. */
-    SaveState parent_state(parentpagemappath, parentpagespath, getPagemapFd(parent_ss_index), getPagesFd(parent_ss_index));
+    /* Load the parent savestate if any, unless its slot is being replaced
+     * by another forked save. */
+    int parent_index = isParentPending(forked_save) ? -1 : parent_ss_index;
+    SaveState parent_state((parent_index < 0) ? "" : parentpagemappath, (parent_index < 0) ? "" : parentpagespath,
+        getPagemapFd(parent_index), getPagesFd(parent_index));
+    parent_state.setReader(SaveState::PARENT_READER);
+    parent_state.loadIndex(StateIndex::SLOT_PARENT);
 
     /* Parse the memory mapping layout.
      * We don't allocate memory here, we are using our special allocated
@@ -951,6 +1414,9 @@ static void writeAllAreas(bool base)
     MachVmMaps memMapLayout;
 #endif
 
+    TimeHolder maps_time;
+    CheckpointStats::startTimer(maps_time);
+
     /* Remove write and add read flags from all memory areas we will be dumping */
     Area area;
     while (memMapLayout.getNextArea(&area)) {
@@ -963,7 +1429,12 @@ static void writeAllAreas(bool base)
         }
     }
 
+    SavestateStats* stats = CheckpointStats::get();
+    if (stats)
+        stats->maps_time += CheckpointStats::elapsed(maps_time);
+
     /* Dump all memory areas */
+    StateIndex::begin();
     memMapLayout.reset();
     while (memMapLayout.getNextArea(&area)) {
         savestate_size += writeAnArea(pmfd, pfd, spmfd, area, parent_state, base);
@@ -975,7 +1446,10 @@ static void writeAllAreas(bool base)
     Utils::writeAll(pmfd, &area, sizeof(area));
     savestate_size += sizeof(area);
 
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    /* Append the index of the savestate */
+    savestate_size += StateIndex::write(pmfd);
+
+    if (crfd != -1) {
         /* Clear soft-dirty bits */
         Utils::writeAll(crfd, "4\n", 2);
     }
@@ -989,7 +1463,7 @@ static void writeAllAreas(bool base)
         }
     }
 
-    if (crfd != 1) {
+    if (crfd != -1) {
         NATIVECALL(close(crfd));
     }
 
@@ -1008,6 +1482,7 @@ static void writeAllAreas(bool base)
         if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
             /* Closing the old savestate memfds and replace with the new one */
             if (getPagemapFd(current_ss_index)) {
+                releaseStoredPages(current_ss_index);
                 NATIVECALL(close(getPagemapFd(current_ss_index)));
                 NATIVECALL(close(getPagesFd(current_ss_index)));
             }
@@ -1020,19 +1495,42 @@ static void writeAllAreas(bool base)
         }
     }
 
+    /* Free the stored pages that are not used anymore */
+    if (PageStore::enabled()) {
+        PageStore::collect();
+        debuglogstdio(LCF_CHECKPOINT, "Page store contains %u pages", PageStore::count());
+    }
+
     NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &new_time));
     delta_time = new_time - old_time;
     debuglogstdio(LCF_INFO, "Saved state %d of size %zu in %f seconds", base?0:ss_index, savestate_size, delta_time.tv_sec + ((double)delta_time.tv_nsec) / 1000000000.0);
 
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK) {
+    if (forked_save) {
         /* Store that we are the child, so that destructors may act differently */
         ThreadManager::setChildFork();
 
-        /* Return the savestate index as status code */
-        _exit(base?0:ss_index);
+        /* The game process installs the state when we exit */
+        _exit(0);
     }
 }
 
+/* Statistics of the area being saved, or nullptr */
+static SavestateStats::Area* current_area_stats = nullptr;
+
+/* Check if a page is zero, and measure the time spent if statistics are
+ * collected */
+static bool isZeroPage(char* addr)
+{
+    if (!current_area_stats)
+        return Utils::isZeroPage(static_cast<void*>(addr));
+
+    TimeHolder start;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+    bool zero = Utils::isZeroPage(static_cast<void*>(addr));
+    current_area_stats->zero_time += CheckpointStats::elapsed(start);
+    return zero;
+}
+
 /* Write a memory area into the savestate. Returns the size of the area in bytes */
 static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &parent_state, bool base)
 {
@@ -1045,12 +1543,21 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
 
     /* Write the area struct */
     area.skip = skipArea(&area);
+    off_t area_offset = lseek(pmfd, 0, SEEK_CUR);
     Utils::writeAll(pmfd, &area, sizeof(area));
     area_size += sizeof(area);
 
     if (area.skip)
         return area_size;
 
+    StateIndex::addArea(area, area_offset);
+
+    /* The base savestate is not part of the statistics */
+    current_area_stats = base ? nullptr : CheckpointStats::addArea(area);
+    TimeHolder area_time;
+    if (current_area_stats)
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &area_time));
+
     if (spmfd != -1) {
         /* Seek at the beginning of the area pagemap */
         MYASSERT(-1 != lseek(spmfd, static_cast<off_t>(reinterpret_cast<uintptr_t>(area.addr) / (4096/8)), SEEK_SET));
@@ -1074,15 +1581,27 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
     /* Current index in the savestate pagemap array */
     int ss_pagemap_i = 0;
 
-    /* Compressed chunk */
-    char compressed_page[LZ4_COMPRESSBOUND(4096)];
+    /* Pages are stored in the shared page store, or compressed by the
+     * checkpoint workers */
+    bool dedup = PageStore::enabled();
+    bool compressed = !dedup && (Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED);
+
+    /* Chunk of page store indexes to be written */
+    uint32_t stored_indexes[1024];
+    int stored_i = 0;
 
     char* endAddr = static_cast<char*>(area.endAddr);
     for (char* curAddr = static_cast<char*>(area.addr); curAddr < endAddr; curAddr += 4096, page_i++) {
 
         /* We write a chunk of savestate pagemaps if it is full */
         if (ss_pagemap_i >= 4096) {
+            /* All flags of the chunk must be known */
+            if (compressed)
+                area_size += flushAllJobs(pfd, ss_pagemaps);
+
             Utils::writeAll(pmfd, ss_pagemaps, 4096);
+            StateIndex::addFlags(ss_pagemaps, 4096);
+            CheckpointStats::addFlags(current_area_stats, ss_pagemaps, 4096);
             ss_pagemap_i = 0;
             area_size += 4096;
         }
@@ -1105,7 +1624,7 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
         }
 
         /* Check if page is zero (only check on anonymous memory)*/
-        else if ((area.flags & Area::AREA_ANON) && Utils::isZeroPage(static_cast<void*>(curAddr))) {
+        else if ((area.flags & Area::AREA_ANON) && isZeroPage(curAddr)) {
             ss_pagemaps[ss_pagemap_i++] = Area::ZERO_PAGE;
         }
 
@@ -1114,19 +1633,15 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
             /* Copy the value of the parent savestate if any */
             if (parent_state) {
                 char parent_flag = parent_state.getPageFlag(curAddr);
-                if ((parent_flag == Area::NONE) || (parent_flag == Area::FULL_PAGE) || (parent_flag == Area::COMPRESSED_PAGE)) {
+                if ((parent_flag == Area::NONE) || (parent_flag == Area::FULL_PAGE) || (parent_flag == Area::COMPRESSED_PAGE) ||
+                    (parent_flag == Area::COMPRESSED_BLOCK_START) || (parent_flag == Area::COMPRESSED_BLOCK)) {
                     /* Parent does not have the page or parent stores the memory page,
                      * saving the full page. */
-
-                    int compressed_size = 0;
-                    if (Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED) {
-                        compressed_size = LZ4_compress_default(curAddr, compressed_page, 4096, LZ4_COMPRESSBOUND(4096));
+                    if (dedup) {
+                        area_size += storePage(pfd, ss_pagemaps, ss_pagemap_i++, curAddr, stored_indexes, stored_i);
                     }
-                    if (compressed_size != 0) {
-                        ss_pagemaps[ss_pagemap_i++] = Area::COMPRESSED_PAGE;
-                        Utils::writeAll(pfd, &compressed_size, sizeof(int));
-                        Utils::writeAll(pfd, compressed_page, compressed_size);
-                        area_size += compressed_size;
+                    else if (compressed) {
+                        area_size += queuePage(pfd, ss_pagemaps, ss_pagemap_i++, curAddr);
                     }
                     else {
                         ss_pagemaps[ss_pagemap_i++] = Area::FULL_PAGE;
@@ -1134,6 +1649,15 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
                         area_size += 4096;
                     }
                 }
+                else if (parent_flag == Area::STORED_PAGE) {
+                    /* Share the stored page of the parent savestate */
+                    uint32_t index = parent_state.getStoredIndex();
+                    PageStore::addRef(index);
+                    ss_pagemaps[ss_pagemap_i++] = Area::STORED_PAGE;
+                    stored_indexes[stored_i++] = index;
+                    if (stored_i == 1024)
+                        area_size += flushStoredIndexes(pfd, stored_indexes, stored_i);
+                }
                 else {
                     ss_pagemaps[ss_pagemap_i++] = parent_flag;
                 }
@@ -1143,15 +1667,11 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
             }
         }
         else {
-            int compressed_size = 0;
-            if (Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED) {
-                compressed_size = LZ4_compress_default(curAddr, compressed_page, 4096, LZ4_COMPRESSBOUND(4096));
+            if (dedup) {
+                area_size += storePage(pfd, ss_pagemaps, ss_pagemap_i++, curAddr, stored_indexes, stored_i);
             }
-            if (compressed_size != 0) {
-                ss_pagemaps[ss_pagemap_i++] = Area::COMPRESSED_PAGE;
-                Utils::writeAll(pfd, &compressed_size, sizeof(int));
-                Utils::writeAll(pfd, compressed_page, compressed_size);
-                area_size += compressed_size;
+            else if (compressed) {
+                area_size += queuePage(pfd, ss_pagemaps, ss_pagemap_i++, curAddr);
             }
             else {
                 ss_pagemaps[ss_pagemap_i++] = Area::FULL_PAGE;
@@ -1161,11 +1681,343 @@ static size_t writeAnArea(int pmfd, int pfd, int spmfd, Area &area, SaveState &p
         }
     }
 
+    /* Writing the remaining compressed pages */
+    if (compressed)
+        area_size += flushAllJobs(pfd, ss_pagemaps);
+
+    /* Writing the remaining stored page indexes */
+    if (dedup)
+        area_size += flushStoredIndexes(pfd, stored_indexes, stored_i);
+
     /* Writing the last savestate pagemap chunk */
     Utils::writeAll(pmfd, ss_pagemaps, ss_pagemap_i);
+    StateIndex::addFlags(ss_pagemaps, ss_pagemap_i);
+    CheckpointStats::addFlags(current_area_stats, ss_pagemaps, ss_pagemap_i);
     area_size += ss_pagemap_i;
 
+    if (current_area_stats) {
+        current_area_stats->bytes = lseek(pfd, 0, SEEK_CUR) - area.page_offset;
+        current_area_stats->time = CheckpointStats::elapsed(area_time);
+        current_area_stats = nullptr;
+    }
+
     return area_size;
 }
 
+/* Store a page in the page store and add its index to the chunk of indexes.
+ * If the store is full, the page is saved as a full page instead. Returns
+ * the number of bytes written. */
+static size_t storePage(int pfd, char* ss_pagemaps, int ss_pagemap_i, char* addr, uint32_t* stored_indexes, int &stored_i)
+{
+    size_t written = 0;
+    uint32_t index;
+
+    if (PageStore::insert(addr, &index)) {
+        ss_pagemaps[ss_pagemap_i] = Area::STORED_PAGE;
+        stored_indexes[stored_i++] = index;
+        if (stored_i == 1024)
+            written += flushStoredIndexes(pfd, stored_indexes, stored_i);
+        return written;
+    }
+
+    /* Indexes must be written before the page to keep the file order */
+    written += flushStoredIndexes(pfd, stored_indexes, stored_i);
+    ss_pagemaps[ss_pagemap_i] = Area::FULL_PAGE;
+    Utils::writeAll(pfd, static_cast<void*>(addr), 4096);
+    return written + 4096;
+}
+
+/* Write the chunk of page store indexes. Returns the number of bytes
+ * written. */
+static size_t flushStoredIndexes(int pfd, uint32_t* stored_indexes, int &stored_i)
+{
+    size_t size = stored_i * sizeof(uint32_t);
+    if (size > 0)
+        Utils::writeAll(pfd, stored_indexes, size);
+    stored_i = 0;
+    return size;
+}
+
+/* Remove the references of a savestate in RAM to the page store, before
+ * the savestate is overwritten */
+static void releaseStoredPages(int index)
+{
+    if (!PageStore::enabled() || !getPagemapFd(index))
+        return;
+
+    SaveState state(nullptr, nullptr, getPagemapFd(index), getPagesFd(index));
+    if (!state)
+        return;
+
+    for (Area area = state.getArea(); area.addr != nullptr; area = state.nextArea()) {
+        if (area.skip)
+            continue;
+
+        for (char* addr = static_cast<char*>(area.addr); addr < static_cast<char*>(area.endAddr); addr += 4096) {
+            if (state.getNextPageFlag() == Area::STORED_PAGE)
+                PageStore::release(state.getStoredIndex());
+        }
+    }
+}
+
+/* Codecs and levels compared by the benchmark */
+static const struct {
+    int codec;
+    int level;
+} benchmark_codecs[] = {
+    {SharedConfig::CODEC_LZ4, 1},
+    {SharedConfig::CODEC_LZ4, 8},
+    {SharedConfig::CODEC_LZ4HC, 4},
+    {SharedConfig::CODEC_LZ4HC, 9},
+    {SharedConfig::CODEC_ZSTD, 1},
+    {SharedConfig::CODEC_ZSTD, 3},
+    {SharedConfig::CODEC_ZSTD, 9},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmark_codecs) / sizeof(benchmark_codecs[0]))
+
+struct BenchmarkResult {
+    size_t size = 0;
+    double save_time = 0;
+    double load_time = 0;
+    bool failed = false;
+};
+
+static double elapsed(const TimeHolder& start)
+{
+    TimeHolder end, delta;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &end));
+    delta = end - start;
+    return delta.tv_sec + ((double)delta.tv_nsec) / 1000000000.0;
+}
+
+/* Compress and decompress a chunk of pages with each codec, using the same
+ * block size as savestates */
+static void benchmarkChunk(char* pages, int nb_pages, char* out, char* check, BenchmarkResult* results)
+{
+    int block_pages = Global::shared_config.savestate_block_pages;
+    if (block_pages < 1)
+        block_pages = 1;
+    if (block_pages > Area::MAX_BLOCK_PAGES)
+        block_pages = Area::MAX_BLOCK_PAGES;
+
+    void* workspace = Codec::getWorkspace(0);
+
+    for (unsigned int c = 0; c < BENCHMARK_COUNT; c++) {
+        int codec = benchmark_codecs[c].codec;
+        int level = Codec::resolveLevel(codec, benchmark_codecs[c].level);
+        if (Codec::resolve(codec) != codec)
+            continue;
+
+        /* Compress each block, prefixed by its compressed size, or by 0 if
+         * the block is stored uncompressed */
+        TimeHolder start;
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+        char* o = out;
+        for (int p = 0; p < nb_pages; p += block_pages) {
+            int size = ((nb_pages - p) < block_pages) ? (nb_pages - p) * 4096 : block_pages * 4096;
+            int compressed_size = Codec::compress(codec, level, workspace, pages + p * 4096, o + sizeof(int), size, LZ4_COMPRESSBOUND(size));
+            memcpy(o, &compressed_size, sizeof(int));
+            o += sizeof(int) + ((compressed_size != 0) ? compressed_size : size);
+            if (compressed_size == 0)
+                memcpy(o - size, pages + p * 4096, size);
+        }
+        results[c].save_time += elapsed(start);
+        results[c].size += o - out;
+
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+        o = out;
+        for (int p = 0; p < nb_pages; p += block_pages) {
+            int size = ((nb_pages - p) < block_pages) ? (nb_pages - p) * 4096 : block_pages * 4096;
+            int compressed_size;
+            memcpy(&compressed_size, o, sizeof(int));
+            o += sizeof(int);
+            if (compressed_size == 0) {
+                memcpy(check + p * 4096, o, size);
+                o += size;
+            }
+            else {
+                if (Codec::decompress(codec, workspace, o, check + p * 4096, compressed_size, size) != size)
+                    results[c].failed = true;
+                o += compressed_size;
+            }
+        }
+        results[c].load_time += elapsed(start);
+
+        if (memcmp(pages, check, nb_pages * 4096) != 0)
+            results[c].failed = true;
+    }
+}
+
+std::string Checkpoint::benchmarkCodecs()
+{
+    if (checkRestore() == SaveStateManager::ESTATE_NOSTATE)
+        return "No savestate to run the codec benchmark on";
+
+    SaveState saved_state(pagemappath, pagespath, getPagemapFd(ss_index), getPagesFd(ss_index));
+    if (!saved_state)
+        return "No savestate to run the codec benchmark on";
+
+    debuglogstdio(LCF_CHECKPOINT, "Running the codec benchmark on savestate %d", ss_index);
+
+    /* Buffers are mapped and unmapped afterwards, so that the game heap, and
+     * thus the next savestates, are left unchanged */
+    size_t chunk_size = Area::MAX_BLOCK_PAGES * 4096;
+    size_t scratch_size = 2 * chunk_size + Area::MAX_BLOCK_PAGES * (sizeof(int) + LZ4_COMPRESSBOUND(4096));
+    void* scratch;
+    NATIVECALL(scratch = mmap(nullptr, scratch_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (scratch == MAP_FAILED)
+        return "Could not allocate memory for the codec benchmark";
+
+    char* pages = static_cast<char*>(scratch);
+    char* check = pages + chunk_size;
+    char* out = check + chunk_size;
+    BenchmarkResult results[BENCHMARK_COUNT];
+
+    /* Gather the pages stored in the savestate into chunks */
+    size_t total_pages = 0;
+    int nb_pages = 0;
+    for (Area area = saved_state.getArea(); area.addr != nullptr; area = saved_state.nextArea()) {
+        if (area.skip)
+            continue;
+
+        for (char* addr = static_cast<char*>(area.addr); addr < static_cast<char*>(area.endAddr); addr += 4096) {
+            char flag = saved_state.getNextPageFlag();
+            if ((flag != Area::FULL_PAGE) && (flag != Area::COMPRESSED_PAGE) &&
+                (flag != Area::COMPRESSED_BLOCK_START) && (flag != Area::COMPRESSED_BLOCK))
+                continue;
+
+            saved_state.readPage(pages + nb_pages * 4096);
+            if (++nb_pages == Area::MAX_BLOCK_PAGES) {
+                benchmarkChunk(pages, nb_pages, out, check, results);
+                total_pages += nb_pages;
+                nb_pages = 0;
+            }
+        }
+    }
+    if (nb_pages > 0) {
+        benchmarkChunk(pages, nb_pages, out, check, results);
+        total_pages += nb_pages;
+    }
+
+    NATIVECALL(munmap(scratch, scratch_size));
+
+    if (total_pages == 0)
+        return "The savestate does not contain any page to compress";
+
+    /* Build the report */
+    double total_mb = total_pages * 4096 / (1024.0 * 1024.0);
+    char line[256];
+    snprintf(line, 256, "Codec benchmark on %zu pages (%.1f MB, stored with %s):\n", total_pages, total_mb, Codec::name(saved_state.getCodec()));
+    std::string report = line;
+
+    for (unsigned int c = 0; c < BENCHMARK_COUNT; c++) {
+        int codec = benchmark_codecs[c].codec;
+        if (Codec::resolve(codec) != codec)
+            continue;
+
+        double size_mb = results[c].size / (1024.0 * 1024.0);
+        snprintf(line, 256, "%s level %d: %.1f MB (%.1f%%), save %.3f s, load %.3f s%s",
+            Codec::name(codec), Codec::resolveLevel(codec, benchmark_codecs[c].level),
+            size_mb, 100.0 * size_mb / total_mb, results[c].save_time, results[c].load_time,
+            results[c].failed ? " [FAILED]" : "");
+        debuglogstdio(LCF_CHECKPOINT | LCF_INFO, "%s", line);
+        report += line;
+        report += '\n';
+    }
+
+    return report;
+}
+
+/* Compressing and writing pages is done by a pipeline of jobs. The checkpoint
+ * thread fills jobs with pages to compress and dispatches them to the
+ * checkpoint workers in a circular order. Results are written in the same
+ * order, so that the layout of the pages file is identical to compressing
+ * each page sequentially.
+ */
+
+/* Index of the oldest dispatched job */
+static int first_job = 0;
+
+/* Number of dispatched jobs that were not written yet */
+static int pending_jobs = 0;
+
+/* Index of the job being filled, or -1 */
+static int filling_job = -1;
+
+/* Start the pipeline from the first job */
+static void resetJobs()
+{
+    first_job = 0;
+    pending_jobs = 0;
+    filling_job = -1;
+}
+
+/* Wait for the oldest dispatched job, write its content and set the page
+ * flags. Returns the number of bytes written. */
+static size_t flushJob(int pfd, char* ss_pagemaps)
+{
+    CheckpointWorkers::wait(first_job);
+    CheckpointWorkers::Job* job = CheckpointWorkers::getJob(first_job);
+
+    Utils::writeAll(pfd, job->out, job->out_size);
+    for (int p = 0; p < job->nb_pages; p++) {
+        ss_pagemaps[job->flag_indexes[p]] = job->flags[p];
+    }
+    StateIndex::addPages(job->out, job->flags, job->nb_pages);
+    if (current_area_stats)
+        current_area_stats->codec_time += job->time;
+
+    first_job = (first_job + 1) % CheckpointWorkers::count();
+    pending_jobs--;
+    return job->out_size;
+}
+
+/* Add a page to be compressed, and dispatch the job if full. Returns the
+ * number of bytes written. */
+static size_t queuePage(int pfd, char* ss_pagemaps, int ss_pagemap_i, char* addr)
+{
+    size_t written = 0;
+
+    if (filling_job == -1) {
+        /* Reuse the oldest job if all jobs are in flight */
+        if (pending_jobs == CheckpointWorkers::count())
+            written += flushJob(pfd, ss_pagemaps);
+
+        filling_job = (first_job + pending_jobs) % CheckpointWorkers::count();
+        CheckpointWorkers::getJob(filling_job)->nb_pages = 0;
+    }
+
+    CheckpointWorkers::Job* job = CheckpointWorkers::getJob(filling_job);
+    job->pages[job->nb_pages] = addr;
+    job->flag_indexes[job->nb_pages] = ss_pagemap_i;
+    job->nb_pages++;
+
+    if (job->nb_pages == WORKER_JOB_PAGES) {
+        CheckpointWorkers::start(filling_job);
+        pending_jobs++;
+        filling_job = -1;
+    }
+
+    return written;
+}
+
+/* Dispatch the job being filled and write all jobs. Returns the number of
+ * bytes written. */
+static size_t flushAllJobs(int pfd, char* ss_pagemaps)
+{
+    size_t written = 0;
+
+    if (filling_job != -1) {
+        CheckpointWorkers::start(filling_job);
+        pending_jobs++;
+        filling_job = -1;
+    }
+
+    while (pending_jobs > 0)
+        written += flushJob(pfd, ss_pagemaps);
+
+    return written;
+}
+
 }
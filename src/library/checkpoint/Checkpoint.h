@@ -23,6 +23,7 @@
 #define LIBTAS_CHECKPOINT_H
 
 #include <string>
+#include <sys/types.h>
 
 namespace libtas {
 namespace Checkpoint
@@ -35,9 +36,31 @@ namespace Checkpoint
 
     void setCurrentToParent();
 
+    /* Install the state saved by a forked process that terminated. Returns
+     * the slot of the state, or -1 if the state was discarded or if the
+     * process was not saving a state. */
+    int finishForkedSave(pid_t pid, bool success);
+
+    /* Check the processes of forked saves without blocking, and install the
+     * state of a process that terminated. Only our own processes are waited
+     * for, not the children of the game. Returns the slot of the installed
+     * state, or -1 if no state was installed. */
+    int waitForkedSaves();
+
+    /* Returns if the latest save of a slot is still being written by a
+     * forked process */
+    bool isForkedSavePending(int slot);
+
+    /* Returns the number of states being saved by forked processes */
+    int forkedSaveCount();
+
     int checkCheckpoint();
     int checkRestore();
     void handler(int signum);
+
+    /* Compress and decompress the pages of the current savestate with each
+     * available codec, and return a report of timings and sizes */
+    std::string benchmarkCodecs();
 }
 }
 
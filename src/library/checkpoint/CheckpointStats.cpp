@@ -0,0 +1,185 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CheckpointStats.h"
+#include "MemArea.h"
+#include "ReservedMemory.h"
+#include "../global.h"
+#include "../GlobalState.h"
+#include "../../shared/messages.h"
+#include "../../shared/sockethelpers.h"
+#include <cstring>
+
+namespace libtas {
+
+static_assert(static_cast<int>(SavestateStats::STORED_PAGE) == static_cast<int>(Area::STORED_PAGE),
+    "Statistics page flags do not match the savestate page flags");
+
+#define MAX_STATS_AREAS 1024
+
+struct StatsRecord {
+    bool pending;
+    SavestateStats stats;
+    SavestateStats::Area areas[MAX_STATS_AREAS];
+};
+
+struct StatsState {
+    /* Operation being recorded plus one, or 0. Reserved memory is
+     * initially zero, so that nothing is recorded before begin(). */
+    int current;
+
+    /* Start of the current operation and of the suspend */
+    TimeHolder start_time;
+
+    /* Last save and last load */
+    StatsRecord records[2];
+};
+
+static_assert(sizeof(StatsState) <= ReservedMemory::STATS_SIZE, "Savestate statistics do not fit in reserved memory");
+
+static StatsState* getState()
+{
+    return static_cast<StatsState*>(ReservedMemory::getAddr(ReservedMemory::STATS_ADDR));
+}
+
+bool CheckpointStats::enabled()
+{
+    return Global::shared_config.savestate_settings & SharedConfig::SS_STATS;
+}
+
+void CheckpointStats::begin(int operation, int slot)
+{
+    StatsState* state = getState();
+    state->current = 0;
+
+    if (!enabled())
+        return;
+
+    StatsRecord& record = state->records[operation];
+    memset(&record.stats, 0, sizeof(SavestateStats));
+    record.stats.operation = operation;
+    record.stats.slot = slot;
+    record.pending = false;
+
+    state->current = operation + 1;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &state->start_time));
+}
+
+void CheckpointStats::suspended()
+{
+    SavestateStats* stats = get();
+    if (stats)
+        stats->suspend_time = elapsed(getState()->start_time);
+}
+
+SavestateStats* CheckpointStats::get()
+{
+    StatsState* state = getState();
+    if (state->current == 0)
+        return nullptr;
+    return &state->records[state->current - 1].stats;
+}
+
+SavestateStats::Area* CheckpointStats::addArea(const Area& area)
+{
+    StatsState* state = getState();
+    if (state->current == 0)
+        return nullptr;
+
+    StatsRecord& record = state->records[state->current - 1];
+    if (record.stats.area_count == MAX_STATS_AREAS) {
+        record.stats.dropped_areas++;
+        return nullptr;
+    }
+
+    SavestateStats::Area& area_stats = record.areas[record.stats.area_count++];
+    memset(&area_stats, 0, sizeof(area_stats));
+    area_stats.addr = reinterpret_cast<uintptr_t>(area.addr);
+    area_stats.size = area.size;
+    strncpy(area_stats.name, area.name, sizeof(area_stats.name) - 1);
+    return &area_stats;
+}
+
+void CheckpointStats::addFlags(SavestateStats::Area* area_stats, const char* flags, int count)
+{
+    if (!area_stats)
+        return;
+
+    for (int i = 0; i < count; i++) {
+        int flag = flags[i];
+        if ((flag >= 0) && (flag < SavestateStats::FLAG_COUNT))
+            area_stats->pages[flag]++;
+    }
+}
+
+void CheckpointStats::end()
+{
+    StatsState* state = getState();
+    if (state->current == 0)
+        return;
+
+    StatsRecord& record = state->records[state->current - 1];
+    SavestateStats& stats = record.stats;
+    stats.total_time = elapsed(state->start_time);
+
+    for (int a = 0; a < stats.area_count; a++) {
+        const SavestateStats::Area& area_stats = record.areas[a];
+        for (int f = 0; f < SavestateStats::FLAG_COUNT; f++)
+            stats.pages[f] += area_stats.pages[f];
+        stats.bytes += area_stats.bytes;
+        stats.zero_time += area_stats.zero_time;
+        stats.codec_time += area_stats.codec_time;
+    }
+
+    record.pending = true;
+    state->current = 0;
+}
+
+void CheckpointStats::startTimer(TimeHolder& start)
+{
+    if (getState()->current != 0)
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+}
+
+double CheckpointStats::elapsed(const TimeHolder& start)
+{
+    TimeHolder end, delta;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &end));
+    delta = end - start;
+    return delta.tv_sec + ((double)delta.tv_nsec) / 1000000000.0;
+}
+
+void CheckpointStats::send()
+{
+    StatsState* state = getState();
+
+    for (int r = 0; r < 2; r++) {
+        StatsRecord& record = state->records[r];
+        if (!record.pending)
+            continue;
+
+        sendMessage(MSGB_SAVESTATE_STATS);
+        sendData(&record.stats, sizeof(SavestateStats));
+        if (record.stats.area_count > 0)
+            sendData(record.areas, record.stats.area_count * sizeof(SavestateStats::Area));
+        record.pending = false;
+    }
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_CHECKPOINTSTATS_H
+#define LIBTAS_CHECKPOINTSTATS_H
+
+#include "../../shared/SavestateStats.h"
+#include "../TimeHolder.h"
+
+namespace libtas {
+
+struct Area;
+
+/* Instrumentation of savestate saving and loading. Statistics are stored in
+ * our reserved memory, because loading a state overwrites the library
+ * memory, and are sent to the program at the next frame boundary. All
+ * functions do nothing if statistics are not collected. */
+namespace CheckpointStats {
+
+/* Returns if statistics are collected */
+bool enabled();
+
+/* Start collecting the statistics of a save or a load, before suspending
+ * the game threads */
+void begin(int operation, int slot);
+
+/* Register the time spent suspending the game threads */
+void suspended();
+
+/* Statistics of the current operation, or nullptr */
+SavestateStats* get();
+
+/* Add a memory area to the current operation. Returns its statistics, or
+ * nullptr if there is no room left for it. */
+SavestateStats::Area* addArea(const Area& area);
+
+/* Count the page flags of an area */
+void addFlags(SavestateStats::Area* area_stats, const char* flags, int count);
+
+/* Finish the current operation and compute the totals */
+void end();
+
+/* Start a timer, if statistics are collected */
+void startTimer(TimeHolder& start);
+
+/* Seconds elapsed since a timer was started */
+double elapsed(const TimeHolder& start);
+
+/* Send the statistics of finished operations to the program. Must be
+ * called with the socket locked. */
+void send();
+
+}
+}
+
+#endif
@@ -0,0 +1,264 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CheckpointWorkers.h"
+#include "ReservedMemory.h"
+#include "MemArea.h"
+#include "Codec.h"
+#include "SaveState.h"
+#include "CheckpointStats.h"
+#include "../logging.h"
+#include "../GlobalState.h"
+#include "../global.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <cstring>
+
+/* Maximum number of worker threads */
+#define MAX_WORKERS 7
+
+/* Size of the stack of each worker thread */
+#define WORKER_STACK_SIZE (256 * 1024)
+
+namespace libtas {
+
+/* Everything used by the worker threads (including their stacks) is located
+ * in our reserved memory, which is never saved nor restored. This way, the
+ * workers are left untouched when a savestate is loaded.
+ */
+struct Worker {
+    CheckpointWorkers::Job job;
+    sem_t sem_start;
+    sem_t sem_done;
+};
+
+/* State of the workers. It must not be restored by a state load, otherwise
+ * loading a state saved before the workers were created would create them
+ * a second time. */
+struct WorkersState {
+    bool initialized;
+
+    /* Number of running worker threads. If zero, jobs are processed by the
+     * calling thread */
+    int nb_threads;
+
+    Worker workers[MAX_WORKERS];
+};
+
+#define WORKERS_STACKS_OFFSET ((sizeof(WorkersState) + 4095) & ~static_cast<size_t>(4095))
+
+static_assert(WORKER_JOB_PAGES >= Area::MAX_BLOCK_PAGES,
+    "A compressed block must fit in a single job");
+
+static_assert(WORKERS_STACKS_OFFSET + MAX_WORKERS * WORKER_STACK_SIZE <= ReservedMemory::WORKERS_SIZE,
+    "Checkpoint workers do not fit in reserved memory");
+
+static WorkersState* getState()
+{
+    return static_cast<WorkersState*>(ReservedMemory::getAddr(ReservedMemory::WORKERS_ADDR));
+}
+
+static Worker* getWorker(int i)
+{
+    return &getState()->workers[i];
+}
+
+static void* getStack(int i)
+{
+    return ReservedMemory::getAddr(ReservedMemory::WORKERS_ADDR + WORKERS_STACKS_OFFSET + i * WORKER_STACK_SIZE);
+}
+
+/* Store a single page */
+static char* compressPage(int codec, int level, void* workspace, char* page, char* out, char* flag)
+{
+    int compressed_size = Codec::compress(codec, level, workspace, page, out + sizeof(int), 4096, LZ4_COMPRESSBOUND(4096));
+    if (compressed_size != 0) {
+        *flag = Area::COMPRESSED_PAGE;
+        memcpy(out, &compressed_size, sizeof(int));
+        return out + sizeof(int) + compressed_size;
+    }
+
+    *flag = Area::FULL_PAGE;
+    memcpy(out, page, 4096);
+    return out + 4096;
+}
+
+static void compressJob(CheckpointWorkers::Job* job, void* workspace)
+{
+    int codec = Codec::resolve(Global::shared_config.savestate_codec);
+    int level = Codec::resolveLevel(codec, Global::shared_config.savestate_codec_level);
+
+    int block_pages = Global::shared_config.savestate_block_pages;
+    if (block_pages > Area::MAX_BLOCK_PAGES)
+        block_pages = Area::MAX_BLOCK_PAGES;
+
+    bool timed = CheckpointStats::enabled();
+    TimeHolder start;
+    if (timed)
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    char* out = job->out;
+    int p = 0;
+    while (p < job->nb_pages) {
+        /* Gather a run of consecutive pages, up to the block size */
+        int run = 1;
+        while ((run < block_pages) && ((p + run) < job->nb_pages) &&
+               (job->pages[p + run] == job->pages[p] + run * 4096))
+            run++;
+
+        if (run == 1) {
+            out = compressPage(codec, level, workspace, job->pages[p], out, &job->flags[p]);
+            p++;
+            continue;
+        }
+
+        /* Compress the whole run as a single block */
+        int compressed_size = Codec::compress(codec, level, workspace, job->pages[p], out + sizeof(int), run * 4096, LZ4_COMPRESSBOUND(run * 4096));
+        if (compressed_size != 0) {
+            memcpy(out, &compressed_size, sizeof(int));
+            out += sizeof(int) + compressed_size;
+            job->flags[p] = Area::COMPRESSED_BLOCK_START;
+            for (int r = 1; r < run; r++)
+                job->flags[p + r] = Area::COMPRESSED_BLOCK;
+            p += run;
+        }
+        else {
+            for (int r = 0; r < run; r++, p++)
+                out = compressPage(codec, level, workspace, job->pages[p], out, &job->flags[p]);
+        }
+    }
+    job->out_size = out - job->out;
+    job->time = timed ? CheckpointStats::elapsed(start) : 0;
+}
+
+static void* workerLoop(void* arg)
+{
+    /* Worker threads are not game threads, all hooked functions must
+     * behave natively */
+    GlobalNative gn;
+
+    Worker* worker = static_cast<Worker*>(arg);
+    void* workspace = Codec::getWorkspace(worker - getWorker(0));
+    while (true) {
+        sem_wait(&worker->sem_start);
+        compressJob(&worker->job, workspace);
+        sem_post(&worker->sem_done);
+    }
+    return nullptr;
+}
+
+int CheckpointWorkers::maxThreads()
+{
+    long nprocs;
+    NATIVECALL(nprocs = sysconf(_SC_NPROCESSORS_ONLN));
+
+    /* Leave one core for the checkpoint thread, which parses the memory
+     * and writes the compressed pages */
+    int nb_threads = static_cast<int>(nprocs) - 1;
+    if (nb_threads > MAX_WORKERS)
+        nb_threads = MAX_WORKERS;
+
+    /* A single worker would only alternate with the checkpoint thread */
+    if (nb_threads <= 1)
+        nb_threads = 0;
+    return nb_threads;
+}
+
+void CheckpointWorkers::init()
+{
+    WorkersState* state = getState();
+    if (state->initialized)
+        return;
+    state->initialized = true;
+
+    int& nb_threads = state->nb_threads;
+
+    /* Each worker needs its own codec workspace, which were counted at
+     * startup */
+    nb_threads = maxThreads();
+    if (nb_threads > (Codec::workspaceCount() - SaveState::THREAD_COUNT))
+        nb_threads = Codec::workspaceCount() - SaveState::THREAD_COUNT;
+    if (nb_threads <= 1) {
+        nb_threads = 0;
+        return;
+    }
+
+    for (int i = 0; i < nb_threads; i++) {
+        Worker* worker = getWorker(i);
+        sem_init(&worker->sem_start, 0, 0);
+        sem_init(&worker->sem_done, 0, 0);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        int ret;
+        NATIVECALL(ret = pthread_attr_setstack(&attr, getStack(i), WORKER_STACK_SIZE));
+        MYASSERT(ret == 0)
+
+        pthread_t pthread_id;
+        NATIVECALL(ret = pthread_create(&pthread_id, &attr, workerLoop, worker));
+        pthread_attr_destroy(&attr);
+
+        if (ret != 0) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create checkpoint worker %d", i);
+            nb_threads = i;
+            break;
+        }
+        NATIVECALL(pthread_detach(pthread_id));
+    }
+
+    debuglogstdio(LCF_CHECKPOINT, "Created %d checkpoint workers", nb_threads);
+}
+
+void CheckpointWorkers::disableThreads()
+{
+    getState()->nb_threads = 0;
+}
+
+int CheckpointWorkers::count()
+{
+    int nb_threads = getState()->nb_threads;
+    return (nb_threads > 0) ? nb_threads : 1;
+}
+
+CheckpointWorkers::Job* CheckpointWorkers::getJob(int i)
+{
+    return &getWorker(i)->job;
+}
+
+void CheckpointWorkers::start(int i)
+{
+    if (getState()->nb_threads == 0) {
+        compressJob(getJob(i), Codec::getWorkspace(i));
+        return;
+    }
+
+    NATIVECALL(sem_post(&getWorker(i)->sem_start));
+}
+
+void CheckpointWorkers::wait(int i)
+{
+    if (getState()->nb_threads == 0)
+        return;
+
+    NATIVECALL(sem_wait(&getWorker(i)->sem_done));
+}
+
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_CHECKPOINTWORKERS_H
+#define LIBTAS_CHECKPOINTWORKERS_H
+
+#include "../../external/lz4.h"
+#include <cstddef>
+
+namespace libtas {
+namespace CheckpointWorkers {
+
+/* Maximum number of pages processed by a single job */
+#define WORKER_JOB_PAGES 64
+
+/* A batch of memory pages to be compressed. Jobs are stored in our reserved
+ * memory, so that nothing gets allocated during a checkpoint. */
+struct Job {
+    /* Input: addresses of the pages to compress */
+    char* pages[WORKER_JOB_PAGES];
+    int nb_pages;
+
+    /* Input: index of each page flag in the savestate pagemap chunk */
+    int flag_indexes[WORKER_JOB_PAGES];
+
+    /* Output: flag of each page (FULL_PAGE, COMPRESSED_PAGE or
+     * COMPRESSED_BLOCK_*) */
+    char flags[WORKER_JOB_PAGES];
+
+    /* Output: data to be written in the pages file, with the same layout as
+     * if the pages were written one at a time */
+    size_t out_size;
+    char out[WORKER_JOB_PAGES * (sizeof(int) + LZ4_COMPRESSBOUND(4096))];
+
+    /* Output: time spent compressing, if statistics are collected */
+    double time;
+};
+
+/* Number of worker threads that would be spawned */
+int maxThreads();
+
+/* Spawn the worker threads if not already done. Must be called before
+ * suspending the game threads. */
+void init();
+
+/* Compress on the calling thread from now on. Used by the forked process,
+ * which does not inherit the worker threads. */
+void disableThreads();
+
+/* Number of jobs that can be processed at the same time */
+int count();
+
+/* Get the job of a worker */
+Job* getJob(int i);
+
+/* Start processing the job of a worker */
+void start(int i);
+
+/* Wait for the job of a worker to complete */
+void wait(int i);
+
+}
+}
+
+#endif
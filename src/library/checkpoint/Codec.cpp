@@ -0,0 +1,219 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "Codec.h"
+#include "ReservedMemory.h"
+#include "MemArea.h"
+#include "../../shared/SharedConfig.h"
+#include "../global.h"
+
+#ifdef LIBTAS_HAS_LZ4HC
+/* Also includes the lz4.h header of the system library, which is not
+ * compatible with our own copy */
+#include <lz4hc.h>
+#else
+#include "../../external/lz4.h"
+#endif
+
+#ifdef LIBTAS_HAS_ZSTD
+/* Needed to use a compression context located in our reserved memory */
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif
+
+namespace libtas {
+
+/* Number and size of the workspaces, which are set once at startup */
+static int workspace_count = 0;
+static size_t workspace_size = 0;
+
+/* Returns the codec if it was built in, or lz4 */
+static int builtCodec(int codec)
+{
+    switch (codec) {
+#ifdef LIBTAS_HAS_LZ4HC
+        case SharedConfig::CODEC_LZ4HC:
+            return codec;
+#endif
+#ifdef LIBTAS_HAS_ZSTD
+        case SharedConfig::CODEC_ZSTD:
+            return codec;
+#endif
+        default:
+            return SharedConfig::CODEC_LZ4;
+    }
+}
+
+/* Returns the size of the context needed to compress a block */
+static size_t contextSize(int codec, int level)
+{
+    switch (codec) {
+#ifdef LIBTAS_HAS_LZ4HC
+        case SharedConfig::CODEC_LZ4HC:
+            return LZ4_sizeofStateHC();
+#endif
+#ifdef LIBTAS_HAS_ZSTD
+        case SharedConfig::CODEC_ZSTD:
+            return ZSTD_estimateCCtxSize_usingCParams(ZSTD_getCParams(level, Area::MAX_BLOCK_PAGES * 4096, 0));
+#endif
+        default:
+            /* lz4 keeps its state on the stack */
+            return 0;
+    }
+}
+
+size_t Codec::initWorkspaces(int count)
+{
+    int codec = builtCodec(Global::shared_config.savestate_codec);
+    int level = Global::shared_config.savestate_codec_level;
+#ifdef LIBTAS_HAS_ZSTD
+    if (codec == SharedConfig::CODEC_ZSTD) {
+        if (level <= 0)
+            level = ZSTD_CLEVEL_DEFAULT;
+        if (level > ZSTD_maxCLevel())
+            level = ZSTD_maxCLevel();
+    }
+#endif
+
+    /* Higher levels are lowered until their context fits */
+    workspace_size = contextSize(codec, level);
+    if (workspace_size > CODEC_MAX_WORKSPACE_SIZE)
+        workspace_size = CODEC_MAX_WORKSPACE_SIZE;
+
+#ifdef LIBTAS_HAS_ZSTD
+    /* Savestates compressed with zstd can always be loaded */
+    if (workspace_size < ZSTD_estimateDCtxSize())
+        workspace_size = ZSTD_estimateDCtxSize();
+#endif
+
+    workspace_size = (workspace_size + 4095) & ~static_cast<size_t>(4095);
+    workspace_count = count;
+    return workspace_count * workspace_size;
+}
+
+int Codec::resolve(int codec)
+{
+    codec = builtCodec(codec);
+
+    /* The context of the lowest level must fit inside a workspace */
+    if (contextSize(codec, 1) > workspace_size)
+        return SharedConfig::CODEC_LZ4;
+    return codec;
+}
+
+int Codec::resolveLevel(int codec, int level)
+{
+    switch (codec) {
+#ifdef LIBTAS_HAS_LZ4HC
+        case SharedConfig::CODEC_LZ4HC:
+            if (level <= 0)
+                return LZ4HC_CLEVEL_DEFAULT;
+            return (level > LZ4HC_CLEVEL_MAX) ? LZ4HC_CLEVEL_MAX : level;
+#endif
+#ifdef LIBTAS_HAS_ZSTD
+        case SharedConfig::CODEC_ZSTD:
+        {
+            if (level <= 0)
+                level = ZSTD_CLEVEL_DEFAULT;
+            if (level > ZSTD_maxCLevel())
+                level = ZSTD_maxCLevel();
+
+            /* The compression context must fit inside a workspace for the
+             * largest compressed block */
+            while ((level > 1) && (ZSTD_estimateCCtxSize_usingCParams(
+                    ZSTD_getCParams(level, Area::MAX_BLOCK_PAGES * 4096, 0)) > workspace_size))
+                level--;
+            return level;
+        }
+#endif
+        default:
+            /* For lz4, the level is the acceleration factor */
+            return (level <= 0) ? 1 : level;
+    }
+}
+
+const char* Codec::name(int codec)
+{
+    switch (codec) {
+        case SharedConfig::CODEC_LZ4HC:
+            return "lz4hc";
+        case SharedConfig::CODEC_ZSTD:
+            return "zstd";
+        default:
+            return "lz4";
+    }
+}
+
+int Codec::workspaceCount()
+{
+    return workspace_count;
+}
+
+void* Codec::getWorkspace(int i)
+{
+    return static_cast<char*>(ReservedMemory::getRegion(ReservedMemory::CODEC_REGION)) + i * workspace_size;
+}
+
+int Codec::compress(int codec, int level, void* workspace, const char* src, char* dst, int src_size, int dst_capacity)
+{
+    switch (codec) {
+#ifdef LIBTAS_HAS_LZ4HC
+        case SharedConfig::CODEC_LZ4HC:
+            return LZ4_compress_HC_extStateHC(workspace, src, dst, src_size, dst_capacity, level);
+#endif
+#ifdef LIBTAS_HAS_ZSTD
+        case SharedConfig::CODEC_ZSTD:
+        {
+            ZSTD_CCtx* cctx = ZSTD_initStaticCCtx(workspace, workspace_size);
+            if (!cctx)
+                return 0;
+            size_t size = ZSTD_compressCCtx(cctx, dst, dst_capacity, src, src_size, level);
+            if (ZSTD_isError(size))
+                return 0;
+            return static_cast<int>(size);
+        }
+#endif
+        default:
+            return LZ4_compress_fast(src, dst, src_size, dst_capacity, level);
+    }
+}
+
+int Codec::decompress(int codec, void* workspace, const char* src, char* dst, int src_size, int dst_capacity)
+{
+    switch (codec) {
+#ifdef LIBTAS_HAS_ZSTD
+        case SharedConfig::CODEC_ZSTD:
+        {
+            ZSTD_DCtx* dctx = ZSTD_initStaticDCtx(workspace, workspace_size);
+            if (!dctx)
+                return -1;
+            size_t size = ZSTD_decompressDCtx(dctx, dst, dst_capacity, src, src_size);
+            if (ZSTD_isError(size))
+                return -1;
+            return static_cast<int>(size);
+        }
+#endif
+        default:
+            /* lz4hc produces regular lz4 data */
+            return LZ4_decompress_safe(src, dst, src_size, dst_capacity);
+    }
+}
+
+}
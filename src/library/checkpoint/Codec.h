@@ -0,0 +1,68 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_CODEC_H
+#define LIBTAS_CODEC_H
+
+#include <cstddef>
+
+/* Maximum size of the memory used by a codec to compress or decompress a
+ * block */
+#define CODEC_MAX_WORKSPACE_SIZE (6 * 1024 * 1024)
+
+namespace libtas {
+namespace Codec {
+
+/* Size the workspaces for the codec of the savestate settings. There is one
+ * workspace for each checkpoint worker, followed by the ones of the threads
+ * reading savestates. Must be called before reserving memory, and returns
+ * the size of the workspaces region. */
+size_t initWorkspaces(int count);
+
+/* Returns the codec that will actually be used when asking for `codec`.
+ * Codecs that were not built in, or whose context does not fit inside the
+ * workspaces sized at startup, fall back to lz4. */
+int resolve(int codec);
+
+/* Returns the level that will actually be used for a codec. A level of 0
+ * selects the default level of the codec. */
+int resolveLevel(int codec, int level);
+
+/* Returns the name of a codec */
+const char* name(int codec);
+
+/* Returns the number of workspaces */
+int workspaceCount();
+
+/* Returns the workspace of index i, located in our reserved memory */
+void* getWorkspace(int i);
+
+/* Compress `src` of size `src_size` into `dst`. Returns the compressed size,
+ * or 0 if the data could not be compressed inside `dst_capacity` bytes.
+ * `codec` and `level` must have been resolved. */
+int compress(int codec, int level, void* workspace, const char* src, char* dst, int src_size, int dst_capacity);
+
+/* Decompress `src` of size `src_size` into `dst`. Returns the decompressed
+ * size, or a negative value on error. */
+int decompress(int codec, void* workspace, const char* src, char* dst, int src_size, int dst_capacity);
+
+}
+}
+
+#endif
@@ -0,0 +1,760 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LazyLoad.h"
+#include "MemArea.h"
+#include "ReservedMemory.h"
+#include "SaveState.h"
+#include "Codec.h"
+#include "../logging.h"
+#include "../GlobalState.h"
+#include "../global.h"
+#include "../TimeHolder.h"
+#include "../../shared/SharedConfig.h"
+
+#include <new>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#endif
+
+/* Minimum number of pages of an area to be lazily loaded */
+#define LAZY_MIN_PAGES 256
+
+/* Maximum number of lazily loaded memory intervals */
+#define LAZY_MAX_INTERVALS 4096
+
+/* Maximum number of ranges of discarded pages */
+#define LAZY_MAX_RANGES 16384
+
+/* Number of pages prefetched between two checks for page faults */
+#define LAZY_PREFETCH_PAGES 64
+
+/* Maximum number of page faults waiting to be served */
+#define LAZY_MAX_FAULTS 1024
+
+/* Size of the stack of the thread */
+#define LAZY_STACK_SIZE (256 * 1024)
+
+namespace libtas {
+
+struct Interval {
+    char* start;
+    char* end;
+};
+
+/* The three savestate readers: one reading sequentially for prefetching,
+ * one for the random accesses of page faults, and one for the base
+ * savestate of incremental savestates */
+enum {
+    READER_PREFETCH,
+    READER_FAULT,
+    READER_BASE,
+    READER_COUNT
+};
+
+struct LazyState {
+    bool initialized;
+
+    /* A lazy loading was started and is not finished yet */
+    bool running;
+
+    sem_t sem_start;
+    sem_t sem_done;
+
+    int uffd;
+
+    /* Reopened savestate file descriptors for savestates in RAM, so that
+     * each reader has its own file offsets */
+    int fds[2 * READER_COUNT];
+
+    bool has_base;
+
+    /* Last address queried on each savestate reader */
+    char* positions[READER_COUNT];
+
+    /* Memory that can still be filled from the savestate, sorted */
+    int nb_intervals;
+    Interval intervals[LAZY_MAX_INTERVALS];
+
+    /* Pages discarded when loading the state */
+    int nb_ranges;
+    Interval ranges[LAZY_MAX_RANGES];
+
+    /* Page faults read but not served yet */
+    int fault_head;
+    int nb_queued_faults;
+    char* queued_faults[LAZY_MAX_FAULTS];
+
+    /* Statistics */
+    size_t deferred_pages;
+    size_t prefetched_pages;
+    size_t faults;
+    double fault_time;
+    TimeHolder start_time;
+};
+
+#define LAZY_READER_SIZE ((sizeof(SaveState) + 63) & ~static_cast<size_t>(63))
+#define LAZY_READERS_OFFSET ((sizeof(LazyState) + 4095) & ~static_cast<size_t>(4095))
+#define LAZY_STACK_OFFSET ((LAZY_READERS_OFFSET + READER_COUNT * LAZY_READER_SIZE + 4095) & ~static_cast<size_t>(4095))
+
+static_assert(LAZY_STACK_OFFSET + LAZY_STACK_SIZE <= ReservedMemory::LAZY_SIZE,
+    "Lazy loading does not fit in reserved memory");
+
+static LazyState* getState()
+{
+    return static_cast<LazyState*>(ReservedMemory::getAddr(ReservedMemory::LAZY_ADDR));
+}
+
+static SaveState* getReader(int i)
+{
+    return static_cast<SaveState*>(ReservedMemory::getAddr(ReservedMemory::LAZY_ADDR + LAZY_READERS_OFFSET + i * LAZY_READER_SIZE));
+}
+
+static void* getStack()
+{
+    return ReservedMemory::getAddr(ReservedMemory::LAZY_ADDR + LAZY_STACK_OFFSET);
+}
+
+static double elapsed(const TimeHolder& start)
+{
+    TimeHolder end, delta;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &end));
+    delta = end - start;
+    return delta.tv_sec + ((double)delta.tv_nsec) / 1000000000.0;
+}
+
+/* Destroy the savestate readers and close all descriptors */
+static void release()
+{
+    LazyState* ls = getState();
+
+    for (int r = 0; r < READER_COUNT; r++) {
+        if ((r == READER_BASE) && !ls->has_base)
+            continue;
+        getReader(r)->~SaveState();
+    }
+
+    for (int i = 0; i < 2 * READER_COUNT; i++) {
+        if (ls->fds[i] > 0)
+            NATIVECALL(close(ls->fds[i]));
+        ls->fds[i] = 0;
+    }
+
+    if (ls->uffd >= 0)
+        NATIVECALL(close(ls->uffd));
+    ls->uffd = -1;
+}
+
+#ifdef __linux__
+
+/* Reopen a savestate memfd with its own file offset */
+static int reopen(int fd)
+{
+    if (fd <= 0)
+        return 0;
+
+    char path[64];
+    snprintf(path, 64, "/proc/self/fd/%d", fd);
+    int newfd;
+    NATIVECALL(newfd = open(path, O_RDONLY | O_CLOEXEC));
+    return (newfd < 0) ? 0 : newfd;
+}
+
+/* Get the content of a page from the savestate. Returns false if the page
+ * must be zero. */
+static bool readPage(int r, char* addr, char* dst)
+{
+    LazyState* ls = getState();
+    SaveState* reader = getReader(r);
+
+    /* Readers can only move forward, unless the savestate has an index */
+    if (addr < ls->positions[r])
+        reader->restart();
+    ls->positions[r] = addr;
+
+    char flag = reader->getPageFlag(addr);
+    if (flag == Area::BASE_PAGE) {
+        if (!ls->has_base)
+            return false;
+        reader = getReader(READER_BASE);
+        if (addr < ls->positions[READER_BASE])
+            reader->restart();
+        ls->positions[READER_BASE] = addr;
+        flag = reader->getPageFlag(addr);
+    }
+
+    switch (flag) {
+        case Area::FULL_PAGE:
+        case Area::COMPRESSED_PAGE:
+        case Area::COMPRESSED_BLOCK_START:
+        case Area::COMPRESSED_BLOCK:
+        case Area::STORED_PAGE:
+            reader->readPage(dst);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void wake(char* addr)
+{
+    struct uffdio_range range;
+    range.start = reinterpret_cast<uintptr_t>(addr);
+    range.len = 4096;
+    ioctl(getState()->uffd, UFFDIO_WAKE, &range);
+}
+
+/* Returns the index of the first interval ending after `addr` */
+static int findInterval(char* addr)
+{
+    LazyState* ls = getState();
+    int lo = 0, hi = ls->nb_intervals;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ls->intervals[mid].end <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool inIntervals(char* addr)
+{
+    LazyState* ls = getState();
+    int i = findInterval(addr);
+    return (i < ls->nb_intervals) && (ls->intervals[i].start <= addr);
+}
+
+static void readEvents();
+
+/* Fill a missing page at `dst` with `content`, or with zeros if null. `src`
+ * is the address of the page in the savestate, or null if the content does
+ * not come from the savestate. */
+static void fillPage(char* dst, const char* content, char* src)
+{
+    LazyState* ls = getState();
+
+    while (true) {
+        int ret;
+        if (content) {
+            struct uffdio_copy copy;
+            copy.dst = reinterpret_cast<uintptr_t>(dst);
+            copy.src = reinterpret_cast<uintptr_t>(content);
+            copy.len = 4096;
+            copy.mode = 0;
+            ret = ioctl(ls->uffd, UFFDIO_COPY, &copy);
+        }
+        else {
+            struct uffdio_zeropage zero;
+            zero.range.start = reinterpret_cast<uintptr_t>(dst);
+            zero.range.len = 4096;
+            zero.mode = 0;
+            ret = ioctl(ls->uffd, UFFDIO_ZEROPAGE, &zero);
+        }
+
+        if (ret == 0)
+            return;
+
+        /* The page was already filled, but a thread may still wait on it */
+        if (errno == EEXIST) {
+            wake(dst);
+            return;
+        }
+
+        /* The memory layout is changing, and the thread that changes it
+         * waits for us to read the event */
+        if (errno != EAGAIN)
+            return;
+
+        readEvents();
+
+        /* The savestate page may have been discarded or unmapped */
+        if (src && !inIntervals(src))
+            return;
+    }
+}
+
+/* Fill all missing pages of [start, end) from the savestate pages at
+ * [src, src + end - start). If `check` is set, only the pages that can still
+ * be filled from the savestate are filled. */
+static void fillRange(int r, char* start, char* end, char* src, bool check)
+{
+    unsigned char vec[LAZY_PREFETCH_PAGES];
+
+    /* Filling a page may process events that fill other pages, so each call
+     * has its own buffer */
+    char page[4096];
+
+    for (char* chunk = start; chunk < end; chunk += LAZY_PREFETCH_PAGES * 4096, src += LAZY_PREFETCH_PAGES * 4096) {
+        size_t len = ((end - chunk) < LAZY_PREFETCH_PAGES * 4096) ? (end - chunk) : LAZY_PREFETCH_PAGES * 4096;
+
+        /* Skip the area if it was unmapped */
+        if (mincore(chunk, len, vec) != 0)
+            continue;
+
+        for (size_t p = 0; p < len / 4096; p++) {
+            char* page_src = src + p * 4096;
+            if ((vec[p] & 1) || (check && !inIntervals(page_src)))
+                continue;
+
+            char* content = readPage(r, page_src, page) ? page : nullptr;
+            fillPage(chunk + p * 4096, content, check ? page_src : nullptr);
+            getState()->prefetched_pages++;
+        }
+    }
+}
+
+/* Pages inside [start, end) cannot be filled from the savestate anymore */
+static void invalidate(char* start, char* end)
+{
+    LazyState* ls = getState();
+
+    int i = findInterval(start);
+    while ((i < ls->nb_intervals) && (ls->intervals[i].start < end)) {
+        Interval& iv = ls->intervals[i];
+
+        if ((start <= iv.start) && (end >= iv.end)) {
+            /* Remove the interval */
+            memmove(&ls->intervals[i], &ls->intervals[i+1], (ls->nb_intervals - i - 1) * sizeof(Interval));
+            ls->nb_intervals--;
+            continue;
+        }
+
+        if (start <= iv.start) {
+            iv.start = end;
+        }
+        else if (end >= iv.end) {
+            iv.end = start;
+        }
+        else if (ls->nb_intervals < LAZY_MAX_INTERVALS) {
+            /* Split the interval */
+            memmove(&ls->intervals[i+1], &ls->intervals[i], (ls->nb_intervals - i) * sizeof(Interval));
+            ls->nb_intervals++;
+            ls->intervals[i].end = start;
+            ls->intervals[i+1].start = end;
+            return;
+        }
+        else {
+            /* No room to split, so we fill the left part now and drop it */
+            fillRange(READER_FAULT, iv.start, start, iv.start, true);
+            i = findInterval(start);
+            if ((i < ls->nb_intervals) && (ls->intervals[i].start < end) && (ls->intervals[i].end > end))
+                ls->intervals[i].start = end;
+            return;
+        }
+        i++;
+    }
+}
+
+/* Memory was moved from `from` to `to`. Missing pages must be filled at their
+ * new address. This is done immediately, because the old memory is unmapped
+ * right after. */
+static void remap(char* from, char* to, size_t len)
+{
+    LazyState* ls = getState();
+    char* from_end = from + len;
+
+    /* The old memory is unmapped as soon as we fill the first page, so we
+     * must gather the intervals beforehand */
+    Interval moved[256];
+    int nb_moved = 0;
+    for (int i = findInterval(from); (i < ls->nb_intervals) && (ls->intervals[i].start < from_end); i++) {
+        if (nb_moved == 256) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many lazily loaded intervals in remapped memory %p", from);
+            break;
+        }
+        moved[nb_moved].start = (from > ls->intervals[i].start) ? from : ls->intervals[i].start;
+        moved[nb_moved].end = (from_end < ls->intervals[i].end) ? from_end : ls->intervals[i].end;
+        nb_moved++;
+    }
+
+    invalidate(from, from_end);
+    invalidate(to, to + len);
+
+    for (int i = 0; i < nb_moved; i++)
+        fillRange(READER_FAULT, to + (moved[i].start - from), to + (moved[i].end - from), moved[i].start, false);
+}
+
+/* Read the pending userfaultfd events. Memory changes are processed
+ * immediately, so that we never fill memory with stale pages. Page faults are
+ * queued. */
+static void readEvents()
+{
+    LazyState* ls = getState();
+
+    while (true) {
+        if ((ls->nb_queued_faults == LAZY_MAX_FAULTS) && (ls->fault_head > 0)) {
+            memmove(&ls->queued_faults[0], &ls->queued_faults[ls->fault_head], (ls->nb_queued_faults - ls->fault_head) * sizeof(char*));
+            ls->nb_queued_faults -= ls->fault_head;
+            ls->fault_head = 0;
+        }
+
+        /* Each message may be a page fault */
+        int room = LAZY_MAX_FAULTS - ls->nb_queued_faults;
+        if (room == 0)
+            return;
+        if (room > 16)
+            room = 16;
+
+        struct uffd_msg msgs[16];
+        ssize_t size = read(ls->uffd, msgs, room * sizeof(struct uffd_msg));
+        if (size <= 0)
+            return;
+
+        for (int m = 0; m < static_cast<int>(size / sizeof(struct uffd_msg)); m++) {
+            switch (msgs[m].event) {
+                case UFFD_EVENT_REMOVE:
+                case UFFD_EVENT_UNMAP:
+                    invalidate(reinterpret_cast<char*>(msgs[m].arg.remove.start), reinterpret_cast<char*>(msgs[m].arg.remove.end));
+                    break;
+                case UFFD_EVENT_REMAP:
+                    remap(reinterpret_cast<char*>(msgs[m].arg.remap.from), reinterpret_cast<char*>(msgs[m].arg.remap.to), msgs[m].arg.remap.len);
+                    break;
+                case UFFD_EVENT_PAGEFAULT:
+                    ls->queued_faults[ls->nb_queued_faults++] = reinterpret_cast<char*>(msgs[m].arg.pagefault.address & ~static_cast<uint64_t>(4095));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static void serveFault(char* addr)
+{
+    LazyState* ls = getState();
+    TimeHolder start;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    /* Memory that was remapped or extended is filled with zeros */
+    if (inIntervals(addr)) {
+        char page[4096];
+        bool data = readPage(READER_FAULT, addr, page);
+        fillPage(addr, data ? page : nullptr, addr);
+
+        /* The page may have been invalidated in the meantime */
+        if (!inIntervals(addr))
+            fillPage(addr, nullptr, nullptr);
+    }
+    else {
+        fillPage(addr, nullptr, nullptr);
+    }
+
+    ls->faults++;
+    ls->fault_time += elapsed(start);
+}
+
+/* Read the userfaultfd events and serve the page faults */
+static void processEvents()
+{
+    LazyState* ls = getState();
+
+    readEvents();
+
+    /* More page faults may be queued while serving one */
+    while (ls->fault_head < ls->nb_queued_faults)
+        serveFault(ls->queued_faults[ls->fault_head++]);
+
+    ls->fault_head = 0;
+    ls->nb_queued_faults = 0;
+}
+
+static void serve()
+{
+    LazyState* ls = getState();
+
+    ls->fault_head = 0;
+    ls->nb_queued_faults = 0;
+
+    /* Prefetch all pages in order, while serving page faults in between */
+    char* cursor = nullptr;
+    while (true) {
+        processEvents();
+
+        int i = findInterval(cursor);
+        if (i == ls->nb_intervals)
+            break;
+
+        if (cursor < ls->intervals[i].start)
+            cursor = ls->intervals[i].start;
+        char* end = ls->intervals[i].end;
+        if ((end - cursor) > LAZY_PREFETCH_PAGES * 4096)
+            end = cursor + LAZY_PREFETCH_PAGES * 4096;
+
+        fillRange(READER_PREFETCH, cursor, end, cursor, true);
+        cursor = end;
+    }
+
+    /* Closing the userfaultfd unregisters all memory */
+    release();
+
+    debuglogstdio(LCF_CHECKPOINT, "Lazy load finished in %f seconds: %zu pages deferred, %zu prefetched, %zu page faults served in %f ms on average",
+        elapsed(ls->start_time), ls->deferred_pages, ls->prefetched_pages, ls->faults,
+        ls->faults ? (1000.0 * ls->fault_time / ls->faults) : 0.0);
+}
+
+static void* lazyLoop(void* arg)
+{
+    /* This thread is not a game thread, all hooked functions must
+     * behave natively */
+    GlobalNative gn;
+
+    LazyState* ls = static_cast<LazyState*>(arg);
+    while (true) {
+        sem_wait(&ls->sem_start);
+        serve();
+        sem_post(&ls->sem_done);
+    }
+    return nullptr;
+}
+
+#endif
+
+void LazyLoad::init()
+{
+#ifdef __linux__
+    LazyState* ls = getState();
+    if (ls->initialized)
+        return;
+    ls->initialized = true;
+    ls->uffd = -1;
+
+    sem_init(&ls->sem_start, 0, 0);
+    sem_init(&ls->sem_done, 0, 0);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    int ret;
+    NATIVECALL(ret = pthread_attr_setstack(&attr, getStack(), LAZY_STACK_SIZE));
+    MYASSERT(ret == 0)
+
+    pthread_t pthread_id;
+    NATIVECALL(ret = pthread_create(&pthread_id, &attr, lazyLoop, ls));
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create the lazy loading thread");
+        ls->initialized = false;
+        return;
+    }
+    NATIVECALL(pthread_detach(pthread_id));
+#endif
+}
+
+void LazyLoad::finish()
+{
+    LazyState* ls = getState();
+    if (!ls->running)
+        return;
+
+    TimeHolder start;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+    sem_wait(&ls->sem_done);
+    ls->running = false;
+
+    debuglogstdio(LCF_CHECKPOINT, "Waited %f seconds for the lazy load to finish", elapsed(start));
+}
+
+bool LazyLoad::prepare(const char* pagemappath, const char* pagespath, int pagemapfd, int pagesfd,
+    const char* basepagemappath, const char* basepagespath, int basepagemapfd, int basepagesfd)
+{
+#ifdef __linux__
+    LazyState* ls = getState();
+    if (!ls->initialized || ls->running)
+        return false;
+
+    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_LAZY))
+        return false;
+
+    /* Page faults triggered by the kernel must be handled, which may not be
+     * allowed for unprivileged users */
+    NATIVECALL(ls->uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+    if (ls->uffd < 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create a userfaultfd, loading the whole state");
+        return false;
+    }
+
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_EVENT_REMAP | UFFD_FEATURE_EVENT_REMOVE | UFFD_FEATURE_EVENT_UNMAP;
+    int ret;
+    NATIVECALL(ret = ioctl(ls->uffd, UFFDIO_API, &api));
+    if (ret != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Userfaultfd does not support the required features, loading the whole state");
+        NATIVECALL(close(ls->uffd));
+        ls->uffd = -1;
+        return false;
+    }
+
+    const char* pagemappaths[READER_COUNT] = {pagemappath, pagemappath, basepagemappath};
+    const char* pagespaths[READER_COUNT] = {pagespath, pagespath, basepagespath};
+    int pagemapfds[READER_COUNT] = {pagemapfd, pagemapfd, basepagemapfd};
+    int pagesfds[READER_COUNT] = {pagesfd, pagesfd, basepagesfd};
+
+    ls->has_base = (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) ?
+        (basepagemapfd > 0) : (basepagemappath[0] != '\0');
+
+    for (int r = 0; r < READER_COUNT; r++) {
+        ls->positions[r] = nullptr;
+        if ((r == READER_BASE) && !ls->has_base)
+            continue;
+
+        if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
+            ls->fds[2*r] = reopen(pagemapfds[r]);
+            ls->fds[2*r+1] = reopen(pagesfds[r]);
+        }
+
+        SaveState* reader = new (getReader(r)) SaveState(pagemappaths[r], pagespaths[r], ls->fds[2*r], ls->fds[2*r+1]);
+        reader->setReader(static_cast<SaveState::Reader>(SaveState::LAZY_PREFETCH_READER + r));
+        reader->loadIndex(StateIndex::SLOT_LAZY_PREFETCH + r);
+    }
+
+    ls->nb_intervals = 0;
+    ls->nb_ranges = 0;
+    ls->deferred_pages = 0;
+    ls->prefetched_pages = 0;
+    ls->faults = 0;
+    ls->fault_time = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LazyLoad::isCandidate(const Area& area, const Area& prev)
+{
+    if (area.skip)
+        return false;
+
+    if (!(area.flags & Area::AREA_ANON) || !(area.flags & Area::AREA_PRIV) || (area.flags & Area::AREA_STACK))
+        return false;
+
+    if ((area.prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
+        return false;
+
+    if (area.size < LAZY_MIN_PAGES * 4096)
+        return false;
+
+    /* The .bss segment of a library directly follows its data segment. It
+     * may be used by the lazy loading thread itself, so it must be restored
+     * immediately. */
+    if ((prev.flags & Area::AREA_FILE) && (prev.endAddr == area.addr))
+        return false;
+
+    return true;
+}
+
+bool LazyLoad::addArea(const Area& area)
+{
+    LazyState* ls = getState();
+    if (ls->nb_intervals == LAZY_MAX_INTERVALS)
+        return false;
+
+    ls->intervals[ls->nb_intervals].start = static_cast<char*>(area.addr);
+    ls->intervals[ls->nb_intervals].end = static_cast<char*>(area.endAddr);
+    ls->nb_intervals++;
+    return true;
+}
+
+bool LazyLoad::addPage(char* addr)
+{
+    LazyState* ls = getState();
+
+    if ((ls->nb_ranges > 0) && (ls->ranges[ls->nb_ranges-1].end == addr)) {
+        ls->ranges[ls->nb_ranges-1].end += 4096;
+        ls->deferred_pages++;
+        return true;
+    }
+
+    if (ls->nb_ranges == LAZY_MAX_RANGES)
+        return false;
+
+    ls->ranges[ls->nb_ranges].start = addr;
+    ls->ranges[ls->nb_ranges].end = addr + 4096;
+    ls->nb_ranges++;
+    ls->deferred_pages++;
+    return true;
+}
+
+void LazyLoad::start()
+{
+#ifdef __linux__
+    LazyState* ls = getState();
+    if (ls->uffd < 0)
+        return;
+
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &ls->start_time));
+
+    /* Discard the deferred pages, then register the areas. Discarding
+     * registered memory would wait for our thread to read the event. */
+    for (int r = 0; r < ls->nb_ranges; r++)
+        NATIVECALL(madvise(ls->ranges[r].start, ls->ranges[r].end - ls->ranges[r].start, MADV_DONTNEED));
+
+    int i = 0;
+    while (i < ls->nb_intervals) {
+        struct uffdio_register reg;
+        reg.range.start = reinterpret_cast<uintptr_t>(ls->intervals[i].start);
+        reg.range.len = ls->intervals[i].end - ls->intervals[i].start;
+        reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+
+        int ret;
+        NATIVECALL(ret = ioctl(ls->uffd, UFFDIO_REGISTER, &reg));
+        if (ret == 0) {
+            i++;
+            continue;
+        }
+
+        /* Restore the discarded pages of this area now */
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not register area %p to userfaultfd", ls->intervals[i].start);
+        for (int r = 0; r < ls->nb_ranges; r++) {
+            if ((ls->ranges[r].start < ls->intervals[i].start) || (ls->ranges[r].start >= ls->intervals[i].end))
+                continue;
+            for (char* addr = ls->ranges[r].start; addr < ls->ranges[r].end; addr += 4096) {
+                readPage(READER_FAULT, addr, addr);
+                ls->deferred_pages--;
+            }
+        }
+        memmove(&ls->intervals[i], &ls->intervals[i+1], (ls->nb_intervals - i - 1) * sizeof(Interval));
+        ls->nb_intervals--;
+    }
+
+    if (ls->nb_intervals == 0) {
+        release();
+        return;
+    }
+
+    debuglogstdio(LCF_CHECKPOINT, "Lazily loading %zu pages in %d areas", ls->deferred_pages, ls->nb_intervals);
+
+    ls->running = true;
+    sem_post(&ls->sem_start);
+#endif
+}
+
+}
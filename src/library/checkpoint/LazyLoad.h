@@ -0,0 +1,67 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_LAZYLOAD_H
+#define LIBTAS_LAZYLOAD_H
+
+namespace libtas {
+
+struct Area;
+
+/* Lazy loading of savestates using userfaultfd. When loading a state, the
+ * pages of large anonymous areas are not restored. Instead, they are
+ * discarded and registered to userfaultfd, so that a thread fills them when
+ * they are first accessed, while prefetching all the remaining pages in the
+ * background.
+ *
+ * Like the checkpoint workers, the thread and everything it uses is located
+ * in our reserved memory, so that it is not modified by loading a state.
+ */
+namespace LazyLoad {
+
+/* Create the thread. Must be called before suspending the game threads. */
+void init();
+
+/* Wait for the current lazy loading (if any) to complete. Must be called
+ * before saving or loading a state. */
+void finish();
+
+/* Start preparing a lazy loading of a savestate, at the beginning of the
+ * restore. Returns false if lazy loading is not possible. */
+bool prepare(const char* pagemappath, const char* pagespath, int pagemapfd, int pagesfd,
+    const char* basepagemappath, const char* basepagespath, int basepagemapfd, int basepagesfd);
+
+/* Returns if an area can be lazily loaded. `prev` is the previous saved area. */
+bool isCandidate(const Area& area, const Area& prev);
+
+/* Register an area that is lazily loaded */
+bool addArea(const Area& area);
+
+/* Defer the restoration of a page of the last registered area. Returns false
+ * if the page must be restored immediately. */
+bool addPage(char* addr);
+
+/* Discard the deferred pages and start the thread, at the end of the
+ * restore */
+void start();
+
+}
+}
+
+#endif
@@ -51,6 +51,14 @@ struct Area {
         FULL_PAGE, /* Area contains a copy of the page */
         BASE_PAGE, /* Page was not modified from base savestate */
         COMPRESSED_PAGE, /* Full page but compressed */
+        COMPRESSED_BLOCK_START, /* First page of a block of consecutive pages compressed together */
+        COMPRESSED_BLOCK, /* Next page inside a compressed block */
+        STORED_PAGE, /* Page is in the shared page store, only its index is saved */
+    };
+
+    /* Maximum number of pages in a compressed block */
+    enum {
+        MAX_BLOCK_PAGES = 64
     };
 
     void* addr;
@@ -0,0 +1,326 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PageKernels.h"
+#include "../logging.h"
+#include "../GlobalState.h"
+#include "../TimeHolder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PAGEKERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace libtas {
+
+static bool isZeroScalar(const void* page)
+{
+    const long long *buf = static_cast<const long long*>(page);
+    size_t end = 4096 / sizeof(*buf);
+
+    for (size_t i = 0; i < end; i += 8) {
+        long long res = buf[i + 0] | buf[i + 1] | buf[i + 2] | buf[i + 3] |
+            buf[i + 4] | buf[i + 5] | buf[i + 6] | buf[i + 7];
+        if (res != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool isEqualScalar(const void* page1, const void* page2)
+{
+    const long long *buf1 = static_cast<const long long*>(page1);
+    const long long *buf2 = static_cast<const long long*>(page2);
+    size_t end = 4096 / sizeof(*buf1);
+
+    for (size_t i = 0; i < end; i += 8) {
+        long long res = (buf1[i + 0] ^ buf2[i + 0]) | (buf1[i + 1] ^ buf2[i + 1]) |
+            (buf1[i + 2] ^ buf2[i + 2]) | (buf1[i + 3] ^ buf2[i + 3]) |
+            (buf1[i + 4] ^ buf2[i + 4]) | (buf1[i + 5] ^ buf2[i + 5]) |
+            (buf1[i + 6] ^ buf2[i + 6]) | (buf1[i + 7] ^ buf2[i + 7]);
+        if (res != 0)
+            return false;
+    }
+    return true;
+}
+
+#ifdef PAGEKERNELS_X86
+
+/* Each kernel processes 256 bytes per iteration before testing the result.
+ * Pages may not be aligned, for example when decompressed inside a block. */
+
+__attribute__((target("sse2")))
+static bool isZeroSSE2(const void* page)
+{
+    const __m128i* p = static_cast<const __m128i*>(page);
+    for (int i = 0; i < 4096 / 16; i += 16) {
+        __m128i v = _mm_loadu_si128(p + i);
+        for (int j = 1; j < 16; j++)
+            v = _mm_or_si128(v, _mm_loadu_si128(p + i + j));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("sse2")))
+static bool isEqualSSE2(const void* page1, const void* page2)
+{
+    const __m128i* p1 = static_cast<const __m128i*>(page1);
+    const __m128i* p2 = static_cast<const __m128i*>(page2);
+    for (int i = 0; i < 4096 / 16; i += 16) {
+        __m128i v = _mm_setzero_si128();
+        for (int j = 0; j < 16; j++)
+            v = _mm_or_si128(v, _mm_xor_si128(_mm_loadu_si128(p1 + i + j), _mm_loadu_si128(p2 + i + j)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool isZeroAVX2(const void* page)
+{
+    const __m256i* p = static_cast<const __m256i*>(page);
+    for (int i = 0; i < 4096 / 32; i += 8) {
+        __m256i v = _mm256_loadu_si256(p + i);
+        for (int j = 1; j < 8; j++)
+            v = _mm256_or_si256(v, _mm256_loadu_si256(p + i + j));
+        if (!_mm256_testz_si256(v, v))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool isEqualAVX2(const void* page1, const void* page2)
+{
+    const __m256i* p1 = static_cast<const __m256i*>(page1);
+    const __m256i* p2 = static_cast<const __m256i*>(page2);
+    for (int i = 0; i < 4096 / 32; i += 8) {
+        __m256i v = _mm256_setzero_si256();
+        for (int j = 0; j < 8; j++)
+            v = _mm256_or_si256(v, _mm256_xor_si256(_mm256_loadu_si256(p1 + i + j), _mm256_loadu_si256(p2 + i + j)));
+        if (!_mm256_testz_si256(v, v))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx512f")))
+static bool isZeroAVX512(const void* page)
+{
+    const __m512i* p = static_cast<const __m512i*>(page);
+    for (int i = 0; i < 4096 / 64; i += 4) {
+        __m512i v = _mm512_or_si512(
+            _mm512_or_si512(_mm512_loadu_si512(p + i), _mm512_loadu_si512(p + i + 1)),
+            _mm512_or_si512(_mm512_loadu_si512(p + i + 2), _mm512_loadu_si512(p + i + 3)));
+        if (_mm512_test_epi64_mask(v, v))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx512f")))
+static bool isEqualAVX512(const void* page1, const void* page2)
+{
+    const __m512i* p1 = static_cast<const __m512i*>(page1);
+    const __m512i* p2 = static_cast<const __m512i*>(page2);
+    for (int i = 0; i < 4096 / 64; i += 4) {
+        __m512i v = _mm512_or_si512(
+            _mm512_or_si512(
+                _mm512_xor_si512(_mm512_loadu_si512(p1 + i), _mm512_loadu_si512(p2 + i)),
+                _mm512_xor_si512(_mm512_loadu_si512(p1 + i + 1), _mm512_loadu_si512(p2 + i + 1))),
+            _mm512_or_si512(
+                _mm512_xor_si512(_mm512_loadu_si512(p1 + i + 2), _mm512_loadu_si512(p2 + i + 2)),
+                _mm512_xor_si512(_mm512_loadu_si512(p1 + i + 3), _mm512_loadu_si512(p2 + i + 3))));
+        if (_mm512_test_epi64_mask(v, v))
+            return false;
+    }
+    return true;
+}
+
+#endif
+
+bool PageKernels::supported(int kernel)
+{
+    switch (kernel) {
+        case KERNEL_SCALAR:
+            return true;
+#ifdef PAGEKERNELS_X86
+        case KERNEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case KERNEL_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+int PageKernels::best()
+{
+    /* The cpu does not change, so we can keep the result */
+    static int best_kernel = -1;
+
+    if (best_kernel == -1) {
+        best_kernel = KERNEL_SCALAR;
+        for (int k = KERNEL_COUNT - 1; k > KERNEL_SCALAR; k--) {
+            if (supported(k)) {
+                best_kernel = k;
+                break;
+            }
+        }
+    }
+    return best_kernel;
+}
+
+const char* PageKernels::name(int kernel)
+{
+    switch (kernel) {
+        case KERNEL_SSE2:
+            return "sse2";
+        case KERNEL_AVX2:
+            return "avx2";
+        case KERNEL_AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+bool PageKernels::isZero(int kernel, const void* page)
+{
+    switch (kernel) {
+#ifdef PAGEKERNELS_X86
+        case KERNEL_SSE2:
+            return isZeroSSE2(page);
+        case KERNEL_AVX2:
+            return isZeroAVX2(page);
+        case KERNEL_AVX512:
+            return isZeroAVX512(page);
+#endif
+        default:
+            return isZeroScalar(page);
+    }
+}
+
+bool PageKernels::isEqual(int kernel, const void* page1, const void* page2)
+{
+    switch (kernel) {
+#ifdef PAGEKERNELS_X86
+        case KERNEL_SSE2:
+            return isEqualSSE2(page1, page2);
+        case KERNEL_AVX2:
+            return isEqualAVX2(page1, page2);
+        case KERNEL_AVX512:
+            return isEqualAVX512(page1, page2);
+#endif
+        default:
+            return isEqualScalar(page1, page2);
+    }
+}
+
+static double elapsed(const TimeHolder& start)
+{
+    TimeHolder end, delta;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &end));
+    delta = end - start;
+    return delta.tv_sec + ((double)delta.tv_nsec) / 1000000000.0;
+}
+
+std::string PageKernels::benchmark()
+{
+    /* Zero and equal pages are the worst case, because all bytes are read */
+    const int nb_pages = 4096;
+    const int repeat = 16;
+
+    /* Buffers are mapped and unmapped afterwards, so that the game heap, and
+     * thus the next savestates, are left unchanged. */
+    size_t size = static_cast<size_t>(nb_pages) * 4096;
+    void* scratch;
+    NATIVECALL(scratch = mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (scratch == MAP_FAILED)
+        return "Could not allocate memory for the page kernel benchmark\n";
+    char* zeros = static_cast<char*>(scratch);
+    char* copy = zeros + size;
+
+    /* Write the buffers, otherwise all their pages are backed by the shared
+     * zero page and reads are much faster than on the game memory */
+    memset(scratch, 0, 2 * size);
+
+    double total_gb = static_cast<double>(nb_pages) * 4096 * repeat / (1024.0 * 1024.0 * 1024.0);
+    char line[256];
+    snprintf(line, 256, "Page kernel benchmark on %d MB:\n", nb_pages * 4096 * repeat / (1024 * 1024));
+    std::string report = line;
+
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        if (!supported(k))
+            continue;
+
+        bool failed = false;
+        int count = 0;
+
+        TimeHolder start;
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+        for (int r = 0; r < repeat; r++)
+            for (int p = 0; p < nb_pages; p++)
+                count += isZero(k, zeros + p * 4096);
+        double zero_time = elapsed(start);
+
+        NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+        for (int r = 0; r < repeat; r++)
+            for (int p = 0; p < nb_pages; p++)
+                count += isEqual(k, zeros + p * 4096, copy + p * 4096);
+        double equal_time = elapsed(start);
+
+        if (count != 2 * repeat * nb_pages)
+            failed = true;
+
+        /* Check that a single different byte is detected anywhere */
+        for (int i = 0; i < 4096; i += 251) {
+            copy[i] = 1;
+            if (isZero(k, copy) || isEqual(k, zeros, copy))
+                failed = true;
+            copy[i] = 0;
+        }
+
+        snprintf(line, 256, "%s: zero %.1f GB/s, equal %.1f GB/s%s%s",
+            name(k), total_gb / zero_time, total_gb / equal_time,
+            (k == best()) ? " (selected)" : "", failed ? " [FAILED]" : "");
+        debuglogstdio(LCF_CHECKPOINT | LCF_INFO, "%s", line);
+        report += line;
+        report += '\n';
+    }
+
+    NATIVECALL(munmap(scratch, 2 * size));
+    return report;
+}
+
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_PAGEKERNELS_H
+#define LIBTAS_PAGEKERNELS_H
+
+#include <string>
+
+namespace libtas {
+
+/* Kernels checking if a memory page is zero, or if two memory pages are
+ * equal. Vector kernels are selected at runtime depending on the cpu. */
+namespace PageKernels {
+
+enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_COUNT
+};
+
+/* Returns if a kernel can run on this cpu */
+bool supported(int kernel);
+
+/* Returns the fastest kernel supported by this cpu */
+int best();
+
+/* Returns the name of a kernel */
+const char* name(int kernel);
+
+/* Returns if a page of 4096 bytes only contains zeros, using a specific kernel */
+bool isZero(int kernel, const void* page);
+
+/* Returns if two pages of 4096 bytes are equal, using a specific kernel */
+bool isEqual(int kernel, const void* page1, const void* page2);
+
+/* Compare the speed of each supported kernel, and returns a report.
+ * Allocates memory, so it must not be called during a checkpoint. */
+std::string benchmark();
+
+}
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PageStore.h"
+#include "MemArea.h"
+#include "ReservedMemory.h"
+#include "../logging.h"
+#include "../GlobalState.h"
+#include "../global.h"
+#include "../../shared/SharedConfig.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* Maximum number of pages in the arena. Only the pages actually stored use
+ * memory, so we can afford a large address range on 64-bit */
+#ifdef __x86_64__
+#define STORE_MAX_PAGES (1u << 24)
+#else
+#define STORE_MAX_PAGES (1u << 16)
+#endif
+
+/* Number of entries of the hash table, so that it is at most half full */
+#define STORE_TABLE_SIZE (2 * STORE_MAX_PAGES)
+
+namespace libtas {
+
+struct StoreHeader {
+    /* Number of arena pages that were ever used */
+    uint32_t used_pages;
+
+    /* Index + 1 of the first free page, or 0 */
+    uint32_t free_head;
+
+    /* Index + 1 of the first page that lost all its references since the
+     * last collect(), or 0 */
+    uint32_t pending_head;
+
+    /* Number of distinct stored pages */
+    uint32_t count;
+};
+
+struct PageMeta {
+    uint64_t hash;
+    uint32_t refcount;
+
+    /* Index + 1 of the next page in the free or pending list */
+    uint32_t next;
+
+    /* Page is in the pending list */
+    uint32_t pending;
+};
+
+/* Layout of the arena: header, page metadata, hash table, then pages */
+#define STORE_META_OFFSET 4096
+#define STORE_TABLE_OFFSET (STORE_META_OFFSET + static_cast<size_t>(STORE_MAX_PAGES) * sizeof(PageMeta))
+#define STORE_PAGES_OFFSET (STORE_TABLE_OFFSET + static_cast<size_t>(STORE_TABLE_SIZE) * sizeof(uint32_t))
+#define STORE_ARENA_SIZE (STORE_PAGES_OFFSET + static_cast<size_t>(STORE_MAX_PAGES) * 4096)
+
+static_assert((STORE_PAGES_OFFSET % 4096) == 0, "Stored pages must be page-aligned");
+
+/* Location of the arena. It is stored in our reserved memory, so that
+ * loading a savestate made before the arena was created does not lose it */
+struct StoreHandle {
+    char* arena;
+    int fd;
+};
+
+static_assert(sizeof(StoreHandle) <= ReservedMemory::STORE_SIZE, "Page store handle does not fit in reserved memory");
+
+static StoreHandle* handle()
+{
+    return static_cast<StoreHandle*>(ReservedMemory::getAddr(ReservedMemory::STORE_ADDR));
+}
+
+static StoreHeader* header()
+{
+    return reinterpret_cast<StoreHeader*>(handle()->arena);
+}
+
+static PageMeta* meta(uint32_t index)
+{
+    return reinterpret_cast<PageMeta*>(handle()->arena + STORE_META_OFFSET) + index;
+}
+
+static uint32_t* table()
+{
+    return reinterpret_cast<uint32_t*>(handle()->arena + STORE_TABLE_OFFSET);
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* 64-bit hash of a page, using four independent lanes like xxHash64 */
+static uint64_t hashPage(const char* page)
+{
+    static const uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static const uint64_t P3 = 0x165667B19E3779F9ull;
+
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(page);
+    uint64_t h0 = P1 + P2, h1 = P2, h2 = 0, h3 = -P1;
+
+    for (int i = 0; i < 512; i += 4) {
+        h0 = rotl64(h0 + words[i + 0] * P2, 31) * P1;
+        h1 = rotl64(h1 + words[i + 1] * P2, 31) * P1;
+        h2 = rotl64(h2 + words[i + 2] * P2, 31) * P1;
+        h3 = rotl64(h3 + words[i + 3] * P2, 31) * P1;
+    }
+
+    uint64_t h = rotl64(h0, 1) + rotl64(h1, 7) + rotl64(h2, 12) + rotl64(h3, 18);
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool PageStore::enabled()
+{
+    /* The forked process cannot update the store of the game process */
+    int settings = Global::shared_config.savestate_settings;
+    return (handle()->arena != nullptr) &&
+        (settings & SharedConfig::SS_RAM) &&
+        (settings & SharedConfig::SS_DEDUP) &&
+        !(settings & SharedConfig::SS_FORK);
+}
+
+void PageStore::init()
+{
+    StoreHandle* h = handle();
+    if (h->arena)
+        return;
+
+#ifdef __linux__
+    int fd = syscall(SYS_memfd_create, "libtas_pagestore", 0);
+    if (fd < 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create the page store");
+        return;
+    }
+
+    /* The memfd is sparse, so this does not use any memory */
+    if (ftruncate(fd, STORE_ARENA_SIZE) != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not resize the page store");
+        NATIVECALL(close(fd));
+        return;
+    }
+
+    void* addr = mmap(nullptr, STORE_ARENA_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (addr == MAP_FAILED) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not map the page store");
+        NATIVECALL(close(fd));
+        return;
+    }
+
+    h->arena = static_cast<char*>(addr);
+    h->fd = fd;
+    debuglogstdio(LCF_CHECKPOINT, "Created page store of %u pages at %p", STORE_MAX_PAGES, h->arena);
+#endif
+}
+
+void PageStore::discard()
+{
+    StoreHandle* h = handle();
+    if (!h->arena)
+        return;
+
+    MYASSERT(munmap(h->arena, STORE_ARENA_SIZE) == 0)
+    NATIVECALL(close(h->fd));
+    h->arena = nullptr;
+    h->fd = -1;
+}
+
+bool PageStore::isArena(const Area *area)
+{
+    return handle()->arena && (area->addr == handle()->arena) && (area->size == STORE_ARENA_SIZE);
+}
+
+bool PageStore::overlapsArena(const Area *area)
+{
+    char* arena = handle()->arena;
+    return arena && (static_cast<char*>(area->addr) < (arena + STORE_ARENA_SIZE)) &&
+        (static_cast<char*>(area->endAddr) > arena);
+}
+
+bool PageStore::insert(const char* page, uint32_t* index)
+{
+    uint64_t hash = hashPage(page);
+    uint32_t* tab = table();
+    uint32_t slot = hash & (STORE_TABLE_SIZE - 1);
+
+    /* Look for an identical page */
+    while (tab[slot]) {
+        uint32_t i = tab[slot] - 1;
+        PageMeta* m = meta(i);
+        if ((m->hash == hash) && (memcmp(getPage(i), page, 4096) == 0)) {
+            m->refcount++;
+            *index = i;
+            return true;
+        }
+        slot = (slot + 1) & (STORE_TABLE_SIZE - 1);
+    }
+
+    /* Allocate a new page */
+    StoreHeader* h = header();
+    uint32_t i;
+    if (h->free_head) {
+        i = h->free_head - 1;
+        h->free_head = meta(i)->next;
+    }
+    else if (h->used_pages < STORE_MAX_PAGES) {
+        i = h->used_pages++;
+    }
+    else {
+        return false;
+    }
+
+    memcpy(handle()->arena + STORE_PAGES_OFFSET + static_cast<size_t>(i) * 4096, page, 4096);
+
+    PageMeta* m = meta(i);
+    m->hash = hash;
+    m->refcount = 1;
+    m->next = 0;
+    m->pending = 0;
+
+    tab[slot] = i + 1;
+    h->count++;
+    *index = i;
+    return true;
+}
+
+void PageStore::addRef(uint32_t index)
+{
+    meta(index)->refcount++;
+}
+
+void PageStore::release(uint32_t index)
+{
+    PageMeta* m = meta(index);
+    MYASSERT(m->refcount > 0)
+
+    m->refcount--;
+    if ((m->refcount == 0) && !m->pending) {
+        m->pending = 1;
+        m->next = header()->pending_head;
+        header()->pending_head = index + 1;
+    }
+}
+
+/* Remove a page from the hash table, shifting back the following entries so
+ * that linear probing still finds them */
+static void removeFromTable(uint32_t index)
+{
+    uint32_t* tab = table();
+    uint32_t hole = meta(index)->hash & (STORE_TABLE_SIZE - 1);
+    while (tab[hole] != index + 1)
+        hole = (hole + 1) & (STORE_TABLE_SIZE - 1);
+
+    uint32_t j = hole;
+    while (true) {
+        j = (j + 1) & (STORE_TABLE_SIZE - 1);
+        if (!tab[j])
+            break;
+
+        /* An entry can fill the hole if its home slot is not between the
+         * hole and itself */
+        uint32_t home = meta(tab[j] - 1)->hash & (STORE_TABLE_SIZE - 1);
+        bool between = (hole <= j) ? ((hole < home) && (home <= j)) : ((hole < home) || (home <= j));
+        if (!between) {
+            tab[hole] = tab[j];
+            hole = j;
+        }
+    }
+    tab[hole] = 0;
+}
+
+void PageStore::collect()
+{
+    if (!handle()->arena)
+        return;
+
+    StoreHeader* h = header();
+    uint32_t p = h->pending_head;
+    h->pending_head = 0;
+
+    while (p) {
+        uint32_t i = p - 1;
+        PageMeta* m = meta(i);
+        p = m->next;
+        m->pending = 0;
+
+        /* The page was reused by the last savestate */
+        if (m->refcount > 0)
+            continue;
+
+        removeFromTable(i);
+        m->next = h->free_head;
+        h->free_head = i + 1;
+        h->count--;
+
+#ifdef __linux__
+        /* Give the memory back */
+        fallocate(handle()->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            STORE_PAGES_OFFSET + static_cast<size_t>(i) * 4096, 4096);
+#endif
+    }
+}
+
+const char* PageStore::getPage(uint32_t index)
+{
+    /* The store was discarded, the savestate cannot be restored */
+    if (!handle()->arena) {
+        static const char zero_page[4096] = {};
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Page %u of the page store was discarded", index);
+        return zero_page;
+    }
+
+    return handle()->arena + STORE_PAGES_OFFSET + static_cast<size_t>(index) * 4096;
+}
+
+uint32_t PageStore::count()
+{
+    return handle()->arena ? header()->count : 0;
+}
+
+}
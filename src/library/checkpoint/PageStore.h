@@ -0,0 +1,82 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_PAGESTORE_H
+#define LIBTAS_PAGESTORE_H
+
+#include <cstdint>
+
+namespace libtas {
+
+struct Area;
+
+/* Store of memory pages shared by all savestates in RAM. Each distinct page
+ * content is stored once in a memfd arena, indexed by the hash of its
+ * content and reference counted. Savestates only store the index of each
+ * page in the arena.
+ *
+ * The arena is mapped once with its maximum size, so that its mapping never
+ * changes and can be skipped by savestates like our reserved memory. It is
+ * kept when loading a savestate made before it was created. All the
+ * bookkeeping is located inside the arena, and its location inside our
+ * reserved memory, so that they are not modified when loading a savestate.
+ */
+namespace PageStore {
+
+/* Returns if savestates should use the page store */
+bool enabled();
+
+/* Create the arena if not already done. Must be called before suspending
+ * the game threads. */
+void init();
+
+/* Unmap the arena and lose all stored pages. Used when loading a savestate
+ * with memory at the location of the arena. */
+void discard();
+
+/* Returns if a memory area is the arena mapping */
+bool isArena(const Area *area);
+
+/* Returns if a memory area overlaps the arena mapping */
+bool overlapsArena(const Area *area);
+
+/* Store a page, or add a reference to an identical stored page. Returns
+ * false if the arena is full. */
+bool insert(const char* page, uint32_t* index);
+
+/* Add a reference to a stored page */
+void addRef(uint32_t index);
+
+/* Remove a reference to a stored page. The page is only freed when calling
+ * collect(), so that it can be reused by the savestate being written. */
+void release(uint32_t index);
+
+/* Free all pages that are not referenced anymore */
+void collect();
+
+/* Returns the content of a stored page */
+const char* getPage(uint32_t index);
+
+/* Returns the number of distinct pages in the store */
+uint32_t count();
+
+}
+}
+
+#endif
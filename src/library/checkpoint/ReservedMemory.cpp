@@ -28,21 +28,29 @@ namespace libtas {
 
 static intptr_t restoreAddr = 0;
 static size_t restoreLength = 0;
+static intptr_t regionOffsets[ReservedMemory::REGION_COUNT];
 
-void ReservedMemory::init()
+void ReservedMemory::init(const size_t* region_sizes)
 {
     /* Create a special place to hold restore memory.
      * will be used for the second stack we will switch to, as well as
      * the ProcSelfMaps object that need some space.
      */
     if (restoreAddr == 0) {
-        restoreLength = RESTORE_TOTAL_SIZE;
+        restoreLength = REGIONS_ADDR;
+        for (int r = 0; r < REGION_COUNT; r++) {
+            regionOffsets[r] = restoreLength;
+            restoreLength += (region_sizes[r] + 4095) & ~static_cast<size_t>(4095);
+        }
+
         void* addr = mmap(nullptr, restoreLength + (2 * 4096), PROT_NONE,
             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
         MYASSERT(addr != MAP_FAILED)
         restoreAddr = reinterpret_cast<intptr_t>(addr) + 4096;
         MYASSERT(mprotect(reinterpret_cast<void*>(restoreAddr), restoreLength, PROT_READ | PROT_WRITE) == 0)
-        memset(reinterpret_cast<void*>(restoreAddr), 0, restoreLength);
+        /* Touch the fixed part of the memory. The regions are only committed
+         * when they are used. */
+        memset(reinterpret_cast<void*>(restoreAddr), 0, REGIONS_ADDR);
     }
 }
 
@@ -51,6 +59,11 @@ void* ReservedMemory::getAddr(intptr_t offset)
     return reinterpret_cast<void*>(restoreAddr+offset);
 }
 
+void* ReservedMemory::getRegion(int region)
+{
+    return reinterpret_cast<void*>(restoreAddr+regionOffsets[region]);
+}
+
 size_t ReservedMemory::getSize()
 {
     return restoreLength;
@@ -26,27 +26,47 @@
 #include <cstddef> // size_t
 
 #define ONE_MB 1024 * 1024
-#define RESTORE_TOTAL_SIZE 5 * ONE_MB
 
 namespace libtas {
 namespace ReservedMemory {
     enum Addresses {
         PAGEMAPS_ADDR = 0,
         PAGES_ADDR = 11*sizeof(int),
-        SS_SLOTS_ADDR = 22*sizeof(int),
-        PSM_ADDR = 22*sizeof(int)+11*sizeof(bool),
+        PSM_ADDR = 22*sizeof(int),
         STACK_ADDR = ONE_MB,
+        WORKERS_ADDR = 3 * ONE_MB,
+        LAZY_ADDR = 7 * ONE_MB,
+        BLOCKS_ADDR = 8 * ONE_MB,
+        FORK_ADDR = 12 * ONE_MB,
+        STATS_ADDR = 13 * ONE_MB,
+        STORE_ADDR = 14 * ONE_MB,
+        REGIONS_ADDR = 15 * ONE_MB,
     };
     enum Sizes {
         PAGEMAPS_SIZE = PAGES_ADDR - PAGEMAPS_ADDR,
-        PAGES_SIZE = SS_SLOTS_ADDR - PAGES_ADDR,
-        SS_SLOTS_SIZE = PSM_ADDR - SS_SLOTS_ADDR,
+        PAGES_SIZE = PSM_ADDR - PAGES_ADDR,
         PSM_SIZE = STACK_ADDR - PSM_ADDR,
-        STACK_SIZE = RESTORE_TOTAL_SIZE - STACK_ADDR,
+        STACK_SIZE = WORKERS_ADDR - STACK_ADDR,
+        WORKERS_SIZE = LAZY_ADDR - WORKERS_ADDR,
+        LAZY_SIZE = BLOCKS_ADDR - LAZY_ADDR,
+        BLOCKS_SIZE = FORK_ADDR - BLOCKS_ADDR,
+        FORK_SIZE = STATS_ADDR - FORK_ADDR,
+        STATS_SIZE = STORE_ADDR - STATS_ADDR,
+        STORE_SIZE = REGIONS_ADDR - STORE_ADDR,
     };
 
-    void init();
+    /* Regions located after the fixed ones, whose size depends on the
+     * number of cores and on the savestate settings */
+    enum Regions {
+        CODEC_REGION,
+        INDEX_REGION,
+        REGION_COUNT
+    };
+
+    /* Reserve the memory, with the size of each region */
+    void init(const size_t* region_sizes);
     void* getAddr(intptr_t offset);
+    void* getRegion(int region);
     size_t getSize();
 
 
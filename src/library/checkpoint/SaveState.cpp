@@ -25,15 +25,60 @@
 #include "../logging.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <cstring>
+#include "Codec.h"
+#include "PageStore.h"
+#include "ReservedMemory.h"
+#include "CheckpointStats.h"
 #include "../../external/lz4.h"
 #include "../global.h"
 #include "../GlobalState.h"
 
 namespace libtas {
 
+/* Buffers used to decompress a block, one for each reader role. They are
+ * located in our reserved memory instead of the stack. */
+struct BlockBuffer {
+    /* Savestate and offset of the block that was decompressed */
+    const SaveState* owner;
+    off_t offset;
+
+    char block[Area::MAX_BLOCK_PAGES * 4096];
+    char compressed[LZ4_COMPRESSBOUND(Area::MAX_BLOCK_PAGES * 4096)];
+};
+
+static_assert(SaveState::READER_COUNT * sizeof(BlockBuffer) <= ReservedMemory::BLOCKS_SIZE,
+    "Block buffers do not fit in reserved memory");
+
+static BlockBuffer* getBlockBuffer(int reader)
+{
+    return static_cast<BlockBuffer*>(ReservedMemory::getAddr(ReservedMemory::BLOCKS_ADDR)) + reader;
+}
+
+/* Forget the blocks decompressed by a savestate, as another one may be
+ * located at the same address later */
+static void releaseBlockBuffers(const SaveState* state)
+{
+    for (int r = 0; r < SaveState::READER_COUNT; r++) {
+        BlockBuffer* buffer = getBlockBuffer(r);
+        if (buffer->owner == state)
+            buffer->owner = nullptr;
+    }
+}
+
 SaveState::SaveState(const char* pagemappath, const char* pagespath, int pagemapfd, int pagesfd)
 {
+    releaseBlockBuffers(this);
     queued_size = 0;
+    stored_indexes_count = 0;
+    unchanged_pages = 0;
+    codec_time = 0;
+    timed = CheckpointStats::enabled();
+    reader = STATE_READER;
+    thread = CHECKPOINT_THREAD;
+    codec = SharedConfig::CODEC_LZ4;
+    pagemap = nullptr;
+    index_area = -1;
 
     if (Global::shared_config.savestate_settings & SharedConfig::SS_RAM) {
         pmfd = pagemapfd;
@@ -59,21 +104,64 @@ SaveState::SaveState(const char* pagemappath, const char* pagespath, int pagemap
         MYASSERT(pfd != -1)
     }
 
-    restart();
+    /* Pages can be compressed with a different codec than the current one */
+    StateHeader sh;
+    readHeader(sh);
+    codec = sh.codec;
 }
 
 SaveState::~SaveState()
 {
+    releaseBlockBuffers(this);
     if (!(Global::shared_config.savestate_settings & SharedConfig::SS_RAM) && (pmfd > 0)) {
         NATIVECALL(close(pmfd));
         NATIVECALL(close(pfd));
     }
 }
 
+bool SaveState::loadIndex(int slot)
+{
+    if (pmfd == -1)
+        return false;
+
+    pagemap = StateIndex::load(pmfd, slot, pagemap_size);
+    if (!pagemap)
+        return false;
+
+    StateIndex::Trailer trailer;
+    memcpy(&trailer, pagemap + pagemap_size - sizeof(trailer), sizeof(trailer));
+    index_lengths = reinterpret_cast<const uint8_t*>(pagemap + trailer.lengths_offset);
+    index_points = reinterpret_cast<const StateIndex::Point*>(pagemap + trailer.points_offset);
+    index_areas = reinterpret_cast<const StateIndex::AreaEntry*>(pagemap + trailer.areas_offset);
+    index_area_count = trailer.area_count;
+
+    restart();
+    return true;
+}
+
+void SaveState::readPagemap(void* dst, size_t size)
+{
+    if (pagemap) {
+        memcpy(dst, pagemap + pagemap_pos, size);
+        pagemap_pos += size;
+    }
+    else {
+        Utils::readAll(pmfd, dst, size);
+    }
+}
+
+void SaveState::seekPagemap(off_t offset)
+{
+    if (pagemap)
+        pagemap_pos = offset;
+    else
+        lseek(pmfd, offset, SEEK_SET);
+}
+
 void SaveState::readHeader(StateHeader& sh)
 {
-    lseek(pmfd, 0, SEEK_SET);
-    Utils::readAll(pmfd, &sh, sizeof(sh));
+    seekPagemap(0);
+    readPagemap(&sh, sizeof(sh));
 
     restart();
 }
@@ -81,8 +169,9 @@ void SaveState::readHeader(StateHeader& sh)
 void SaveState::restart()
 {
     /* Seek after the savestate header */
-    lseek(pmfd, sizeof(StateHeader), SEEK_SET);
+    seekPagemap(sizeof(StateHeader));
     flags_remaining = 0;
+    index_area = -1;
 
     /* Read the first area */
     nextArea();
@@ -90,6 +179,12 @@ void SaveState::restart()
 
 char SaveState::nextFlag()
 {
+    if (pagemap) {
+        flags_remaining--;
+        current_flag = pagemap[pagemap_pos++];
+        return current_flag;
+    }
+
     if (flag_i == 4096) {
     	MYASSERT(flags_remaining > 0);
 
@@ -107,9 +202,13 @@ char SaveState::nextFlag()
 
 Area SaveState::nextArea()
 {
-    if (flags_remaining > 0)
-        lseek(pmfd, flags_remaining, SEEK_CUR);
-    Utils::readAll(pmfd, &area, sizeof(Area));
+    if (flags_remaining > 0) {
+        if (pagemap)
+            pagemap_pos += flags_remaining;
+        else
+            lseek(pmfd, flags_remaining, SEEK_CUR);
+    }
+    readPagemap(&area, sizeof(Area));
     next_pfd_offset = area.page_offset;
     current_addr = static_cast<char*>(area.addr);
     flag_i = 4096;
@@ -118,6 +217,13 @@ Area SaveState::nextArea()
     } else {
         flags_remaining = area.size / 4096;
     }
+
+    if (pagemap && area.addr && !area.skip) {
+        /* Skipped areas are not in the index */
+        index_area++;
+        MYASSERT(index_area < index_area_count)
+        lengths_pos = index_points[index_areas[index_area].first_point].lengths_pos;
+    }
     return area;
 }
 
@@ -132,6 +238,14 @@ char SaveState::getPageFlag(char* addr)
     if (addr == (current_addr - 4096))
         return current_flag;
 
+    /* Use the index unless the address is a few pages after the current one */
+    if (pagemap && ((area.addr == nullptr) || area.skip || (addr < current_addr) ||
+        (addr >= static_cast<char*>(area.endAddr)) ||
+        ((addr - current_addr) >= StateIndex::STRIDE * 4096))) {
+        if (!seekIndex(addr))
+            return Area::NONE;
+    }
+
     while ((area.addr != nullptr) && (addr >= static_cast<char*>(area.endAddr))) {
         /* Skip areas until the one we are interested in */
         nextArea();
@@ -151,37 +265,102 @@ char SaveState::getPageFlag(char* addr)
     char flag;
     do {
         flag = nextFlag();
-        if (flag == Area::FULL_PAGE) {
-            next_pfd_offset += 4096;
-        }
-        else if (flag == Area::COMPRESSED_PAGE) {
-            lseek(pfd, next_pfd_offset, SEEK_SET);
-            Utils::readAll(pfd, &compressed_length, sizeof(int));
-            next_pfd_offset += sizeof(int) + compressed_length;
-        }
+        advanceOffset(flag);
         current_addr += 4096;
     } while (current_addr <= addr);
 
     return flag;
 }
 
+bool SaveState::seekIndex(char* addr)
+{
+    /* Look for the first area ending after the address */
+    int low = 0;
+    int high = index_area_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (index_areas[mid].endAddr <= addr)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if ((low == index_area_count) || (addr < index_areas[low].addr))
+        return false;
+
+    const StateIndex::AreaEntry& entry = index_areas[low];
+    if (index_area != low) {
+        memcpy(&area, pagemap + entry.area_offset, sizeof(Area));
+        index_area = low;
+    }
+
+    /* Restore the state of the reader at the closest point */
+    int point_i = (addr - entry.addr) / (StateIndex::STRIDE * 4096);
+    const StateIndex::Point& point = index_points[entry.first_point + point_i];
+    int page = point_i * StateIndex::STRIDE;
+
+    pagemap_pos = entry.area_offset + sizeof(Area) + page;
+    flags_remaining = area.size / 4096 - page;
+    current_addr = entry.addr + page * 4096;
+    next_pfd_offset = point.pfd_offset;
+    block_offset = point.block_offset;
+    block_length = point.block_length;
+    block_page = point.block_page;
+    lengths_pos = point.lengths_pos;
+    return true;
+}
+
 /* Like getPageFlag(), but assumes you're going through the addresses
  * sequentially.  This means it can skip some checks and be a little faster. */
 char SaveState::getNextPageFlag()
 {
     char flag = nextFlag();
-    if (flag == Area::FULL_PAGE) {
-        next_pfd_offset += 4096;
-    }
-    else if (flag == Area::COMPRESSED_PAGE) {
-        lseek(pfd, next_pfd_offset, SEEK_SET);
-        Utils::readAll(pfd, &compressed_length, sizeof(int));
-        next_pfd_offset += sizeof(int) + compressed_length;
-    }
+    advanceOffset(flag);
     current_addr += 4096;
     return flag;
 }
 
+void SaveState::advanceOffset(char flag)
+{
+    switch (flag) {
+        case Area::FULL_PAGE:
+            next_pfd_offset += 4096;
+            break;
+        case Area::COMPRESSED_PAGE:
+            if (pagemap) {
+                compressed_length = StateIndex::readLength(index_lengths, lengths_pos);
+            }
+            else {
+                lseek(pfd, next_pfd_offset, SEEK_SET);
+                Utils::readAll(pfd, &compressed_length, sizeof(int));
+            }
+            next_pfd_offset += sizeof(int) + compressed_length;
+            break;
+        case Area::COMPRESSED_BLOCK_START:
+            /* The block header is only read once for all its pages */
+            if (pagemap) {
+                block_length = StateIndex::readLength(index_lengths, lengths_pos);
+            }
+            else {
+                lseek(pfd, next_pfd_offset, SEEK_SET);
+                Utils::readAll(pfd, &block_length, sizeof(int));
+            }
+            block_offset = next_pfd_offset;
+            block_page = 0;
+            next_pfd_offset += sizeof(int) + block_length;
+            break;
+        case Area::COMPRESSED_BLOCK:
+            block_page++;
+            break;
+        case Area::STORED_PAGE:
+            stored_offset = next_pfd_offset;
+            next_pfd_offset += sizeof(uint32_t);
+            break;
+        default:
+            break;
+    }
+}
+
 void SaveState::finishLoad()
 {
     if (queued_size > 0) {
@@ -209,11 +388,91 @@ void SaveState::queuePageLoad(char* addr)
         queued_addr = addr;
         queued_size = 4096;
     }
-    else if (current_flag == Area::COMPRESSED_PAGE) {
+    else if (current_flag == Area::STORED_PAGE) {
+        restorePage(addr, PageStore::getPage(getStoredIndex()));
+    }
+    else {
+        char page[4096];
+        restorePage(addr, decompressPage(page));
+    }
+}
+
+void SaveState::restorePage(char* addr, const char* page)
+{
+    /* Don't write to a page that already contains the stored values, so
+     * that it does not become dirty or gets copied */
+    if (Utils::isEqualPage(addr, page)) {
+        unchanged_pages++;
+        return;
+    }
+    memcpy(addr, page, 4096);
+}
+
+void SaveState::readPage(char* dst)
+{
+    if (current_flag == Area::FULL_PAGE) {
+        lseek(pfd, next_pfd_offset - 4096, SEEK_SET);
+        Utils::readAll(pfd, dst, 4096);
+    }
+    else if (current_flag == Area::STORED_PAGE) {
+        memcpy(dst, PageStore::getPage(getStoredIndex()), 4096);
+    }
+    else {
+        const char* page = decompressPage(dst);
+        if (page != dst)
+            memcpy(dst, page, 4096);
+    }
+}
+
+uint32_t SaveState::getStoredIndex()
+{
+    /* Indexes are read in chunks, because they are mostly consecutive in
+     * the pages file */
+    off_t i = (stored_offset - stored_indexes_offset) / static_cast<off_t>(sizeof(uint32_t));
+    if ((stored_indexes_count == 0) || (stored_offset < stored_indexes_offset) || (i >= stored_indexes_count)) {
+        lseek(pfd, stored_offset, SEEK_SET);
+        ssize_t size = Utils::readAll(pfd, stored_indexes, sizeof(stored_indexes));
+        MYASSERT(size >= static_cast<ssize_t>(sizeof(uint32_t)))
+        stored_indexes_offset = stored_offset;
+        stored_indexes_count = size / sizeof(uint32_t);
+        i = 0;
+    }
+    return stored_indexes[i];
+}
+
+const char* SaveState::decompressPage(char* dst)
+{
+    void* workspace = Codec::getWorkspace(Codec::workspaceCount() - THREAD_COUNT + thread);
+    TimeHolder start;
+
+    if (current_flag == Area::COMPRESSED_PAGE) {
         char compressed[LZ4_COMPRESSBOUND(4096)];
+        lseek(pfd, next_pfd_offset - compressed_length, SEEK_SET);
         Utils::readAll(pfd, compressed, compressed_length);
-        LZ4_decompress_safe(compressed, addr, compressed_length, 4096);
+        if (timed)
+            NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+        Codec::decompress(codec, workspace, compressed, dst, compressed_length, 4096);
+        if (timed)
+            codec_time += CheckpointStats::elapsed(start);
+        return dst;
+    }
+    else if ((current_flag == Area::COMPRESSED_BLOCK_START) || (current_flag == Area::COMPRESSED_BLOCK)) {
+        /* Decompress the whole block once, and copy each page from it */
+        BlockBuffer* buffer = getBlockBuffer(reader);
+        if ((buffer->owner != this) || (buffer->offset != block_offset)) {
+            lseek(pfd, block_offset + sizeof(int), SEEK_SET);
+            Utils::readAll(pfd, buffer->compressed, block_length);
+            if (timed)
+                NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &start));
+            Codec::decompress(codec, workspace, buffer->compressed, buffer->block, block_length, sizeof(buffer->block));
+            if (timed)
+                codec_time += CheckpointStats::elapsed(start);
+            buffer->owner = this;
+            buffer->offset = block_offset;
+        }
+        return buffer->block + block_page * 4096;
     }
+    return dst;
 }
 
 }
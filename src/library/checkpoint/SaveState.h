@@ -24,14 +24,41 @@
 
 #include "MemArea.h"
 #include "StateHeader.h"
+#include "StateIndex.h"
 
 namespace libtas {
 class SaveState
 {
     public:
+        /* Threads reading savestates. Each one has its own codec workspace,
+         * after the ones of the checkpoint workers. */
+        enum Thread {
+            LAZY_THREAD,
+            CHECKPOINT_THREAD,
+            THREAD_COUNT
+        };
+
+        /* Savestates that may be read at the same time. Each one has its own
+         * buffer to decompress blocks, so that reading one savestate does not
+         * evict the block of another. */
+        enum Reader {
+            STATE_READER,
+            PARENT_READER,
+            BASE_READER,
+            LAZY_PREFETCH_READER,
+            LAZY_FAULT_READER,
+            LAZY_BASE_READER,
+            READER_COUNT
+        };
+
         SaveState(const char* pagemappath, const char* pagespath, int pagemapfd, int pagesfd);
         ~SaveState();
 
+	/* Load the pagemap file and its index into a slot of our reserved memory,
+	 * so that page flags are found without any syscall. Also resets back to
+	 * first area. Returns false if the savestate has no index. */
+	bool loadIndex(int slot);
+
 	// Also resets back to first area
 	void readHeader(StateHeader& sh);
 
@@ -46,6 +73,28 @@ class SaveState
 	void queuePageLoad(char* addr);
 	void finishLoad();
 
+	/* Read the current page into a buffer instead of its memory location */
+	void readPage(char* dst);
+
+	/* Codec used to compress the pages of this savestate */
+	int getCodec() { return codec; }
+
+	/* Index in the page store of the current page */
+	uint32_t getStoredIndex();
+
+	/* Number of loaded pages that already contained the stored values */
+	size_t getUnchangedPages() { return unchanged_pages; }
+
+	/* Time spent decompressing pages, if statistics are collected */
+	double getCodecTime() { return codec_time; }
+
+	/* Select the buffer used to decompress blocks, and the codec workspace
+	 * of the thread reading the savestate */
+	void setReader(Reader r) {
+	    reader = r;
+	    thread = (r >= LAZY_PREFETCH_READER) ? LAZY_THREAD : CHECKPOINT_THREAD;
+	}
+
     explicit operator bool() const {
         return (pmfd != -1);
     }
@@ -53,12 +102,31 @@ class SaveState
     private:
 	char nextFlag();
 
+	/* Read from the pagemap file, or from its loaded content */
+	void readPagemap(void* dst, size_t size);
+	void seekPagemap(off_t offset);
+
+	/* Move to the closest indexed page before an address. Returns false if
+	 * the address is not inside a saved area. */
+	bool seekIndex(char* addr);
+
+	/* Update the offset in the pages file after reading a flag */
+	void advanceOffset(char flag);
+
+	/* Decompress the current page. Returns the decompressed page, which is
+	 * either `dst` or inside the decompressed block. */
+	const char* decompressPage(char* dst);
+
+	/* Copy a page into memory, unless it already contains the same values */
+	void restorePage(char* addr, const char* page);
+
 	char flags[4096];
     char current_flag;
 	int flag_i;
 	int flags_remaining;
 
     int pmfd, pfd;
+    int codec;
 
     Area area;
     char* current_addr;
@@ -68,6 +136,46 @@ class SaveState
     char* queued_addr;
 	off_t queued_offset;
 	int queued_size;
+
+    /* Current compressed block */
+    off_t block_offset;
+    int block_length;
+    int block_page;
+
+    /* Offset of the index of the current stored page */
+    off_t stored_offset;
+
+    /* Chunk of stored page indexes read from the pages file */
+    uint32_t stored_indexes[1024];
+    off_t stored_indexes_offset;
+    int stored_indexes_count;
+
+    /* Content of the pagemap file loaded with its index, or nullptr */
+    const char* pagemap;
+    size_t pagemap_size;
+    off_t pagemap_pos;
+
+    /* Tables of the index */
+    const StateIndex::AreaEntry* index_areas;
+    int index_area_count;
+    const StateIndex::Point* index_points;
+    const uint8_t* index_lengths;
+
+    /* Index of the current area in the area table, and position of the
+     * length of the next compressed page */
+    int index_area;
+    uint32_t lengths_pos;
+
+    /* Number of loaded pages that already contained the stored values */
+    size_t unchanged_pages;
+
+    /* Time spent decompressing pages, and if it is measured */
+    double codec_time;
+    bool timed;
+
+    /* Role and thread of the reader of the savestate */
+    Reader reader;
+    Thread thread;
 };
 }
 
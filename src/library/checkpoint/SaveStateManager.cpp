@@ -24,7 +24,6 @@
 #include <algorithm> // std::find
 #include <sys/mman.h>
 #include <sys/syscall.h> // syscall, SYS_gettid
-#include <sys/wait.h> // waitpid
 #ifdef __unix__
 #include <X11/Xlib.h> // XLockDisplay
 #endif
@@ -33,6 +32,13 @@
 #include "ThreadManager.h"
 #include "ThreadSync.h"
 #include "Checkpoint.h"
+#include "CheckpointWorkers.h"
+#include "CheckpointStats.h"
+#include "PageStore.h"
+#include "LazyLoad.h"
+#include "Codec.h"
+#include "StateIndex.h"
+#include "SaveState.h"
 #include "../timewrappers.h" // clock_gettime
 #include "../logging.h"
 #include "../global.h"
@@ -60,7 +66,6 @@ static volatile bool restoreInProgress = false;
 static int numThreads;
 static int sig_suspend_threads = SIGXFSZ;
 static int sig_checkpoint = SIGSYS;
-static bool* state_dirty;
 
 int SaveStateManager::sigCheckpoint()
 {
@@ -77,10 +82,11 @@ void SaveStateManager::init()
     sem_init(&semNotifyCkptThread, 0, 0);
     sem_init(&semWaitForCkptThreadSignal, 0, 0);
 
-    ReservedMemory::init();
-
-    state_dirty = static_cast<bool*>(ReservedMemory::getAddr(ReservedMemory::SS_SLOTS_ADDR));
-    memset(state_dirty, 0, 11*sizeof(bool));
+    /* Only reserve the codec workspaces and index slots that can be used */
+    size_t region_sizes[ReservedMemory::REGION_COUNT];
+    region_sizes[ReservedMemory::CODEC_REGION] = Codec::initWorkspaces(CheckpointWorkers::maxThreads() + SaveState::THREAD_COUNT);
+    region_sizes[ReservedMemory::INDEX_REGION] = StateIndex::initSlots(Global::shared_config.savestate_settings & SharedConfig::SS_LAZY);
+    ReservedMemory::init(region_sizes);
 }
 
 void SaveStateManager::initCheckpointThread()
@@ -135,54 +141,29 @@ void SaveStateManager::initThreadFromChild(ThreadInfo* thread)
 
 int SaveStateManager::waitChild()
 {
-    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_FORK))
-        return -1;
-
-    int status;
-    pid_t pid = waitpid(-1, &status, WNOHANG);
-    if (pid <= 0) {
-        return -1;
-    }
-    status = WEXITSTATUS(status);
-    if ((status < 0) && (status > 10)) {
-        debuglogstdio(LCF_THREAD | LCF_CHECKPOINT | LCF_ERROR, "Got unknown status code %d from pid %d", status, pid);
-        return -1;
-    }
-    if (!state_dirty[status]) {
-        debuglogstdio(LCF_THREAD | LCF_CHECKPOINT | LCF_ERROR, "State saving %d completed but was already ready", status);
-        return -1;
-    }
-
-    state_dirty[status] = false;
-    return status;
+    return Checkpoint::waitForkedSaves();
 }
 
 bool SaveStateManager::stateReady(int slot)
 {
-    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_FORK))
-        return true;
-
-    if ((slot < 0) && (slot > 10)) {
+    if ((slot < 0) || (slot > 10)) {
         debuglogstdio(LCF_THREAD | LCF_CHECKPOINT | LCF_ERROR, "Wrong slot number");
         return false;
     }
-    return !state_dirty[slot];
-}
 
-void SaveStateManager::stateStatus(int slot, bool dirty)
-{
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK)
-        state_dirty[slot] = dirty;
+    /* A state being saved by a forked process is only ready when the latest
+     * save of this slot is written */
+    return !Checkpoint::isForkedSavePending(slot);
 }
 
 int SaveStateManager::checkpoint(int slot)
 {
-    if (!stateReady(slot))
-        return ESTATE_NOTCOMPLETE;
-
     ThreadInfo *current_thread = ThreadManager::getCurrentThread();
     MYASSERT(current_thread->state == ThreadInfo::ST_CKPNTHREAD)
 
+    /* All pages of a lazily loaded state must be restored before saving */
+    LazyLoad::finish();
+
     ThreadSync::acquireLocks();
 
     restoreInProgress = false;
@@ -243,8 +224,25 @@ int SaveStateManager::checkpoint(int slot)
     }
 #endif
 
+    /* Spawn the threads that compress memory pages. This must be done
+     * before suspending threads, so that nothing is allocated during the
+     * checkpoint.
+     */
+    if (Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED)
+        CheckpointWorkers::init();
+
+    /* Create the store of pages shared between savestates in RAM. It must
+     * exist before the first savestate, so that it is part of every memory
+     * layout that we restore. */
+    if ((Global::shared_config.savestate_settings & SharedConfig::SS_RAM) &&
+        (Global::shared_config.savestate_settings & SharedConfig::SS_DEDUP))
+        PageStore::init();
+
+    CheckpointStats::begin(SavestateStats::SAVE, slot);
+
     /* Sending a suspend signal to all threads */
     suspendThreads();
+    CheckpointStats::suspended();
 
 #ifdef __linux__
     /* Disable the signal that refills the fake urandom pipe. Must be done
@@ -302,10 +300,6 @@ int SaveStateManager::checkpoint(int slot)
 
     ThreadSync::releaseLocks();
 
-    /* Mark the savestate as dirty in case of fork savestate */
-    if (!isLoading())
-        stateStatus(slot, true);
-
     return ESTATE_OK;
 }
 
@@ -316,6 +310,10 @@ int SaveStateManager::restore(int slot)
 
     ThreadInfo *current_thread = ThreadManager::getCurrentThread();
     MYASSERT(current_thread->state == ThreadInfo::ST_CKPNTHREAD)
+
+    /* The previous lazy load must be done before loading another state */
+    LazyLoad::finish();
+
     ThreadSync::acquireLocks();
 
     /* We must close the connection to the sound device. This must be done
@@ -353,7 +351,15 @@ int SaveStateManager::restore(int slot)
     }
 #endif
 
+    /* Spawn the thread that fills the pages of lazily loaded states. This
+     * must be done before suspending threads. */
+    if (Global::shared_config.savestate_settings & SharedConfig::SS_LAZY)
+        LazyLoad::init();
+
+    CheckpointStats::begin(SavestateStats::LOAD, slot);
+
     suspendThreads();
+    CheckpointStats::suspended();
 
     restoreInProgress = true;
 
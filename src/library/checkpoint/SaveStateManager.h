@@ -43,6 +43,8 @@ enum Error {
     ESTATE_NOTCOMPLETE = -5, // State still being saved
 };
 
+/* Reserve our memory, whose size depends on the savestate settings. Must be
+ * called after receiving the config. */
 void init();
 
 /* Initialize the signal handler for the checkpoint thread */
@@ -50,15 +52,13 @@ void initCheckpointThread();
 
 void initThreadFromChild(ThreadInfo* thread);
 
-/* Wait for a child to terminate and register the savestate slot */
+/* Check for terminated children that were saving states. Returns the slot
+ * of a savestate that was completed, or -1 */
 int waitChild();
 
 /* Returns if a state is completed (useful for fork savestates) */
 bool stateReady(int slot);
 
-/* Change the dirty state of savestate when doing forked savestate */
-void stateStatus(int slot, bool dirty);
-
 /* Save a savestate and returns if succeeded */
 int checkpoint(int slot);
 
@@ -32,6 +32,9 @@ struct StateHeader {
     pthread_t pthread_ids[STATEMAXTHREADS];
     pid_t tids[STATEMAXTHREADS];
     int states[STATEMAXTHREADS];
+
+    /* Codec used to compress the pages of this savestate */
+    int codec;
 };
 }
 
@@ -0,0 +1,281 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StateIndex.h"
+#include "MemArea.h"
+#include "ReservedMemory.h"
+#include "../Utils.h"
+#include "../logging.h"
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+
+namespace libtas {
+
+/* Layout of the slot used when building an index */
+#define MAX_INDEX_AREAS (StateIndex::SLOT_SIZE / 512)
+#define MAX_INDEX_POINTS (StateIndex::SLOT_SIZE / 128)
+#define INDEX_POINTS_OFFSET (MAX_INDEX_AREAS * sizeof(StateIndex::AreaEntry))
+#define INDEX_LENGTHS_OFFSET (INDEX_POINTS_OFFSET + MAX_INDEX_POINTS * sizeof(StateIndex::Point))
+#define MAX_INDEX_LENGTHS (StateIndex::SLOT_SIZE - INDEX_LENGTHS_OFFSET)
+
+/* The index is dropped if it does not fit */
+static bool failed;
+
+static int area_count;
+static uint32_t point_count;
+static uint32_t lengths_size;
+
+/* Simulated state of a reader after the last registered flag */
+static StateIndex::Point cursor;
+
+/* Index of the next page of the current area */
+static int page_i;
+
+/* Number of reserved slots, which is set once at startup */
+static int slot_count = 0;
+
+static char* getSlot(int slot)
+{
+    return static_cast<char*>(ReservedMemory::getRegion(ReservedMemory::INDEX_REGION)) + slot * static_cast<size_t>(StateIndex::SLOT_SIZE);
+}
+
+size_t StateIndex::initSlots(bool lazy)
+{
+    slot_count = lazy ? SLOT_COUNT : SLOT_LAZY_PREFETCH;
+    return slot_count * static_cast<size_t>(SLOT_SIZE);
+}
+
+static StateIndex::AreaEntry* getAreas()
+{
+    return reinterpret_cast<StateIndex::AreaEntry*>(getSlot(StateIndex::SLOT_WRITE));
+}
+
+static StateIndex::Point* getPoints()
+{
+    return reinterpret_cast<StateIndex::Point*>(getSlot(StateIndex::SLOT_WRITE) + INDEX_POINTS_OFFSET);
+}
+
+static uint8_t* getLengths()
+{
+    return reinterpret_cast<uint8_t*>(getSlot(StateIndex::SLOT_WRITE) + INDEX_LENGTHS_OFFSET);
+}
+
+void StateIndex::begin()
+{
+    failed = false;
+    area_count = 0;
+    point_count = 0;
+    lengths_size = 0;
+    cursor.lengths_pos = 0;
+}
+
+void StateIndex::addArea(const Area& area, off_t offset)
+{
+    if (failed)
+        return;
+
+    if (area_count == MAX_INDEX_AREAS) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many areas, the savestate index is not saved");
+        failed = true;
+        return;
+    }
+
+    AreaEntry& entry = getAreas()[area_count++];
+    entry.addr = static_cast<char*>(area.addr);
+    entry.endAddr = static_cast<char*>(area.endAddr);
+    entry.area_offset = offset;
+    entry.first_point = point_count;
+
+    cursor.pfd_offset = area.page_offset;
+    cursor.block_offset = -1;
+    cursor.block_length = 0;
+    cursor.block_page = 0;
+    page_i = 0;
+}
+
+void StateIndex::addPages(const char* data, const char* flags, int count)
+{
+    if (failed)
+        return;
+
+    uint8_t* lengths = getLengths();
+
+    for (int p = 0; p < count; p++) {
+        if (flags[p] == Area::FULL_PAGE) {
+            data += 4096;
+        }
+        else if ((flags[p] == Area::COMPRESSED_PAGE) || (flags[p] == Area::COMPRESSED_BLOCK_START)) {
+            int length;
+            memcpy(&length, data, sizeof(int));
+            data += sizeof(int) + length;
+
+            /* Encode the length as a varint */
+            if (lengths_size + 5 > MAX_INDEX_LENGTHS) {
+                debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many compressed pages, the savestate index is not saved");
+                failed = true;
+                return;
+            }
+            uint32_t value = length;
+            while (value >= 0x80) {
+                lengths[lengths_size++] = static_cast<uint8_t>(value) | 0x80;
+                value >>= 7;
+            }
+            lengths[lengths_size++] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+void StateIndex::addFlags(const char* flags, int count)
+{
+    if (failed)
+        return;
+
+    Point* points = getPoints();
+    const uint8_t* lengths = getLengths();
+
+    for (int f = 0; f < count; f++, page_i++) {
+        if ((page_i % STRIDE) == 0) {
+            if (point_count == MAX_INDEX_POINTS) {
+                debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many pages, the savestate index is not saved");
+                failed = true;
+                return;
+            }
+            points[point_count++] = cursor;
+        }
+
+        /* Same as SaveState::advanceOffset() */
+        switch (flags[f]) {
+            case Area::FULL_PAGE:
+                cursor.pfd_offset += 4096;
+                break;
+            case Area::COMPRESSED_PAGE:
+                MYASSERT(cursor.lengths_pos < lengths_size)
+                cursor.pfd_offset += sizeof(int) + readLength(lengths, cursor.lengths_pos);
+                break;
+            case Area::COMPRESSED_BLOCK_START:
+                MYASSERT(cursor.lengths_pos < lengths_size)
+                cursor.block_length = readLength(lengths, cursor.lengths_pos);
+                cursor.block_offset = cursor.pfd_offset;
+                cursor.block_page = 0;
+                cursor.pfd_offset += sizeof(int) + cursor.block_length;
+                break;
+            case Area::COMPRESSED_BLOCK:
+                cursor.block_page++;
+                break;
+            case Area::STORED_PAGE:
+                cursor.pfd_offset += sizeof(uint32_t);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+size_t StateIndex::write(int pmfd)
+{
+    if (failed)
+        return 0;
+
+    Trailer trailer;
+    trailer.lengths_offset = lseek(pmfd, 0, SEEK_CUR);
+    MYASSERT(trailer.lengths_offset != -1)
+
+    Utils::writeAll(pmfd, getLengths(), lengths_size);
+
+    /* Align the tables */
+    static const char padding[8] = {};
+    size_t padding_size = (8 - (trailer.lengths_offset + lengths_size) % 8) % 8;
+    Utils::writeAll(pmfd, padding, padding_size);
+
+    trailer.points_offset = trailer.lengths_offset + lengths_size + padding_size;
+    Utils::writeAll(pmfd, getPoints(), point_count * sizeof(Point));
+
+    trailer.areas_offset = trailer.points_offset + point_count * sizeof(Point);
+    Utils::writeAll(pmfd, getAreas(), area_count * sizeof(AreaEntry));
+
+    trailer.area_count = area_count;
+    trailer.magic = MAGIC;
+    Utils::writeAll(pmfd, &trailer, sizeof(trailer));
+
+    size_t size = trailer.areas_offset + area_count * sizeof(AreaEntry) + sizeof(trailer) - trailer.lengths_offset;
+    debuglogstdio(LCF_CHECKPOINT, "Savestate index of %d areas and %u points in %zu bytes", area_count, point_count, size);
+    return size;
+}
+
+/* Read from a file descriptor at an offset, without changing its file offset,
+ * because file descriptors may be shared between savestate readers */
+static bool preadAll(int fd, void* buf, size_t count, off_t offset)
+{
+    char* ptr = static_cast<char*>(buf);
+    while (count > 0) {
+        ssize_t rc = pread(fd, ptr, count, offset);
+        if (rc == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (rc == 0)
+            return false;
+        ptr += rc;
+        offset += rc;
+        count -= rc;
+    }
+    return true;
+}
+
+const char* StateIndex::load(int pmfd, int slot, size_t& size)
+{
+    /* Lazy loading was enabled after startup */
+    if (slot >= slot_count)
+        return nullptr;
+
+    struct stat st;
+    if ((fstat(pmfd, &st) != 0) || (st.st_size < static_cast<off_t>(sizeof(Trailer))))
+        return nullptr;
+
+    /* Savestates from previous versions don't have an index */
+    Trailer trailer;
+    off_t trailer_offset = st.st_size - sizeof(Trailer);
+    if (!preadAll(pmfd, &trailer, sizeof(trailer), trailer_offset) || (trailer.magic != MAGIC))
+        return nullptr;
+
+    if ((trailer.lengths_offset > trailer.points_offset) ||
+        (trailer.points_offset > trailer.areas_offset) ||
+        (trailer.area_count < 0) ||
+        (trailer.areas_offset + trailer.area_count * static_cast<off_t>(sizeof(AreaEntry)) != trailer_offset)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Savestate index is corrupted");
+        return nullptr;
+    }
+
+    if (st.st_size > SLOT_SIZE) {
+        debuglogstdio(LCF_CHECKPOINT, "Savestate pagemap is too large to be loaded with its index");
+        return nullptr;
+    }
+
+    char* pagemap = getSlot(slot);
+    if (!preadAll(pmfd, pagemap, st.st_size, 0))
+        return nullptr;
+
+    size = st.st_size;
+    return pagemap;
+}
+
+}
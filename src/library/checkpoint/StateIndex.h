@@ -0,0 +1,144 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_STATEINDEX_H
+#define LIBTAS_STATEINDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace libtas {
+
+struct Area;
+
+/* Index appended at the end of each savestate pagemap file, after the eof
+ * area, so that the flag and the location in the pages file of any page can
+ * be found without walking through the pagemap file or reading the pages
+ * file. It is made of:
+ * - the length of each compressed page or block, in page order, encoded as
+ *   varints. These are the offset deltas that otherwise must be read from
+ *   the pages file.
+ * - a table of points, which store the state of a reader every STRIDE pages
+ *   of each area.
+ * - a table of the saved areas, sorted by address.
+ * - a trailer locating the tables.
+ *
+ * When reading a savestate, the whole pagemap file is loaded once inside a
+ * slot of our reserved memory, so that nothing gets allocated during a
+ * restore and no syscall is needed to query a page flag.
+ */
+namespace StateIndex {
+
+enum {
+    MAGIC = 0x78646e49,
+
+    /* Number of pages between two points */
+    STRIDE = 64,
+
+    /* Size of each slot in reserved memory. The memory of 32-bit games is
+     * much smaller, and so are their pagemap files. */
+    SLOT_SIZE = (sizeof(void*) == 4) ? (2 * 1024 * 1024) : (8 * 1024 * 1024),
+};
+
+/* Slots of reserved memory in which pagemap files are loaded */
+enum Slot {
+    SLOT_WRITE, /* Index of the savestate being saved */
+    SLOT_STATE,
+    SLOT_PARENT,
+    SLOT_BASE,
+    SLOT_LAZY_PREFETCH, /* Slots of the lazy loading readers, in order */
+    SLOT_LAZY_FAULT,
+    SLOT_LAZY_BASE,
+    SLOT_COUNT
+};
+
+struct AreaEntry {
+    char* addr;
+    char* endAddr;
+
+    /* Offset of the Area struct in the pagemap file, followed by its flags */
+    off_t area_offset;
+
+    /* Index of the first point of the area */
+    uint32_t first_point;
+};
+
+/* State of a reader before reading a page */
+struct Point {
+    off_t pfd_offset;
+    off_t block_offset;
+    uint32_t lengths_pos;
+    int block_length;
+    int block_page;
+};
+
+struct Trailer {
+    off_t lengths_offset;
+    off_t points_offset;
+    off_t areas_offset;
+    int area_count;
+    int magic;
+};
+
+/* Count the slots to reserve, depending on whether savestates are loaded
+ * lazily. Must be called before reserving memory, and returns the size of
+ * the slots region. */
+size_t initSlots(bool lazy);
+
+/* Start building the index of the savestate being saved */
+void begin();
+
+/* Register a saved area, whose Area struct is located at `offset` in the
+ * pagemap file */
+void addArea(const Area& area, off_t offset);
+
+/* Register the data of compressed pages written in the pages file with their
+ * flags, in page order. Must be called before registering the flags. */
+void addPages(const char* data, const char* flags, int count);
+
+/* Register a chunk of page flags of the last registered area */
+void addFlags(const char* flags, int count);
+
+/* Append the index to the pagemap file. Returns the number of bytes written */
+size_t write(int pmfd);
+
+/* Load the whole pagemap file into a slot if it contains an index. Returns
+ * the loaded content and its size, or nullptr, also when the slot was not
+ * reserved. */
+const char* load(int pmfd, int slot, size_t& size);
+
+/* Decode a length from the lengths array and advance the position */
+inline int readLength(const uint8_t* lengths, uint32_t& pos)
+{
+    uint32_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = lengths[pos++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return static_cast<int>(value);
+}
+
+}
+}
+
+#endif
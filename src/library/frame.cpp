@@ -37,6 +37,8 @@
 #include "checkpoint/SaveStateManager.h"
 #include "checkpoint/Checkpoint.h"
 #include "checkpoint/ThreadSync.h"
+#include "checkpoint/PageKernels.h"
+#include "checkpoint/CheckpointStats.h"
 #include "ScreenCapture.h"
 #include "WindowTitle.h"
 #include "sdl/SDLEventQueue.h"
@@ -45,6 +47,7 @@
 #include "hook.h"
 #include "GameHacks.h"
 #include "PerfTimer.h"
+#include "MemoryMirror.h"
 
 #ifdef __unix__
 #include "xlib/xevents.h"
@@ -297,6 +300,9 @@ void frameBoundary(std::function<void()> draw, RenderHUD& hud)
     /* Other threads may send socket messages, so we lock the socket */
     lockSocket();
 
+    /* Send all messages of the start of the frame boundary in a single write */
+    bufferSocket();
+
     /* Send framecount and internal time */    
     sendFrameCountTime();
 
@@ -319,14 +325,24 @@ void frameBoundary(std::function<void()> draw, RenderHUD& hud)
         ThreadManager::resetThreadListChanged();
     }
 
+    /* Send the statistics of the last savestates */
+    CheckpointStats::send();
+
     /* Send message if non-draw frame */
     if (!draw) {
         sendMessage(MSGB_NONDRAW_FRAME);
     }
 
+    /* Copy the mirrored memory before the program reads it */
+    MemoryMirror::update();
+
     /* Last message to send */
     sendMessage(MSGB_START_FRAMEBOUNDARY);
 
+    /* Exit the game if the program is gone */
+    if (flushSocket() == -1)
+        exit(1);
+
     /* Reset ramwatches and lua drawings */
     RenderHUD::resetWatches();
     RenderHUD::resetLua();
@@ -352,6 +368,9 @@ void frameBoundary(std::function<void()> draw, RenderHUD& hud)
             sendData(&h, sizeof(int));
             break;
         }
+        case MSGN_MEMORY_MIRROR:
+            MemoryMirror::receive();
+            break;
         case MSGN_LUA_TEXT:
         {
             int x, y;
@@ -704,7 +723,7 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
                 break;
 
             case MSGN_ALL_INPUTS:
-                receiveData(&ai, sizeof(AllInputs));
+                ai_encoder.receive(ai);
                 /* Update framerate if necessary (do we actually need to?) */
                 if (Global::shared_config.variable_framerate) {
                     Global::shared_config.framerate_num = ai.framerate_num;
@@ -721,7 +740,7 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
                 break;
 
             case MSGN_PREVIEW_INPUTS:
-                receiveData(&preview_ai, sizeof(AllInputs));
+                preview_ai_encoder.receive(preview_ai);
                 screen_redraw(draw, hud, preview_ai);
                 break;
 
@@ -767,6 +786,14 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
                     MYASSERT(message == MSGN_CONFIG)
                     receiveData(&Global::shared_config, sizeof(SharedConfig));
 
+                    /* The program resets the previous inputs of the compact
+                     * encoding, which were restored with the memory */
+                    ai_encoder.reset();
+                    preview_ai_encoder.reset();
+
+                    /* Memory has changed, so the mirror must be copied again */
+                    MemoryMirror::update();
+
                     /* We must send again the frame count and time because it
                      * probably has changed.
                      */
@@ -799,11 +826,24 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
 
                 break;
 
+            case MSGN_SAVESTATE_BENCHMARK:
+            {
+                std::string report = Checkpoint::benchmarkCodecs();
+                report += '\n';
+                report += PageKernels::benchmark();
+                sendMessage(MSGB_SAVESTATE_BENCHMARK);
+                sendString(report);
+                break;
+            }
+
             case MSGN_LOADSTATE:
                 status = SaveStateManager::restore(slot);
 
                 SaveStateManager::printError(status);
 
+                /* Restoring may have failed after modifying memory */
+                MemoryMirror::update();
+
                 /* If restoring failed, we return here. We still send the
                  * frame count and time because the program will pull a
                  * message in either case.
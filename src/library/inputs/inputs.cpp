@@ -29,6 +29,9 @@ AllInputs old_game_ai;
 AllInputs game_unclipped_ai;
 AllInputs old_game_unclipped_ai;
 
+AllInputsEncoder ai_encoder;
+AllInputsEncoder preview_ai_encoder;
+
 bool pointer_clipping = false;
 int clipping_x, clipping_y, clipping_w, clipping_h;
 
@@ -23,6 +23,7 @@
 /* TODO: I don't know where to put these, so in a separate file for now */
 
 #include "../../shared/AllInputs.h"
+#include "../../shared/AllInputsEncoder.h"
 
 namespace libtas {
 
@@ -45,6 +46,10 @@ extern AllInputs old_game_ai;
 extern AllInputs game_unclipped_ai;
 extern AllInputs old_game_unclipped_ai;
 
+/* Decoders of the inputs and preview inputs sent by the program */
+extern AllInputsEncoder ai_encoder;
+extern AllInputsEncoder preview_ai_encoder;
+
 /* Is the pointer clipped inside a window? */
 extern bool pointer_clipping;
 
@@ -42,6 +42,7 @@
 #include "Stack.h"
 #include "monowrappers.h"
 #include "GlobalState.h"
+#include "MemoryMirror.h"
 
 extern char**environ;
 
@@ -83,7 +84,7 @@ void __attribute__((constructor)) init(void)
     }
 
     ThreadManager::init();
-    SaveStateManager::init();
+    MemoryMirror::init();
     Stack::grow();
 
     initSocketGame();
@@ -107,6 +108,16 @@ void __attribute__((constructor)) init(void)
     sendString(commit_hash);
 #endif
 
+    /* Send the file descriptor of the memory mirror */
+    sendMessage(MSGB_MEMORY_MIRROR);
+    int mirror_fd = MemoryMirror::fd();
+    sendData(&mirror_fd, sizeof(int));
+
+    /* Send the version of the compact encoding of inputs */
+    sendMessage(MSGB_COMPACT_INPUTS);
+    int compact_version = AllInputsEncoder::VERSION;
+    sendData(&compact_version, sizeof(int));
+
     /* End message */
     sendMessage(MSGB_END_INIT);
 
@@ -122,6 +133,7 @@ void __attribute__((constructor)) init(void)
         std::string steamremotestorage;
         int index;
         int config_size;
+        int version;
         switch (message) {
             case MSGN_CONFIG_SIZE:
                 debuglogstdio(LCF_SOCKET, "Receiving config size");
@@ -159,6 +171,11 @@ void __attribute__((constructor)) init(void)
                 steamremotestorage = receiveString();
                 SteamSetRemoteStorageFolder(steamremotestorage);
                 break;
+            case MSGN_COMPACT_INPUTS:
+                receiveData(&version, sizeof(int));
+                ai_encoder.enabled = (version == AllInputsEncoder::VERSION);
+                preview_ai_encoder.enabled = ai_encoder.enabled;
+                break;
             case MSGN_INITIAL_FRAMECOUNT_TIME:
                 /* Set the framecount and time to their initial values */
                 receiveData(&framecount, sizeof(uint64_t));
@@ -172,11 +189,15 @@ void __attribute__((constructor)) init(void)
         message = receiveMessage();
     }
 
+    SaveStateManager::init();
+
     if (Global::shared_config.sigint_upon_launch) {
         raise(SIGINT);
     }
 
     ai.emptyInputs();
+    ai_encoder.reset();
+    preview_ai_encoder.reset();
     old_ai.emptyInputs();
     game_ai.emptyInputs();
     old_game_ai.emptyInputs();
@@ -29,6 +29,9 @@
 static time_t last_time_saved = time(nullptr);
 static int nb_frame_advance = 0;
 
+/* Size of the movie journal above which the whole movie is saved */
+static const uint64_t journal_max_size = 16 * 1024 * 1024;
+
 void AutoSave::update(Context* context, MovieFile& movie)
 {
 	/* Check if autosave is enabled */
@@ -46,6 +49,16 @@ void AutoSave::update(Context* context, MovieFile& movie)
 		nb_frame_advance = 0;
 		time(&last_time_saved);
 
+		/* Only write the changes of the inputs into the journal, until it
+		 * becomes large */
+		if (movie.journal->active()) {
+			movie.journal->flush(movie.inputs->input_list);
+			if ((movie.journal->size() < journal_max_size) || movie.journal->rebasing()) {
+				movie.inputs->modifiedSinceLastAutoSave = false;
+				return;
+			}
+		}
+
 		/* Build the autosave filename */
 		std::string moviename = fileFromPath(context->config.moviefile);
 
@@ -66,8 +79,12 @@ void AutoSave::update(Context* context, MovieFile& movie)
 
 		std::cout << "Autosave movie to " << moviename << std::endl;
 
-		/* Save the movie */
-		movie.saveMovie(moviename);
+		/* Save the movie in the background */
+		movie.saveMovieInBackground(moviename);
+
+		/* Start a new journal from this autosave once it is written */
+		if (movie.journal->active())
+			movie.journal->rebase(moviename, movie.inputs->hash(), movie.inputs->input_list);
 
 		movie.inputs->modifiedSinceLastAutoSave = false;
 	}
@@ -102,6 +102,9 @@ void Config::save(const std::string& gamepath) {
     settings.setValue("editor_autoscroll", editor_autoscroll);
     settings.setValue("editor_rewind_seek", editor_rewind_seek);
     settings.setValue("editor_rewind_fastforward", editor_rewind_fastforward);
+    settings.setValue("ramsearch_memory_budget", ramsearch_memory_budget);
+    settings.setValue("memory_mirror", memory_mirror);
+    settings.setValue("movie_text_inputs", movie_text_inputs);
 
     settings.beginGroup("keymapping");
 
@@ -179,6 +182,9 @@ void Config::save(const std::string& gamepath) {
     settings.endArray();
 
     settings.setValue("savestate_settings", sc.savestate_settings);
+    settings.setValue("savestate_block_pages", sc.savestate_block_pages);
+    settings.setValue("savestate_codec", sc.savestate_codec);
+    settings.setValue("savestate_codec_level", sc.savestate_codec_level);
 
     settings.endGroup();
 }
@@ -260,6 +266,9 @@ void Config::load(const std::string& gamepath) {
     editor_autoscroll = settings.value("editor_autoscroll", editor_autoscroll).toBool();
     editor_rewind_seek = settings.value("editor_rewind_seek", editor_rewind_seek).toBool();
     editor_rewind_fastforward = settings.value("editor_rewind_fastforward", editor_rewind_fastforward).toBool();
+    ramsearch_memory_budget = settings.value("ramsearch_memory_budget", ramsearch_memory_budget).toInt();
+    memory_mirror = settings.value("memory_mirror", memory_mirror).toBool();
+    movie_text_inputs = settings.value("movie_text_inputs", movie_text_inputs).toBool();
 
     /* Load key mapping */
 
@@ -331,6 +340,9 @@ void Config::load(const std::string& gamepath) {
     sc.audio_codec = settings.value("audio_codec", sc.audio_codec).toInt();
     sc.audio_bitrate = settings.value("audio_bitrate", sc.audio_bitrate).toInt();
     sc.savestate_settings = settings.value("savestate_settings", sc.savestate_settings).toInt();
+    sc.savestate_block_pages = settings.value("savestate_block_pages", sc.savestate_block_pages).toInt();
+    sc.savestate_codec = settings.value("savestate_codec", sc.savestate_codec).toInt();
+    sc.savestate_codec_level = settings.value("savestate_codec_level", sc.savestate_codec_level).toInt();
     sc.opengl_soft = settings.value("opengl_soft", sc.opengl_soft).toBool();
     sc.opengl_performance = settings.value("opengl_performance", sc.opengl_performance).toBool();
 
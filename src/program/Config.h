@@ -86,6 +86,15 @@ public:
     /* Directory holding files storing ram search results */
     std::string ramsearchdir;
 
+    /* Memory used by ram search results before storing them in a file (in MB) */
+    int ramsearch_memory_budget = 1024;
+
+    /* Read ram watches and lua memory from a copy shared by the game */
+    bool memory_mirror = false;
+
+    /* Store the movie inputs as text in addition to the binary inputs */
+    bool movie_text_inputs = true;
+
     /* Flags when end of movie */
     enum MovieEnd {
         MOVIEEND_READ = 0,
@@ -31,6 +31,7 @@
 #include <stdint.h>
 #include "ConcurrentQueue.h"
 #include "KeyMapping.h"
+#include "../shared/AllInputsEncoder.h"
 
 struct Context {
     /* Execution status */
@@ -129,6 +130,10 @@ struct Context {
     
     /* Indicate if the current frame is a draw frame */
     bool draw_frame;
+
+    /* Encoders of the inputs and preview inputs sent to the game */
+    AllInputsEncoder inputs_encoder;
+    AllInputsEncoder preview_encoder;
 };
 
 #endif
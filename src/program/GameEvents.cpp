@@ -324,6 +324,15 @@ bool GameEvents::processEvent(GameEvents::EventType type, struct HotKey &hk)
             emit sharedConfigChanged();
             return false;
 
+        /* Compare savestate codecs on the last state */
+        case HOTKEY_BENCHMARK_SAVESTATE:
+        {
+            std::string report = SaveStateList::benchmark(context);
+            if (!report.empty())
+                emit alertToShow(QString(report.c_str()));
+            return false;
+        }
+
         } /* switch(hk.type) */
         break;
 
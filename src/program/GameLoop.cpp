@@ -39,10 +39,12 @@
 #include "lua/Callbacks.h"
 #include "lua/NamedLuaFunction.h"
 #include "ramsearch/MemAccess.h"
+#include "ramsearch/IRamWatchDetailed.h"
 
 #include "../shared/sockethelpers.h"
 #include "../shared/SharedConfig.h"
 #include "../shared/messages.h"
+#include "../shared/SavestateStats.h"
 
 #include <string>
 #include <iostream>
@@ -56,6 +58,63 @@
 // #include <X11/X.h>
 #include <stdint.h>
 #include <cstdlib>
+#include <vector>
+#include <QtCore/QJsonArray>
+
+/* Convert the page counts of savestate statistics */
+static QJsonObject pagesToJson(const uint64_t* pages)
+{
+    QJsonObject json;
+    json["no_page"] = static_cast<double>(pages[SavestateStats::NO_PAGE]);
+    json["zero"] = static_cast<double>(pages[SavestateStats::ZERO_PAGE]);
+    json["full"] = static_cast<double>(pages[SavestateStats::FULL_PAGE]);
+    json["base"] = static_cast<double>(pages[SavestateStats::BASE_PAGE]);
+    json["compressed"] = static_cast<double>(pages[SavestateStats::COMPRESSED_PAGE] +
+        pages[SavestateStats::COMPRESSED_BLOCK_START] + pages[SavestateStats::COMPRESSED_BLOCK]);
+    json["stored"] = static_cast<double>(pages[SavestateStats::STORED_PAGE]);
+    return json;
+}
+
+static QJsonObject statsToJson(const SavestateStats& stats, const std::vector<SavestateStats::Area>& areas)
+{
+    QJsonObject json;
+    json["operation"] = (stats.operation == SavestateStats::SAVE) ? "save" : "load";
+    json["slot"] = stats.slot;
+    json["total_time"] = stats.total_time;
+    json["suspend_time"] = stats.suspend_time;
+    json["maps_time"] = stats.maps_time;
+    json["zero_time"] = stats.zero_time;
+    json["codec_time"] = stats.codec_time;
+    json["dropped_areas"] = stats.dropped_areas;
+    json["pages"] = pagesToJson(stats.pages);
+
+    if (stats.operation == SavestateStats::SAVE) {
+        json["bytes"] = static_cast<double>(stats.bytes);
+
+        /* Ratio between the bytes written and the size of the saved pages */
+        uint64_t data_pages = stats.pages[SavestateStats::FULL_PAGE] + stats.pages[SavestateStats::COMPRESSED_PAGE] +
+            stats.pages[SavestateStats::COMPRESSED_BLOCK_START] + stats.pages[SavestateStats::COMPRESSED_BLOCK];
+        if (data_pages > 0)
+            json["compression_ratio"] = static_cast<double>(stats.bytes) / (data_pages * 4096.0);
+    }
+
+    QJsonArray json_areas;
+    for (const SavestateStats::Area& area : areas) {
+        QJsonObject json_area;
+        json_area["address"] = QString("0x%1").arg(area.addr, 0, 16);
+        json_area["size"] = static_cast<double>(area.size);
+        json_area["name"] = QString(area.name);
+        json_area["pages"] = pagesToJson(area.pages);
+        if (stats.operation == SavestateStats::SAVE)
+            json_area["bytes"] = static_cast<double>(area.bytes);
+        json_area["time"] = area.time;
+        json_area["zero_time"] = area.zero_time;
+        json_area["codec_time"] = area.codec_time;
+        json_areas.append(json_area);
+    }
+    json["areas"] = json_areas;
+    return json;
+}
 
 GameLoop::GameLoop(Context* c) : movie(MovieFile(c)), context(c)
 {
@@ -224,6 +283,26 @@ void GameLoop::init()
                 context->config.sc.recording = SharedConfig::NO_RECORDING;
             }
             else {
+                /* Offer to recover the changes of a previous execution
+                 * that did not exit properly */
+                bool recovered = false;
+                if (movie.hasJournal()) {
+                    std::promise<bool> recoverAnswer;
+                    std::future<bool> futureRecover = recoverAnswer.get_future();
+                    emit askToShow(QString("Unsaved changes of the movie from a previous execution were found. Do you want to recover them?"), &recoverAnswer);
+
+                    if (futureRecover.get()) {
+                        int count = movie.recoverJournal();
+                        if (count < 0)
+                            emit alertToShow(QString("Could not recover the unsaved changes of the movie"));
+                        else
+                            recovered = true;
+                    }
+                }
+
+                if (!recovered)
+                    movie.startJournal(true);
+
                 /* Update the UI accordingly */
                 emit configChanged();
             }
@@ -235,6 +314,8 @@ void GameLoop::init()
         }
         else {
             movie.clear();
+            if (context->config.sc.recording == SharedConfig::RECORDING_WRITE)
+                movie.startJournal(false);
         }
     }
 
@@ -279,6 +360,12 @@ void GameLoop::initProcessMessages()
         return;
     }
 
+    /* Inputs are sent in full, unless the game supports the compact encoding */
+    context->inputs_encoder.enabled = false;
+    context->inputs_encoder.reset();
+    context->preview_encoder.enabled = false;
+    context->preview_encoder.reset();
+
     /* Receive informations from the game */
     int message = receiveMessage();
     while (message != MSGB_END_INIT) {
@@ -290,6 +377,27 @@ void GameLoop::initProcessMessages()
                 MemAccess::init(context->game_pid);
                 break;
 
+            /* Get the file descriptor of the memory mirror */
+            case MSGB_MEMORY_MIRROR:
+                {
+                    int mirror_fd;
+                    receiveData(&mirror_fd, sizeof(int));
+                    MemAccess::initMirror(mirror_fd);
+                }
+                break;
+
+            /* Use the compact encoding of inputs if the same version is
+             * supported */
+            case MSGB_COMPACT_INPUTS:
+                {
+                    int version;
+                    receiveData(&version, sizeof(int));
+                    bool compact = (version == AllInputsEncoder::VERSION);
+                    context->inputs_encoder.enabled = compact;
+                    context->preview_encoder.enabled = compact;
+                }
+                break;
+
             case MSGB_GIT_COMMIT:
                 {
                     std::string lib_commit = receiveString();
@@ -375,6 +483,12 @@ void GameLoop::initProcessMessages()
     sendMessage(MSGN_ENCODING_SEGMENT);
     sendData(&encoding_segment, sizeof(int));
 
+    if (context->inputs_encoder.enabled) {
+        sendMessage(MSGN_COMPACT_INPUTS);
+        int version = AllInputsEncoder::VERSION;
+        sendData(&version, sizeof(int));
+    }
+
     /* End message */
     sendMessage(MSGN_END_INIT);
 }
@@ -472,6 +586,16 @@ bool GameLoop::startFrameMessages()
         case MSGB_NONDRAW_FRAME:
             context->draw_frame = false;
             break;
+        case MSGB_SAVESTATE_STATS:
+        {
+            SavestateStats stats;
+            receiveData(&stats, sizeof(SavestateStats));
+            std::vector<SavestateStats::Area> areas(stats.area_count);
+            if (stats.area_count > 0)
+                receiveData(areas.data(), stats.area_count * sizeof(SavestateStats::Area));
+            emit savestateStats(statsToJson(stats, areas));
+            break;
+        }
 
         case MSGB_SYMBOL_ADDRESS: {
             std::string sym = receiveString();
@@ -515,6 +639,10 @@ bool GameLoop::startFrameMessages()
      * is a draw frame or not */
     movie.editor->setDraw(context->draw_frame);
 
+    /* Ram watches and lua can now read the mirrored memory */
+    updateMemoryMirror();
+    IRamWatchDetailed::invalidate_all();
+
     /* Send ram watches */
     if (context->config.sc.osd & SharedConfig::OSD_RAMWATCHES) {
         std::string ramwatch;
@@ -534,6 +662,46 @@ bool GameLoop::startFrameMessages()
     return false;
 }
 
+void GameLoop::updateMemoryMirror()
+{
+    /* Stop the mirror in the game if it was disabled */
+    if (!context->config.memory_mirror) {
+        if (MemAccess::hasMirror()) {
+            sendMessage(MSGN_MEMORY_MIRROR);
+            int count = 0;
+            sendData(&count, sizeof(int));
+            if (receiveMessage() != MSGB_MEMORY_MIRROR) {
+                std::cerr << "Got wrong message after memory mirror" << std::endl;
+            }
+            receiveData(&count, sizeof(int));
+            MemAccess::enableMirror(false);
+        }
+        return;
+    }
+
+    if (!MemAccess::enableMirror(true))
+        return;
+
+    /* Send the list of pages if it changed, the game copies them before
+     * replying */
+    std::vector<uint64_t> pages;
+    if (MemAccess::mirrorPages(pages)) {
+        sendMessage(MSGN_MEMORY_MIRROR);
+        int count = pages.size();
+        sendData(&count, sizeof(int));
+        if (count > 0)
+            sendData(pages.data(), count * sizeof(uint64_t));
+
+        if (receiveMessage() != MSGB_MEMORY_MIRROR) {
+            std::cerr << "Got wrong message after memory mirror" << std::endl;
+            return;
+        }
+        receiveData(&count, sizeof(int));
+    }
+
+    MemAccess::validateMirror(pages);
+}
+
 void GameLoop::sleepSendPreview()
 {
     /* Sleep a bit to not surcharge the processor */
@@ -562,8 +730,9 @@ void GameLoop::sleepSendPreview()
 
     /* Send inputs if changed */
     if (!(preview_ai == last_preview_ai)) {
-        sendMessage(MSGN_PREVIEW_INPUTS);
-        sendData(&preview_ai, sizeof(AllInputs));
+        bufferSocket();
+        context->preview_encoder.send(MSGN_PREVIEW_INPUTS, preview_ai);
+        flushSocket();
         last_preview_ai = preview_ai;
     }
 }
@@ -750,6 +919,9 @@ void GameLoop::endFrameMessages(AllInputs &ai)
         context->config.sc_modified = true;
     }
 
+    /* Send all messages of the end of the frame boundary in a single write */
+    bufferSocket();
+
     /* Send shared config if modified */
     if (context->config.sc_modified) {
         /* Send config */
@@ -767,20 +939,24 @@ void GameLoop::endFrameMessages(AllInputs &ai)
     }
 
     /* Send inputs and end of frame */
-    sendMessage(MSGN_ALL_INPUTS);
-    sendData(&ai, sizeof(AllInputs));
+    context->inputs_encoder.send(MSGN_ALL_INPUTS, ai);
 
     if ((context->status == Context::QUITTING) || (context->status == Context::RESTARTING)) {
         sendMessage(MSGN_USERQUIT);
     }
 
+    /* The game will modify its memory */
+    MemAccess::invalidateMirror();
+
     sendMessage(MSGN_END_FRAMEBOUNDARY);
+    flushSocket();
 }
 
 void GameLoop::loopExit()
 {
     /* Unvalidate the game pid */
     context->game_pid = 0;
+    MemAccess::enableMirror(false);
 
     /* We need to restart the game if we got a restart input, or if:
      * - auto-restart is set
@@ -21,6 +21,7 @@
 #define LIBTAS_GAMELOOP_H_INCLUDED
 
 #include <QtCore/QObject>
+#include <QtCore/QJsonObject>
 
 #include "movie/MovieFile.h"
 #include "../shared/GameInfo.h"
@@ -63,6 +64,8 @@ private:
 
     bool startFrameMessages();
 
+    void updateMemoryMirror();
+
     void sleepSendPreview();
 
     void processInputs(AllInputs &ai);
@@ -96,6 +99,9 @@ signals:
     void getRamWatch(std::string &watch);
 
     void getTimeTrace(int type, unsigned long long hash, std::string stacktrace);
+
+    /* Statistics of a savestate save or load */
+    void savestateStats(QJsonObject stats);
     
     /* Savestates have been invalidated by thread change */
     void invalidateSavestates();
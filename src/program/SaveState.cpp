@@ -23,6 +23,8 @@
 #include "Context.h"
 #include "SaveState.h"
 #include "utils.h"
+#include "ramsearch/MemAccess.h"
+#include "ramsearch/MemScanner.h"
 #include "../shared/sockethelpers.h"
 #include "../shared/SharedConfig.h"
 #include "../shared/messages.h"
@@ -114,6 +116,9 @@ const std::string& SaveState::getMoviePath() const
 
 int SaveState::save(Context* context, const MovieFile& m)
 {    
+    /* Savestates may clear the soft-dirty bits of the game */
+    MemScanner::invalidate_dirty_tracking();
+
     if (context->config.sc.recording != SharedConfig::NO_RECORDING) {
         /* Save the movie file */
         m.copyTo(*movie);
@@ -157,6 +162,9 @@ int SaveState::save(Context* context, const MovieFile& m)
 
 int SaveState::load(Context* context, const MovieFile& m, bool branch)
 {
+    /* Savestates may clear the soft-dirty bits of the game */
+    MemScanner::invalidate_dirty_tracking();
+
     /* Check that the savestate exists (check for both savestate files and 
      * framecount, because there can be leftover savestate files from
      * forked savestate of previous execution). */
@@ -166,6 +174,9 @@ int SaveState::load(Context* context, const MovieFile& m, bool branch)
          * the movie and fast-forward to the savestate movie frame.
          */
 
+        /* The savestate movie may still be written in the background */
+        MovieArchive::wait();
+
         if ((context->config.sc.recording != SharedConfig::NO_RECORDING) &&
             (access(movie_path.c_str(), F_OK) == 0)) {
 
@@ -232,11 +243,44 @@ int SaveState::load(Context* context, const MovieFile& m, bool branch)
         sendString(loading_msg);
     }
 
+    /* Memory will change, the game copies the mirror again after loading */
+    MemAccess::invalidateMirror();
     sendMessage(MSGN_LOADSTATE);
      
     return 0;
 }
 
+std::string SaveState::benchmark(Context* context)
+{
+    if ((access(pagemap_path.c_str(), F_OK) != 0) || (access(pages_path.c_str(), F_OK) != 0) ||
+        (framecount == 0) || invalid) {
+        return no_state_msg;
+    }
+
+    /* Benchmarked loads may clear the soft-dirty bits of the game */
+    MemScanner::invalidate_dirty_tracking();
+
+    /* Send the savestate index */
+    sendMessage(MSGN_SAVESTATE_INDEX);
+    sendData(&id, sizeof(int));
+
+    /* Send savestate path */
+    if (! (context->config.sc.savestate_settings & SharedConfig::SS_RAM)) {
+        sendMessage(MSGN_SAVESTATE_PATH);
+        sendString(path);
+    }
+
+    sendMessage(MSGN_SAVESTATE_BENCHMARK);
+
+    int message = receiveMessage();
+    if (message != MSGB_SAVESTATE_BENCHMARK) {
+        std::cerr << "Got wrong message after savestate benchmark" << std::endl;
+        return std::string();
+    }
+
+    return receiveString();
+}
+
 int SaveState::postLoad(Context* context, MovieFile& m, bool branch)
 {
     int message = receiveMessage();
@@ -253,6 +297,10 @@ int SaveState::postLoad(Context* context, MovieFile& m, bool branch)
         sendMessage(MSGN_CONFIG);
         sendData(&context->config.sc, sizeof(SharedConfig));
 
+        /* The game reset the previous inputs of the compact encoding */
+        context->inputs_encoder.reset();
+        context->preview_encoder.reset();
+
         if ((context->config.sc.recording == SharedConfig::RECORDING_WRITE) || branch) {
             /* When in writing move or loading a branch,
              * we load the movie associated with the savestate.
@@ -284,6 +332,8 @@ int SaveState::postLoad(Context* context, MovieFile& m, bool branch)
     context->new_realtime_sec = context->current_realtime_sec;
     context->new_realtime_nsec = context->current_realtime_nsec;    
 
+    MemAccess::validateMirror();
+
     if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
         context->config.sc.movie_framecount = context->framecount;
         m.header->length_sec = context->current_time_sec;
@@ -306,5 +356,5 @@ int SaveState::postLoad(Context* context, MovieFile& m, bool branch)
 void SaveState::backupMovie()
 {
     if (framecount) // 0 means no state has been made
-        movie->saveMovie(movie_path);
+        movie->saveMovieInBackground(movie_path);
 }
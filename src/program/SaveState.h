@@ -78,6 +78,10 @@ public:
     /* Load state. Return 0 or error (<0) */
     int load(Context* context, const MovieFile& movie, bool branch);
 
+    /* Ask the game to compare savestate codecs on this state. Return the
+     * benchmark report */
+    std::string benchmark(Context* context);
+
     /* Process after state loading. Return message or error */
     int postLoad(Context* context, MovieFile& movie, bool branch);
 
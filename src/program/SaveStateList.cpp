@@ -103,6 +103,15 @@ int SaveStateList::postLoad(int id, Context* context, MovieFile& movie, bool bra
     return message;
 }
 
+std::string SaveStateList::benchmark(Context* context)
+{
+    if (last_state_id == -1)
+        return std::string("Save a state first to run the codec benchmark");
+
+    SaveState& ss = get(last_state_id);
+    return ss.benchmark(context);
+}
+
 void SaveStateList::invalidate()
 {
     for (int i = 0; i < NB_STATES; i++) {
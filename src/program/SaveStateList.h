@@ -45,6 +45,10 @@ namespace SaveStateList {
     /* Process after loading state from its id and handle parent */
     int postLoad(int id, Context* context, MovieFile& movie, bool branch);
 
+    /* Compare savestate codecs on the last saved or loaded state, and return
+     * the benchmark report */
+    std::string benchmark(Context* context);
+
     /* Invalidate all savestates. Used when threads have changed */
     void invalidate();
 
@@ -22,6 +22,7 @@
 #include "../Context.h"
 #include "NamedLuaFunction.h"
 #include "LuaFunctionList.h"
+#include "Memory.h"
 
 #include <iostream>
 extern "C" {
@@ -80,7 +81,17 @@ int Callbacks::onPaint(lua_State *L)
 
 void Callbacks::call(NamedLuaFunction::CallbackType type)
 {
+    /* The game is stopped at a frame boundary during callbacks, except for
+     * the startup callback which runs during the game initialization, so
+     * memory cannot be cached there */
+    if (type == NamedLuaFunction::CallbackStartup) {
+        lfl.call(type);
+        return;
+    }
+
+    Memory::beginCache();
     lfl.call(type);
+    Memory::endCache();
 }
 
 }
@@ -21,6 +21,7 @@
 #include "../ramsearch/MemAccess.h"
 
 #include <iostream>
+#include <cstring>
 extern "C" {
 #include <lua.h>
 #include <lauxlib.h>
@@ -54,9 +55,59 @@ void Lua::Memory::registerFunctions(lua_State *L)
     lua_setglobal(L, "memory");
 }
 
+/* Pages read during a callback */
+#define CACHE_PAGES 64
+
+struct CachedPage {
+    uintptr_t addr;
+    uint8_t data[4096];
+};
+
+static CachedPage cached_pages[CACHE_PAGES];
+static int cached_count = 0;
+static int cached_next = 0; // next page to replace
+static bool caching = false;
+
+void Lua::Memory::beginCache()
+{
+    caching = true;
+    cached_count = 0;
+    cached_next = 0;
+}
+
+void Lua::Memory::endCache()
+{
+    caching = false;
+    cached_count = 0;
+}
+
 bool Lua::Memory::read(uintptr_t addr, void* return_value, int size)
 {
-    return MemAccess::read(return_value, reinterpret_cast<void*>(addr), size) == size;
+    uintptr_t page_addr = addr & ~static_cast<uintptr_t>(4095);
+
+    /* Only cache reads that are inside a single page. The memory mirror
+     * already serves watched pages without syscalls. */
+    if (!caching || MemAccess::hasMirror() || ((addr - page_addr + size) > 4096))
+        return MemAccess::read(return_value, reinterpret_cast<void*>(addr), size, true) == size;
+
+    for (int p = 0; p < cached_count; p++) {
+        if (cached_pages[p].addr == page_addr) {
+            memcpy(return_value, cached_pages[p].data + (addr - page_addr), size);
+            return true;
+        }
+    }
+
+    CachedPage& page = cached_pages[cached_next];
+    if (MemAccess::read(page.data, reinterpret_cast<void*>(page_addr), 4096, true) != 4096)
+        return MemAccess::read(return_value, reinterpret_cast<void*>(addr), size, true) == size;
+
+    page.addr = page_addr;
+    cached_next = (cached_next + 1) % CACHE_PAGES;
+    if (cached_count < CACHE_PAGES)
+        cached_count++;
+
+    memcpy(return_value, page.data + (addr - page_addr), size);
+    return true;
 }
 
 /* Define a macro to declare all read functions */
@@ -101,6 +152,12 @@ READFUNCNUMBER(d, double)
 void Lua::Memory::write(uintptr_t addr, void* value, int size)
 {
     MemAccess::write(value, reinterpret_cast<void*>(addr), size);
+
+    /* Drop the cached pages that were written */
+    for (int p = 0; p < cached_count; p++) {
+        if ((cached_pages[p].addr < (addr + size)) && ((cached_pages[p].addr + 4096) > addr))
+            cached_pages[p].addr = 0;
+    }
 }
 
 /* Define a macro to declare all write functions */
@@ -32,6 +32,12 @@ namespace Memory {
     /* Register all functions */
     void registerFunctions(lua_State *L);
 
+    /* Cache the pages of game memory that are read until endCache() is
+     * called, so that reads of the same page only cost one syscall. Must
+     * only be used while the game is not running. */
+    void beginCache();
+    void endCache();
+
     /* Helper function for reading an integer */
     bool read(uintptr_t addr, void* return_value, int size);
 
@@ -0,0 +1,218 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InputList.h"
+
+#include <algorithm>
+
+void InputList::clear()
+{
+    chunks.clear();
+    starts.clear();
+    total_size = 0;
+}
+
+size_t InputList::chunkIndex(uint64_t pos) const
+{
+    /* Chunks are full when inputs are only appended, so try that first */
+    size_t c = pos / CHUNK_FRAMES;
+    if ((c < chunks.size()) && (starts[c] <= pos) && (pos < starts[c] + chunks[c]->size()))
+        return c;
+
+    return std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+}
+
+InputList::Chunk& InputList::unshare(size_t c)
+{
+    if (chunks[c].use_count() > 1)
+        chunks[c] = std::make_shared<Chunk>(*chunks[c]);
+    return *chunks[c];
+}
+
+void InputList::updateStarts(size_t c)
+{
+    starts.resize(chunks.size());
+    for (; c < chunks.size(); c++)
+        starts[c] = (c == 0) ? 0 : (starts[c-1] + chunks[c-1]->size());
+}
+
+const AllInputs& InputList::operator[](uint64_t pos) const
+{
+    size_t c = chunkIndex(pos);
+    return (*chunks[c])[pos - starts[c]];
+}
+
+AllInputs& InputList::edit(uint64_t pos)
+{
+    size_t c = chunkIndex(pos);
+    return unshare(c)[pos - starts[c]];
+}
+
+void InputList::push_back(const AllInputs& inputs)
+{
+    if (chunks.empty() || (chunks.back()->size() >= CHUNK_FRAMES)) {
+        chunks.push_back(std::make_shared<Chunk>());
+        chunks.back()->reserve(CHUNK_FRAMES);
+        starts.push_back(total_size);
+    }
+
+    unshare(chunks.size() - 1).push_back(inputs);
+    total_size++;
+}
+
+void InputList::truncate(uint64_t pos)
+{
+    if (pos >= total_size)
+        return;
+
+    size_t c = chunkIndex(pos);
+    uint64_t offset = pos - starts[c];
+
+    if (offset == 0) {
+        chunks.resize(c);
+        starts.resize(c);
+    }
+    else {
+        chunks.resize(c + 1);
+        starts.resize(c + 1);
+        Chunk& chunk = *chunks[c];
+        if (chunks[c].use_count() > 1) {
+            /* Only copy the frames that are kept */
+            chunks[c] = std::make_shared<Chunk>(chunk.begin(), chunk.begin() + offset);
+            chunks[c]->reserve(CHUNK_FRAMES);
+        }
+        else {
+            chunk.resize(offset);
+        }
+    }
+    total_size = pos;
+}
+
+void InputList::insert(uint64_t pos, const AllInputs& inputs)
+{
+    if (pos == total_size) {
+        push_back(inputs);
+        return;
+    }
+
+    size_t c = chunkIndex(pos);
+    Chunk& chunk = unshare(c);
+    chunk.insert(chunk.begin() + (pos - starts[c]), inputs);
+
+    /* Split the chunk in two if too large */
+    if (chunk.size() > CHUNK_FRAMES) {
+        size_t half = chunk.size() / 2;
+        auto second = std::make_shared<Chunk>(chunk.begin() + half, chunk.end());
+        chunk.resize(half);
+        chunks.insert(chunks.begin() + c + 1, second);
+    }
+
+    total_size++;
+    updateStarts(c + 1);
+}
+
+void InputList::erase(uint64_t pos)
+{
+    if (pos >= total_size)
+        return;
+
+    size_t c = chunkIndex(pos);
+    Chunk& chunk = unshare(c);
+    chunk.erase(chunk.begin() + (pos - starts[c]));
+
+    if (chunk.empty()) {
+        chunks.erase(chunks.begin() + c);
+    }
+    /* Merge with the next chunk if both fit in one */
+    else if (((c + 1) < chunks.size()) && ((chunk.size() + chunks[c+1]->size()) <= CHUNK_FRAMES)) {
+        chunk.insert(chunk.end(), chunks[c+1]->begin(), chunks[c+1]->end());
+        chunks.erase(chunks.begin() + c + 1);
+    }
+
+    total_size--;
+    updateStarts(c);
+}
+
+bool InputList::equalPrefix(const InputList& other, uint64_t count) const
+{
+    if ((count > total_size) || (count > other.total_size))
+        return false;
+
+    return commonPrefix(other, count) == count;
+}
+
+uint64_t InputList::commonPrefix(const InputList& other, uint64_t max, uint64_t pos) const
+{
+    uint64_t first = pos;
+    uint64_t end = std::min(total_size, other.total_size);
+    if (pos >= end)
+        return 0;
+    uint64_t count = pos + std::min(max, end - pos);
+    while (pos < count) {
+        size_t c = chunkIndex(pos);
+        size_t oc = other.chunkIndex(pos);
+        uint64_t offset = pos - starts[c];
+        uint64_t other_offset = pos - other.starts[oc];
+
+        /* Compare up to the end of the first chunk to end */
+        uint64_t length = std::min(chunks[c]->size() - offset, other.chunks[oc]->size() - other_offset);
+        length = std::min(length, count - pos);
+
+        /* Same frames of a shared chunk */
+        if ((chunks[c] != other.chunks[oc]) || (offset != other_offset)) {
+            auto begin = chunks[c]->begin() + offset;
+            auto mismatch = std::mismatch(begin, begin + length, other.chunks[oc]->begin() + other_offset);
+            if (mismatch.first != (begin + length))
+                return pos + (mismatch.first - begin) - first;
+        }
+
+        pos += length;
+    }
+
+    return count - first;
+}
+
+uint64_t InputList::commonSuffix(const InputList& other, uint64_t max) const
+{
+    max = std::min(max, std::min(total_size, other.total_size));
+    uint64_t count = 0;
+    while (count < max) {
+        uint64_t pos = total_size - 1 - count;
+        uint64_t other_pos = other.total_size - 1 - count;
+        size_t c = chunkIndex(pos);
+        size_t oc = other.chunkIndex(other_pos);
+        uint64_t offset = pos - starts[c];
+        uint64_t other_offset = other_pos - other.starts[oc];
+
+        /* Compare down to the start of the first chunk to end */
+        uint64_t length = std::min(offset, other_offset) + 1;
+        length = std::min(length, max - count);
+
+        if ((chunks[c] != other.chunks[oc]) || (offset != other_offset)) {
+            for (uint64_t i = 0; i < length; i++) {
+                if (!((*chunks[c])[offset - i] == (*other.chunks[oc])[other_offset - i]))
+                    return count + i;
+            }
+        }
+
+        count += length;
+    }
+
+    return count;
+}
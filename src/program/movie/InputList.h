@@ -0,0 +1,123 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_INPUTLIST_H_INCLUDED
+#define LIBTAS_INPUTLIST_H_INCLUDED
+
+#include "../../shared/AllInputs.h"
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+/* List of movie inputs, stored as chunks of frames that are shared between
+ * copies of the list. Copying a list only copies the chunk pointers, and a
+ * chunk is copied when it is modified while being shared. This is used for
+ * savestate movies, which are copies of the current movie that only differ
+ * in their last frames. */
+class InputList {
+public:
+    /* Maximum number of frames in a chunk */
+    static const size_t CHUNK_FRAMES = 1024;
+
+    class const_iterator {
+    public:
+        const_iterator(const InputList* l, size_t c, size_t o) : list(l), chunk(c), offset(o) {}
+
+        const AllInputs& operator*() const {return (*list->chunks[chunk])[offset];}
+        const AllInputs* operator->() const {return &(*list->chunks[chunk])[offset];}
+
+        const_iterator& operator++()
+        {
+            if (++offset == list->chunks[chunk]->size()) {
+                chunk++;
+                offset = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {return (chunk == other.chunk) && (offset == other.offset);}
+        bool operator!=(const const_iterator& other) const {return !(*this == other);}
+
+    private:
+        const InputList* list;
+        size_t chunk;
+        size_t offset;
+    };
+
+    /* Number of frames */
+    uint64_t size() const {return total_size;}
+    bool empty() const {return total_size == 0;}
+
+    /* Remove all frames */
+    void clear();
+
+    /* Read a frame */
+    const AllInputs& operator[](uint64_t pos) const;
+
+    /* Get a frame to modify it, copying its chunk if shared */
+    AllInputs& edit(uint64_t pos);
+
+    /* Append a frame */
+    void push_back(const AllInputs& inputs);
+
+    /* Remove all frames starting from pos */
+    void truncate(uint64_t pos);
+
+    /* Insert a frame before pos */
+    void insert(uint64_t pos, const AllInputs& inputs);
+
+    /* Remove the frame at pos */
+    void erase(uint64_t pos);
+
+    /* Check if the first `count` frames are equal to the ones of another
+     * list. Shared chunks are not compared. */
+    bool equalPrefix(const InputList& other, uint64_t count) const;
+
+    /* Number of identical frames of both lists starting from frame `pos`,
+     * up to `max` */
+    uint64_t commonPrefix(const InputList& other, uint64_t max, uint64_t pos = 0) const;
+
+    /* Number of identical frames at the end of both lists, up to `max` */
+    uint64_t commonSuffix(const InputList& other, uint64_t max) const;
+
+    const_iterator begin() const {return const_iterator(this, 0, 0);}
+    const_iterator end() const {return const_iterator(this, chunks.size(), 0);}
+
+private:
+    typedef std::vector<AllInputs> Chunk;
+
+    /* Chunks of frames, none of them being empty */
+    std::vector<std::shared_ptr<Chunk>> chunks;
+
+    /* Index of the first frame of each chunk */
+    std::vector<uint64_t> starts;
+
+    uint64_t total_size = 0;
+
+    /* Index of the chunk containing a frame */
+    size_t chunkIndex(uint64_t pos) const;
+
+    /* Copy a chunk if it is shared with another list */
+    Chunk& unshare(size_t c);
+
+    /* Recompute chunk starts after chunk c */
+    void updateStarts(size_t c);
+};
+
+#endif
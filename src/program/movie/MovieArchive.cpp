@@ -0,0 +1,424 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MovieArchive.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <zlib.h>
+#include <unistd.h>
+
+/* Header of a file inside a ustar archive */
+struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+static_assert(sizeof(TarHeader) == 512, "Tar header must be a block");
+
+#define TAR_BLOCK 512
+
+static unsigned int tarChecksum(const TarHeader& header)
+{
+    /* The checksum field is counted as spaces */
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&header);
+    unsigned int sum = 0;
+    for (size_t i = 0; i < sizeof(TarHeader); i++) {
+        if ((i >= offsetof(TarHeader, chksum)) && (i < offsetof(TarHeader, chksum) + sizeof(header.chksum)))
+            sum += ' ';
+        else
+            sum += bytes[i];
+    }
+    return sum;
+}
+
+static uint64_t tarOctal(const char* field, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        if ((field[i] < '0') || (field[i] > '7'))
+            break;
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+/* Streaming gzip compressor writing into a file */
+class GzipWriter {
+public:
+    GzipWriter(FILE* f) : file(f), out(256*1024)
+    {
+        memset(&stream, 0, sizeof(stream));
+        /* 15 window bits, plus 16 for a gzip header */
+        ok = (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    }
+
+    ~GzipWriter()
+    {
+        deflateEnd(&stream);
+    }
+
+    bool write(const void* data, size_t size)
+    {
+        stream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+        stream.avail_in = size;
+        while (ok && stream.avail_in)
+            deflateOut(Z_NO_FLUSH);
+        return ok;
+    }
+
+    bool finish()
+    {
+        int ret = Z_OK;
+        while (ok && (ret != Z_STREAM_END))
+            ret = deflateOut(Z_FINISH);
+        return ok;
+    }
+
+    bool ok;
+
+private:
+    int deflateOut(int flush)
+    {
+        stream.next_out = out.data();
+        stream.avail_out = out.size();
+        int ret = deflate(&stream, flush);
+        if (ret == Z_STREAM_ERROR) {
+            ok = false;
+            return ret;
+        }
+        size_t size = out.size() - stream.avail_out;
+        if (size && (fwrite(out.data(), 1, size, file) != size))
+            ok = false;
+        return ret;
+    }
+
+    FILE* file;
+    z_stream stream;
+    std::vector<Bytef> out;
+};
+
+/* Decompress a whole gzip file. Concatenated gzip members are supported,
+ * as gzip does. */
+static int gunzipFile(const std::string& path, std::string& tar)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return MovieArchive::EOPEN;
+
+    std::string compressed((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    /* 15 window bits, plus 32 for automatic gzip/zlib header detection */
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)
+        return MovieArchive::ECORRUPT;
+
+    stream.next_in = reinterpret_cast<Bytef*>(&compressed[0]);
+    stream.avail_in = compressed.size();
+
+    tar.clear();
+    size_t produced = 0;
+    int ret = Z_OK;
+    while (true) {
+        if (produced == tar.size())
+            tar.resize(std::max(tar.size() * 2, compressed.size() * 4 + TAR_BLOCK * 4));
+        stream.next_out = reinterpret_cast<Bytef*>(&tar[produced]);
+        stream.avail_out = tar.size() - produced;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        produced = tar.size() - stream.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            /* Continue with the next gzip member if any */
+            if (stream.avail_in == 0)
+                break;
+            inflateReset(&stream);
+            continue;
+        }
+        if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+            break;
+        if ((ret == Z_BUF_ERROR) && (stream.avail_in == 0))
+            break;
+    }
+    inflateEnd(&stream);
+    tar.resize(produced);
+
+    /* Old movie files may contain trailing garbage, which gzip ignores */
+    if ((ret != Z_STREAM_END) && (produced == 0))
+        return MovieArchive::ECORRUPT;
+
+    return 0;
+}
+
+int MovieArchive::read(const std::string& path, std::vector<Entry>& entries)
+{
+    entries.clear();
+
+    std::string tar;
+    int ret = gunzipFile(path, tar);
+    if (ret < 0)
+        return ret;
+
+    std::string long_name;
+    size_t pos = 0;
+    while (pos + TAR_BLOCK <= tar.size()) {
+        TarHeader header;
+        memcpy(&header, &tar[pos], TAR_BLOCK);
+        pos += TAR_BLOCK;
+
+        /* End of archive */
+        if (header.name[0] == '\0')
+            break;
+
+        if (tarOctal(header.chksum, sizeof(header.chksum)) != tarChecksum(header))
+            return ECORRUPT;
+
+        uint64_t size = tarOctal(header.size, sizeof(header.size));
+        if (size > tar.size() - pos)
+            return ECORRUPT;
+
+        std::string name;
+        if (!long_name.empty()) {
+            name = long_name;
+            long_name.clear();
+        }
+        else {
+            if ((memcmp(header.magic, "ustar", 5) == 0) && header.prefix[0]) {
+                name.assign(header.prefix, strnlen(header.prefix, sizeof(header.prefix)));
+                name += '/';
+            }
+            name.append(header.name, strnlen(header.name, sizeof(header.name)));
+        }
+
+        switch (header.typeflag) {
+            case '0':
+            case '\0':
+                if (name.compare(0, 2, "./") == 0)
+                    name.erase(0, 2);
+                entries.push_back({name, tar.substr(pos, size)});
+                break;
+            case 'L':
+                /* GNU long name of the next file */
+                long_name.assign(&tar[pos], strnlen(&tar[pos], size));
+                break;
+            default:
+                /* Directories, links and extended headers are ignored */
+                break;
+        }
+
+        pos += (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+    }
+
+    return 0;
+}
+
+int MovieArchive::write(const std::string& path, const std::vector<Entry>& entries)
+{
+    std::string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return EOPEN;
+
+    GzipWriter gzip(file);
+    static const char zeros[2 * TAR_BLOCK] = {};
+    time_t now = time(nullptr);
+
+    for (const Entry& entry : entries) {
+        TarHeader header;
+        memset(&header, 0, sizeof(header));
+        strncpy(header.name, entry.name.c_str(), sizeof(header.name) - 1);
+        snprintf(header.mode, sizeof(header.mode), "%07o", 0644);
+        snprintf(header.uid, sizeof(header.uid), "%07o", 0);
+        snprintf(header.gid, sizeof(header.gid), "%07o", 0);
+        snprintf(header.size, sizeof(header.size), "%011llo", static_cast<unsigned long long>(entry.data.size()));
+        snprintf(header.mtime, sizeof(header.mtime), "%011llo", static_cast<unsigned long long>(now));
+        header.typeflag = '0';
+        memcpy(header.magic, "ustar", 6);
+        memcpy(header.version, "00", 2);
+        snprintf(header.chksum, sizeof(header.chksum), "%06o", tarChecksum(header));
+        header.chksum[7] = ' ';
+
+        gzip.write(&header, TAR_BLOCK);
+        gzip.write(entry.data.data(), entry.data.size());
+        size_t padding = (TAR_BLOCK - entry.data.size() % TAR_BLOCK) % TAR_BLOCK;
+        gzip.write(zeros, padding);
+    }
+
+    /* End of archive */
+    gzip.write(zeros, 2 * TAR_BLOCK);
+    gzip.finish();
+
+    bool closed = (fclose(file) == 0);
+    bool ok = gzip.ok && closed;
+    if (!ok || (rename(temp_path.c_str(), path.c_str()) != 0)) {
+        unlink(temp_path.c_str());
+        return EWRITE;
+    }
+
+    return 0;
+}
+
+/* Thread writing archives in the background. Pending writes are finished
+ * when the program exits. */
+class MovieArchiveWriter {
+public:
+    struct Job {
+        std::string path;
+        std::vector<MovieArchive::Entry> entries;
+    };
+
+    ~MovieArchiveWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cond.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void push(const std::string& path, std::vector<MovieArchive::Entry>&& entries)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!thread.joinable())
+                thread = std::thread(&MovieArchiveWriter::run, this);
+
+            /* Replace a pending write of the same file */
+            bool replaced = false;
+            for (Job& job : jobs) {
+                if (job.path == path) {
+                    job.entries = std::move(entries);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced)
+                jobs.push_back({path, std::move(entries)});
+            results[path] = 1;
+        }
+        cond.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]{return jobs.empty() && !busy;});
+    }
+
+    int result(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = results.find(path);
+        if (it == results.end())
+            return MovieArchive::EWRITE;
+
+        int ret = it->second;
+        if (ret != 1)
+            results.erase(it);
+        return ret;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [this]{return quit || !jobs.empty();});
+            if (jobs.empty())
+                return;
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+            lock.unlock();
+
+            int ret = MovieArchive::write(job.path, job.entries);
+            if (ret < 0)
+                std::cerr << "Could not write movie file " << job.path << std::endl;
+
+            lock.lock();
+            busy = false;
+
+            /* The file may have been queued again while being written */
+            auto queued = std::find_if(jobs.begin(), jobs.end(), [&job](const Job& j){return j.path == job.path;});
+            if (queued == jobs.end())
+                results[job.path] = ret;
+            cond.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+
+    /* Result of the last write of each file, or 1 if it is not written yet */
+    std::map<std::string, int> results;
+    bool busy = false;
+    bool quit = false;
+    std::thread thread;
+};
+
+static MovieArchiveWriter& backgroundWriter()
+{
+    static MovieArchiveWriter writer;
+    return writer;
+}
+
+void MovieArchive::writeInBackground(const std::string& path, std::vector<Entry>&& entries)
+{
+    backgroundWriter().push(path, std::move(entries));
+}
+
+int MovieArchive::backgroundResult(const std::string& path)
+{
+    return backgroundWriter().result(path);
+}
+
+void MovieArchive::wait()
+{
+    backgroundWriter().wait();
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MOVIEARCHIVE_H_INCLUDED
+#define LIBTAS_MOVIEARCHIVE_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+/* Reader and writer of movie files, which are gzip-compressed tar archives.
+ * Archives are built from memory and compressed with zlib, without calling
+ * external programs, and can be written by a background thread. */
+class MovieArchive {
+public:
+    /* A file of the archive */
+    struct Entry {
+        std::string name;
+        std::string data;
+    };
+
+    /* List of error codes */
+    enum Error {
+        EOPEN = -1, // Could not open the archive
+        ECORRUPT = -2, // Archive is not a valid tar+gzip file
+        EWRITE = -3, // Could not write the archive
+    };
+
+    /* Read all regular files of an archive.
+     * Returns 0 if no error, or a negative value if an error occured */
+    static int read(const std::string& path, std::vector<Entry>& entries);
+
+    /* Write files into an archive. The archive is first written into a
+     * temporary file next to it, then renamed, so that the previous archive
+     * stays valid until the new one is complete.
+     * Returns 0 if no error, or a negative value if an error occured */
+    static int write(const std::string& path, const std::vector<Entry>& entries);
+
+    /* Queue the writing of an archive in a background thread. Archives are
+     * written in order, and a pending write to the same path is replaced. */
+    static void writeInBackground(const std::string& path, std::vector<Entry>&& entries);
+
+    /* Result of the background write of an archive. Returns 1 while the
+     * archive is waiting or being written. Otherwise returns 0 if no error,
+     * or a negative value if an error occured or if the archive was not
+     * written in the background, and the result is forgotten. */
+    static int backgroundResult(const std::string& path);
+
+    /* Wait for all background writes to finish */
+    static void wait();
+};
+
+#endif
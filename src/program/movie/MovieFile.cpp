@@ -17,13 +17,17 @@
     along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <sstream>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
 #include <fcntl.h> // O_RDONLY, O_WRONLY, O_CREAT
 #include <errno.h>
 #include <unistd.h>
 
 #include "MovieFile.h"
+#include "MovieFileInputsBinary.h"
+#include "../utils.h"
 
 MovieFile::MovieFile(Context* c) : context(c)
 {
@@ -31,6 +35,7 @@ MovieFile::MovieFile(Context* c) : context(c)
     inputs = new MovieFileInputs(c);
     annotations = new MovieFileAnnotations(c);
     editor = new MovieFileEditor(c);
+    journal = new MovieJournal();
 }
 
 const char* MovieFile::errorString(int error_code) {
@@ -60,44 +65,56 @@ void MovieFile::clear()
     editor->clear();
 }
 
+/* Files of a movie, in the order they are stored in the archive */
+static const char* movie_files[] = {"inputs", "inputs.bin", "config.ini", "editor.ini", "annotations.txt"};
+
 int MovieFile::extractMovie(const std::string& moviefile)
 {
     if (moviefile.empty())
         return ENOMOVIE;
 
+    /* The movie may still be written in the background */
+    MovieArchive::wait();
+
     /* Check that the moviefile exists */
     if (access(moviefile.c_str(), F_OK) != 0)
         return ENOMOVIE;
 
     /* Empty the temp directory */
-    std::string configfile = context->config.tempmoviedir + "/config.ini";
-    std::string editorfile = context->config.tempmoviedir + "/editor.ini";
-    std::string inputfile = context->config.tempmoviedir + "/inputs";
-    std::string annotationsfile = context->config.tempmoviedir + "/annotations.txt";
-    unlink(configfile.c_str());
-    unlink(editorfile.c_str());
-    unlink(inputfile.c_str());
-    unlink(annotationsfile.c_str());
-
-    /* Build the tar command */
-    std::ostringstream oss;
-    /* Piping gzip -> tar to avoid gzip warnings on old movie files */
-    oss << "gzip -dq < \"";
-    oss << moviefile;
-    oss << "\" | tar -xUf - -C ";
-    oss << context->config.tempmoviedir;
-
-    /* Execute the tar command */
-    // std::cout << oss.str() << std::endl;
-    int ret = system(oss.str().c_str());
-
-    if (!WIFEXITED(ret) || (WEXITSTATUS(ret) != 0))
+    for (const char* name : movie_files) {
+        std::string file = context->config.tempmoviedir + "/" + name;
+        unlink(file.c_str());
+    }
+
+    std::vector<MovieArchive::Entry> entries;
+    if (MovieArchive::read(moviefile, entries) < 0)
         return EBADARCHIVE;
 
+    /* Write the movie files in the temp directory. Other files are ignored,
+     * and we don't follow paths outside of the directory. */
+    bool has_inputs = false;
+    bool has_config = false;
+    for (const MovieArchive::Entry& entry : entries) {
+        bool known = false;
+        for (const char* name : movie_files)
+            known |= (entry.name == name);
+        if (!known)
+            continue;
+
+        std::string file = context->config.tempmoviedir + "/" + entry.name;
+        std::ofstream stream(file, std::ofstream::trunc | std::ofstream::binary);
+        stream.write(entry.data.data(), entry.data.size());
+        if (!stream)
+            return EBADARCHIVE;
+
+        has_inputs |= (entry.name == "inputs") || (entry.name == "inputs.bin");
+        has_config |= (entry.name == "config.ini");
+    }
+
     /* Check the presence of the inputs and config files */
-    if (access(configfile.c_str(), F_OK) != 0)
+    if (!has_config)
         return ENOCONFIG;
-    if (access(inputfile.c_str(), F_OK) != 0)
+    if (!has_inputs)
         return ENOINPUTS;
 
     return 0;
@@ -152,35 +169,68 @@ int MovieFile::loadSavestateMovie(const std::string& moviefile)
     return 0;
 }
 
+int MovieFile::buildMovie(uint64_t nb_frames, std::vector<MovieArchive::Entry>& entries)
+{
+    std::string text_inputs, binary_inputs;
+    inputs->save(text_inputs, binary_inputs);
+
+    /* Header and editor files are built by QSettings, which only writes to
+     * files, so we read them back */
+    header->save(inputs->input_list.size(), nb_frames);
+    editor->save();
+
+    entries.clear();
+    if (context->config.movie_text_inputs)
+        entries.push_back({"inputs", std::move(text_inputs)});
+    entries.push_back({"inputs.bin", std::move(binary_inputs)});
+
+    for (const char* name : {"config.ini", "editor.ini"}) {
+        std::string file = context->config.tempmoviedir + "/" + name;
+        std::ifstream stream(file, std::ifstream::binary);
+        if (!stream)
+            return EBADARCHIVE;
+        entries.push_back({name, std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>())});
+    }
+
+    entries.push_back({"annotations.txt", annotations->text});
+
+    return 0;
+}
+
 int MovieFile::saveMovie(const std::string& moviefile, uint64_t nb_frames)
 {
     /* Skip empty moviefiles, if user tested the annotations without specifying a movie */
     if (moviefile.empty())
         return ENOMOVIE;
 
-    inputs->save();
-    header->save(inputs->input_list.size(), nb_frames);
-    annotations->save();
-    editor->save();
-
-    /* Build the tar command */
-    std::ostringstream oss;
-    oss << "tar -czUf \"";
-    oss << moviefile;
-    oss << "\" -C ";
-    oss << context->config.tempmoviedir;
-    oss << " inputs config.ini editor.ini annotations.txt";
+    std::vector<MovieArchive::Entry> entries;
+    int ret = buildMovie(nb_frames, entries);
+    if (ret < 0)
+        return ret;
 
-    /* Execute the tar command */
-    // std::cout << oss.str() << std::endl;
-    int ret = system(oss.str().c_str());
+    /* Wait for a previous background save of the same movie */
+    MovieArchive::wait();
 
-    if (!WIFEXITED(ret) || (WEXITSTATUS(ret) != 0))
+    if (MovieArchive::write(moviefile, entries) < 0)
         return EBADARCHIVE;
 
     return 0;
 }
 
+int MovieFile::saveMovieInBackground(const std::string& moviefile)
+{
+    if (moviefile.empty())
+        return ENOMOVIE;
+
+    std::vector<MovieArchive::Entry> entries;
+    int ret = buildMovie(inputs->input_list.size(), entries);
+    if (ret < 0)
+        return ret;
+
+    MovieArchive::writeInBackground(moviefile, std::move(entries));
+    return 0;
+}
+
 int MovieFile::saveMovie(const std::string& moviefile)
 {
     return saveMovie(moviefile, inputs->input_list.size());
@@ -189,7 +239,13 @@ int MovieFile::saveMovie(const std::string& moviefile)
 int MovieFile::saveMovie()
 {
     inputs->modifiedSinceLastSave = false;
-    return saveMovie(context->config.moviefile);
+    int ret = saveMovie(context->config.moviefile);
+
+    /* Changes are now relative to the saved movie */
+    if ((ret == 0) && journal->active())
+        startJournal(true);
+
+    return ret;
 }
 
 void MovieFile::copyTo(MovieFile& movie) const
@@ -220,6 +276,7 @@ void MovieFile::close()
 {
     inputs->close();
     editor->close();
+    journal->remove();
 }
 
 void MovieFile::updateLength()
@@ -241,3 +298,84 @@ void MovieFile::updateLength()
         context->config.sc_modified = true;
     }
 }
+
+std::string MovieFile::journalPath() const
+{
+    /* Journals are stored with autosaves, named after the movie */
+    std::string moviename = fileFromPath(context->config.moviefile);
+    if ((moviename.size() > 4) && (moviename.compare(moviename.size() - 4, 4, ".ltm") == 0))
+        moviename.resize(moviename.size() - 4);
+
+    return context->config.tempmoviedir + "/" + moviename + ".journal";
+}
+
+void MovieFile::startJournal(bool from_file)
+{
+    if (context->config.moviefile.empty())
+        return;
+
+    journal->start(journalPath(), context->config.moviefile, from_file ? context->config.moviefile : "",
+        inputs->hash(), inputs->input_list);
+}
+
+bool MovieFile::hasJournal() const
+{
+    if (context->config.moviefile.empty())
+        return false;
+
+    MovieJournal::Info info;
+    return MovieJournal::readInfo(journalPath(), info) && info.has_records &&
+        (info.movie == context->config.moviefile);
+}
+
+int MovieFile::recoverJournal()
+{
+    std::string path = journalPath();
+    MovieJournal::Info info;
+    if (!MovieJournal::readInfo(path, info))
+        return -1;
+
+    /* Get the inputs the journal is based on: the movie file, an autosave or
+     * an empty movie */
+    MovieFileInputs base(context);
+    base.framerate_num = inputs->framerate_num;
+    base.framerate_den = inputs->framerate_den;
+
+    if (info.base == context->config.moviefile) {
+        base.input_list = inputs->input_list;
+    }
+    else if (!info.base.empty()) {
+        std::vector<MovieArchive::Entry> entries;
+        if (MovieArchive::read(info.base, entries) < 0)
+            return -1;
+
+        bool found = false;
+        uint64_t text_hash;
+        for (const MovieArchive::Entry& entry : entries) {
+            if (entry.name == "inputs.bin")
+                found = MovieFileInputsBinary::load(entry.data.data(), entry.data.size(), base.input_list, text_hash);
+        }
+        if (!found)
+            return -1;
+    }
+
+    if (base.hash() != info.base_hash) {
+        std::cerr << "Movie journal " << path << " does not match the movie it is based on" << std::endl;
+        return -1;
+    }
+
+    InputList recovered = base.input_list;
+    int count = MovieJournal::replay(path, recovered);
+    if (count < 0)
+        return -1;
+
+    inputs->input_list = recovered;
+    inputs->wasModified();
+    updateLength();
+
+    /* Write the recovered changes into a new journal, as the previous one may
+     * end with an incomplete change */
+    journal->start(path, context->config.moviefile, info.base, info.base_hash, base.input_list);
+    journal->flush(inputs->input_list);
+    return count;
+}
@@ -26,8 +26,11 @@
 #include "MovieFileEditor.h"
 #include "MovieFileHeader.h"
 #include "MovieFileInputs.h"
+#include "MovieArchive.h"
+#include "MovieJournal.h"
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 class MovieFile {
@@ -38,6 +41,9 @@ public:
     MovieFileAnnotations* annotations;
     MovieFileEditor* editor;
 
+    /* Journal of the changes of the inputs since the movie was saved */
+    MovieJournal* journal;
+
     /* List of error codes */
     enum Error {
         ENOMOVIE = -1, // No movie file at the specified path
@@ -76,6 +82,11 @@ public:
     /* Write only the n first frames of input into the movie file. Used for savestate movies */
     int saveMovie(const std::string& moviefile, uint64_t frame_nb);
 
+    /* Write the movie file in a background thread. The movie is serialized
+     * before returning, so it can be modified afterwards.
+     * Returns 0 if no error, or a negative value if an error occured */
+    int saveMovieInBackground(const std::string& moviefile);
+
     /* Copy movie to another one */
     void copyTo(MovieFile& movie) const;
 
@@ -90,9 +101,28 @@ public:
     /* Update movie length from movie framecount */
     void updateLength();
 
+    /* Start a new journal for the movie. Its inputs must be equal to the
+     * movie file if `from_file` is true, or be empty otherwise */
+    void startJournal(bool from_file);
+
+    /* Check if a journal of unsaved changes was left for the movie by a
+     * previous execution that did not exit properly */
+    bool hasJournal() const;
+
+    /* Replay the journal left for the movie into the inputs, and continue
+     * writing it.
+     * Returns the number of changes, or a negative value if an error occured */
+    int recoverJournal();
+
 private:
     Context* context;    
 
+    /* Path of the journal of the movie */
+    std::string journalPath() const;
+
+    /* Serialize all files of the movie */
+    int buildMovie(uint64_t frame_nb, std::vector<MovieArchive::Entry>& entries);
+
 };
 
 #endif
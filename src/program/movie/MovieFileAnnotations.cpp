@@ -41,12 +41,3 @@ void MovieFileAnnotations::load()
         text = "";
     }
 }
-
-void MovieFileAnnotations::save()
-{
-    /* Save annotations */
-    std::string annotations_file = context->config.tempmoviedir + "/annotations.txt";
-    std::ofstream annotations_stream(annotations_file);
-    annotations_stream << text;
-    annotations_stream.close();
-}
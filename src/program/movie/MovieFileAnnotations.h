@@ -38,9 +38,6 @@ public:
      * Returns 0 if no error, or a negative value if an error occured */
     void load();
 
-    /* Write the inputs into a file and compress to the whole moviefile */
-    void save();
-
 private:
     Context* context;
 
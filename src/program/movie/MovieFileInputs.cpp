@@ -22,6 +22,7 @@
 #include <sstream>
 
 #include "MovieFileInputs.h"
+#include "MovieFileInputsBinary.h"
 #include "../utils.h"
 #include "../../shared/version.h"
 
@@ -29,7 +30,7 @@ MovieFileInputs::MovieFileInputs(Context* c) : context(c)
 {
     rek.assign(R"(\|K([0-9a-f]*(?::[0-9a-f]+)*)\|)", std::regex::ECMAScript|std::regex::optimize);
     rem.assign(R"(\|M([\-0-9]+:[\-0-9]+:(?:[AR]:)?[\.1-5]{5})\|)", std::regex::ECMAScript|std::regex::optimize);
-    rec.assign(R"(\|C([1-4](?:[\-0-9]+:){6}.{15})\|)", std::regex::ECMAScript|std::regex::optimize);
+    rec.assign(R"(\|C([1-4](?:[\-0-9]+:){6}.{15})(?=\|))", std::regex::ECMAScript|std::regex::optimize);
     ref.assign(R"(\|F(.{1,9})\|)", std::regex::ECMAScript|std::regex::optimize);
     ret.assign(R"(\|T([0-9]+:[0-9]+)\|)", std::regex::ECMAScript|std::regex::optimize);
     red.assign(R"(\|D([0-9]+:[0-9]+)\|)", std::regex::ECMAScript|std::regex::optimize);
@@ -49,13 +50,37 @@ void MovieFileInputs::load()
 {
     /* Clear structures */
     input_list.clear();
-    
-    /* Open the input file and parse each line to fill our input list */
+
+    /* Read the whole text inputs, to check if the binary inputs match them */
     std::string input_file = context->config.tempmoviedir + "/inputs";
-    std::ifstream input_stream(input_file);
+    std::ifstream input_stream(input_file, std::ios::binary);
+    bool has_text = input_stream.is_open();
+    std::string text;
+    if (has_text) {
+        input_stream.seekg(0, std::ios::end);
+        text.resize(input_stream.tellg());
+        input_stream.seekg(0, std::ios::beg);
+        input_stream.read(&text[0], text.size());
+        input_stream.close();
+    }
+
+    /* Use the binary inputs if they were saved along with the same text
+     * inputs, or without text inputs. Otherwise, the text inputs may have been
+     * modified by another program. */
+    std::string binary_file = context->config.tempmoviedir + "/inputs.bin";
+    uint64_t text_hash;
+    if (MovieFileInputsBinary::load(binary_file, input_list, text_hash)) {
+        if (!has_text || (text_hash == MovieFileInputsBinary::hash(text.data(), text.size())))
+            return;
+        std::cerr << "Binary inputs do not match the text inputs, reading the text inputs" << std::endl;
+        input_list.clear();
+    }
+
+    /* Parse each line to fill our input list */
+    std::istringstream text_stream(text);
     std::string line;
 
-    while (std::getline(input_stream, line)) {
+    while (std::getline(text_stream, line)) {
         if (!line.empty() && (line[0] == '|')) {
             AllInputs ai;
             readFrame(line, ai);
@@ -63,21 +88,83 @@ void MovieFileInputs::load()
         }
     }
 
-    input_stream.close();
-
     return;
 }
 
-void MovieFileInputs::save()
+void MovieFileInputs::save(std::string& text, std::string& binary)
 {
-    /* Format and write input frames into the input file */
-    std::string input_file = context->config.tempmoviedir + "/inputs";
-    std::ofstream input_stream(input_file, std::ofstream::trunc);
+    /* Format input frames into the text inputs */
+    uint64_t text_hash = 0;
+    text.clear();
+
+    if (context->config.movie_text_inputs) {
+        std::ostringstream input_stream;
+        for (auto it = input_list.begin(); it != input_list.end(); ++it) {
+            writeFrame(input_stream, *it);
+        }
+
+        text = input_stream.str();
+        text_hash = MovieFileInputsBinary::hash(text.data(), text.size());
+    }
+
+    /* Encode the binary inputs, normalized so that they match the text inputs */
+    MovieFileInputsBinary::save(binary, input_list, text_hash,
+        [this](AllInputs& ai){normalizeFrame(ai);});
+}
+
+void MovieFileInputs::normalizeFrame(AllInputs& inputs) const
+{
+    /* Keyboard inputs are stored up to the first empty key */
+    int k = 0;
+    while ((k < AllInputs::MAXKEYS) && inputs.keyboard[k])
+        k++;
+    for (; k < AllInputs::MAXKEYS; k++)
+        inputs.keyboard[k] = 0;
+
+    if (context->config.sc.mouse_support) {
+        if (inputs.pointer_mode != SingleInput::POINTER_MODE_RELATIVE)
+            inputs.pointer_mode = SingleInput::POINTER_MODE_ABSOLUTE;
+        inputs.pointer_mask &= (1 << (SingleInput::POINTER_B5 + 1)) - 1;
+    }
+    else {
+        inputs.pointer_x = 0;
+        inputs.pointer_y = 0;
+        inputs.pointer_mode = SingleInput::POINTER_MODE_ABSOLUTE;
+        inputs.pointer_mask = 0;
+    }
+
+    for (int joy=0; joy<AllInputs::MAXJOYS; joy++) {
+        if (joy < context->config.sc.nb_controllers) {
+            inputs.controller_buttons[joy] &= (1 << (SingleInput::BUTTON_DPAD_RIGHT + 1)) - 1;
+        }
+        else {
+            inputs.controller_axes[joy].fill(0);
+            inputs.controller_buttons[joy] = 0;
+        }
+    }
+
+    inputs.flags &= (1 << (SingleInput::FLAG_FOCUS_UNFOCUS + 1)) - 1;
+
+    /* Framerate is only stored if different from initial framerate */
+    if (!context->config.sc.variable_framerate || !inputs.framerate_num ||
+        ((inputs.framerate_num == framerate_num) && (inputs.framerate_den == framerate_den))) {
+        inputs.framerate_num = 0;
+        inputs.framerate_den = 0;
+    }
+
+    if (!inputs.realtime_sec)
+        inputs.realtime_nsec = 0;
+}
 
-    for (auto it = input_list.begin(); it != input_list.end(); ++it) {
-        writeFrame(input_stream, *it);
+uint64_t MovieFileInputs::hash() const
+{
+    uint64_t h = MovieFileInputsBinary::hash(nullptr, 0);
+    for (const AllInputs& inputs : input_list) {
+        AllInputs ai = inputs;
+        normalizeFrame(ai);
+        h = MovieFileInputsBinary::hash(reinterpret_cast<const char*>(&ai), sizeof(AllInputs), h);
     }
-    input_stream.close();
+    return h;
 }
 
 int MovieFileInputs::writeFrame(std::ostream& input_stream, const AllInputs& inputs)
@@ -380,10 +467,10 @@ int MovieFileInputs::setInputs(const AllInputs& inputs, uint64_t pos, bool keep_
          * the end.
          */
         if (keep_inputs) {
-            input_list[pos] = inputs;
+            input_list.edit(pos) = inputs;
         }
         else {
-            input_list.resize(pos);
+            input_list.truncate(pos);
             input_list.push_back(inputs);
         }
         wasModified();
@@ -430,7 +517,7 @@ void MovieFileInputs::insertInputsBefore(const AllInputs& inputs, uint64_t pos)
     if (pos > input_list.size())
         return;
 
-    input_list.insert(input_list.begin() + pos, inputs);
+    input_list.insert(pos, inputs);
     wasModified();
 }
 
@@ -439,7 +526,7 @@ void MovieFileInputs::deleteInputs(uint64_t pos)
     if (pos >= input_list.size())
         return;
 
-    input_list.erase(input_list.begin() + pos);
+    input_list.erase(pos);
     wasModified();
 }
 
@@ -460,7 +547,7 @@ bool MovieFileInputs::isPrefix(const MovieFileInputs* movie, unsigned int frame)
     if (frame > input_list.size())
         return false;
 
-    return std::equal(movie->input_list.begin(), movie->input_list.begin() + frame, input_list.begin());
+    return input_list.equalPrefix(movie->input_list, frame);
 }
 
 void MovieFileInputs::wasModified()
@@ -23,6 +23,7 @@
 #include "../../shared/AllInputs.h"
 #include "../Context.h"
 #include "../ConcurrentQueue.h"
+#include "InputList.h"
 #include <fstream>
 #include <string>
 #include <vector>
@@ -41,9 +42,10 @@ class MovieFileInputs {
 public:
 
     /* The list of inputs. We need this to be public because a movie may
-     * check if another movie is a prefix
+     * check if another movie is a prefix. Copies of the list share their
+     * frames until modified.
      */
-    std::vector<AllInputs> input_list;
+    InputList input_list;
 
     /* Flag storing if the movie has been modified since last save.
      * Used for prompting a message when the game exits if the user wants
@@ -74,8 +76,16 @@ public:
      * Returns 0 if no error, or a negative value if an error occured */
     void load();
 
-    /* Write the inputs into a file and compress to the whole moviefile */
-    void save();
+    /* Serialize the inputs into the text inputs, which are left empty if
+     * disabled, and the binary inputs */
+    void save(std::string& text, std::string& binary);
+
+    /* Modify a frame of inputs so that it only contains what the text inputs
+     * can store */
+    void normalizeFrame(AllInputs& inputs) const;
+
+    /* Hash of all frames of inputs, after being normalized */
+    uint64_t hash() const;
 
     /* Write a single frame of inputs into the input stream */
     int writeFrame(std::ostream& input_stream, const AllInputs& inputs);
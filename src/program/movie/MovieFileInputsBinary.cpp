@@ -0,0 +1,289 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MovieFileInputsBinary.h"
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Columns of the binary inputs, in the order of the file */
+#define COLUMN_KEYBOARD 0
+#define COLUMN_POINTER (COLUMN_KEYBOARD + AllInputs::MAXKEYS)
+#define COLUMN_AXES (COLUMN_POINTER + 4)
+#define COLUMN_BUTTONS (COLUMN_AXES + AllInputs::MAXJOYS*AllInputs::MAXAXES)
+#define COLUMN_FLAGS (COLUMN_BUTTONS + AllInputs::MAXJOYS)
+#define COLUMN_FRAMERATE (COLUMN_FLAGS + 1)
+#define COLUMN_REALTIME (COLUMN_FRAMERATE + 2)
+#define COLUMN_COUNT (COLUMN_REALTIME + 2)
+
+/* Header of the binary inputs file, followed by the size of each column and
+ * the columns */
+struct InputsBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t frame_count;
+    uint64_t text_hash;
+    uint32_t column_count;
+    uint32_t reserved;
+};
+
+static const char inputs_binary_magic[4] = {'L', 'T', 'I', 'B'};
+
+/* Get the values of all columns of a frame */
+static void getColumns(const AllInputs& ai, int64_t* values)
+{
+    for (int k = 0; k < AllInputs::MAXKEYS; k++)
+        values[COLUMN_KEYBOARD + k] = ai.keyboard[k];
+
+    values[COLUMN_POINTER] = ai.pointer_x;
+    values[COLUMN_POINTER + 1] = ai.pointer_y;
+    values[COLUMN_POINTER + 2] = ai.pointer_mode;
+    values[COLUMN_POINTER + 3] = ai.pointer_mask;
+
+    for (int j = 0; j < AllInputs::MAXJOYS; j++) {
+        for (int a = 0; a < AllInputs::MAXAXES; a++)
+            values[COLUMN_AXES + j*AllInputs::MAXAXES + a] = ai.controller_axes[j][a];
+        values[COLUMN_BUTTONS + j] = ai.controller_buttons[j];
+    }
+
+    values[COLUMN_FLAGS] = ai.flags;
+    values[COLUMN_FRAMERATE] = ai.framerate_num;
+    values[COLUMN_FRAMERATE + 1] = ai.framerate_den;
+    values[COLUMN_REALTIME] = ai.realtime_sec;
+    values[COLUMN_REALTIME + 1] = ai.realtime_nsec;
+}
+
+/* Set a frame from the values of all columns */
+static void setColumns(AllInputs& ai, const int64_t* values)
+{
+    for (int k = 0; k < AllInputs::MAXKEYS; k++)
+        ai.keyboard[k] = values[COLUMN_KEYBOARD + k];
+
+    ai.pointer_x = values[COLUMN_POINTER];
+    ai.pointer_y = values[COLUMN_POINTER + 1];
+    ai.pointer_mode = values[COLUMN_POINTER + 2];
+    ai.pointer_mask = values[COLUMN_POINTER + 3];
+
+    for (int j = 0; j < AllInputs::MAXJOYS; j++) {
+        for (int a = 0; a < AllInputs::MAXAXES; a++)
+            ai.controller_axes[j][a] = values[COLUMN_AXES + j*AllInputs::MAXAXES + a];
+        ai.controller_buttons[j] = values[COLUMN_BUTTONS + j];
+    }
+
+    ai.flags = values[COLUMN_FLAGS];
+    ai.framerate_num = values[COLUMN_FRAMERATE];
+    ai.framerate_den = values[COLUMN_FRAMERATE + 1];
+    ai.realtime_sec = values[COLUMN_REALTIME];
+    ai.realtime_nsec = values[COLUMN_REALTIME + 1];
+}
+
+static void writeVarint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+/* Read a varint, returns false if it goes past the end */
+static bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; (in < end) && (shift < 64); shift += 7) {
+        uint8_t b = *in++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* Encoder of a column, as runs of (length, difference with the previous
+ * frame) */
+struct ColumnEncoder {
+    std::vector<uint8_t> data;
+    int64_t previous = 0;
+    int64_t delta = 0;
+    uint64_t run = 0;
+
+    void flush()
+    {
+        if (run == 0)
+            return;
+        writeVarint(data, run);
+        /* Zigzag encoding of the signed difference */
+        writeVarint(data, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    }
+
+    void add(int64_t value)
+    {
+        int64_t d = value - previous;
+        previous = value;
+        if ((run > 0) && (d == delta)) {
+            run++;
+            return;
+        }
+        flush();
+        delta = d;
+        run = 1;
+    }
+};
+
+/* Decoder of a column */
+struct ColumnDecoder {
+    const uint8_t* data;
+    const uint8_t* end;
+    int64_t value = 0;
+    int64_t delta = 0;
+    uint64_t run = 0;
+
+    bool next()
+    {
+        if (run == 0) {
+            uint64_t zigzag;
+            if (!readVarint(data, end, run) || !readVarint(data, end, zigzag) || (run == 0))
+                return false;
+            delta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        }
+        value += delta;
+        run--;
+        return true;
+    }
+};
+
+void MovieFileInputsBinary::save(std::string& data, const InputList& input_list, uint64_t text_hash, std::function<void(AllInputs&)> normalize)
+{
+    std::vector<ColumnEncoder> columns(COLUMN_COUNT);
+    int64_t values[COLUMN_COUNT];
+
+    for (const AllInputs& inputs : input_list) {
+        AllInputs ai = inputs;
+        normalize(ai);
+        getColumns(ai, values);
+        for (int c = 0; c < COLUMN_COUNT; c++)
+            columns[c].add(values[c]);
+    }
+
+    InputsBinaryHeader header;
+    memcpy(header.magic, inputs_binary_magic, 4);
+    header.version = 1;
+    header.frame_count = input_list.size();
+    header.text_hash = text_hash;
+    header.column_count = COLUMN_COUNT;
+    header.reserved = 0;
+
+    data.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (ColumnEncoder& column : columns) {
+        column.flush();
+        uint64_t size = column.data.size();
+        data.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    }
+    for (const ColumnEncoder& column : columns)
+        data.append(reinterpret_cast<const char*>(column.data.data()), column.data.size());
+}
+
+bool MovieFileInputsBinary::load(const char* buffer, size_t file_size, InputList& input_list, uint64_t& text_hash)
+{
+    if (file_size < sizeof(InputsBinaryHeader))
+        return false;
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer);
+    const uint8_t* end = data + file_size;
+
+    InputsBinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    /* Columns added by later versions are ignored */
+    size_t tables_size = sizeof(header) + static_cast<size_t>(header.column_count) * sizeof(uint64_t);
+    if ((memcmp(header.magic, inputs_binary_magic, 4) != 0) || (header.version != 1) ||
+        (header.column_count < COLUMN_COUNT) || (header.column_count >= 4096) || (tables_size > file_size))
+        return false;
+
+    std::vector<ColumnDecoder> columns(COLUMN_COUNT);
+    const uint8_t* column_data = data + tables_size;
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        uint64_t size;
+        memcpy(&size, data + sizeof(header) + c * sizeof(uint64_t), sizeof(size));
+        if (size > static_cast<uint64_t>(end - column_data))
+            return false;
+        columns[c].data = column_data;
+        columns[c].end = column_data + size;
+        column_data += size;
+    }
+
+    input_list.clear();
+    int64_t values[COLUMN_COUNT];
+    AllInputs ai;
+    for (uint64_t f = 0; f < header.frame_count; f++) {
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            if (!columns[c].next()) {
+                input_list.clear();
+                return false;
+            }
+            values[c] = columns[c].value;
+        }
+        setColumns(ai, values);
+        input_list.push_back(ai);
+    }
+
+    text_hash = header.text_hash;
+    return true;
+}
+
+bool MovieFileInputsBinary::load(const std::string& path, InputList& input_list, uint64_t& text_hash)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+
+    size_t file_size = st.st_size;
+    void* map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    bool ok = load(static_cast<const char*>(map), file_size, input_list, text_hash);
+    munmap(map, file_size);
+
+    if (!ok)
+        std::cerr << "The binary inputs " << path << " are invalid" << std::endl;
+    return ok;
+}
+
+uint64_t MovieFileInputsBinary::hash(const char* data, size_t size, uint64_t h)
+{
+    /* FNV-1a */
+    for (size_t i = 0; i < size; i++) {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
@@ -0,0 +1,52 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MOVIEFILEINPUTSBINARY_H_INCLUDED
+#define LIBTAS_MOVIEFILEINPUTSBINARY_H_INCLUDED
+
+#include "InputList.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+/* Binary encoding of the movie inputs, stored next to the text inputs in
+ * the movie file. Each field of AllInputs is a column, that is stored as
+ * runs of identical differences between consecutive frames, so that inputs
+ * that are constant or change linearly take a few bytes for the whole
+ * movie. The file also stores the hash of the text inputs that were saved
+ * with it, to detect if the text inputs were modified by another program. */
+class MovieFileInputsBinary {
+public:
+    /* Encode the inputs into a buffer. Each frame is first passed to
+     * `normalize`, so that it contains the same values as the text inputs. */
+    static void save(std::string& data, const InputList& input_list, uint64_t text_hash, std::function<void(AllInputs&)> normalize);
+
+    /* Decode the inputs from a buffer. Returns if it succeeded. */
+    static bool load(const char* data, size_t size, InputList& input_list, uint64_t& text_hash);
+
+    /* Decode the inputs from a file. Returns if it succeeded. */
+    static bool load(const std::string& path, InputList& input_list, uint64_t& text_hash);
+
+    /* Hash of the text inputs. The hash of a previous buffer can be passed
+     * to hash several buffers in a row. */
+    static uint64_t hash(const char* data, size_t size, uint64_t h = 0xcbf29ce484222325ull);
+};
+
+#endif
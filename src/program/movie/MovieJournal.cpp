@@ -0,0 +1,313 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MovieJournal.h"
+#include "MovieFileInputsBinary.h"
+#include "MovieArchive.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+/* Header of the journal file, followed by the movie and base paths */
+struct JournalHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t frame_size;
+    uint32_t movie_length;
+    uint32_t base_length;
+    uint32_t reserved;
+    uint64_t base_hash;
+};
+
+/* Header of a change, followed by the inserted frames. The change removes
+ * `remove_count` frames at `start` and inserts `insert_count` frames. */
+struct JournalRecord {
+    uint64_t start;
+    uint64_t remove_count;
+    uint64_t insert_count;
+    uint64_t checksum;
+};
+
+static const char journal_magic[4] = {'L', 'T', 'J', 'N'};
+
+MovieJournal::~MovieJournal()
+{
+    if (file)
+        fclose(file);
+}
+
+bool MovieJournal::create(const std::string& base, uint64_t base_hash)
+{
+    if (file)
+        fclose(file);
+
+    /* Write into a temporary file, so that the previous journal stays valid
+     * until the new one is complete */
+    std::string temp_path = path + ".tmp";
+    file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Could not create movie journal " << path << std::endl;
+        return false;
+    }
+
+    JournalHeader header;
+    memcpy(header.magic, journal_magic, 4);
+    header.version = 1;
+    header.frame_size = sizeof(AllInputs);
+    header.movie_length = movie.size();
+    header.base_length = base.size();
+    header.reserved = 0;
+    header.base_hash = base_hash;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(movie.data(), 1, movie.size(), file);
+    fwrite(base.data(), 1, base.size(), file);
+    file_size = sizeof(header) + movie.size() + base.size();
+
+    if ((fflush(file) != 0) || (rename(temp_path.c_str(), path.c_str()) != 0)) {
+        std::cerr << "Could not create movie journal " << path << std::endl;
+        fclose(file);
+        file = nullptr;
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool MovieJournal::start(const std::string& p, const std::string& m, const std::string& base, uint64_t base_hash, const InputList& inputs)
+{
+    path = p;
+    movie = m;
+    rebase_pending = false;
+    rebase_snapshot.clear();
+    snapshot = inputs;
+    return create(base, base_hash);
+}
+
+int64_t MovieJournal::flush(const InputList& inputs)
+{
+    if (!file)
+        return -1;
+
+    /* Start a journal based on the new base movie once it is written. If it
+     * could not be written, keep the current journal, so that a new base
+     * movie is saved again. */
+    if (rebase_pending) {
+        int ret = MovieArchive::backgroundResult(rebase_path);
+        if (ret <= 0) {
+            rebase_pending = false;
+            if (ret == 0) {
+                snapshot = rebase_snapshot;
+                rebase_snapshot.clear();
+                if (!create(rebase_path, rebase_hash))
+                    return -1;
+            }
+            else {
+                std::cerr << "Could not write base movie " << rebase_path << " of the movie journal" << std::endl;
+                rebase_snapshot.clear();
+            }
+        }
+    }
+
+    /* Find the range of frames that changed. Shared chunks of inputs are
+     * skipped without being compared. */
+    uint64_t prefix = inputs.commonPrefix(snapshot, UINT64_MAX);
+    uint64_t suffix = inputs.commonSuffix(snapshot, std::min(inputs.size(), snapshot.size()) - prefix);
+    uint64_t old_end = snapshot.size() - suffix;
+    uint64_t new_end = inputs.size() - suffix;
+
+    /* Inside this range, frames that were modified in place are written as
+     * separate changes, so that editing a frame while appending others does
+     * not write all the frames in between. */
+    int64_t written = 0;
+    uint64_t pos = prefix;
+    uint64_t aligned_end = std::min(old_end, new_end);
+    while (pos < aligned_end) {
+        uint64_t count = 0;
+        while ((pos + count < aligned_end) && !(inputs[pos + count] == snapshot[pos + count]))
+            count++;
+
+        if (count > 0) {
+            if (!writeRecord(inputs, pos, count, count))
+                return -1;
+            written += sizeof(JournalRecord) + count * sizeof(AllInputs);
+            pos += count;
+        }
+
+        pos += inputs.commonPrefix(snapshot, aligned_end - pos, pos);
+    }
+
+    /* Then frames that were inserted or removed */
+    if (new_end != old_end) {
+        uint64_t insert_count = (new_end > old_end) ? (new_end - old_end) : 0;
+        uint64_t remove_count = (old_end > new_end) ? (old_end - new_end) : 0;
+        if (!writeRecord(inputs, aligned_end, remove_count, insert_count))
+            return -1;
+        written += sizeof(JournalRecord) + insert_count * sizeof(AllInputs);
+    }
+
+    if (written == 0)
+        return 0;
+
+    if (fflush(file) != 0) {
+        std::cerr << "Could not write movie journal " << path << std::endl;
+        return -1;
+    }
+
+    file_size += written;
+    snapshot = inputs;
+    return written;
+}
+
+bool MovieJournal::writeRecord(const InputList& inputs, uint64_t start, uint64_t remove_count, uint64_t insert_count)
+{
+    JournalRecord record;
+    record.start = start;
+    record.remove_count = remove_count;
+    record.insert_count = insert_count;
+
+    record.checksum = MovieFileInputsBinary::hash(reinterpret_cast<const char*>(&record), offsetof(JournalRecord, checksum));
+    for (uint64_t f = 0; f < insert_count; f++)
+        record.checksum = MovieFileInputsBinary::hash(reinterpret_cast<const char*>(&inputs[start + f]), sizeof(AllInputs), record.checksum);
+
+    if (fwrite(&record, sizeof(record), 1, file) != 1) {
+        std::cerr << "Could not write movie journal " << path << std::endl;
+        return false;
+    }
+    for (uint64_t f = 0; f < insert_count; f++) {
+        if (fwrite(&inputs[start + f], sizeof(AllInputs), 1, file) != 1) {
+            std::cerr << "Could not write movie journal " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void MovieJournal::rebase(const std::string& base, uint64_t base_hash, const InputList& inputs)
+{
+    rebase_pending = true;
+    rebase_path = base;
+    rebase_hash = base_hash;
+    rebase_snapshot = inputs;
+}
+
+void MovieJournal::remove()
+{
+    if (!file)
+        return;
+
+    fclose(file);
+    file = nullptr;
+    unlink(path.c_str());
+    snapshot.clear();
+    rebase_pending = false;
+    rebase_snapshot.clear();
+}
+
+bool MovieJournal::readInfo(const std::string& path, Info& info)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+        return false;
+
+    JournalHeader header;
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!stream || (memcmp(header.magic, journal_magic, 4) != 0) || (header.version != 1) ||
+        (header.frame_size != sizeof(AllInputs)) || (header.movie_length > 4096) || (header.base_length > 4096))
+        return false;
+
+    info.movie.resize(header.movie_length);
+    info.base.resize(header.base_length);
+    stream.read(&info.movie[0], header.movie_length);
+    stream.read(&info.base[0], header.base_length);
+    if (!stream)
+        return false;
+
+    info.base_hash = header.base_hash;
+    info.has_records = (stream.peek() != std::ifstream::traits_type::eof());
+    return true;
+}
+
+int MovieJournal::replay(const std::string& path, InputList& inputs)
+{
+    Info info;
+    if (!readInfo(path, info))
+        return -1;
+
+    std::ifstream stream(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    size_t pos = sizeof(JournalHeader) + info.movie.size() + info.base.size();
+
+    int count = 0;
+    std::vector<AllInputs> frames;
+    while (pos + sizeof(JournalRecord) <= data.size()) {
+        JournalRecord record;
+        memcpy(&record, &data[pos], sizeof(record));
+        pos += sizeof(record);
+
+        /* Check that the change was completely written */
+        if ((record.insert_count > (data.size() - pos) / sizeof(AllInputs)) ||
+            (record.start > inputs.size()) || (record.remove_count > inputs.size() - record.start))
+            break;
+
+        uint64_t checksum = MovieFileInputsBinary::hash(reinterpret_cast<const char*>(&record), offsetof(JournalRecord, checksum));
+        checksum = MovieFileInputsBinary::hash(&data[pos], record.insert_count * sizeof(AllInputs), checksum);
+        if (checksum != record.checksum)
+            break;
+
+        frames.resize(record.insert_count);
+        memcpy(frames.data(), &data[pos], record.insert_count * sizeof(AllInputs));
+        pos += record.insert_count * sizeof(AllInputs);
+
+        /* Overwrite the frames present in both ranges, then remove or insert
+         * the remaining ones */
+        uint64_t common = std::min(record.remove_count, record.insert_count);
+        for (uint64_t f = 0; f < common; f++)
+            inputs.edit(record.start + f) = frames[f];
+
+        uint64_t end = record.start + common;
+        if (record.remove_count > common) {
+            if ((record.start + record.remove_count) == inputs.size())
+                inputs.truncate(end);
+            else
+                for (uint64_t f = common; f < record.remove_count; f++)
+                    inputs.erase(end);
+        }
+        else if (end == inputs.size()) {
+            for (uint64_t f = common; f < record.insert_count; f++)
+                inputs.push_back(frames[f]);
+        }
+        else {
+            for (uint64_t f = common; f < record.insert_count; f++)
+                inputs.insert(record.start + f, frames[f]);
+        }
+
+        count++;
+    }
+
+    return count;
+}
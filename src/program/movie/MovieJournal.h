@@ -0,0 +1,110 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MOVIEJOURNAL_H_INCLUDED
+#define LIBTAS_MOVIEJOURNAL_H_INCLUDED
+
+#include "InputList.h"
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+/* Append-only journal of the changes made to the inputs of a movie since it
+ * was last written in full. Each record replaces a range of frames by new
+ * frames, so writing the journal costs the size of the changes instead of
+ * the length of the movie. If the program did not exit properly, the journal
+ * can be replayed over the movie it is based on to recover the inputs. */
+class MovieJournal {
+public:
+    /* Header of a journal file */
+    struct Info {
+        /* Movie the journal belongs to */
+        std::string movie;
+
+        /* Movie file containing the inputs the journal is based on, or empty
+         * if it is based on an empty movie */
+        std::string base;
+
+        /* Hash of the inputs of the base movie */
+        uint64_t base_hash;
+
+        /* If the journal contains changes */
+        bool has_records;
+    };
+
+    ~MovieJournal();
+
+    /* Start a new journal at `path`, for inputs equal to the base movie */
+    bool start(const std::string& path, const std::string& movie, const std::string& base, uint64_t base_hash, const InputList& inputs);
+
+    /* Append the changes of the inputs since the last flush.
+     * Returns the number of bytes written, or -1 if an error occured */
+    int64_t flush(const InputList& inputs);
+
+    /* Indicate that the inputs are being written into a new base movie in
+     * the background. A new journal based on it is started at the first flush
+     * after the file was written, or the current journal is kept if the file
+     * could not be written. */
+    void rebase(const std::string& base, uint64_t base_hash, const InputList& inputs);
+
+    /* Stop and delete the journal */
+    void remove();
+
+    /* If a journal is being written */
+    bool active() const {return file != nullptr;}
+
+    /* Size of the journal in bytes */
+    uint64_t size() const {return file_size;}
+
+    /* If a new base movie is being written */
+    bool rebasing() const {return rebase_pending;}
+
+    /* Read the header of a journal file */
+    static bool readInfo(const std::string& path, Info& info);
+
+    /* Apply the changes of a journal file to the inputs of its base movie.
+     * Stops at the first incomplete change, which can happen if the program
+     * crashed while writing it.
+     * Returns the number of changes applied, or -1 if an error occured */
+    static int replay(const std::string& path, InputList& inputs);
+
+private:
+    std::string path;
+    std::string movie;
+    FILE* file = nullptr;
+    uint64_t file_size = 0;
+
+    /* Inputs at the last flush */
+    InputList snapshot;
+
+    /* Pending base movie */
+    bool rebase_pending = false;
+    std::string rebase_path;
+    uint64_t rebase_hash;
+    InputList rebase_snapshot;
+
+    /* Write the journal header into a new file */
+    bool create(const std::string& base, uint64_t base_hash);
+
+    /* Write a change replacing `remove_count` frames at `start` by
+     * `insert_count` frames of inputs at the same position */
+    bool writeRecord(const InputList& inputs, uint64_t start, uint64_t remove_count, uint64_t insert_count);
+};
+
+#endif
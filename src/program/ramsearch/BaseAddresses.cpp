@@ -41,7 +41,7 @@
 // static task_t task;
 // #endif
 
-static std::map<std::string,std::pair<uintptr_t, uintptr_t>> library_addresses;
+static BaseAddresses::AddressTable library_addresses;
 
 void BaseAddresses::load()
 {
@@ -132,7 +132,12 @@ std::string BaseAddresses::getFileAndOffset(uintptr_t addr, off_t &offset)
     if (library_addresses.empty())
         load();
 
-    for (const auto& it : library_addresses) {
+    return getFileAndOffset(library_addresses, addr, offset);
+}
+
+std::string BaseAddresses::getFileAndOffset(const AddressTable& table, uintptr_t addr, off_t &offset)
+{
+    for (const auto& it : table) {
         if ((addr >= it.second.first) && (addr < it.second.second)) {
             /* Found a matching section */        
             /* For stack, save the negative offset from the end */
@@ -148,3 +153,11 @@ std::string BaseAddresses::getFileAndOffset(uintptr_t addr, off_t &offset)
     offset = 0;
     return "";
 }
+
+const BaseAddresses::AddressTable& BaseAddresses::getAddressTable()
+{
+    if (library_addresses.empty())
+        load();
+
+    return library_addresses;
+}
@@ -23,11 +23,16 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <string>
+#include <map>
+#include <utility>
 #include <cstdint>
 
 /* Holds the base address for executable and each loaded library */
 namespace BaseAddresses {
 
+    /* Base and end addresses of each file */
+    typedef std::map<std::string,std::pair<uintptr_t, uintptr_t>> AddressTable;
+
     /* Query all loaded libraries and executable, and store base and end addresses */
     void load();
 
@@ -39,6 +44,12 @@ namespace BaseAddresses {
 
     /* Get the file and offset from an address */
     std::string getFileAndOffset(uintptr_t addr, off_t &offset);
+
+    /* Get the file and offset from an address, using another table of files */
+    std::string getFileAndOffset(const AddressTable& table, uintptr_t addr, off_t &offset);
+
+    /* Return the table of all loaded files */
+    const AddressTable& getAddressTable();
 }
 
 #endif
@@ -21,6 +21,7 @@
 #include "TypeIndex.h"
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <inttypes.h>
 
 typedef union {
@@ -40,78 +41,143 @@ typedef union {
 static value_t compare_value;
 static value_t different_value;
 
-typedef bool (*compare_t)(const value_t*);
-static compare_t compare_method;
-
 static int value_type;
 
-#define DEFINE_CHECK_TYPED(T) \
-static bool check_equal_##T(const value_t* value) \
-{\
-    return value->v_##T == compare_value.v_##T;\
-}\
-static bool check_notequal_##T(const value_t* value) \
-{\
-    return value->v_##T != compare_value.v_##T;\
-}\
-static bool check_less_##T(const value_t* value) \
-{\
-    return value->v_##T < compare_value.v_##T;\
-}\
-static bool check_greater_##T(const value_t* value) \
-{\
-    return value->v_##T > compare_value.v_##T;\
-}\
-static bool check_lessequal_##T(const value_t* value) \
-{\
-    return value->v_##T <= compare_value.v_##T;\
-}\
-static bool check_greaterequal_##T(const value_t* value) \
-{\
-    return value->v_##T>= compare_value.v_##T;\
-}\
-static bool check_different_##T(const value_t* value) \
-{\
-    return (value->v_##T - compare_value.v_##T) == different_value.v_##T;\
-}\
-
-DEFINE_CHECK_TYPED(int8_t)
-DEFINE_CHECK_TYPED(uint8_t)
-DEFINE_CHECK_TYPED(int16_t)
-DEFINE_CHECK_TYPED(uint16_t)
-DEFINE_CHECK_TYPED(int32_t)
-DEFINE_CHECK_TYPED(uint32_t)
-DEFINE_CHECK_TYPED(int64_t)
-DEFINE_CHECK_TYPED(uint64_t)
-DEFINE_CHECK_TYPED(float)
-DEFINE_CHECK_TYPED(double)
-
-#define DEFINE_COMPARE_METHOD_TYPED(T) \
-compare_value.v_##T = static_cast<T>(compare_value_db);\
-different_value.v_##T = static_cast<T>(different_value_db);\
-switch(compare_operator) {\
-    case CompareOperator::Equal:\
-        compare_method = &check_equal_##T;\
-        break;\
-    case CompareOperator::NotEqual:\
-        compare_method = &check_notequal_##T;\
-        break;\
-    case CompareOperator::Less:\
-        compare_method = &check_less_##T;\
-        break;\
-    case CompareOperator::Greater:\
-        compare_method = &check_greater_##T;\
-        break;\
-    case CompareOperator::LessEqual:\
-        compare_method = &check_lessequal_##T;\
-        break;\
-    case CompareOperator::GreaterEqual:\
-        compare_method = &check_greaterequal_##T;\
-        break;\
-    case CompareOperator::Different:\
-        compare_method = &check_different_##T;\
-        break;\
-}\
+#if defined(__x86_64__) || defined(__i386__)
+#define COMPARE_X86
+#endif
+
+/* Comparison operators. `c` is the stored constant value or the old value,
+ * and `d` is the stored different value */
+template <typename T> struct OpEqual {
+    static inline bool check(T v, T c, T d) {return v == c;}
+};
+template <typename T> struct OpNotEqual {
+    static inline bool check(T v, T c, T d) {return v != c;}
+};
+template <typename T> struct OpLess {
+    static inline bool check(T v, T c, T d) {return v < c;}
+};
+template <typename T> struct OpGreater {
+    static inline bool check(T v, T c, T d) {return v > c;}
+};
+template <typename T> struct OpLessEqual {
+    static inline bool check(T v, T c, T d) {return v <= c;}
+};
+template <typename T> struct OpGreaterEqual {
+    static inline bool check(T v, T c, T d) {return v >= c;}
+};
+template <typename T> struct OpDifferent {
+    static inline bool check(T v, T c, T d) {return (v - c) == d;}
+};
+
+/* Compare a chunk of values and fill the match mask. Values are processed by
+ * blocks of 64 with a fixed trip count, so that the compiler turns the
+ * comparison into vector instructions, and the results are then packed into
+ * one mask word. If `old_values` is null, values are compared to the stored
+ * constant value. */
+template <typename T, template <typename> class Op>
+__attribute__((always_inline))
+static inline int compare_chunk_body(const void* values, const void* old_values, int count, uint64_t* mask)
+{
+    const T* v = static_cast<const T*>(values);
+    const T* o = static_cast<const T*>(old_values);
+    T c, d;
+    memcpy(&c, &compare_value, sizeof(T));
+    memcpy(&d, &different_value, sizeof(T));
+
+    int matches = 0;
+    int b = 0;
+    for (; b + 64 <= count; b += 64) {
+        uint8_t res[64];
+        if (o) {
+            for (int j = 0; j < 64; j++)
+                res[j] = Op<T>::check(v[b+j], o[b+j], d);
+        }
+        else {
+            for (int j = 0; j < 64; j++)
+                res[j] = Op<T>::check(v[b+j], c, d);
+        }
+        uint64_t m = 0;
+        for (int j = 0; j < 64; j++)
+            m |= static_cast<uint64_t>(res[j]) << j;
+        mask[b/64] = m;
+        matches += __builtin_popcountll(m);
+    }
+
+    /* Remaining values */
+    if (b < count) {
+        uint64_t m = 0;
+        for (int j = 0; b + j < count; j++)
+            if (Op<T>::check(v[b+j], o ? o[b+j] : c, d))
+                m |= static_cast<uint64_t>(1) << j;
+        mask[b/64] = m;
+        matches += __builtin_popcountll(m);
+    }
+    return matches;
+}
+
+template <typename T, template <typename> class Op>
+static int compare_chunk(const void* values, const void* old_values, int count, uint64_t* mask)
+{
+    return compare_chunk_body<T, Op>(values, old_values, count, mask);
+}
+
+#ifdef COMPARE_X86
+template <typename T, template <typename> class Op>
+__attribute__((target("avx2")))
+static int compare_chunk_avx2(const void* values, const void* old_values, int count, uint64_t* mask)
+{
+    return compare_chunk_body<T, Op>(values, old_values, count, mask);
+}
+#endif
+
+typedef int (*compare_chunk_t)(const void*, const void*, int, uint64_t*);
+static compare_chunk_t compare_method;
+
+template <typename T, template <typename> class Op>
+static compare_chunk_t select_kernel()
+{
+#ifdef COMPARE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &compare_chunk_avx2<T, Op>;
+#endif
+    return &compare_chunk<T, Op>;
+}
+
+template <typename T>
+static void init_typed(CompareOperator compare_operator, double compare_value_db, double different_value_db)
+{
+    T c = static_cast<T>(compare_value_db);
+    T d = static_cast<T>(different_value_db);
+    memcpy(&compare_value, &c, sizeof(T));
+    memcpy(&different_value, &d, sizeof(T));
+
+    switch(compare_operator) {
+        case CompareOperator::Equal:
+            compare_method = select_kernel<T, OpEqual>();
+            break;
+        case CompareOperator::NotEqual:
+            compare_method = select_kernel<T, OpNotEqual>();
+            break;
+        case CompareOperator::Less:
+            compare_method = select_kernel<T, OpLess>();
+            break;
+        case CompareOperator::Greater:
+            compare_method = select_kernel<T, OpGreater>();
+            break;
+        case CompareOperator::LessEqual:
+            compare_method = select_kernel<T, OpLessEqual>();
+            break;
+        case CompareOperator::GreaterEqual:
+            compare_method = select_kernel<T, OpGreaterEqual>();
+            break;
+        case CompareOperator::Different:
+            compare_method = select_kernel<T, OpDifferent>();
+            break;
+    }
+}
 
 void CompareOperations::init(int vt, CompareOperator compare_operator, double compare_value_db, double different_value_db)
 {
@@ -120,47 +186,58 @@ void CompareOperations::init(int vt, CompareOperator compare_operator, double co
     /* Initialize the comparaison method and values */
     switch(value_type) {
         case RamChar:
-            DEFINE_COMPARE_METHOD_TYPED(int8_t)
+            init_typed<int8_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamUnsignedChar:
-            DEFINE_COMPARE_METHOD_TYPED(uint8_t)
+            init_typed<uint8_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamShort:
-            DEFINE_COMPARE_METHOD_TYPED(int16_t)
+            init_typed<int16_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamUnsignedShort:
-            DEFINE_COMPARE_METHOD_TYPED(uint16_t)
+            init_typed<uint16_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamInt:
-            DEFINE_COMPARE_METHOD_TYPED(int32_t)
+            init_typed<int32_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamUnsignedInt:
-            DEFINE_COMPARE_METHOD_TYPED(uint32_t)
+            init_typed<uint32_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamLong:
-            DEFINE_COMPARE_METHOD_TYPED(int64_t)
+            init_typed<int64_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamUnsignedLong:
-            DEFINE_COMPARE_METHOD_TYPED(uint64_t)
+            init_typed<uint64_t>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamFloat:
-            DEFINE_COMPARE_METHOD_TYPED(float)
+            init_typed<float>(compare_operator, compare_value_db, different_value_db);
             break;
         case RamDouble:
-            DEFINE_COMPARE_METHOD_TYPED(double)
+            init_typed<double>(compare_operator, compare_value_db, different_value_db);
             break;
     }
 }
 
 bool CompareOperations::check_value(const void* value)
 {
-    return compare_method(static_cast<const value_t*>(value));
+    uint64_t mask;
+    return compare_method(value, nullptr, 1, &mask);
 }
 
 bool CompareOperations::check_previous(const void* value, const void* old_value)
 {
-    compare_value = *static_cast<const value_t*>(old_value);
-    return compare_method(static_cast<const value_t*>(value));
+    uint64_t mask;
+    return compare_method(value, old_value, 1, &mask);
+}
+
+int CompareOperations::check_value_chunk(const void* values, int count, uint64_t* mask)
+{
+    return compare_method(values, nullptr, count, mask);
+}
+
+int CompareOperations::check_previous_chunk(const void* values, const void* old_values, int count, uint64_t* mask)
+{
+    return compare_method(values, old_values, count, mask);
 }
 
 const char* CompareOperations::tostring(const void* value, bool hex)
@@ -47,6 +47,14 @@ namespace CompareOperations {
 
     /* Compute the comparaison between the content of value and the old value */
     bool check_previous(const void* value, const void* old_value);
+
+    /* Compare a chunk of `count` contiguous values with the stored constant
+     * value, and set the bit i of the match mask if value i matches. The mask
+     * must hold (count+63)/64 words. Returns the number of matches. */
+    int check_value_chunk(const void* values, int count, uint64_t* mask);
+
+    /* Same as above, comparing each value with the corresponding old value */
+    int check_previous_chunk(const void* values, const void* old_values, int count, uint64_t* mask);
     
     /* Format a value to be shown */
     const char* tostring(const void* value, bool hex);
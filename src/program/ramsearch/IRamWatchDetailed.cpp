@@ -28,6 +28,8 @@
 #include <iostream>
 
 bool IRamWatchDetailed::isValid;
+std::atomic<uint64_t> IRamWatchDetailed::generation(1);
+std::mutex IRamWatchDetailed::mutex;
 
 void IRamWatchDetailed::update_addr()
 {
@@ -51,7 +53,7 @@ void IRamWatchDetailed::update_addr()
         int i=0;
         for (auto offset : pointer_offsets) {
             uintptr_t next_address;
-            isValid = (MemAccess::read(&next_address, reinterpret_cast<void*>(address), sizeof(uintptr_t)) == sizeof(uintptr_t));
+            isValid = (MemAccess::read(&next_address, reinterpret_cast<void*>(address), sizeof(uintptr_t), true) == sizeof(uintptr_t));
             if (isValid)
                 pointer_addresses[i++] = next_address;
             else
@@ -62,3 +64,84 @@ void IRamWatchDetailed::update_addr()
     }
 
 }
+
+void IRamWatchDetailed::invalidate_all()
+{
+    generation++;
+}
+
+void IRamWatchDetailed::update_all(std::vector<std::unique_ptr<IRamWatchDetailed>>& watches)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t current_generation = generation;
+
+    std::vector<MemAccess::ReadRequest> requests;
+    std::vector<IRamWatchDetailed*> requested;
+    std::vector<uintptr_t> next_addresses(watches.size());
+
+    /* Start pointer chains from their base address */
+    size_t max_depth = 0;
+    for (auto& watch : watches) {
+        watch->cached_generation = current_generation;
+        watch->cached_valid = true;
+        if (!watch->isPointer)
+            continue;
+
+        if (!watch->base_address) {
+            if (watch->base_file.empty())
+                watch->base_address = watch->base_file_offset;
+            else
+                watch->base_address = BaseAddresses::getBaseAddress(watch->base_file) + watch->base_file_offset;
+        }
+        watch->pointer_addresses.assign(watch->pointer_offsets.size(), 0);
+        watch->address = watch->base_address;
+        if (watch->pointer_offsets.size() > max_depth)
+            max_depth = watch->pointer_offsets.size();
+    }
+
+    /* Follow all pointer chains one level at a time */
+    for (size_t level = 0; level < max_depth; level++) {
+        requests.clear();
+        requested.clear();
+        for (auto& watch : watches) {
+            if (!watch->isPointer || !watch->cached_valid || (level >= watch->pointer_offsets.size()))
+                continue;
+            MemAccess::ReadRequest req;
+            req.local_addr = &next_addresses[requests.size()];
+            req.remote_addr = watch->address;
+            req.size = sizeof(uintptr_t);
+            requests.push_back(req);
+            requested.push_back(watch.get());
+        }
+
+        MemAccess::readBatch(requests.data(), requests.size(), true);
+
+        for (size_t r = 0; r < requests.size(); r++) {
+            IRamWatchDetailed* watch = requested[r];
+            watch->cached_valid = requests[r].valid;
+            if (watch->cached_valid) {
+                watch->pointer_addresses[level] = next_addresses[r];
+                watch->address = next_addresses[r] + watch->pointer_offsets[level];
+            }
+        }
+    }
+
+    /* Read all values */
+    requests.clear();
+    requested.clear();
+    for (auto& watch : watches) {
+        if (!watch->cached_valid)
+            continue;
+        MemAccess::ReadRequest req;
+        req.local_addr = watch->cached_value;
+        req.remote_addr = watch->address;
+        req.size = watch->value_size();
+        requests.push_back(req);
+        requested.push_back(watch.get());
+    }
+
+    MemAccess::readBatch(requests.data(), requests.size(), true);
+
+    for (size_t r = 0; r < requests.size(); r++)
+        requested[r]->cached_valid = requests[r].valid;
+}
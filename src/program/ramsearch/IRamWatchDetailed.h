@@ -23,6 +23,9 @@
 // #include <sys/types.h>
 #include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <cstdint>
 
 
@@ -45,6 +48,18 @@ public:
     /* Returns the index of the stored type */
     virtual int type() = 0;
 
+    /* Returns the size of the stored type */
+    virtual int value_size() = 0;
+
+    /* Resolve the addresses and read the values of all watches, with a few
+     * syscalls for each level of pointer chains. The values are then
+     * returned by value_str() until the next poke or the next call to
+     * invalidate_all(). */
+    static void update_all(std::vector<std::unique_ptr<IRamWatchDetailed>>& watches);
+
+    /* Drop the values read by update_all(), because the game memory changed */
+    static void invalidate_all();
+
     uintptr_t address;
     std::string label;
     bool hex;
@@ -59,6 +74,18 @@ public:
 
     static bool isValid;
 
+    /* Value read by update_all(), used while the generation did not change */
+    uint64_t cached_generation = 0;
+    bool cached_valid;
+    uint8_t cached_value[8];
+
+    /* Incremented each time the game memory changes */
+    static std::atomic<uint64_t> generation;
+
+    /* Watches are read by both the UI thread and the game loop thread, which
+     * sends them to the game */
+    static std::mutex mutex;
+
 };
 
 #endif
@@ -18,11 +18,23 @@
  */
 
 #include "MemAccess.h"
+#include "../../shared/MemoryMirror.h"
 
 #include <stdint.h>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <climits>
 #ifdef __unix__
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #elif defined(__APPLE__) && defined(__MACH__)
 #include <mach/vm_map.h>
 #include <mach/mach_traps.h>
@@ -34,8 +46,121 @@ static task_t task;
 
 static pid_t game_pid;
 
+/* Number of frame boundaries after which a page that is not read anymore
+ * is removed from the mirror */
+#define MIRROR_KEEP_FRAMES 60
+
+static int mirror_fd = -1;
+static const uint8_t* mirror = nullptr;
+static std::atomic<bool> mirror_mapped(false);
+static std::mutex mirror_mutex;
+
+/* Reads can use the mirror */
+static bool mirror_valid = false;
+
+/* Sorted list of mirrored pages, in the order of the mirror */
+static std::vector<uint64_t> mirror_pages;
+
+/* Mirrored pages that we wrote into since the game copied them */
+static std::vector<bool> mirror_stale;
+
+/* Pages read by ram watches and lua scripts, with the number of frame
+ * boundaries since their last read */
+static std::map<uint64_t, int> mirror_uses;
+
+/* Returns the index of a page in the mirror, or -1. Must be called with the
+ * mirror locked, like all functions below. */
+static int mirrorIndex(uint64_t page_addr)
+{
+    auto it = std::lower_bound(mirror_pages.begin(), mirror_pages.end(), page_addr);
+    if ((it == mirror_pages.end()) || (*it != page_addr))
+        return -1;
+    return it - mirror_pages.begin();
+}
+
+/* Copy a range of game memory from the mirror if possible, and register its
+ * page to be mirrored if asked */
+static bool readMirror(void* local_addr, uintptr_t remote_addr, size_t size, bool track)
+{
+    if (!mirror)
+        return false;
+
+    uint64_t page_addr = remote_addr & ~static_cast<uint64_t>(MIRROR_PAGE_SIZE - 1);
+    if ((remote_addr + size) > (page_addr + MIRROR_PAGE_SIZE))
+        return false;
+
+    if (track) {
+        auto it = mirror_uses.find(page_addr);
+        if (it != mirror_uses.end())
+            it->second = 0;
+        else if (mirror_uses.size() < MIRROR_MAX_PAGES)
+            mirror_uses.emplace(page_addr, 0);
+    }
+
+    if (!mirror_valid)
+        return false;
+
+    int index = mirrorIndex(page_addr);
+    if (index < 0)
+        return false;
+
+    const MirrorHeader* header = reinterpret_cast<const MirrorHeader*>(mirror);
+    if ((static_cast<uint32_t>(index) >= header->count) || !header->valid[index] || mirror_stale[index])
+        return false;
+
+    memcpy(local_addr, mirror + MIRROR_HEADER_SIZE + static_cast<size_t>(index) * MIRROR_PAGE_SIZE + (remote_addr - page_addr), size);
+    return true;
+}
+
+/* Mark the mirrored pages of a range that we are writing into */
+static void staleMirror(uintptr_t remote_addr, size_t size)
+{
+    uint64_t page_addr = remote_addr & ~static_cast<uint64_t>(MIRROR_PAGE_SIZE - 1);
+    for (; page_addr < (remote_addr + size); page_addr += MIRROR_PAGE_SIZE) {
+        int index = mirrorIndex(page_addr);
+        if (index >= 0)
+            mirror_stale[index] = true;
+    }
+}
+
+/* Memory image read instead of the game process */
+static std::vector<MemAccess::ImageArea> image_areas;
+
+/* Read a range of the memory image, which may span consecutive areas.
+ * Returns the size that could be read. */
+static size_t readImage(void* local_addr, uintptr_t remote_addr, size_t size)
+{
+    auto it = std::upper_bound(image_areas.begin(), image_areas.end(), remote_addr, [](uintptr_t addr, const MemAccess::ImageArea& area) {
+        return addr < area.addr;
+    });
+    if (it == image_areas.begin())
+        return 0;
+    --it;
+
+    size_t read_size = 0;
+    while ((read_size < size) && (it != image_areas.end()) && (remote_addr >= it->addr) && (remote_addr < (it->addr + it->size))) {
+        size_t len = std::min(size - read_size, static_cast<size_t>(it->addr + it->size - remote_addr));
+        uint8_t* dst = static_cast<uint8_t*>(local_addr) + read_size;
+        if (it->data)
+            memcpy(dst, it->data + (remote_addr - it->addr), len);
+        else
+            memset(dst, 0, len);
+        read_size += len;
+        remote_addr += len;
+        ++it;
+    }
+    return read_size;
+}
+
+void MemAccess::initImage(const std::vector<ImageArea>& areas)
+{
+    image_areas = areas;
+}
+
 void MemAccess::init(pid_t pid)
 {
+    initMirror(-1);
+
 #if defined(__APPLE__) && defined(__MACH__)
     kern_return_t error = task_for_pid(mach_task_self(), pid, &task);
     if (error != KERN_SUCCESS) {
@@ -52,10 +177,19 @@ pid_t MemAccess::getPid()
     return game_pid;
 }
 
-size_t MemAccess::read(void* local_addr, void* remote_addr, size_t size)
+size_t MemAccess::read(void* local_addr, void* remote_addr, size_t size, bool track)
 {
+    if (!image_areas.empty())
+        return readImage(local_addr, reinterpret_cast<uintptr_t>(remote_addr), size);
+
     if (!game_pid)
         return 0;
+
+    if (mirror_mapped) {
+        std::lock_guard<std::mutex> lock(mirror_mutex);
+        if (readMirror(local_addr, reinterpret_cast<uintptr_t>(remote_addr), size, track))
+            return size;
+    }
         
 #ifdef __unix__
     struct iovec local, remote;
@@ -75,11 +209,158 @@ size_t MemAccess::read(void* local_addr, void* remote_addr, size_t size)
 #endif
 }
 
+/* Requests separated by at most this number of bytes are read together */
+#define COALESCE_GAP 64
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+int MemAccess::readBatch(ReadRequest* requests, int count, bool track)
+{
+    for (int r = 0; r < count; r++)
+        requests[r].valid = false;
+
+    if (!image_areas.empty()) {
+        int valid_count = 0;
+        for (int r = 0; r < count; r++) {
+            ReadRequest& req = requests[r];
+            req.valid = (readImage(req.local_addr, req.remote_addr, req.size) == req.size);
+            valid_count += req.valid;
+        }
+        return valid_count;
+    }
+
+    if (!game_pid || (count == 0))
+        return 0;
+
+    /* Read the requests from the mirror if possible */
+    std::vector<int> order;
+    order.reserve(count);
+    int valid_count = 0;
+    if (mirror_mapped) {
+        std::lock_guard<std::mutex> lock(mirror_mutex);
+        for (int r = 0; r < count; r++) {
+            ReadRequest& req = requests[r];
+            if ((req.size > 0) && readMirror(req.local_addr, req.remote_addr, req.size, track)) {
+                req.valid = true;
+                valid_count++;
+            }
+            else {
+                order.push_back(r);
+            }
+        }
+    }
+    else {
+        for (int r = 0; r < count; r++)
+            order.push_back(r);
+    }
+
+#ifdef __unix__
+    /* Sort requests by address, and coalesce them into spans. The memory
+     * between two requests of a span always belongs to a page holding one
+     * of them. */
+    std::sort(order.begin(), order.end(), [requests](int a, int b) {
+        return requests[a].remote_addr < requests[b].remote_addr;
+    });
+
+    struct Span {
+        uintptr_t beg, end;
+        size_t offset; // offset in the local buffer
+        int first, last; // range of requests in order
+    };
+    std::vector<Span> spans;
+    size_t total_size = 0;
+    for (int o = 0; o < static_cast<int>(order.size()); o++) {
+        const ReadRequest& req = requests[order[o]];
+        if (req.size == 0)
+            continue;
+        uintptr_t end = req.remote_addr + req.size;
+        if (!spans.empty() && (req.remote_addr <= spans.back().end + COALESCE_GAP)) {
+            Span& span = spans.back();
+            if (end > span.end) {
+                total_size += end - span.end;
+                span.end = end;
+            }
+            span.last = o;
+        }
+        else {
+            spans.push_back({req.remote_addr, end, total_size, o, o});
+            total_size += req.size;
+        }
+    }
+
+    std::vector<uint8_t> buffer(total_size);
+    std::vector<bool> span_valid(spans.size(), false);
+    std::vector<struct iovec> local(IOV_MAX), remote(IOV_MAX);
+
+    /* Read the spans by groups of IOV_MAX. The syscall stops at the first
+     * span that cannot be read, so we continue after it. */
+    size_t s = 0;
+    while (s < spans.size()) {
+        size_t n = std::min(spans.size() - s, static_cast<size_t>(IOV_MAX));
+        for (size_t i = 0; i < n; i++) {
+            const Span& span = spans[s+i];
+            local[i].iov_base = buffer.data() + span.offset;
+            local[i].iov_len = span.end - span.beg;
+            remote[i].iov_base = reinterpret_cast<void*>(span.beg);
+            remote[i].iov_len = span.end - span.beg;
+        }
+
+        ssize_t ret = process_vm_readv(game_pid, local.data(), n, remote.data(), n, 0);
+        size_t read_size = (ret > 0) ? ret : 0;
+
+        size_t i = 0;
+        for (; i < n; i++) {
+            size_t len = spans[s+i].end - spans[s+i].beg;
+            if (read_size < len)
+                break;
+            span_valid[s+i] = true;
+            read_size -= len;
+        }
+
+        /* Skip the span that could not be read */
+        s += (i < n) ? (i + 1) : n;
+    }
+
+    /* Copy the results, and read the requests of invalid spans one by one */
+    for (size_t sp = 0; sp < spans.size(); sp++) {
+        const Span& span = spans[sp];
+        for (int o = span.first; o <= span.last; o++) {
+            ReadRequest& req = requests[order[o]];
+            if (req.size == 0)
+                continue;
+            if (span_valid[sp]) {
+                memcpy(req.local_addr, buffer.data() + span.offset + (req.remote_addr - span.beg), req.size);
+                req.valid = true;
+            }
+            else {
+                req.valid = (read(req.local_addr, reinterpret_cast<void*>(req.remote_addr), req.size) == req.size);
+            }
+            valid_count += req.valid;
+        }
+    }
+    return valid_count;
+#else
+    for (int r : order) {
+        ReadRequest& req = requests[r];
+        req.valid = (read(req.local_addr, reinterpret_cast<void*>(req.remote_addr), req.size) == req.size);
+        valid_count += req.valid;
+    }
+    return valid_count;
+#endif
+}
+
 size_t MemAccess::write(void* local_addr, void* remote_addr, size_t size)
 {
     if (!game_pid)
         return 0;
 
+    if (mirror_mapped) {
+        std::lock_guard<std::mutex> lock(mirror_mutex);
+        staleMirror(reinterpret_cast<uintptr_t>(remote_addr), size);
+    }
+
 #ifdef __unix__
     struct iovec local, remote;
     local.iov_base = local_addr;
@@ -96,3 +377,103 @@ size_t MemAccess::write(void* local_addr, void* remote_addr, size_t size)
     return size;
 #endif
 }
+
+void MemAccess::initMirror(int fd)
+{
+    enableMirror(false);
+    mirror_fd = fd;
+}
+
+bool MemAccess::enableMirror(bool enable)
+{
+    std::lock_guard<std::mutex> lock(mirror_mutex);
+
+    if (!enable) {
+#ifdef __linux__
+        if (mirror)
+            munmap(const_cast<uint8_t*>(mirror), MIRROR_SIZE);
+#endif
+        mirror = nullptr;
+        mirror_mapped = false;
+        mirror_valid = false;
+        mirror_pages.clear();
+        mirror_stale.clear();
+        mirror_uses.clear();
+        return false;
+    }
+
+    if (mirror)
+        return true;
+
+#ifdef __linux__
+    if ((mirror_fd < 0) || !game_pid)
+        return false;
+
+    /* Open the memfd of the game through its file descriptor */
+    std::string path = "/proc/" + std::to_string(game_pid) + "/fd/" + std::to_string(mirror_fd);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open the memory mirror " << path << std::endl;
+        mirror_fd = -1;
+        return false;
+    }
+
+    void* addr = mmap(nullptr, MIRROR_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Could not map the memory mirror" << std::endl;
+        mirror_fd = -1;
+        return false;
+    }
+
+    mirror = static_cast<const uint8_t*>(addr);
+    mirror_mapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MemAccess::hasMirror()
+{
+    return mirror_mapped;
+}
+
+bool MemAccess::mirrorPages(std::vector<uint64_t>& pages)
+{
+    std::lock_guard<std::mutex> lock(mirror_mutex);
+
+    pages.clear();
+    for (auto it = mirror_uses.begin(); it != mirror_uses.end(); ) {
+        if (++it->second > MIRROR_KEEP_FRAMES) {
+            it = mirror_uses.erase(it);
+            continue;
+        }
+        if (pages.size() < MIRROR_MAX_PAGES)
+            pages.push_back(it->first);
+        ++it;
+    }
+
+    return pages != mirror_pages;
+}
+
+void MemAccess::validateMirror(const std::vector<uint64_t>& pages)
+{
+    std::lock_guard<std::mutex> lock(mirror_mutex);
+    mirror_pages = pages;
+    mirror_stale.assign(mirror_pages.size(), false);
+    mirror_valid = (mirror != nullptr);
+}
+
+void MemAccess::validateMirror()
+{
+    std::lock_guard<std::mutex> lock(mirror_mutex);
+    mirror_stale.assign(mirror_pages.size(), false);
+    mirror_valid = (mirror != nullptr);
+}
+
+void MemAccess::invalidateMirror()
+{
+    std::lock_guard<std::mutex> lock(mirror_mutex);
+    mirror_valid = false;
+}
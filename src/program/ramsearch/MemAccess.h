@@ -21,7 +21,9 @@
 #define LIBTAS_MEMACCESS_H_INCLUDED
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
+#include <vector>
 
 /* Functions to read/write into game memroy */
 namespace MemAccess {
@@ -30,9 +32,64 @@ namespace MemAccess {
     
     pid_t getPid();
     
-    size_t read(void* local_addr, void* remote_addr, size_t size);
+    /* Read a range of game memory. Ranges read with `track` set, by ram
+     * watches and lua scripts, have their page added to the memory mirror. */
+    size_t read(void* local_addr, void* remote_addr, size_t size, bool track = false);
+
+    /* A range of game memory to read with readBatch() */
+    struct ReadRequest {
+        void* local_addr;
+        uintptr_t remote_addr;
+        size_t size;
+        bool valid; // set if the range could be read
+    };
+
+    /* Read many scattered ranges of game memory with a few syscalls. Close
+     * ranges are coalesced, and up to IOV_MAX coalesced ranges are read per
+     * syscall. If a coalesced range cannot be read, its requests are read
+     * one by one. Returns the number of valid requests. `track` has the
+     * same meaning as for read(). */
+    int readBatch(ReadRequest* requests, int count, bool track = false);
 
     size_t write(void* local_addr, void* remote_addr, size_t size);    
+
+    /* An area of a memory image. Areas without data only contain zeros. */
+    struct ImageArea {
+        uintptr_t addr;
+        size_t size;
+        const uint8_t* data;
+    };
+
+    /* Read a memory image instead of the game process, so that the RAM
+     * search can run without a game. Areas must be sorted by address. An
+     * empty image reads the game process again. */
+    void initImage(const std::vector<ImageArea>& areas);
+
+    /* The memory mirror holds a copy of the game pages that are read often
+     * (see shared/MemoryMirror.h). While it is valid, reads of mirrored
+     * pages are plain loads. Pages of tracked reads are added to the
+     * mirror at the next frame boundary, and pages that are not read
+     * anymore are removed from it. */
+
+    /* Set the file descriptor of the mirror inside the game process */
+    void initMirror(int fd);
+
+    /* Map or unmap the mirror. Returns if the mirror is mapped. */
+    bool enableMirror(bool enable);
+
+    /* Returns if the mirror is mapped */
+    bool hasMirror();
+
+    /* Build the list of pages to mirror. Returns if it differs from the
+     * list of mirrored pages. */
+    bool mirrorPages(std::vector<uint64_t>& pages);
+
+    /* The game has copied the pages into the mirror, reads can use it */
+    void validateMirror(const std::vector<uint64_t>& pages);
+    void validateMirror();
+
+    /* The game memory is about to change, reads must not use the mirror */
+    void invalidateMirror();
 }
 
 #endif
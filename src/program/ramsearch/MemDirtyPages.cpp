@@ -0,0 +1,112 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemDirtyPages.h"
+
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Flags of a pagemap entry */
+#define PAGEMAP_SOFT_DIRTY (0x1ull << 55)
+#define PAGEMAP_SWAPPED (0x1ull << 62)
+#define PAGEMAP_PRESENT (0x1ull << 63)
+
+/* Number of pagemap entries read at once */
+#define PAGEMAP_BATCH 4096
+
+bool MemDirtyPages::clear(pid_t pid)
+{
+#ifdef __linux__
+    std::string path = "/proc/" + std::to_string(pid) + "/clear_refs";
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0)
+        return false;
+
+    bool ret = (write(fd, "4\n", 2) == 2);
+    close(fd);
+    return ret;
+#else
+    return false;
+#endif
+}
+
+bool MemDirtyPages::snapshot(pid_t pid, const std::vector<MemScanChunk>& chunks)
+{
+    reset();
+
+#ifdef __linux__
+    std::string path = "/proc/" + std::to_string(pid) + "/pagemap";
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    std::vector<uint64_t> entries(PAGEMAP_BATCH);
+
+    for (const MemScanChunk& chunk : chunks) {
+        uint64_t first_page = chunk.beg_address / 4096;
+        uint64_t page_count = ((chunk.end_address + 4095) / 4096) - first_page;
+
+        chunk_addresses.push_back(chunk.beg_address);
+        chunk_offsets.push_back(bits.size());
+        size_t offset = bits.size();
+        bits.resize(offset + (page_count + 63) / 64, 0);
+
+        for (uint64_t p = 0; p < page_count; p += PAGEMAP_BATCH) {
+            size_t count = std::min<uint64_t>(PAGEMAP_BATCH, page_count - p);
+            ssize_t ret = pread(fd, entries.data(), count * sizeof(uint64_t), (first_page + p) * sizeof(uint64_t));
+            if (ret != static_cast<ssize_t>(count * sizeof(uint64_t))) {
+                close(fd);
+                reset();
+                return false;
+            }
+
+            /* A page that is neither present nor swapped may have been
+             * discarded, losing its soft-dirty bit, so it is not clean */
+            for (size_t e = 0; e < count; e++) {
+                uint64_t entry = entries[e];
+                if (!(entry & PAGEMAP_SOFT_DIRTY) && (entry & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)))
+                    bits[offset + (p + e) / 64] |= 0x1ull << ((p + e) % 64);
+            }
+        }
+    }
+
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MemDirtyPages::reset()
+{
+    chunk_addresses.clear();
+    chunk_offsets.clear();
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+const uint64_t* MemDirtyPages::clean_pages(uintptr_t beg_address) const
+{
+    auto it = std::lower_bound(chunk_addresses.begin(), chunk_addresses.end(), beg_address);
+    if ((it == chunk_addresses.end()) || (*it != beg_address))
+        return nullptr;
+    return bits.data() + chunk_offsets[it - chunk_addresses.begin()];
+}
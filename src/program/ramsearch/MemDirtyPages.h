@@ -0,0 +1,62 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMDIRTYPAGES_H_INCLUDED
+#define LIBTAS_MEMDIRTYPAGES_H_INCLUDED
+
+#include "MemScanStore.h"
+
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+
+/* Pages of game memory that were not written since the soft-dirty bits of
+ * the game were cleared, read from /proc/pid/pagemap. The scanner clears the
+ * bits right before reading memory, so that the next scan only needs to read
+ * again the pages that were written in between. */
+class MemDirtyPages {
+    public:
+        /* Clear the soft-dirty bits of the game. Returns if it succeeded. */
+        static bool clear(pid_t pid);
+
+        /* Store which pages of the chunks are clean. Chunks must be ordered
+         * by address. Returns if pagemap could be read. */
+        bool snapshot(pid_t pid, const std::vector<MemScanChunk>& chunks);
+
+        /* Free the snapshot */
+        void reset();
+
+        /* Bitmap of the clean pages of the chunk starting at an address, one
+         * bit per page starting from the page of that address, or nullptr */
+        const uint64_t* clean_pages(uintptr_t beg_address) const;
+
+        /* Returns if the page of an address is clean in the bitmap of a chunk */
+        static bool is_clean(const uint64_t* clean, uintptr_t beg_address, uintptr_t addr)
+        {
+            uint64_t p = (addr / 4096) - (beg_address / 4096);
+            return (clean[p / 64] >> (p % 64)) & 1;
+        }
+
+    private:
+        std::vector<uintptr_t> chunk_addresses; // beginning of each chunk
+        std::vector<size_t> chunk_offsets; // first word of each chunk bitmap
+        std::vector<uint64_t> bits;
+};
+
+#endif
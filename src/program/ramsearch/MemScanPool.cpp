@@ -0,0 +1,145 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemScanPool.h"
+
+#include <chrono>
+
+MemScanPool::MemScanPool(int count)
+{
+    if (count <= 0)
+        count = std::thread::hardware_concurrency();
+    if (count <= 0)
+        count = 4;
+
+    for (int t = 0; t < count; t++)
+        queues.emplace_back(new Queue());
+    for (int t = 0; t < count; t++)
+        threads.emplace_back(&MemScanPool::thread_loop, this, t);
+}
+
+MemScanPool::~MemScanPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    job_cv.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+int MemScanPool::thread_count() const
+{
+    return threads.size();
+}
+
+void MemScanPool::start(int count, std::function<void(int, int)> j)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    job = j;
+    remaining_items = count;
+
+    /* Split the items evenly between threads */
+    int thread_count = threads.size();
+    job_id++;
+    for (int t = 0; t < thread_count; t++) {
+        std::lock_guard<std::mutex> queue_lock(queues[t]->mutex);
+        queues[t]->job_id = job_id;
+        queues[t]->beg = static_cast<int64_t>(count) * t / thread_count;
+        queues[t]->end = static_cast<int64_t>(count) * (t+1) / thread_count;
+    }
+
+    job_cv.notify_all();
+}
+
+bool MemScanPool::wait(int ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return done_cv.wait_for(lock, std::chrono::milliseconds(ms), [this]{return remaining_items == 0;});
+}
+
+int MemScanPool::next_item(int t, int id)
+{
+    /* Take our own items from the beginning */
+    {
+        Queue& queue = *queues[t];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.job_id != id)
+            return -1;
+        if (queue.beg < queue.end)
+            return queue.beg++;
+    }
+
+    /* Steal from the end of the thread with the most remaining items */
+    while (true) {
+        int victim = -1;
+        int victim_count = 0;
+        for (unsigned int v = 0; v < queues.size(); v++) {
+            std::lock_guard<std::mutex> lock(queues[v]->mutex);
+            int count = queues[v]->end - queues[v]->beg;
+            if ((queues[v]->job_id == id) && (count > victim_count)) {
+                victim = v;
+                victim_count = count;
+            }
+        }
+
+        if (victim == -1)
+            return -1;
+
+        Queue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if ((queue.job_id == id) && (queue.beg < queue.end))
+            return --queue.end;
+
+        /* Someone else took the items in the meantime, try again */
+    }
+}
+
+void MemScanPool::thread_loop(int t)
+{
+    int last_job_id = 0;
+
+    while (true) {
+        std::function<void(int, int)> current_job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_cv.wait(lock, [&]{return quit || (job_id != last_job_id);});
+            if (quit)
+                return;
+            last_job_id = job_id;
+            current_job = job;
+        }
+
+        int processed = 0;
+        /* Items are tagged with their job, so that a thread that woke up
+         * late does not process the items of a newer job */
+        for (int item = next_item(t, last_job_id); item != -1; item = next_item(t, last_job_id)) {
+            current_job(t, item);
+            processed++;
+        }
+
+        if (processed > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            remaining_items -= processed;
+            if (remaining_items == 0)
+                done_cv.notify_all();
+        }
+    }
+}
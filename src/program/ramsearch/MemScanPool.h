@@ -0,0 +1,79 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMSCANPOOL_H_INCLUDED
+#define LIBTAS_MEMSCANPOOL_H_INCLUDED
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+/* Persistent pool of scanning threads, one per cpu core by default. A job is split into
+ * items that are first distributed in contiguous ranges to each thread. A
+ * thread that has finished its range steals items from the end of the range
+ * of the most loaded thread, so that all threads finish at the same time. */
+class MemScanPool {
+    public:
+        /* Start `count` threads, or one per cpu core if zero */
+        MemScanPool(int count = 0);
+        ~MemScanPool();
+
+        /* Returns the number of threads */
+        int thread_count() const;
+
+        /* Start processing `count` items. The job is called with the index
+         * of the thread and the index of the item. Returns immediately. */
+        void start(int count, std::function<void(int, int)> job);
+
+        /* Wait for the current job to be finished, for at most `ms`
+         * milliseconds. Returns if the job is finished. */
+        bool wait(int ms);
+
+    private:
+        /* Remaining items of a thread, from beg to end */
+        struct Queue {
+            std::mutex mutex;
+            int job_id = 0;
+            int beg = 0;
+            int end = 0;
+        };
+
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<Queue>> queues;
+
+        std::mutex mutex;
+        std::condition_variable job_cv; // signal a new job or the exit
+        std::condition_variable done_cv; // signal the end of a job
+        std::function<void(int, int)> job;
+        int job_id = 0;
+        int remaining_items = 0; // items that are not processed yet
+        bool quit = false;
+
+        /* Main function of each thread */
+        void thread_loop(int t);
+
+        /* Take the next item of a job for a thread, or steal one from another
+         * thread. Returns -1 if there is no item left. */
+        int next_item(int t, int id);
+};
+
+#endif
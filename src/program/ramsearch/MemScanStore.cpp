@@ -0,0 +1,352 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemScanStore.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Number of shards of the region pages */
+#define PAGE_SHARDS 16
+
+/* Number of region pages allocated at once */
+#define PAGE_SLAB 64
+
+/* Size of the first mapping of a segment, and maximum size of the next ones */
+#define SEGMENT_MIN_SIZE (64 * 1024 * 1024)
+#define SEGMENT_MAX_SIZE (1024 * 1024 * 1024)
+
+static void write_varint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static uint64_t read_varint(const uint8_t* in, uint64_t& pos)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+        b = in[pos++];
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+MemScanStore::MemScanStore(std::string path) : file_path(path), page_shards(new PageShard[PAGE_SHARDS])
+{
+    fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        std::cerr << "error: could not create scan file " << file_path << std::endl;
+}
+
+MemScanStore::~MemScanStore()
+{
+    reset(0);
+    if (fd >= 0) {
+        close(fd);
+        std::remove(file_path.c_str());
+    }
+}
+
+void MemScanStore::reset(uint64_t budget)
+{
+    /* Shards are locked before the store when allocating pages */
+    for (int s = 0; s < PAGE_SHARDS; s++) {
+        std::lock_guard<std::mutex> shard_lock(page_shards[s].mutex);
+        page_shards[s].pages.clear();
+        page_shards[s].slab = nullptr;
+        page_shards[s].slab_used = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& mapping : mappings)
+        munmap(mapping.first, mapping.second);
+    mappings.clear();
+    memory_segment = Segment();
+    file_segment = Segment();
+
+    if ((file_end > 0) && (ftruncate(fd, 0) < 0))
+        std::cerr << "error: could not truncate " << file_path << std::endl;
+
+    memory_budget = budget;
+    memory_used = 0;
+    file_used = 0;
+    file_end = 0;
+}
+
+uint8_t* MemScanStore::allocate_in(Segment& segment, size_t size, bool in_file)
+{
+    if (segment.addr && ((segment.used + size) <= segment.size)) {
+        uint8_t* data = segment.addr + segment.used;
+        segment.used += size;
+        return data;
+    }
+
+    size_t map_size = segment.size ? std::min<size_t>(2 * segment.size, SEGMENT_MAX_SIZE) : SEGMENT_MIN_SIZE;
+    if (map_size < size)
+        map_size = (size + 4095) & ~static_cast<size_t>(4095);
+
+    void* addr;
+    if (in_file) {
+        if (ftruncate(fd, file_end + map_size) < 0) {
+            std::cerr << "error: could not extend " << file_path << std::endl;
+            return nullptr;
+        }
+        addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, file_end);
+        if (addr == MAP_FAILED) {
+            std::cerr << "error: could not map " << file_path << std::endl;
+            return nullptr;
+        }
+        file_end += map_size;
+    }
+    else {
+        addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            return nullptr;
+    }
+
+    mappings.push_back(std::make_pair(addr, map_size));
+    segment.addr = static_cast<uint8_t*>(addr);
+    segment.size = map_size;
+    segment.used = size;
+    return segment.addr;
+}
+
+uint8_t* MemScanStore::allocate(size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* Keep chunks aligned on 8 bytes */
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    if ((memory_used + size) <= memory_budget) {
+        uint8_t* data = allocate_in(memory_segment, size, false);
+        if (data) {
+            memory_used += size;
+            return data;
+        }
+    }
+
+    /* Above the budget, store the chunk in the file */
+    if (fd < 0)
+        return nullptr;
+
+    uint8_t* data = allocate_in(file_segment, size, true);
+    if (data)
+        file_used += size;
+    return data;
+}
+
+const uint8_t* MemScanStore::allocate_page(const uint8_t* page, uint64_t hash)
+{
+    PageShard& shard = page_shards[hash % PAGE_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto range = shard.pages.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (memcmp(it->second, page, 4096) == 0)
+            return it->second;
+    }
+
+    if (!shard.slab || (shard.slab_used == PAGE_SLAB)) {
+        shard.slab = allocate(PAGE_SLAB * 4096);
+        shard.slab_used = 0;
+        if (!shard.slab)
+            return nullptr;
+    }
+
+    uint8_t* stored = shard.slab + (shard.slab_used++) * 4096;
+    memcpy(stored, page, 4096);
+    shard.pages.insert(std::make_pair(hash, stored));
+    return stored;
+}
+
+uint64_t MemScanStore::memory_size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_used;
+}
+
+uint64_t MemScanStore::file_size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return file_used;
+}
+
+void MemScanChunkWriter::begin(uintptr_t ba, uintptr_t ea, int vs)
+{
+    beg_address = ba;
+    end_address = ea;
+    value_size = vs;
+    runs.clear();
+    values.clear();
+    run_start = 0;
+    run_length = 0;
+    last_run_end = 0;
+}
+
+void MemScanChunkWriter::flush_run()
+{
+    if (run_length == 0)
+        return;
+
+    write_varint(runs, run_start - last_run_end);
+    write_varint(runs, run_length);
+    last_run_end = run_start + run_length;
+}
+
+void MemScanChunkWriter::add(uintptr_t addr, const uint8_t* value)
+{
+    uint64_t slot = (addr - beg_address) / value_size;
+
+    if ((run_length == 0) || (slot != (run_start + run_length))) {
+        flush_run();
+        run_start = slot;
+        run_length = 0;
+    }
+    run_length++;
+
+    values.insert(values.end(), value, value + value_size);
+}
+
+void MemScanChunkWriter::add_mask(uintptr_t addr, const uint8_t* memory, const uint64_t* mask, int count)
+{
+    int mask_count = (count + 63) / 64;
+    for (int w = 0; w < mask_count; w++) {
+        for (uint64_t m = mask[w]; m; m &= m - 1) {
+            int v = (w*64 + __builtin_ctzll(m)) * value_size;
+            add(addr + v, memory + v);
+        }
+    }
+}
+
+bool MemScanChunkWriter::finish(MemScanStore& store, MemScanChunk& chunk)
+{
+    flush_run();
+
+    chunk.beg_address = beg_address;
+    chunk.end_address = end_address;
+    chunk.size = values.size();
+    chunk.addresses = nullptr;
+    chunk.addresses_size = 0;
+    chunk.values = nullptr;
+
+    if (values.empty())
+        return true;
+
+    /* Dense results are smaller as a bitmap */
+    uint64_t slots = (end_address - beg_address) / value_size;
+    uint64_t bitmap_size = ((slots + 63) / 64) * sizeof(uint64_t);
+    if (runs.size() > bitmap_size) {
+        chunk.encoding = MemScanChunk::ENCODING_BITMAP;
+        chunk.addresses_size = bitmap_size;
+    }
+    else {
+        chunk.encoding = MemScanChunk::ENCODING_RUNS;
+        chunk.addresses_size = runs.size();
+    }
+
+    /* Values are stored after the addresses, aligned on 8 bytes */
+    uint64_t values_offset = (chunk.addresses_size + 7) & ~static_cast<uint64_t>(7);
+    uint8_t* data = store.allocate(values_offset + values.size());
+    if (!data)
+        return false;
+
+    if (chunk.encoding == MemScanChunk::ENCODING_BITMAP) {
+        uint64_t* bitmap = reinterpret_cast<uint64_t*>(data);
+        memset(bitmap, 0, bitmap_size);
+        uint64_t pos = 0;
+        uint64_t slot = 0;
+        while (pos < runs.size()) {
+            slot += read_varint(runs.data(), pos);
+            uint64_t length = read_varint(runs.data(), pos);
+            for (uint64_t s = slot; s < slot + length; s++)
+                bitmap[s / 64] |= static_cast<uint64_t>(1) << (s % 64);
+            slot += length;
+        }
+    }
+    else {
+        memcpy(data, runs.data(), runs.size());
+    }
+
+    memcpy(data + values_offset, values.data(), values.size());
+    chunk.addresses = data;
+    chunk.values = data + values_offset;
+    return true;
+}
+
+MemScanChunkReader::MemScanChunkReader(const MemScanChunk& c, int vs) : chunk(c), value_size(vs)
+{
+    count = chunk.size / value_size;
+    index = 0;
+    slot = 0;
+    pos = 0;
+    run_remaining = 0;
+    word = 0;
+    if ((chunk.encoding == MemScanChunk::ENCODING_BITMAP) && (chunk.addresses_size > 0))
+        memcpy(&word, chunk.addresses, sizeof(uint64_t));
+}
+
+bool MemScanChunkReader::next(uintptr_t& addr, const uint8_t*& value)
+{
+    if (index >= count)
+        return false;
+
+    switch (chunk.encoding) {
+        case MemScanChunk::ENCODING_REGION:
+            /* Regions are not iterated */
+            return false;
+        case MemScanChunk::ENCODING_RUNS:
+            if (run_remaining == 0) {
+                slot += read_varint(chunk.addresses, pos);
+                run_remaining = read_varint(chunk.addresses, pos);
+            }
+            run_remaining--;
+            break;
+        case MemScanChunk::ENCODING_BITMAP:
+            while (word == 0) {
+                pos += sizeof(uint64_t);
+                if (pos >= chunk.addresses_size)
+                    return false;
+                memcpy(&word, chunk.addresses + pos, sizeof(uint64_t));
+            }
+            slot = pos * 8 + __builtin_ctzll(word);
+            word &= word - 1;
+            break;
+    }
+
+    addr = chunk.beg_address + slot * value_size;
+    value = chunk.values + index * value_size;
+    index++;
+    if (chunk.encoding == MemScanChunk::ENCODING_RUNS)
+        slot++;
+    return true;
+}
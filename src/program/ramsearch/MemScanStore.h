@@ -0,0 +1,171 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMSCANSTORE_H_INCLUDED
+#define LIBTAS_MEMSCANSTORE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <sys/types.h>
+
+/* Entries of the page table of a region. Other entries are the address of
+ * the page contents inside the store. */
+#define REGION_PAGE_ZERO 0 // page only containing zeros
+#define REGION_PAGE_FILE (0x1ull << 63) // page equal to the mapped file, at the offset in the lower bits
+
+/* Results of a scan work item. Chunks are kept in the order of their work
+ * items, so that the results of all threads are ordered by address without
+ * merging them. Addresses are stored relative to the beginning of the chunk,
+ * in units of the value size (slots), either as runs of consecutive slots or
+ * as a bitmap of all slots, and values are packed after them. */
+struct MemScanChunk {
+    enum Encoding {
+        ENCODING_REGION, // all values of the range, as a table of pages stored in `addresses`
+        ENCODING_RUNS, // sequence of varint pairs (gap from the end of the previous run, run length)
+        ENCODING_BITMAP, // one bit per slot, in 64-bit words
+    };
+
+    uintptr_t beg_address = 0; // range of memory covered by the chunk
+    uintptr_t end_address = 0;
+    uint64_t size = 0; // size of the values (in bytes)
+    int encoding = ENCODING_REGION;
+    const uint8_t* addresses = nullptr; // encoded addresses
+    uint64_t addresses_size = 0; // size of the encoded addresses (in bytes)
+    const uint8_t* values = nullptr; // packed values
+    int file = -1; // descriptor of the read-only file mapped at the range, for regions
+    off_t file_offset = 0; // offset of the range inside the file
+};
+
+/* Storage of the results of a scan. Chunks are stored in memory until the
+ * memory budget is reached, and in a mmapped file after that. Chunks are
+ * packed into a few large mappings, whose size doubles each time, so that
+ * the number of mappings stays low. Allocations can be made from several
+ * threads, and everything is freed at once. */
+class MemScanStore {
+    public:
+        MemScanStore(std::string path);
+        ~MemScanStore();
+
+        /* Free all results, and set the memory budget of the next ones */
+        void reset(uint64_t budget);
+
+        /* Allocate room for a chunk. Returns nullptr on failure. */
+        uint8_t* allocate(size_t size);
+
+        /* Store a page of a region, with the hash of its contents. Identical
+         * pages are only stored once. Returns nullptr on failure. */
+        const uint8_t* allocate_page(const uint8_t* page, uint64_t hash);
+
+        /* Size of the results stored in memory and in the file (in bytes) */
+        uint64_t memory_size() const;
+        uint64_t file_size() const;
+
+    private:
+        std::string file_path; // file of the results above the memory budget
+        int fd;
+
+        mutable std::mutex mutex;
+        uint64_t memory_budget = 0;
+        uint64_t memory_used = 0;
+        uint64_t file_used = 0;
+        off_t file_end = 0; // size of the file, which is entirely mapped
+
+        /* Last mapping in which chunks are packed */
+        struct Segment {
+            uint8_t* addr = nullptr;
+            size_t size = 0;
+            size_t used = 0;
+        };
+        Segment memory_segment; // anonymous mapping
+        Segment file_segment; // mapping of the file
+
+        std::vector<std::pair<void*, size_t>> mappings; // all mappings, in memory and in the file
+
+        /* Allocate inside a segment, mapping a new one if it is full. The
+         * store must be locked. */
+        uint8_t* allocate_in(Segment& segment, size_t size, bool in_file);
+
+        /* Pages of regions, split by hash so that threads rarely wait for
+         * each other. Pages are allocated by slabs. */
+        struct PageShard {
+            std::mutex mutex;
+            std::unordered_multimap<uint64_t, const uint8_t*> pages;
+            uint8_t* slab = nullptr;
+            int slab_used = 0;
+        };
+        std::unique_ptr<PageShard[]> page_shards;
+};
+
+/* Build the results of a work item. Addresses must be added in increasing
+ * order, and must be aligned on the value size from the beginning of the
+ * chunk. */
+class MemScanChunkWriter {
+    public:
+        /* Start a new chunk */
+        void begin(uintptr_t beg_address, uintptr_t end_address, int value_size);
+
+        /* Add a result */
+        void add(uintptr_t addr, const uint8_t* value);
+
+        /* Add the values of a piece of memory that are selected by a match
+         * mask, as returned by CompareOperations */
+        void add_mask(uintptr_t addr, const uint8_t* memory, const uint64_t* mask, int count);
+
+        /* Store the chunk, choosing the smallest address encoding */
+        bool finish(MemScanStore& store, MemScanChunk& chunk);
+
+    private:
+        uintptr_t beg_address;
+        uintptr_t end_address;
+        int value_size;
+
+        std::vector<uint8_t> runs;
+        std::vector<uint8_t> values;
+        uint64_t run_start; // current run, in slots
+        uint64_t run_length;
+        uint64_t last_run_end; // end of the last written run
+
+        /* Encode the current run */
+        void flush_run();
+};
+
+/* Iterate over the results of a chunk */
+class MemScanChunkReader {
+    public:
+        MemScanChunkReader(const MemScanChunk& chunk, int value_size);
+
+        /* Get the next result. Returns false after the last result. */
+        bool next(uintptr_t& addr, const uint8_t*& value);
+
+    private:
+        const MemScanChunk& chunk;
+        int value_size;
+        uint64_t count; // number of results
+        uint64_t index; // index of the next result
+        uint64_t slot; // slot of the next result
+        uint64_t pos; // position in the encoded addresses
+        uint64_t run_remaining; // remaining slots of the current run
+        uint64_t word; // remaining bits of the current bitmap word
+};
+
+#endif
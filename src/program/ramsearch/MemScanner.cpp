@@ -22,29 +22,48 @@
 #include "MemLayout.h"
 #include "MemScanner.h"
 #include "MemScannerThread.h"
-#include <sstream>
-#include <fstream>
+#include "MemScanPool.h"
 #include <iostream>
-#include <thread>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 
 std::string MemScanner::memscan_path;
-std::string MemScanner::addresses_path;
-std::string MemScanner::values_path;
+std::atomic<uint64_t> MemScanner::dirty_epoch(1);
+
+MemScanner::MemScanner() {}
+
+/* Defined here because of the forward-declared members */
+MemScanner::~MemScanner()
+{
+    close_mapped_files();
+}
 
 void MemScanner::init(std::string path)
 {
     memscan_path = path;
-    
-    std::ostringstream ossov;
-    ossov << memscan_path << "/memory.bin";
-    values_path = ossov.str();
-
-    std::ostringstream ossoa;
-    ossoa << memscan_path << "/addresses.bin";
-    addresses_path = ossoa.str();
+}
+
+void MemScanner::invalidate_dirty_tracking()
+{
+    dirty_epoch++;
 }
 
 void MemScanner::first_scan(pid_t pid, int mem_flags, int type, CompareType ct, CompareOperator co, double cv, double dv)
+{
+    /* Read the whole memory layout */
+    std::unique_ptr<MemLayout> memlayout (new MemLayout(pid));
+
+    std::vector<MemSection> sections;
+    MemSection section;
+    while (memlayout->nextSection(MemSection::MemAll, mem_flags, section)) {
+        sections.push_back(section);
+    }
+
+    first_scan(sections, type, ct, co, cv, dv);
+}
+
+void MemScanner::first_scan(const std::vector<MemSection>& sections, int type, CompareType ct, CompareOperator co, double cv, double dv)
 {
     value_type = type;
     switch (value_type) {
@@ -68,17 +87,12 @@ void MemScanner::first_scan(pid_t pid, int mem_flags, int type, CompareType ct,
             break;
     }
 
-    /* Read the whole memory layout */
-    std::unique_ptr<MemLayout> memlayout (new MemLayout(pid));
+    close_mapped_files();
 
-    memsections.clear();
-    
-    MemSection section;
+    memsections = sections;
     total_size = 0;
-    while (memlayout->nextSection(MemSection::MemAll, mem_flags, section)) {
-        memsections.push_back(section);
-        total_size += section.size;
-    }
+    for (const MemSection& s : memsections)
+        total_size += s.size;
         
     if (total_size == 0) return;
 
@@ -96,175 +110,147 @@ void MemScanner::scan(bool first, CompareType ct, CompareOperator co, double cv,
 
     CompareOperations::init(value_type, compare_operator, compare_value, different_value);
 
-    /* Split the work between threads */
-    std::vector<MemScannerThread> memscanners;
-    std::vector<std::thread> memscan_threads;
-    uint64_t block_size = (total_size / THREAD_COUNT) & 0xfffffffffffff000;
-
-    int beg_region = 0;
-    int end_region = 0;
-    uintptr_t beg_address = 0;
-    uintptr_t end_address = 0;
-    size_t cur_region_offset = 0;
-
-    int thread_count = THREAD_COUNT;
-    if (block_size == 0)
-        thread_count = 1;
-    
-    for (int t = 0; t < thread_count-1; t++) {
-        uint64_t cur_block_size = memsections[beg_region].size - cur_region_offset;    
-        while ((cur_block_size < block_size) && (end_region < memsections.size())) {
-            end_region++;
-            cur_block_size += memsections[end_region].size;
-        }
-        
-        cur_region_offset = memsections[end_region].size - (cur_block_size - block_size);
-        end_address = memsections[end_region].addr + cur_region_offset;
-        
-        /* Sanitize beg and end addresses */
-        if (beg_address < memsections[beg_region].addr)
-            beg_address = memsections[beg_region].addr;
-        if (end_address > memsections[end_region].endaddr)
-            end_address = memsections[end_region].endaddr;
-
-        /* Configure the scanner thread */
-        memscanners.emplace_back(*this, beg_region, end_region, beg_address, end_address, t*block_size, block_size);
-        
-        /* Set the beg variables for the next thread */
-        if (cur_block_size == block_size) {
-            /* Nothing left in this section, skip to the beginning of the next section */
-            beg_region = end_region + 1;
-            beg_address = memsections[beg_region].addr;
-        }
-        else {
-            beg_region = end_region;
-            beg_address = end_address;
-        }
+    /* Start the pool of scanner threads on the first scan */
+    if (!pool) {
+        pool.reset(new MemScanPool(thread_count));
+        for (int t = 0; t < pool->thread_count(); t++)
+            memscanners.emplace_back(new MemScannerThread(*this, t));
+        for (int g = 0; g < 2; g++)
+            stores[g].reset(new MemScanStore(memscan_path + "/results-" + std::to_string(g) + ".tmp"));
     }
-    
-    /* Last scanner thread gets the remaining memory */
-    end_region = memsections.size() - 1;
-    end_address = memsections.back().endaddr;
-    memscanners.emplace_back(*this, beg_region, end_region, beg_address, end_address, (thread_count-1)*block_size, total_size-((thread_count-1)*block_size));
-    
-    /* Start all threads */
-    for (int t = 0; t < thread_count; t++) {
-        if (first) {
-            if (compare_type == CompareType::Previous)
-                memscan_threads.emplace_back(&MemScannerThread::first_region_scan, &memscanners[t]);
-            else
-                memscan_threads.emplace_back(&MemScannerThread::first_address_scan, &memscanners[t]);            
-        }
-        else {
-            if (last_scan_was_region)
-                memscan_threads.emplace_back(&MemScannerThread::next_scan_from_region, &memscanners[t]);
-            else
-                memscan_threads.emplace_back(&MemScannerThread::next_scan_from_address, &memscanners[t]);
+
+    /* Build the work items. The first scan splits each memory section in
+     * items of chunk_size bytes, and the next scans process each chunk of
+     * the previous results. */
+    std::vector<MemScanChunk> items;
+    bool region_scan = first && (compare_type == CompareType::Previous);
+    if (first) {
+        for (const MemSection& section : memsections) {
+            /* Unmodified pages of read-only file mappings are not stored by
+             * region scans, they are read again from the file */
+            int file = region_scan ? open_mapped_file(section) : -1;
+            for (uintptr_t addr = section.addr; addr < section.endaddr; addr += chunk_size) {
+                MemScanChunk item;
+                item.beg_address = addr;
+                item.end_address = std::min<uintptr_t>(addr + chunk_size, section.endaddr);
+                item.size = item.end_address - item.beg_address;
+                item.file = file;
+                item.file_offset = section.offset + (addr - section.addr);
+                items.push_back(item);
+            }
         }
     }
+    else {
+        items = results;
+    }
+
+    /* Which pages were not written since the previous scan must be known
+     * before clearing the soft-dirty bits, and the bits must be cleared
+     * before reading memory, so that no write is missed */
+    pid_t pid = MemAccess::getPid();
+    if (dirty_tracking_epoch != dirty_epoch)
+        dirty_tracking = false;
+    use_dirty_pages = !first && soft_dirty && dirty_tracking && dirty_pages.snapshot(pid, items);
+    dirty_tracking_epoch = dirty_epoch;
+    dirty_tracking = soft_dirty && MemDirtyPages::clear(pid);
+
+    if (region_scan && !mapped_files.empty()) {
+        std::string path = "/proc/" + std::to_string(pid) + "/pagemap";
+        pagemap_fd = open(path.c_str(), O_RDONLY);
+    }
+
+    void (MemScannerThread::*scan_method)(const MemScanChunk&, MemScanChunk&);
+    if (first) {
+        if (compare_type == CompareType::Previous)
+            scan_method = &MemScannerThread::first_region_scan;
+        else
+            scan_method = &MemScannerThread::first_address_scan;
+    }
+    else {
+        if (last_scan_was_region)
+            scan_method = &MemScannerThread::next_scan_from_region;
+        else
+            scan_method = &MemScannerThread::next_scan_from_address;
+    }
+
+    /* Results are stored in the order of the work items */
+    /* The new results get the memory budget left by the previous ones */
+    uint64_t previous_memory_size = stores[generation]->memory_size();
+    stores[1 - generation]->reset((memory_budget > previous_memory_size) ? (memory_budget - previous_memory_size) : 0);
+    for (auto& mst : memscanners)
+        mst->processed_memory_size = 0;
+    std::vector<MemScanChunk> new_results(items.size());
+
+    pool->start(items.size(), [&](int thread, int item) {
+        (memscanners[thread].get()->*scan_method)(items[item], new_results[item]);
+    });
 
     /* Update progress bar */
-    /* We would normally just join all threads, but we need to update the scan
-     * state periodically to update the progress bar. So we check if all
-     * scan threads have finished. */
+    /* We need to update the scan state periodically to update the progress
+     * bar, so we wait for the pool with a timeout. */
     bool scan_finished = false;
-    uint64_t total_processed_size = 0;
-    while (!scan_finished) { 
-        scan_finished = true;
-        total_processed_size = 0;
-        for (const auto& ms : memscanners) {
-            total_processed_size += ms.processed_memory_size;
-            scan_finished &= ms.finished;
-        }
+    while (!scan_finished) {
+        scan_finished = pool->wait(100);
+        uint64_t total_processed_size = 0;
+        for (const auto& mst : memscanners)
+            total_processed_size += mst->processed_memory_size;
         emit signalProgress(total_processed_size);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
-    last_scan_was_region = (first && (compare_type == CompareType::Previous));
-
-    /* Wait for the thread to finish. */
-    total_size = 0;
-    total_processed_size = 0;
-    for (int t = 0; t < thread_count; t++) {
-        memscan_threads[t].join();
+    last_scan_was_region = region_scan;
 
-        /* Compute total size and processed size (for display) */
-        total_size += memscanners[t].new_memory_size;
-        total_processed_size += memscanners[t].processed_memory_size;
+    if (pagemap_fd >= 0) {
+        close(pagemap_fd);
+        pagemap_fd = -1;
     }
 
-    /* If user requested a stop, skip the file merging and report as if
-     * we didn't find any result */
+    use_dirty_pages = false;
+    dirty_pages.reset();
+
+    addresses.clear();
+    old_values.clear();
+
+    /* If user requested a stop, report as if we didn't find any result */
     if (is_stopped) {
-        addresses.clear();
-        old_values.clear();
+        results.clear();
+        for (int g = 0; g < 2; g++)
+            stores[g]->reset(0);
         total_size = 0;
+        close_mapped_files();
         return;
     }
 
-    /* Wait for each thread to finish and merge all individual files created
-     * by each thread into a single file, and inside vectors to be displayed. */
-    /* TODO: this can take a bit of time, do this in another thread if we don't
-     * need to display values (above threshold).
-     * Prevent a new search until the file merge is completed */
-    std::ofstream ovfs(values_path, std::ofstream::binary);
-    std::ofstream oafs;
-    if (!last_scan_was_region) {
-        oafs.open(addresses_path, std::ofstream::binary);
+    /* The new results become the last scan, without any merging, and the
+     * previous results are freed. Only keep the chunks that contain results. */
+    stores[generation]->reset(0);
+    generation = 1 - generation;
+    results.clear();
+    total_size = 0;
+    for (const MemScanChunk& chunk : new_results) {
+        if (chunk.size == 0)
+            continue;
+        results.push_back(chunk);
+        total_size += chunk.size;
     }
 
-    /* Reset progress bar to show progression of file merging */
-    emit signalProgress(0);
-    uint64_t cur_size = 0;
+    /* Files are only needed by the results of a region scan */
+    if (!last_scan_was_region)
+        close_mapped_files();
 
-    for (int t = 0; t < thread_count; t++) {
-        const MemScannerThread& mst = memscanners[t];
-        
-        /* For some reason, trying to append an empty file messes up the stream */
-        if (memscanners[t].new_memory_size == 0)
-            continue;
-            
-        /* Append memscan_thread file to unique file */
-        if (!last_scan_was_region) {
-            std::ifstream iafs(mst.addresses_path, std::ios_base::binary);
-            oafs << iafs.rdbuf();
-            uint64_t recorded_size = memscanners[t].new_memory_size * sizeof(uintptr_t) / value_type_size;
-            if (iafs.tellg() != recorded_size)
-                std::cerr << "Mismatch size between recorded (" << recorded_size << ") and file (" <<  iafs.tellg() << ") sizes" << std::endl;
-        }
-        std::ifstream ivfs(mst.values_path, std::ios_base::binary);
-        ovfs << ivfs.rdbuf();
-        if (ivfs.tellg() != memscanners[t].new_memory_size)
-            std::cerr << "Mismatch size between recorded (" << memscanners[t].new_memory_size << ") and file (" <<  ivfs.tellg() << ") sizes" << std::endl;
-        
-        if (is_stopped) {
-            addresses.clear();
-            old_values.clear();
-            total_size = 0;
-            return;
-        }
-
-        /* Some math to reuse progress bar that has the old size for total */
-        cur_size += memscanners[t].new_memory_size;
-        emit signalProgress(cur_size*total_processed_size/total_size);
-    }
-    
     /* If the total size is below threshold, load all data (except if region data) */
     if (last_scan_was_region) return;
 
-    addresses.clear();
-    old_values.clear();
-    
     if (total_size < (DISPLAY_THRESHOLD*value_type_size)) {
-        /* Close the streams before reading the files */
-        oafs.close();
-        ovfs.close();
-        
-        std::ifstream iafs(addresses_path, std::ios::in | std::ios::binary);
-        addresses = std::vector<char>(std::istreambuf_iterator<char>(iafs), std::istreambuf_iterator<char>());
-
-        std::ifstream ivfs(values_path, std::ios::in | std::ios::binary);
-        old_values = std::vector<char>(std::istreambuf_iterator<char>(ivfs), std::istreambuf_iterator<char>());
+        for (const MemScanChunk& chunk : results) {
+            MemScanChunkReader reader(chunk, value_type_size);
+            uintptr_t addr;
+            const uint8_t* value;
+            while (reader.next(addr, value)) {
+                const char* addr_bytes = reinterpret_cast<const char*>(&addr);
+                addresses.insert(addresses.end(), addr_bytes, addr_bytes + sizeof(uintptr_t));
+                old_values.insert(old_values.end(), value, value + value_type_size);
+            }
+        }
     }
 }
 
@@ -313,7 +299,41 @@ const char* MemScanner::get_current_value(int index, bool hex) const
 void MemScanner::clear()
 {
     total_size = 0;
+    dirty_tracking = false;
+    results.clear();
+    for (int g = 0; g < 2; g++)
+        if (stores[g])
+            stores[g]->reset(0);
     addresses.clear();
     old_values.clear();
     memsections.clear();
+    close_mapped_files();
+}
+
+int MemScanner::open_mapped_file(const MemSection& section)
+{
+    if (section.writeflag || section.sharedflag || section.filename.empty() || (section.filename[0] != '/'))
+        return -1;
+
+    /* The file may have been replaced since it was mapped */
+    const std::string deleted = " (deleted)";
+    if ((section.filename.size() > deleted.size()) &&
+        (section.filename.compare(section.filename.size() - deleted.size(), deleted.size(), deleted) == 0))
+        return -1;
+
+    auto it = mapped_files.find(section.filename);
+    if (it != mapped_files.end())
+        return it->second;
+
+    int fd = open(section.filename.c_str(), O_RDONLY);
+    mapped_files[section.filename] = fd;
+    return fd;
+}
+
+void MemScanner::close_mapped_files()
+{
+    for (auto& file : mapped_files)
+        if (file.second >= 0)
+            close(file.second);
+    mapped_files.clear();
 }
@@ -22,24 +22,45 @@
 
 #include "CompareOperations.h"
 #include "MemSection.h"
+#include "MemScanStore.h"
+#include "MemDirtyPages.h"
 // #include "MemScanner.h"
 
 #include <QtCore/QObject>
 #include <string>
 #include <vector>
+#include <memory>
+#include <map>
+#include <atomic>
 #include <cstdint>
+#include <sys/types.h>
+
+/* Forward declaration */
+class MemScannerThread;
+class MemScanPool;
 
 /* Store a section of the game memory */
 class MemScanner : public QObject {
     Q_OBJECT
     
     public:
+        MemScanner();
+        ~MemScanner();
+
         /* Initialize the memory scanner with the memory scan path */
         static void init(std::string path);
 
+        /* Soft-dirty bits cannot be trusted anymore by any scanner, because
+         * a savestate may have cleared them. Must be called on each savestate
+         * save or load, and when savestate settings change. */
+        static void invalidate_dirty_tracking();
+
         /* First memory scan */
         void first_scan(pid_t pid, int mem_flags, int type, CompareType ct, CompareOperator co, double cv, double dv);
 
+        /* First memory scan of a list of memory sections */
+        void first_scan(const std::vector<MemSection>& sections, int type, CompareType ct, CompareOperator co, double cv, double dv);
+
         /* Generic memory scan method */
         void scan(bool first, CompareType ct, CompareOperator co, double cv, double dv);
 
@@ -68,12 +89,43 @@ class MemScanner : public QObject {
         /* Array of all memory sections parsed from /proc/self/maps */
         std::vector<MemSection> memsections;
         
-        const int THREAD_COUNT = 4;
         const uint64_t DISPLAY_THRESHOLD = 10000; // don't display results when above threshold
         
+        /* Size of the memory covered by each work item of a first scan. Items
+         * never span over two memory sections. */
+        uint64_t chunk_size = 16*1024*1024;
+
+        /* Number of scanner threads, or zero for one per cpu core. Only read
+         * before the first scan. */
+        int thread_count = 0;
+
+        /* Memory used by the results of the last two scans, before storing
+         * them in a file */
+        uint64_t memory_budget = 1024*1024*1024;
+
+        /* Use the soft-dirty bits of the game to only read again the pages
+         * that were written since the previous scan. Must not be set when
+         * savestates use the soft-dirty bits. */
+        bool soft_dirty = false;
+
+        /* Clean pages of the previous results, if used by the current scan */
+        MemDirtyPages dirty_pages;
+        bool use_dirty_pages = false;
+
+        /* Descriptor of the pagemap of the game during a first region scan,
+         * to know which pages of read-only file mappings were not modified */
+        int pagemap_fd = -1;
+
         static std::string memscan_path; // directory containing all scan files
-        static std::string addresses_path; // output file containing all scan addresses
-        static std::string values_path; // output file containing all scan values
+
+        /* Scanner threads */
+        std::vector<std::unique_ptr<MemScannerThread>> memscanners;
+
+        /* Storage of the results, alternating between two generations, so
+         * that a scan reads the results of the previous one while storing
+         * its own */
+        std::unique_ptr<MemScanStore> stores[2];
+        int generation = 0;
         
         int value_type;
         int value_type_size;
@@ -86,11 +138,33 @@ class MemScanner : public QObject {
         
     private:
         bool last_scan_was_region = true;
+
+        /* Soft-dirty bits were cleared right before the last scan */
+        bool dirty_tracking = false;
+
+        /* Value of dirty_epoch when the soft-dirty bits were cleared */
+        uint64_t dirty_tracking_epoch = 0;
+        static std::atomic<uint64_t> dirty_epoch;
         uint64_t total_size = 0; // total size of the last scan (in bytes)
 
+        std::unique_ptr<MemScanPool> pool;
+
+        std::vector<MemScanChunk> results; // ordered results of the last scan
+
         std::vector<char> addresses; // scan addresses shown to the user
         std::vector<char> old_values; // scan previous values shown to the user
 
+        /* Read-only files mapped by the game, that hold the unmodified
+         * pages of a region scan */
+        std::map<std::string, int> mapped_files;
+
+        /* Open the file of a read-only file mapping. Returns -1 if the
+         * section is not a read-only file mapping or on failure. */
+        int open_mapped_file(const MemSection& section);
+
+        /* Close all mapped files */
+        void close_mapped_files();
+
     signals:
         /* Update the scan progress bar */
         void signalProgress(int);
@@ -23,221 +23,217 @@
 #include "MemAccess.h"
 #include "CompareOperations.h"
 
-#include <cstring>
-#include <sstream>
-#include <fstream>
 #include <iostream>
 #include <vector>
-#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
 
 #define MEMORY_CHUNK_SIZE 1024*1024
 
-MemScannerThread::MemScannerThread(MemScanner& ms, int br, int er, uintptr_t ba, uintptr_t ea, off_t mo, uint64_t mem) : memscanner(ms), beg_region(br), end_region(er), beg_address(ba), end_address(ea), memory_offset(mo), memory_size(mem)
+/* Flags of a pagemap entry */
+#define PAGEMAP_FILE (0x1ull << 61)
+#define PAGEMAP_SWAPPED (0x1ull << 62)
+#define PAGEMAP_PRESENT (0x1ull << 63)
+
+MemScannerThread::MemScannerThread(MemScanner& ms, int i) : memscanner(ms), index(i)
 {
-    finished = false;
+    processed_memory_size = 0;
 }
 
-MemScannerThread::~MemScannerThread()
+void MemScannerThread::finish_result(MemScanChunk& result)
 {
-    if (!addresses_path.empty())
-        std::remove(addresses_path.c_str());
-    if (!values_path.empty())
-        std::remove(values_path.c_str());
+    /* Results are stored in the generation that is not the last scan */
+    MemScanStore& store = *memscanner.stores[1 - memscanner.generation];
+    if (!writer.finish(store, result)) {
+        std::cerr << "error: could not store the scan results at address " << result.beg_address << std::endl;
+        result.size = 0;
+    }
 }
 
-void MemScannerThread::create_output_files()
+/* Hash the contents of a page. Returns false if the page only contains
+ * zeros. */
+static bool hash_page(const uint8_t* page, uint64_t& hash)
 {
-    /* Create the files with names from the thread tid */
-    std::ostringstream ossa;
-    ossa << memscanner.memscan_path << "/addresses-" << std::this_thread::get_id() << ".tmp";    
-    addresses_path = ossa.str();
-
-    std::ostringstream ossv;
-    ossv << memscanner.memscan_path << "/memory-" << std::this_thread::get_id() << ".tmp";
-    values_path = ossv.str();
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(page);
+    uint64_t h = 0;
+    uint64_t bits = 0;
+    for (int w = 0; w < 4096/8; w++) {
+        bits |= words[w];
+        h = (h ^ words[w]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+    }
+    hash = h;
+    return bits != 0;
 }
 
-void MemScannerThread::first_region_scan()
+void MemScannerThread::first_region_scan(const MemScanChunk& item, MemScanChunk& result)
 {
-    create_output_files();    
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
-    new_memory_size = 0;
-    processed_memory_size = 0;
-    
-    /* Start searching from beg_address to end_address, which were split evenly
-     * between all threads. Read memory by chunks */
-    uintptr_t cur_beg_addr = beg_address;
-    uintptr_t cur_end_addr;
-    for (int r = beg_region; r <= end_region; r++) {
-        const MemSection& ms = memscanner.memsections[r];
-
-        /* Determine region start and end addresses */
-        if (r > beg_region) cur_beg_addr = ms.addr;
-    
-        if (r == end_region) {
-            if ((end_address <= ms.addr) || (end_address > ms.endaddr)) {
-                std::cerr << "Wrong end address" << std::endl;
-                return;
+    result.beg_address = item.beg_address;
+    result.end_address = item.end_address;
+    result.encoding = MemScanChunk::ENCODING_REGION;
+    result.size = 0;
+    result.file = item.file;
+    result.values = nullptr;
+
+    /* The memory is stored as a table of pages. Pages of zeros are not
+     * stored, identical pages are stored once, and pages of read-only file
+     * mappings that were not modified are read again from the file. */
+    MemScanStore& store = *memscanner.stores[1 - memscanner.generation];
+    uint64_t page_count = (item.end_address - item.beg_address) / 4096;
+    uint64_t* pages = reinterpret_cast<uint64_t*>(store.allocate(page_count * sizeof(uint64_t)));
+    if (!pages) {
+        std::cerr << "error: could not store the scan results at address " << item.beg_address << std::endl;
+        return;
+    }
+    result.addresses = reinterpret_cast<const uint8_t*>(pages);
+    result.addresses_size = page_count * sizeof(uint64_t);
+
+    std::vector<uint8_t> chunk;
+    chunk.resize(MEMORY_CHUNK_SIZE);
+
+    /* Read memory by pages, gathering the pages of a chunk in a few syscalls */
+    for (uintptr_t cur_beg_addr = item.beg_address; cur_beg_addr < item.end_address; cur_beg_addr += MEMORY_CHUNK_SIZE) {
+        int chunk_size = MEMORY_CHUNK_SIZE;
+        if ((item.end_address - cur_beg_addr) < chunk_size)
+            chunk_size = item.end_address - cur_beg_addr;
+
+        int chunk_pages = chunk_size / 4096;
+        uint64_t* chunk_table = pages + (cur_beg_addr - item.beg_address) / 4096;
+        bool file_pages = (item.file >= 0) && read_pagemap(cur_beg_addr, chunk_pages);
+
+        requests.clear();
+        for (int p = 0; p < chunk_pages; p++) {
+            if (file_pages && is_file_page(pagemap[p])) {
+                chunk_table[p] = REGION_PAGE_FILE | (item.file_offset + (cur_beg_addr - item.beg_address) + p * 4096);
+                continue;
             }
-            cur_end_addr = end_address;
-        }
-        else {
-            cur_end_addr = ms.endaddr;
+            MemAccess::ReadRequest req;
+            req.local_addr = &chunk[p * 4096];
+            req.remote_addr = cur_beg_addr + p * 4096;
+            req.size = 4096;
+            requests.push_back(req);
         }
-        
-        /* Write data */
-        uint8_t chunk[4096];
-        
-        for (uintptr_t ca = cur_beg_addr; ca < cur_end_addr; ca += 4096) {
-            int readValues = MemAccess::read(chunk, reinterpret_cast<void*>(ca), 4096);
-            if (readValues < 0) {
-                std::cerr << "Cound not read game process at address " << ca << std::endl;
+        MemAccess::readBatch(requests.data(), requests.size());
+
+        for (const MemAccess::ReadRequest& req : requests) {
+            uint64_t& entry = chunk_table[(req.remote_addr - cur_beg_addr) / 4096];
+            entry = REGION_PAGE_ZERO;
+            if (!req.valid) {
+                std::cerr << "Cound not read game process at address " << req.remote_addr << std::endl;
+                continue;
             }
-            vfs.write((char*)chunk, 4096);
-            new_memory_size += 4096;
-            processed_memory_size += 4096;
-            
-            if (memscanner.is_stopped) {
-                finished = true;
-                return;                
+
+            const uint8_t* page = static_cast<const uint8_t*>(req.local_addr);
+            uint64_t hash;
+            if (!hash_page(page, hash))
+                continue;
+
+            const uint8_t* stored = store.allocate_page(page, hash);
+            if (!stored) {
+                std::cerr << "error: could not store the scan results at address " << req.remote_addr << std::endl;
+                return;
             }
+            entry = reinterpret_cast<uintptr_t>(stored);
         }
+        processed_memory_size += chunk_size;
+
+        if (memscanner.is_stopped)
+            return;
     }
-    finished = true;
+
+    result.size = item.end_address - item.beg_address;
 }
 
-void MemScannerThread::first_address_scan()
+void MemScannerThread::first_address_scan(const MemScanChunk& item, MemScanChunk& result)
 {
-    create_output_files();    
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
-    new_memory_size = 0;
-    processed_memory_size = 0;
+    writer.begin(item.beg_address, item.end_address, memscanner.value_type_size);
 
-    /* Save in files by batches */
-    uintptr_t batch_addresses[4096];
-    uint8_t batch_values[4096*8];
-    int batch_index = 0;
-    
-    /* Start searching from beg_address to end_address, which were split evenly
-     * between all threads. Read memory by chunks */
-    uintptr_t cur_beg_addr = beg_address;
-    uintptr_t cur_end_addr;
-    for (int r = beg_region; r <= end_region; r++) {
-        const MemSection& ms = memscanner.memsections[r];
-
-        /* Determine region start and end addresses */
-        if (r > beg_region) cur_beg_addr = ms.addr;
-    
-        if (r == end_region) {
-            if ((end_address <= ms.addr) || (end_address > ms.endaddr)) {
-                std::cerr << "Wrong end address" << std::endl;
-                return;
-            }
-            cur_end_addr = end_address;
-        }
-        else {
-            cur_end_addr = ms.endaddr;
-        }
-        
-        /* Write data */
-        uint8_t chunk[4096];
-        
-        for (uintptr_t ca = cur_beg_addr; ca < cur_end_addr; ca += 4096) {
-            processed_memory_size += 4096;
-
-            int readValues = MemAccess::read(chunk, reinterpret_cast<void*>(ca), 4096);
-            if (readValues < 0)
+    /* Match mask of a chunk, one bit per value */
+    int value_count = 4096 / memscanner.value_type_size;
+    uint64_t mask[4096 / 64];
+
+    /* Read memory by pages, gathering the pages of a chunk in a few syscalls */
+    std::vector<uint8_t> chunk;
+    chunk.resize(MEMORY_CHUNK_SIZE);
+
+    for (uintptr_t cur_beg_addr = item.beg_address; cur_beg_addr < item.end_address; cur_beg_addr += MEMORY_CHUNK_SIZE) {
+        int chunk_size = MEMORY_CHUNK_SIZE;
+        if ((item.end_address - cur_beg_addr) < chunk_size)
+            chunk_size = item.end_address - cur_beg_addr;
+
+        processed_memory_size += chunk_size;
+
+        if (memscanner.is_stopped)
+            return;
+
+        read_pages(chunk.data(), cur_beg_addr, chunk_size);
+
+        for (const MemAccess::ReadRequest& req : requests) {
+            if (!req.valid)
                 continue;
-            for (int v = 0; v < 4096; v += memscanner.value_type_size) {
-                if (CompareOperations::check_value(chunk+v)) {
-                    batch_addresses[batch_index] = ca + v;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), chunk+v, memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == 4096) {
-                        afs.write((char*)batch_addresses, 4096*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, 4096*memscanner.value_type_size);
-                        new_memory_size += 4096*memscanner.value_type_size;
-                        batch_index = 0;
-                    }
-                }
 
-                if (memscanner.is_stopped) {
-                    finished = true;
-                    return;                
-                }
-            }
+            /* Compare the whole page, and only look at the matching values */
+            const uint8_t* page = static_cast<const uint8_t*>(req.local_addr);
+            if (CompareOperations::check_value_chunk(page, value_count, mask) > 0)
+                writer.add_mask(req.remote_addr, page, mask, value_count);
         }
     }
-    
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    new_memory_size += batch_index*memscanner.value_type_size;
-    finished = true;
+
+    finish_result(result);
 }
 
-void MemScannerThread::next_scan_from_region()
+void MemScannerThread::next_scan_from_region(const MemScanChunk& previous, MemScanChunk& result)
 {
-    create_output_files();    
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
-    new_memory_size = 0;
-    processed_memory_size = 0;
+    writer.begin(previous.beg_address, previous.end_address, memscanner.value_type_size);
 
     std::vector<uint8_t> new_memory;
     new_memory.resize(MEMORY_CHUNK_SIZE);
+    std::vector<uint8_t> old_memory_buffer;
+    old_memory_buffer.resize(MEMORY_CHUNK_SIZE);
 
-    /* If we compare from previous memory, read and process saved memory by
-     * chunks and by region, because all threads access to the same file. */
-    std::vector<char> old_memory;
-    std::ifstream ivfs;
-    if (memscanner.compare_type == CompareType::Previous) {
-        old_memory.resize(MEMORY_CHUNK_SIZE);
-        
-        ivfs.open(memscanner.values_path, std::ofstream::binary);
-        ivfs.seekg(memory_offset);
-    }
-    
-    /* Save in files by batches */
-    uintptr_t batch_addresses[4096];
-    uint8_t batch_values[4096*8];
-    int batch_index = 0;
-
-    uintptr_t cur_beg_addr = beg_address;
-    uintptr_t cur_end_addr;
-    for (int r = beg_region; r <= end_region; r++) {
-        const MemSection& ms = memscanner.memsections[r];
-
-        /* Determine region start and end addresses */
-        if (r > beg_region) cur_beg_addr = ms.addr;
-    
-        if (r == end_region) {
-            if ((end_address <= ms.addr) || (end_address > ms.endaddr)) {
-                std::cerr << "Wrong end address" << std::endl;
-                return;
+    /* Match mask of a chunk, one bit per value */
+    std::vector<uint64_t> mask;
+    mask.resize(MEMORY_CHUNK_SIZE / 64);
+
+    /* Pages that were not written since the previous scan */
+    const uint64_t* clean = memscanner.use_dirty_pages ? memscanner.dirty_pages.clean_pages(previous.beg_address) : nullptr;
+
+    /* Read chunks of memory */
+    for (uintptr_t cur_beg_addr = previous.beg_address; cur_beg_addr < previous.end_address; cur_beg_addr += MEMORY_CHUNK_SIZE) {
+        int chunk_size = MEMORY_CHUNK_SIZE;
+        if ((previous.end_address - cur_beg_addr) < chunk_size)
+            chunk_size = previous.end_address - cur_beg_addr;
+
+        processed_memory_size += chunk_size;
+
+        read_region(previous, cur_beg_addr, chunk_size, old_memory_buffer.data());
+        const uint8_t* old_memory = old_memory_buffer.data();
+
+        if (clean) {
+            /* Only read the written pages, and copy the other ones from the
+             * previous values */
+            requests.clear();
+            for (int p = 0; p < chunk_size; p += 4096) {
+                int page_size = std::min(4096, chunk_size - p);
+                if (MemDirtyPages::is_clean(clean, previous.beg_address, cur_beg_addr + p)) {
+                    memcpy(&new_memory[p], old_memory + p, page_size);
+                    continue;
+                }
+                MemAccess::ReadRequest req;
+                req.local_addr = &new_memory[p];
+                req.remote_addr = cur_beg_addr + p;
+                req.size = page_size;
+                requests.push_back(req);
+            }
+            MemAccess::readBatch(requests.data(), requests.size());
+            for (const MemAccess::ReadRequest& req : requests) {
+                if (!req.valid) {
+                    std::cerr << "Cound not read game process at address " << req.remote_addr << std::endl;
+                }
             }
-            cur_end_addr = end_address;
         }
         else {
-            cur_end_addr = ms.endaddr;
-        }
-        
-        /* Read chunks of memory */
-        while (cur_beg_addr < cur_end_addr) {
-            int chunk_size = MEMORY_CHUNK_SIZE;
-            if ((cur_end_addr - cur_beg_addr) < chunk_size)
-                chunk_size = cur_end_addr - cur_beg_addr;
-            
-            processed_memory_size += chunk_size;
-
-            if (memscanner.compare_type == CompareType::Previous) {
-                ivfs.read(old_memory.data(), chunk_size);
-            }
-            
             int readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(cur_beg_addr), chunk_size);
             if (readValues < 0) {
                 std::cerr << "Cound not read game process at address " << cur_beg_addr << std::endl;
@@ -245,174 +241,198 @@ void MemScannerThread::next_scan_from_region()
             if (readValues < chunk_size) {
                 std::cerr << "Did not read enough memory at address " << cur_beg_addr << std::endl;
             }
-            
-            for (int v = 0; v < chunk_size; v += memscanner.value_type_size) {
-                if (((memscanner.compare_type == CompareType::Previous) && 
-                    CompareOperations::check_previous(&new_memory[v], &old_memory[v])) ||
-                    ((memscanner.compare_type == CompareType::Value) && 
-                    CompareOperations::check_value(&new_memory[v]))) {
-                    batch_addresses[batch_index] = cur_beg_addr + v;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), &new_memory[v], memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == 4096) {
-                        afs.write((char*)batch_addresses, 4096*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, 4096*memscanner.value_type_size);
-                        new_memory_size += 4096*memscanner.value_type_size;
-                        batch_index = 0;
-                    }
-                }
-                
-                if (memscanner.is_stopped) {
-                    finished = true;
-                    return;                
-                }
-            }
-            
-            cur_beg_addr += chunk_size;            
         }
+
+        /* Compare the whole chunk with the previous values that are stored
+         * in the previous results, and only look at the matching values */
+        int value_count = chunk_size / memscanner.value_type_size;
+        int matches;
+        if (memscanner.compare_type == CompareType::Previous)
+            matches = CompareOperations::check_previous_chunk(new_memory.data(), old_memory, value_count, mask.data());
+        else
+            matches = CompareOperations::check_value_chunk(new_memory.data(), value_count, mask.data());
+
+        if (matches > 0)
+            writer.add_mask(cur_beg_addr, new_memory.data(), mask.data(), value_count);
+
+        if (memscanner.is_stopped)
+            return;
     }
-    
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    new_memory_size += batch_index*memscanner.value_type_size;
-    finished = true;
+
+    finish_result(result);
 }
 
-void MemScannerThread::next_scan_from_address()
+void MemScannerThread::next_scan_from_address(const MemScanChunk& previous, MemScanChunk& result)
 {
-    create_output_files();
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
-    new_memory_size = 0;
-    processed_memory_size = 0;
-
-    int size_ratio = sizeof(uintptr_t)/memscanner.value_type_size;
+    writer.begin(previous.beg_address, previous.end_address, memscanner.value_type_size);
 
     std::vector<uint8_t> new_memory;
-    new_memory.resize(4096);
-
-    /* If we compare from previous memory, read and process saved memory by
-     * chunks and by region, because all threads access to the same file. */
-    int max_chunk_size = MEMORY_CHUNK_SIZE;
-    if (memory_size < max_chunk_size)
-        max_chunk_size = memory_size;
-
-    std::vector<char> old_memory;
-
-    std::ifstream ivfs;
-    if (memscanner.compare_type == CompareType::Previous) {
-        old_memory.resize(max_chunk_size);
-        
-        ivfs.open(memscanner.values_path, std::ifstream::binary);
-        ivfs.seekg(memory_offset);
-    }
+    new_memory.resize(MEMORY_CHUNK_SIZE);
 
+    /* Decode the previous results by chunks. Previous values are read in
+     * place from the previous results. */
+    int max_chunk_count = MEMORY_CHUNK_SIZE / memscanner.value_type_size;
     std::vector<uintptr_t> old_addresses;
-    old_addresses.resize(max_chunk_size/memscanner.value_type_size);
-
-    std::ifstream iafs(memscanner.addresses_path, std::ifstream::binary);
-    if (!iafs)
-        std::cerr << "error: could not open file " << memscanner.addresses_path << std::endl;
-    iafs.seekg(memory_offset*size_ratio);
-    if (!iafs)
-        std::cerr << "error: could not seek to offset " << memory_offset*size_ratio << std::endl;
-    
-    /* Save in files by batches */
-    uintptr_t batch_addresses[4096];
-    uint8_t batch_values[4096*8];
-    int batch_index = 0;
+    old_addresses.resize(max_chunk_count);
+    std::vector<const uint8_t*> old_values;
+    old_values.resize(max_chunk_count);
+
+    /* First address index of each memory read */
+    std::vector<int> groups;
+
+    /* Pages that were not written since the previous scan. Their values
+     * are the previous ones, so they are not read. */
+    const uint64_t* clean = memscanner.use_dirty_pages ? memscanner.dirty_pages.clean_pages(previous.beg_address) : nullptr;
+    std::vector<bool> clean_groups;
+
+    MemScanChunkReader reader(previous, memscanner.value_type_size);
+
+    while (true) {
+        int chunk_count = 0;
+        while ((chunk_count < max_chunk_count) && reader.next(old_addresses[chunk_count], old_values[chunk_count]))
+            chunk_count++;
+
+        if (chunk_count == 0)
+            break;
 
-    /* Read chunks of memory */
-    uint64_t remaining_memory_size = memory_size;
-    while (remaining_memory_size > 0) {
-        int chunk_size = MEMORY_CHUNK_SIZE;
-        if (remaining_memory_size < chunk_size)
-            chunk_size = remaining_memory_size;
-        
-        if (memscanner.compare_type == CompareType::Previous) {
-            ivfs.read(old_memory.data(), chunk_size);
-            if (!ivfs)
-                std::cerr << "error: only " << ivfs.gcount() << " could be read from " << chunk_size << std::endl;
-        }
-        iafs.read((char*)old_addresses.data(), chunk_size*size_ratio);
-        if (!iafs)
-        std::cerr << "error: only " << iafs.gcount() << " could be read from " << chunk_size << std::endl;
-        
         int addr_beg_index = 0;
-        int addr_end_index = chunk_size / memscanner.value_type_size;
+        int addr_end_index = chunk_count;
 
-        // std::cout << "Index " << addr_beg_index << " to " << addr_end_index << " for thread " << std::this_thread::get_id() << std::endl;
-        // std::cout << "Chunk " << old_addresses[addr_beg_index] << " to " << old_addresses[addr_end_index-1] << " for thread " << std::this_thread::get_id() << std::endl;
-        
         while (addr_beg_index < addr_end_index) {
-            
-            /* Look at all old addresses that are inside the same memory page.
-             * From cheatengine source code comments, it is faster to load an 
-             * entire memory page and look at the specific addresses than loading
-             * each individual addresses (because caching), except if you only
-             * need one address in the memory page.
-             */
-            uintptr_t beg_addr = old_addresses[addr_beg_index];
-            uintptr_t beg_page = beg_addr & 0xfffffffffffff000;
-            
-            int addr_cur_index;
-            for (addr_cur_index = addr_beg_index+1; addr_cur_index < addr_end_index; addr_cur_index++) {
-                if ((old_addresses[addr_cur_index] & 0xfffffffffffff000) != beg_page)
-                    break;
-            }
-            
-            processed_memory_size += (addr_cur_index-addr_beg_index)*memscanner.value_type_size;
 
-            int readValues;
+            /* Gather the reads until the buffer is full */
+            requests.clear();
+            groups.clear();
+            clean_groups.clear();
+            size_t memory_size = 0;
+
+            while ((addr_beg_index < addr_end_index) && ((memory_size + 4096) <= new_memory.size())) {
+
+                /* Look at all old addresses that are inside the same memory page.
+                 * From cheatengine source code comments, it is faster to load an 
+                 * entire memory page and look at the specific addresses than loading
+                 * each individual addresses (because caching), except if you only
+                 * need one address in the memory page.
+                 */
+                uintptr_t beg_addr = old_addresses[addr_beg_index];
+                uintptr_t beg_page = beg_addr & 0xfffffffffffff000;
+
+                int addr_cur_index;
+                for (addr_cur_index = addr_beg_index+1; addr_cur_index < addr_end_index; addr_cur_index++) {
+                    if ((old_addresses[addr_cur_index] & 0xfffffffffffff000) != beg_page)
+                        break;
+                }
 
-            /* If only one address in page, load that address */
-            if ((addr_cur_index-addr_beg_index) == 1) {
-                readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(beg_addr), memscanner.value_type_size);
-            }
-            else {
-                /* Load all values from first to last address */
+                processed_memory_size += (addr_cur_index-addr_beg_index)*memscanner.value_type_size;
+
+                /* Load all values from first to last address. If only one
+                 * address in page, this only loads that address */
                 uintptr_t last_addr = old_addresses[addr_cur_index-1];
-                readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(beg_addr), (last_addr-beg_addr)+memscanner.value_type_size);
+                bool is_clean = clean && MemDirtyPages::is_clean(clean, previous.beg_address, beg_page);
+                MemAccess::ReadRequest req;
+                req.local_addr = &new_memory[memory_size];
+                req.remote_addr = beg_addr;
+                req.size = is_clean ? 0 : (last_addr-beg_addr)+memscanner.value_type_size;
+                requests.push_back(req);
+                groups.push_back(addr_beg_index);
+                clean_groups.push_back(is_clean);
+                memory_size += req.size;
+
+                addr_beg_index = addr_cur_index;
             }
-            if (readValues < 0)
-                continue;
-            
-            for (int i = addr_beg_index; i < addr_cur_index; i++) {
-                uintptr_t addr = old_addresses[i];
-                int mem_index = addr-beg_addr;
-                
-                if (((memscanner.compare_type == CompareType::Previous) && 
-                    CompareOperations::check_previous(&new_memory[mem_index], &old_memory[i*memscanner.value_type_size])) ||
-                    ((memscanner.compare_type == CompareType::Value) && 
-                    CompareOperations::check_value(&new_memory[mem_index]))) {
-                    batch_addresses[batch_index] = addr;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), &new_memory[mem_index], memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == 4096) {
-                        afs.write((char*)batch_addresses, 4096*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, 4096*memscanner.value_type_size);
-                        new_memory_size += 4096*memscanner.value_type_size;
-                        batch_index = 0;
+            groups.push_back(addr_beg_index);
+
+            /* Read all values with a few syscalls */
+            MemAccess::readBatch(requests.data(), requests.size());
+
+            for (unsigned int g = 0; g < requests.size(); g++) {
+                const MemAccess::ReadRequest& req = requests[g];
+                if (!req.valid && !clean_groups[g])
+                    continue;
+
+                const uint8_t* memory = static_cast<const uint8_t*>(req.local_addr);
+                for (int i = groups[g]; i < groups[g+1]; i++) {
+                    uintptr_t addr = old_addresses[i];
+                    const uint8_t* value = clean_groups[g] ? old_values[i] : &memory[addr-req.remote_addr];
+
+                    if (((memscanner.compare_type == CompareType::Previous) && 
+                        CompareOperations::check_previous(value, old_values[i])) ||
+                        ((memscanner.compare_type == CompareType::Value) && 
+                        CompareOperations::check_value(value))) {
+                        writer.add(addr, value);
                     }
                 }
-                
-                if (memscanner.is_stopped) {
-                    finished = true;
-                    return;                
-                }
             }
-            
-            addr_beg_index = addr_cur_index;
         }
-        memory_offset += chunk_size;
-        remaining_memory_size -= chunk_size;
+
+        if (memscanner.is_stopped)
+            return;
     }
     
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    new_memory_size += batch_index*memscanner.value_type_size;
-    finished = true;
+    finish_result(result);
+}
+
+void MemScannerThread::read_pages(uint8_t* local_addr, uintptr_t remote_addr, int size)
+{
+    requests.clear();
+    for (int p = 0; p < size; p += 4096) {
+        MemAccess::ReadRequest req;
+        req.local_addr = local_addr + p;
+        req.remote_addr = remote_addr + p;
+        req.size = 4096;
+        requests.push_back(req);
+    }
+    MemAccess::readBatch(requests.data(), requests.size());
+}
+
+void MemScannerThread::read_region(const MemScanChunk& region, uintptr_t addr, int size, uint8_t* memory)
+{
+    const uint64_t* pages = reinterpret_cast<const uint64_t*>(region.addresses) + (addr - region.beg_address) / 4096;
+    int page_count = size / 4096;
+
+    for (int p = 0; p < page_count; p++) {
+        uint8_t* page = memory + p * 4096;
+        uint64_t entry = pages[p];
+
+        if (entry == REGION_PAGE_ZERO) {
+            memset(page, 0, 4096);
+        }
+        else if (entry & REGION_PAGE_FILE) {
+            /* Read consecutive pages of the file at once */
+            int count = 1;
+            while (((p + count) < page_count) && (pages[p + count] == (entry + count * 4096)))
+                count++;
+
+            off_t offset = entry & ~REGION_PAGE_FILE;
+            ssize_t ret = pread(region.file, page, count * 4096, offset);
+            if (ret < 0)
+                ret = 0;
+            /* Pages past the end of the file cannot be read from memory either */
+            if (ret < (count * 4096))
+                memset(page + ret, 0, count * 4096 - ret);
+            p += count - 1;
+        }
+        else {
+            memcpy(page, reinterpret_cast<const uint8_t*>(entry), 4096);
+        }
+    }
+}
+
+bool MemScannerThread::read_pagemap(uintptr_t addr, int count)
+{
+    if (memscanner.pagemap_fd < 0)
+        return false;
+
+    pagemap.resize(count);
+    ssize_t size = count * sizeof(uint64_t);
+    return pread(memscanner.pagemap_fd, pagemap.data(), size, (addr / 4096) * sizeof(uint64_t)) == size;
+}
+
+bool MemScannerThread::is_file_page(uint64_t entry)
+{
+    /* A page of a private file mapping that was never faulted in still
+     * holds the file contents, and a modified page becomes anonymous */
+    if (!(entry & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)))
+        return true;
+    return (entry & PAGEMAP_PRESENT) && (entry & PAGEMAP_FILE);
 }
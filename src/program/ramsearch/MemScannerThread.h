@@ -21,46 +21,63 @@
 #define LIBTAS_MEMSCANNERTHREAD_H_INCLUDED
 
 #include "MemScanner.h"
+#include "MemAccess.h"
 
 #include <string>
 #include <cstdint>
+#include <atomic>
+#include <vector>
 
-/* Store a section of the game memory */
+/* Scan work items on a thread of the scanner pool, and store the results in
+ * the results store of the new scan */
 class MemScannerThread {
     public:
-        MemScannerThread(MemScanner& ms, int br, int er, uintptr_t ba, uintptr_t ea, off_t mo, uint64_t mem);
-        ~MemScannerThread();
+        MemScannerThread(MemScanner& ms, int i);
 
-        /* Create the output files that are named based on the scanning thread id */
-        void create_output_files();
-        
-        /* First scan that will store the full memory when user set 'unknown value' */
-        void first_region_scan();
+        /* First scan that will store the full memory when user set 'unknown value'.
+         * The memory is stored as a table of pages, see MemScanChunk. */
+        void first_region_scan(const MemScanChunk& item, MemScanChunk& result);
 
         /* First scan that will store memory and addresses because user compare
          * to some value */
-        void first_address_scan();
+        void first_address_scan(const MemScanChunk& item, MemScanChunk& result);
 
         /* Subsequent scan when previous was unknown (full memory) */
-        void next_scan_from_region();
+        void next_scan_from_region(const MemScanChunk& previous, MemScanChunk& result);
 
         /* Subsequent scan when previous had memory and addresses (common case) */
-        void next_scan_from_address();
+        void next_scan_from_address(const MemScanChunk& previous, MemScanChunk& result);
 
         const MemScanner& memscanner; // Reference to the scanner controller
-        int beg_region, end_region; // Range of memory regions to search into
-        uintptr_t beg_address, end_address; // Range of memory addresses to search into
-        
-        off_t memory_offset; // Offset in the memory file pointed by the starting address
-        uint64_t memory_size; // Size of the memory file portion to process (in bytes)
-        
-        uint64_t new_memory_size; // New size after the scan (in bytes)
-        volatile uint64_t processed_memory_size; // Current processed size (in bytes), used for progress bar
-        
-        std::string addresses_path; // Output file of addresses
-        std::string values_path; // Output file of values
-        
-        volatile bool finished; // indicate if scan is finished, used for progress bar
+        int index; // Index of the thread in the pool
+
+        std::atomic<uint64_t> processed_memory_size; // Current processed size (in bytes), used for progress bar
+
+    private:
+        MemScanChunkWriter writer; // Builder of the results of a work item
+
+        /* Memory reads gathered in a single batch */
+        std::vector<MemAccess::ReadRequest> requests;
+
+        /* Pagemap entries of the pages being read */
+        std::vector<uint64_t> pagemap;
+
+        /* Store the results of a work item */
+        void finish_result(MemScanChunk& result);
+
+        /* Read consecutive pages with a few syscalls, each page being a
+         * separate request that can be invalid */
+        void read_pages(uint8_t* local_addr, uintptr_t remote_addr, int size);
+
+        /* Rebuild the memory of a region stored by a first region scan */
+        void read_region(const MemScanChunk& region, uintptr_t addr, int size, uint8_t* memory);
+
+        /* Read the pagemap entries of consecutive pages. Returns false on
+         * failure. */
+        bool read_pagemap(uintptr_t addr, int count);
+
+        /* Returns if a page of a read-only file mapping is equal to the file */
+        static bool is_file_page(uint64_t entry);
 };
 
 #endif
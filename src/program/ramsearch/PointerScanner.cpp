@@ -0,0 +1,670 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PointerScanner.h"
+#include "MemScanPool.h"
+#include "MemAccess.h"
+#include "MemLayout.h"
+#include "MemSection.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+/* Size of the memory covered by each work item when locating pointers */
+#define LOCATE_ITEM_SIZE (16*1024*1024)
+
+/* Number of pages read at once */
+#define LOCATE_BATCH_PAGES 256
+
+/* Number of addresses processed by each work item of a chain search level */
+#define SEARCH_ITEM_NODES 1024
+
+/* Number of chains followed by each work item when validating chains */
+#define VALIDATE_ITEM_CHAINS 4096
+
+/* Number of bits sorted by each pass of the radix sort */
+#define RADIX_BITS 11
+
+PointerScanner::PointerScanner() {}
+
+/* Defined here because of the forward-declared members */
+PointerScanner::~PointerScanner() {}
+
+MemScanPool& PointerScanner::getPool()
+{
+    if (!pool)
+        pool.reset(new MemScanPool());
+    return *pool;
+}
+
+/* LSD radix sort of entries by pointed address. Passes where all entries
+ * have the same digit are skipped, which is the case of the high bits. The
+ * sort is stable, so entries with the same value stay ordered by address. */
+static void radixSort(std::vector<PointerEntry>& entries)
+{
+    if (entries.size() < 2)
+        return;
+
+    const uintptr_t mask = (1 << RADIX_BITS) - 1;
+    std::vector<PointerEntry> sorted(entries.size());
+    std::vector<size_t> offsets(mask + 1);
+
+    for (unsigned int shift = 0; shift < 8*sizeof(uintptr_t); shift += RADIX_BITS) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const PointerEntry& entry : entries)
+            offsets[(entry.value >> shift) & mask]++;
+
+        if (offsets[(entries[0].value >> shift) & mask] == entries.size())
+            continue;
+
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+
+        for (const PointerEntry& entry : entries)
+            sorted[offsets[(entry.value >> shift) & mask]++] = entry;
+
+        entries.swap(sorted);
+    }
+}
+
+void PointerScanner::locatePointers(std::function<void(int)> progress)
+{
+    clear();
+
+    /* Files may have been loaded or the game restarted since the last query */
+    BaseAddresses::load();
+    files = BaseAddresses::getAddressTable();
+
+    std::unique_ptr<MemLayout> memlayout (new MemLayout(MemAccess::getPid()));
+
+    int type_flag = (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemHeap | MemSection::MemAnonymousMappingRW | MemSection::MemFileMappingRW | MemSection::MemStack);
+    int static_flag = (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack);
+
+    /* Sections that could contain pointers, and sections that pointers can
+     * point to. If pointing to a static section, we can skip it. */
+    std::vector<MemSection> sections;
+    std::vector<std::pair<uintptr_t, uintptr_t>> targets;
+    uint64_t total_size = 0;
+
+    MemSection section;
+    while (memlayout->nextSection(type_flag, 0, section)) {
+        sections.push_back(section);
+        total_size += section.size;
+        if (!(section.type & static_flag))
+            targets.push_back(std::make_pair(section.addr, section.endaddr));
+    }
+
+    if (total_size == 0)
+        return;
+
+    /* Split sections in work items */
+    struct Item {
+        uintptr_t beg, end;
+        bool is_static;
+    };
+    std::vector<Item> items;
+    for (const MemSection& s : sections) {
+        for (uintptr_t addr = s.addr; addr < s.endaddr; addr += LOCATE_ITEM_SIZE) {
+            items.push_back({addr, std::min<uintptr_t>(addr + LOCATE_ITEM_SIZE, s.endaddr), static_cast<bool>(s.type & static_flag)});
+        }
+    }
+
+    MemScanPool& p = getPool();
+
+    /* Read buffers of each thread */
+    struct Buffers {
+        std::vector<uintptr_t> pages;
+        std::vector<MemAccess::ReadRequest> requests;
+    };
+    std::vector<Buffers> buffers(p.thread_count());
+
+    std::vector<std::vector<PointerEntry>> item_pointers(items.size());
+    std::atomic<uint64_t> processed_size(0);
+
+    p.start(items.size(), [&](int thread, int i) {
+        const Item& item = items[i];
+        Buffers& buf = buffers[thread];
+        buf.pages.resize(LOCATE_BATCH_PAGES*4096/sizeof(uintptr_t));
+        buf.requests.resize(LOCATE_BATCH_PAGES);
+
+        for (uintptr_t batch_addr = item.beg; batch_addr < item.end; batch_addr += LOCATE_BATCH_PAGES*4096) {
+            /* Read values by pages, gathering pages in a few syscalls */
+            int page_count = 0;
+            for (uintptr_t addr = batch_addr; (addr < item.end) && (page_count < LOCATE_BATCH_PAGES); addr += 4096, page_count++) {
+                buf.requests[page_count].local_addr = &buf.pages[page_count*4096/sizeof(uintptr_t)];
+                buf.requests[page_count].remote_addr = addr;
+                buf.requests[page_count].size = 4096;
+            }
+            MemAccess::readBatch(buf.requests.data(), page_count);
+
+            for (int r = 0; r < page_count; r++) {
+                const MemAccess::ReadRequest& req = buf.requests[r];
+                if (!req.valid)
+                    continue;
+
+                const uintptr_t* values = static_cast<const uintptr_t*>(req.local_addr);
+                for (unsigned int v = 0; v < 4096/sizeof(uintptr_t); v++) {
+                    /* Check if the value could be a pointer. Sections are
+                     * ordered, so we look for the last one starting before
+                     * the value. */
+                    auto it = std::upper_bound(targets.begin(), targets.end(), std::make_pair(values[v], UINTPTR_MAX));
+                    if ((it == targets.begin()) || (values[v] >= (it-1)->second))
+                        continue;
+
+                    item_pointers[i].push_back({values[v], req.remote_addr + v*sizeof(uintptr_t)});
+                }
+            }
+            processed_size += page_count*4096;
+        }
+    });
+
+    /* Update progress bar */
+    while (!p.wait(100))
+        progress(static_cast<int>(100 * processed_size / total_size));
+
+    /* Gather all pointers, and sort them by value */
+    size_t count = 0, static_count = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i].is_static)
+            static_count += item_pointers[i].size();
+        else
+            count += item_pointers[i].size();
+    }
+    pointers.reserve(count);
+    static_pointers.reserve(static_count);
+    for (size_t i = 0; i < items.size(); i++) {
+        std::vector<PointerEntry>& dest = items[i].is_static ? static_pointers : pointers;
+        dest.insert(dest.end(), item_pointers[i].begin(), item_pointers[i].end());
+        std::vector<PointerEntry>().swap(item_pointers[i]);
+    }
+
+    radixSort(pointers);
+    radixSort(static_pointers);
+
+    progress(100);
+}
+
+/* Returns the first entry pointing at or after an address */
+static std::vector<PointerEntry>::const_iterator lowerBound(const std::vector<PointerEntry>& entries, uintptr_t value)
+{
+    return std::lower_bound(entries.begin(), entries.end(), value, [](const PointerEntry& entry, uintptr_t v) {
+        return entry.value < v;
+    });
+}
+
+void PointerScanner::findChains(uintptr_t addr, int max_level, int max_offset, std::vector<PointerChain>& chains)
+{
+    chains.clear();
+    if (max_level <= 0)
+        return;
+
+    /* The search is done breadth-first, one level at a time. Each level
+     * holds the distinct addresses that are pointed by a chain, and each of
+     * them has links to the addresses of the previous level that it points
+     * to (with an offset), so that chains sharing addresses are not searched
+     * again. */
+    struct Link {
+        uint32_t child; // index of the address in the previous level
+        int offset;
+    };
+    struct Node {
+        uintptr_t address;
+        size_t first_link;
+        size_t link_count;
+    };
+    struct Candidate {
+        uintptr_t address;
+        uint32_t child;
+        int offset;
+    };
+    struct Base {
+        int level;
+        uint32_t node;
+        uintptr_t address;
+        int offset;
+    };
+
+    std::vector<std::vector<Node>> nodes(max_level);
+    std::vector<std::vector<Link>> links(max_level);
+    std::vector<Base> bases;
+
+    nodes[0].push_back({addr, 0, 0});
+
+    /* Sorted addresses of all levels, to prune addresses already reached */
+    std::vector<uintptr_t> visited(1, addr);
+
+    MemScanPool& p = getPool();
+
+    for (int level = 0; (level < max_level) && !nodes[level].empty(); level++) {
+        const std::vector<Node>& frontier = nodes[level];
+        bool last_level = (level == (max_level-1));
+
+        int item_count = (frontier.size() + SEARCH_ITEM_NODES - 1) / SEARCH_ITEM_NODES;
+        std::vector<std::vector<Base>> item_bases(item_count);
+        std::vector<std::vector<Candidate>> item_candidates(item_count);
+
+        p.start(item_count, [&](int, int item) {
+            size_t end = std::min<size_t>(frontier.size(), (item+1) * SEARCH_ITEM_NODES);
+            for (size_t n = item * SEARCH_ITEM_NODES; n < end; n++) {
+                uintptr_t a = frontier[n].address;
+                uintptr_t low = (a > static_cast<uintptr_t>(max_offset)) ? (a - max_offset) : 0;
+
+                /* Search inside static data */
+                for (auto it = lowerBound(static_pointers, low); (it != static_pointers.end()) && (it->value <= a); ++it)
+                    item_bases[item].push_back({level, static_cast<uint32_t>(n), it->address, static_cast<int>(a - it->value)});
+
+                /* Stop if we reached the last level */
+                if (last_level)
+                    continue;
+
+                /* Search inside dynamic data */
+                for (auto it = lowerBound(pointers, low); (it != pointers.end()) && (it->value <= a); ++it)
+                    item_candidates[item].push_back({it->address, static_cast<uint32_t>(n), static_cast<int>(a - it->value)});
+            }
+        });
+        while (!p.wait(100)) {}
+
+        for (const auto& b : item_bases)
+            bases.insert(bases.end(), b.begin(), b.end());
+
+        if (last_level)
+            break;
+
+        /* Build the next level from the pointers that were not already
+         * reached, merging the identical addresses */
+        std::vector<Candidate> candidates;
+        for (auto& c : item_candidates) {
+            for (const Candidate& candidate : c) {
+                if (!std::binary_search(visited.begin(), visited.end(), candidate.address))
+                    candidates.push_back(candidate);
+            }
+            std::vector<Candidate>().swap(c);
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return (a.address < b.address) || ((a.address == b.address) && (a.child < b.child));
+        });
+
+        std::vector<Node>& next_nodes = nodes[level+1];
+        std::vector<Link>& next_links = links[level+1];
+        next_links.reserve(candidates.size());
+        size_t visited_size = visited.size();
+        for (const Candidate& candidate : candidates) {
+            if (next_nodes.empty() || (next_nodes.back().address != candidate.address)) {
+                next_nodes.push_back({candidate.address, next_links.size(), 0});
+                visited.push_back(candidate.address);
+            }
+            next_links.push_back({candidate.child, candidate.offset});
+            next_nodes.back().link_count++;
+        }
+        std::inplace_merge(visited.begin(), visited.begin() + visited_size, visited.end());
+    }
+
+    /* Build all chains, from each base down to the searched address */
+    std::vector<int> offsets(max_level);
+    std::function<void(const Base&, int, uint32_t)> build = [&](const Base& base, int level, uint32_t node) {
+        if (level == 0) {
+            chains.push_back(std::make_pair(base.address, std::vector<int>(offsets.begin(), offsets.begin() + base.level + 1)));
+            return;
+        }
+        const Node& n = nodes[level][node];
+        for (size_t l = n.first_link; l < (n.first_link + n.link_count); l++) {
+            const Link& link = links[level][l];
+            offsets[level-1] = link.offset;
+            build(base, level-1, link.child);
+        }
+    };
+
+    for (const Base& base : bases) {
+        offsets[base.level] = base.offset;
+        build(base, base.level, base.node);
+    }
+}
+
+std::string PointerScanner::getFileAndOffset(uintptr_t addr, off_t &offset) const
+{
+    return BaseAddresses::getFileAndOffset(files, addr, offset);
+}
+
+/* Header of a pointer map file */
+struct PointerMapHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t pointer_size;
+    uint32_t file_count;
+    uint64_t pointer_count;
+    uint64_t static_pointer_count;
+};
+
+static const char pointer_map_magic[4] = {'L', 'T', 'P', 'M'};
+
+/* Returns the number of bytes left to read in a file, so that sizes read
+ * from a corrupt file are not used to allocate memory */
+static uint64_t remainingSize(std::ifstream& file, std::streamoff file_size)
+{
+    std::streamoff pos = file.tellg();
+    if (!file || (pos < 0) || (pos > file_size))
+        return 0;
+    return file_size - pos;
+}
+
+bool PointerScanner::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Could not open pointer map " << path << std::endl;
+        return false;
+    }
+
+    PointerMapHeader header;
+    memcpy(header.magic, pointer_map_magic, 4);
+    header.version = 1;
+    header.pointer_size = sizeof(uintptr_t);
+    header.file_count = files.size();
+    header.pointer_count = pointers.size();
+    header.static_pointer_count = static_pointers.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const auto& f : files) {
+        uint32_t length = f.first.size();
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(f.first.data(), length);
+        file.write(reinterpret_cast<const char*>(&f.second.first), sizeof(uintptr_t));
+        file.write(reinterpret_cast<const char*>(&f.second.second), sizeof(uintptr_t));
+    }
+
+    file.write(reinterpret_cast<const char*>(pointers.data()), pointers.size() * sizeof(PointerEntry));
+    file.write(reinterpret_cast<const char*>(static_pointers.data()), static_pointers.size() * sizeof(PointerEntry));
+
+    if (!file) {
+        std::cerr << "Could not write pointer map " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PointerScanner::load(const std::string& path)
+{
+    clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open pointer map " << path << std::endl;
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    PointerMapHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || (memcmp(header.magic, pointer_map_magic, 4) != 0) ||
+        (header.version != 1) || (header.pointer_size != sizeof(uintptr_t))) {
+        std::cerr << "File " << path << " is not a valid pointer map" << std::endl;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        uint32_t length = 0;
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!file || (length > remainingSize(file, file_size))) {
+            std::cerr << "Could not read pointer map " << path << std::endl;
+            clear();
+            return false;
+        }
+        std::string name(length, '\0');
+        file.read(&name[0], length);
+        uintptr_t beg = 0, end = 0;
+        file.read(reinterpret_cast<char*>(&beg), sizeof(uintptr_t));
+        file.read(reinterpret_cast<char*>(&end), sizeof(uintptr_t));
+        files[name] = std::make_pair(beg, end);
+    }
+
+    uint64_t entry_count = remainingSize(file, file_size) / sizeof(PointerEntry);
+    if ((header.pointer_count > entry_count) || (header.static_pointer_count > (entry_count - header.pointer_count))) {
+        std::cerr << "Could not read pointer map " << path << std::endl;
+        clear();
+        return false;
+    }
+
+    pointers.resize(header.pointer_count);
+    static_pointers.resize(header.static_pointer_count);
+    file.read(reinterpret_cast<char*>(pointers.data()), pointers.size() * sizeof(PointerEntry));
+    file.read(reinterpret_cast<char*>(static_pointers.data()), static_pointers.size() * sizeof(PointerEntry));
+
+    if (!file) {
+        std::cerr << "Could not read pointer map " << path << std::endl;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void PointerScanner::clear()
+{
+    std::vector<PointerEntry>().swap(pointers);
+    std::vector<PointerEntry>().swap(static_pointers);
+    files.clear();
+}
+
+/* Header of a pointer chain file */
+struct PointerChainHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t chain_count;
+};
+
+static const char pointer_chain_magic[4] = {'L', 'T', 'P', 'C'};
+
+bool PointerScanner::saveChains(const std::string& path, const std::vector<PointerChain>& chains, const BaseAddresses::AddressTable& table)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Could not open pointer chain file " << path << std::endl;
+        return false;
+    }
+
+    PointerChainHeader header;
+    memcpy(header.magic, pointer_chain_magic, 4);
+    header.version = 1;
+    header.chain_count = chains.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    /* Each chain is stored as the file name, the offset in the file, and
+     * the pointer offsets */
+    for (const PointerChain& chain : chains) {
+        off_t offset;
+        std::string name = BaseAddresses::getFileAndOffset(table, chain.first, offset);
+        int64_t file_offset = name.empty() ? static_cast<int64_t>(chain.first) : static_cast<int64_t>(offset);
+
+        uint32_t length = name.size();
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(name.data(), length);
+        file.write(reinterpret_cast<const char*>(&file_offset), sizeof(file_offset));
+
+        uint32_t offset_count = chain.second.size();
+        file.write(reinterpret_cast<const char*>(&offset_count), sizeof(offset_count));
+        for (int o : chain.second) {
+            int32_t o32 = o;
+            file.write(reinterpret_cast<const char*>(&o32), sizeof(o32));
+        }
+    }
+
+    if (!file) {
+        std::cerr << "Could not write pointer chain file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PointerScanner::loadChains(const std::string& path, std::vector<FileChain>& file_chains)
+{
+    file_chains.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open pointer chain file " << path << std::endl;
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    PointerChainHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || (memcmp(header.magic, pointer_chain_magic, 4) != 0) || (header.version != 1)) {
+        std::cerr << "File " << path << " is not a valid pointer chain file" << std::endl;
+        return false;
+    }
+
+    for (uint64_t c = 0; file && (c < header.chain_count); c++) {
+        FileChain chain;
+        uint32_t length = 0;
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!file || (length > remainingSize(file, file_size)))
+            break;
+        chain.file.resize(length);
+        file.read(&chain.file[0], length);
+
+        int64_t file_offset = 0;
+        file.read(reinterpret_cast<char*>(&file_offset), sizeof(file_offset));
+        chain.file_offset = file_offset;
+
+        uint32_t offset_count = 0;
+        file.read(reinterpret_cast<char*>(&offset_count), sizeof(offset_count));
+        if (!file || (offset_count > 64))
+            break;
+        chain.offsets.resize(offset_count);
+        for (uint32_t o = 0; o < offset_count; o++) {
+            int32_t o32 = 0;
+            file.read(reinterpret_cast<char*>(&o32), sizeof(o32));
+            chain.offsets[o] = o32;
+        }
+
+        file_chains.push_back(std::move(chain));
+    }
+
+    if (!file || (file_chains.size() != header.chain_count)) {
+        std::cerr << "Could not read pointer chain file " << path << std::endl;
+        file_chains.clear();
+        return false;
+    }
+    return true;
+}
+
+void PointerScanner::validateChains(uintptr_t addr, const std::vector<FileChain>& file_chains, std::vector<PointerChain>& chains, BaseAddresses::AddressTable& table)
+{
+    chains.clear();
+
+    /* Get the base addresses from the current files. This is done before
+     * starting threads, because the table of files is not shared. */
+    BaseAddresses::load();
+    table = BaseAddresses::getAddressTable();
+
+    std::vector<uintptr_t> bases(file_chains.size(), 0);
+    for (size_t c = 0; c < file_chains.size(); c++) {
+        const FileChain& chain = file_chains[c];
+        if (chain.file.empty()) {
+            bases[c] = chain.file_offset;
+            continue;
+        }
+        auto it = table.find(chain.file);
+        if (it == table.end())
+            continue;
+
+        /* For stack, the offset is from the end */
+        if (chain.file.find("[stack") == 0)
+            bases[c] = it->second.second + chain.file_offset;
+        else
+            bases[c] = it->second.first + chain.file_offset;
+    }
+
+    MemScanPool& p = getPool();
+
+    int item_count = (file_chains.size() + VALIDATE_ITEM_CHAINS - 1) / VALIDATE_ITEM_CHAINS;
+    std::vector<std::vector<size_t>> item_valid(item_count);
+
+    p.start(item_count, [&](int, int item) {
+        size_t beg = item * VALIDATE_ITEM_CHAINS;
+        size_t end = std::min<size_t>(file_chains.size(), beg + VALIDATE_ITEM_CHAINS);
+
+        /* Current address of each chain, and the chains still followed */
+        std::vector<uintptr_t> addresses(bases.begin() + beg, bases.begin() + end);
+        std::vector<size_t> alive;
+        size_t max_depth = 0;
+        for (size_t c = beg; c < end; c++) {
+            if (!bases[c])
+                continue;
+            alive.push_back(c);
+            max_depth = std::max(max_depth, file_chains[c].offsets.size());
+        }
+
+        std::vector<uintptr_t> next_addresses(alive.size());
+        std::vector<MemAccess::ReadRequest> requests;
+
+        /* Follow all chains one level at a time, so that each level is read
+         * with a few syscalls. Offsets are stored from the last pointer to
+         * the first one. */
+        for (size_t level = 0; level < max_depth; level++) {
+            requests.resize(alive.size());
+            for (size_t a = 0; a < alive.size(); a++) {
+                requests[a].local_addr = &next_addresses[a];
+                requests[a].remote_addr = addresses[alive[a] - beg];
+                requests[a].size = sizeof(uintptr_t);
+            }
+            MemAccess::readBatch(requests.data(), requests.size());
+
+            size_t kept = 0;
+            for (size_t a = 0; a < alive.size(); a++) {
+                size_t c = alive[a];
+                const std::vector<int>& offsets = file_chains[c].offsets;
+                if (!requests[a].valid)
+                    continue;
+
+                if (level < offsets.size())
+                    addresses[c - beg] = next_addresses[a] + offsets[offsets.size() - 1 - level];
+
+                /* Keep following chains that are not finished */
+                if ((level + 1) < offsets.size())
+                    alive[kept++] = c;
+                else if (addresses[c - beg] == addr)
+                    item_valid[item].push_back(c);
+            }
+            alive.resize(kept);
+        }
+
+        std::sort(item_valid[item].begin(), item_valid[item].end());
+    });
+    while (!p.wait(100)) {}
+
+    for (const auto& valid : item_valid) {
+        for (size_t c : valid) {
+            chains.push_back(std::make_pair(bases[c], file_chains[c].offsets));
+        }
+    }
+}
@@ -0,0 +1,112 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_POINTERSCANNER_H_INCLUDED
+#define LIBTAS_POINTERSCANNER_H_INCLUDED
+
+#include "BaseAddresses.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <sys/types.h>
+
+/* Forward declaration */
+class MemScanPool;
+
+/* Pointer-sized value of game memory that points inside a dynamic section */
+struct PointerEntry {
+    uintptr_t value; // pointed address
+    uintptr_t address; // address of the pointer
+};
+
+/* Chain of pointers, with the base address and the offsets from the last
+ * pointer to the first one */
+typedef std::pair<uintptr_t, std::vector<int>> PointerChain;
+
+/* Chain of pointers with the base address stored as a file and offset, so
+ * that it can be followed in another run of the game */
+struct FileChain {
+    std::string file;
+    off_t file_offset;
+    std::vector<int> offsets;
+};
+
+/* Map of all pointers of the game memory, stored in flat arrays sorted by
+ * pointed address, and search of pointer chains inside it. The map can be
+ * saved into a file, so that chains can be searched in a previous run of
+ * the game. */
+class PointerScanner {
+    public:
+        PointerScanner();
+        ~PointerScanner();
+
+        /* Pointers stored in dynamic memory, and in static memory (data, bss
+         * and stack) */
+        std::vector<PointerEntry> pointers;
+        std::vector<PointerEntry> static_pointers;
+
+        /* Files of the game when the map was built, to get the file and
+         * offset of base addresses */
+        BaseAddresses::AddressTable files;
+
+        /* Read all pointers of the game memory using all threads. Progress
+         * is reported between 0 and 100. */
+        void locatePointers(std::function<void(int)> progress);
+
+        /* Find all chains of pointers that start from a static address and
+         * end with the specified address, in maximum `max_level` levels and
+         * with a maximum offset of `max_offset`. Chains that go through the
+         * same address twice, or through an address that is also reached
+         * in fewer levels, are not reported. */
+        void findChains(uintptr_t addr, int max_level, int max_offset, std::vector<PointerChain>& chains);
+
+        /* Get the file and offset of an address when the map was built */
+        std::string getFileAndOffset(uintptr_t addr, off_t &offset) const;
+
+        /* Save or load the map. Returns if it succeeded. */
+        bool save(const std::string& path) const;
+        bool load(const std::string& path);
+
+        /* Free the map */
+        void clear();
+
+        /* Save chains, with base addresses converted into files and offsets
+         * using the specified table. Returns if it succeeded. */
+        static bool saveChains(const std::string& path, const std::vector<PointerChain>& chains, const BaseAddresses::AddressTable& table);
+
+        /* Load saved chains. Returns if it succeeded. */
+        static bool loadChains(const std::string& path, std::vector<FileChain>& file_chains);
+
+        /* Follow all saved chains in the current game memory using all
+         * threads, and keep the ones that still end with the specified
+         * address. The current table of files is stored in `table`. */
+        void validateChains(uintptr_t addr, const std::vector<FileChain>& file_chains, std::vector<PointerChain>& chains, BaseAddresses::AddressTable& table);
+
+    private:
+        std::unique_ptr<MemScanPool> pool;
+
+        /* Start the pool if not already done */
+        MemScanPool& getPool();
+};
+
+#endif
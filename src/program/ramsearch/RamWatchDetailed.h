@@ -25,6 +25,7 @@
 #include "MemAccess.h"
 #include <sstream>
 #include <iostream>
+#include <cstring>
 
 template <class T>
 class RamWatchDetailed : public IRamWatchDetailed {
@@ -33,18 +34,28 @@ public:
 
     T get_value()
     {
+        /* Use the value read by update_all() */
+        if (cached_generation == generation) {
+            isValid = cached_valid;
+            T value = 0;
+            if (isValid)
+                memcpy(&value, cached_value, sizeof(T));
+            return value;
+        }
+
         update_addr();
 
         if (!isValid)
             return 0;
 
         T value = 0;
-        isValid = (MemAccess::read(&value, reinterpret_cast<void*>(address), sizeof(T)) == sizeof(T));
+        isValid = (MemAccess::read(&value, reinterpret_cast<void*>(address), sizeof(T), true) == sizeof(T));
         return value;
     }
 
     std::string value_str()
     {
+        std::lock_guard<std::mutex> lock(mutex);
         std::ostringstream oss;
         if (hex) oss << std::hex;
         /* Output char and unsigned char as integer values. There might be a
@@ -89,6 +100,8 @@ public:
         }
 
         /* Write value into the game process address */
+        std::lock_guard<std::mutex> lock(mutex);
+        cached_generation = 0;
         return MemAccess::write(&value, reinterpret_cast<void*>(address), sizeof(T));
     }
 
@@ -97,6 +110,11 @@ public:
         return type_index<T>();
     }
 
+    int value_size()
+    {
+        return sizeof(T);
+    }
+
 };
 
 #endif
@@ -745,7 +745,7 @@ void InputEditorModel::clearUniqueInput(int column)
         return;
 
     for (unsigned int f = context->framecount; f < movie->inputs->nbFrames(); f++) {
-        movie->inputs->input_list[f].setInput(si, 0);
+        movie->inputs->input_list.edit(f).setInput(si, 0);
     }
 
     movie->inputs->wasModified();
@@ -763,7 +763,7 @@ bool InputEditorModel::removeUniqueInput(int column)
 
     /* Clear remaining frames */
     for (unsigned int f = context->framecount; f < movie->inputs->nbFrames(); f++) {
-        movie->inputs->input_list[f].setInput(si, 0);
+        movie->inputs->input_list.edit(f).setInput(si, 0);
     }
 
     movie->inputs->wasModified();
@@ -815,7 +815,7 @@ void InputEditorModel::lockUniqueInput(int column, bool locked)
 
 void InputEditorModel::clearInput(int row)
 {
-    movie->inputs->input_list[row].emptyInputs();
+    movie->inputs->input_list.edit(row).emptyInputs();
     emit dataChanged(index(row, 0), index(row, columnCount()));
 
     movie->inputs->wasModified();
@@ -44,6 +44,7 @@
 #include "InputEditorModel.h"
 #include "AnnotationsWindow.h"
 #include "TimeTraceWindow.h"
+#include "SavestateStatsWindow.h"
 #include "TimeTraceModel.h"
 #include "LuaConsoleWindow.h"
 #include "../movie/MovieFile.h"
@@ -168,6 +169,7 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
     inputEditorWindow = new InputEditorWindow(c, this);
     annotationsWindow = new AnnotationsWindow(c, this);
     timeTraceWindow = new TimeTraceWindow(c, this);
+    savestateStatsWindow = new SavestateStatsWindow(c, this);
     luaConsoleWindow = new LuaConsoleWindow(this);
 
     connect(gameLoop, &GameLoop::inputsToBeChanged, inputEditorWindow->inputEditorView->inputEditorModel, &InputEditorModel::beginModifyInputs);
@@ -184,6 +186,7 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
     connect(gameLoop->gameEvents, &GameEvents::savestatePerformed, inputEditorWindow->inputEditorView->inputEditorModel, &InputEditorModel::registerSavestate);
     connect(gameLoop, &GameLoop::invalidateSavestates, inputEditorWindow->inputEditorView->inputEditorModel, &InputEditorModel::invalidateSavestates);
     connect(gameLoop, &GameLoop::getTimeTrace, timeTraceWindow->timeTraceModel, &TimeTraceModel::addCall);
+    connect(gameLoop, &GameLoop::savestateStats, savestateStatsWindow, &SavestateStatsWindow::addStats);
     connect(gameLoop, &GameLoop::statusChanged, settingsWindow, &SettingsWindow::update);
 
     /* Menu */
@@ -660,6 +663,9 @@ void MainWindow::createMenus()
 
     toolsMenu->addAction(tr("Ram Search..."), ramSearchWindow, &RamSearchWindow::show);
     toolsMenu->addAction(tr("Ram Watch..."), ramWatchWindow, &RamWatchWindow::show);
+    memoryMirrorAction = toolsMenu->addAction(tr("Mirror watched memory"), this, LAMBDABOOLSLOT(context->config.memory_mirror));
+    memoryMirrorAction->setCheckable(true);
+    memoryMirrorAction->setToolTip("When checked, the game shares a copy of the memory read by ram watches and lua, which is faster to read");
 
     toolsMenu->addSeparator();
 
@@ -676,6 +682,11 @@ void MainWindow::createMenus()
     disabledActionsOnStart.append(busyloopAction);
 
     toolsMenu->addAction(tr("Time Trace..."), timeTraceWindow, &TimeTraceWindow::show);
+    toolsMenu->addAction(tr("Savestate Statistics..."), savestateStatsWindow, &SavestateStatsWindow::show);
+    toolsMenu->addAction(tr("Benchmark savestates"), this, [=](){
+        if (context->status != Context::INACTIVE)
+            context->hotkey_pressed_queue.push(HOTKEY_BENCHMARK_SAVESTATE);
+    });
 
 
     /* Input Menu */
@@ -999,6 +1010,7 @@ void MainWindow::updateUIFromConfig()
     mouseModeAction->setChecked(context->config.sc.mouse_mode_relative);
 
     busyloopAction->setChecked(context->config.sc.busyloop_detection);
+    memoryMirrorAction->setChecked(context->config.memory_mirror);
 
     setCheckboxesFromMask(fastforwardGroup, context->config.sc.fastforward_mode);
     setRadioFromList(fastforwardRenderGroup, context->config.sc.fastforward_render);
@@ -61,6 +61,7 @@ class OsdWindow;
 class AnnotationsWindow;
 class AutoSaveWindow;
 class TimeTraceWindow;
+class SavestateStatsWindow;
 class LuaConsoleWindow;
 
 class MainWindow : public QMainWindow
@@ -92,6 +93,7 @@ public:
     AnnotationsWindow* annotationsWindow;
     AutoSaveWindow* autoSaveWindow;
     TimeTraceWindow* timeTraceWindow;
+    SavestateStatsWindow* savestateStatsWindow;
     LuaConsoleWindow* luaConsoleWindow;
 
     QList<QWidget*> disabledWidgetsOnStart;
@@ -108,6 +110,7 @@ public:
     QAction *renderPerfAction;
 
     QAction *busyloopAction;
+    QAction *memoryMirrorAction;
 
     QAction *configEncodeAction;
     QAction *toggleEncodeAction;
@@ -19,140 +19,87 @@
 
 #include "PointerScanModel.h"
 #include "../utils.h"
-#include "../ramsearch/MemAccess.h"
-#include "../ramsearch/MemLayout.h"
-#include "../ramsearch/BaseAddresses.h"
 #include "../Context.h"
 
-#include <sstream>
-#include <fstream>
-#include <iostream>
-#include <memory>
+#include <vector>
+#include <algorithm>
 
 PointerScanModel::PointerScanModel(Context* c, QObject *parent) : QAbstractTableModel(parent), context(c) {}
 
 void PointerScanModel::locatePointers()
 {
-    pointer_map.clear();
-    static_pointer_map.clear();
-
-    std::unique_ptr<MemLayout> memlayout (new MemLayout(context->game_pid));
-    
-    std::vector<MemSection> memory_sections;
-    file_mapping_sections.clear();
-
-    int type_flag = (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemHeap | MemSection::MemAnonymousMappingRW | MemSection::MemFileMappingRW | MemSection::MemStack);
-    uint64_t total_size = memlayout->totalSize(type_flag, 0);
-    
-    MemSection section;
-    while (memlayout->nextSection(type_flag, 0, section)) {
-        /* Only store sections that could contain pointers */
-        memory_sections.push_back(section);
-        
-        /* Keep the file mapping to access to the file and offsets */
-        if (section.type & (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemFileMappingRW | MemSection::MemStack)) {
-            file_mapping_sections.push_back(section);
-        }
-    }
+    scanner.locatePointers([this](int progress) {
+        emit signalProgress(progress);
+    });
+}
 
-    /* Read all memory and store all pointers */
-    int cur_size = 0;
-    for (const MemSection &section : memory_sections) {
+void PointerScanModel::findPointerChain(uintptr_t addr, int ml, int max_offset)
+{
+    /* Don't locate pointers again if this is the same frame, or if a map
+     * was loaded and the game did not advance */
+    if (map_loaded) {
+        if (last_scan_frame != context->framecount)
+            map_loaded = false;
+    }
+    else if (last_scan_frame != context->framecount) {
+        locatePointers();
+    }
+    last_scan_frame = context->framecount;
 
-        for (uintptr_t addr = section.addr; addr < section.endaddr; addr += 4096) {
+    beginResetModel();
 
-            /* Read values in chunks of 4096 bytes so we lower the number of calls. */
-            uintptr_t chunk[4096/sizeof(uintptr_t)];
-            int readValues = MemAccess::read(chunk, reinterpret_cast<void*>(addr), 4096);
-            if (readValues < 0) {
-                continue;
-            }
+    max_level = ml;
+    scanner.findChains(addr, max_level, max_offset, pointer_chains);
+    chain_files = scanner.files;
 
-            /* Update progress bar */
-            emit signalProgress((int)(100 * ((float)cur_size / total_size)));
-
-            for (unsigned int i = 0; i < readValues/sizeof(uintptr_t); i++, cur_size += sizeof(uintptr_t)) {
-                /* Check if the value could be a pointer */
-                bool isPointer = false;
-
-                for (const MemSection &ms : memory_sections) {
-                    /* If pointing to a static section, we can skip it */
-                    if (ms.type & (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack)) {
-                        continue;
-                    }
-
-                    /* We take advantage of the fact that sections are ordered */
-                    if (chunk[i] < ms.addr) {
-                        break;
-                    }
-                    if (chunk[i] < ms.endaddr) {
-                        isPointer = true;
-                        break;
-                    }
-                }
-
-                if (isPointer) {
-                    uintptr_t stored_addr = addr + i*sizeof(uintptr_t);
-                    if (section.type & (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack)) {
-                        static_pointer_map.insert(std::make_pair(chunk[i], stored_addr));
-                    }
-                    else {
-                        pointer_map.insert(std::make_pair(chunk[i], stored_addr));
-                    }
-                }
-            }
-        }
-    }
+    endResetModel();
 }
 
-void PointerScanModel::findPointerChain(uintptr_t addr, int ml, int max_offset)
+bool PointerScanModel::saveMap(const std::string& path)
 {
-    static uint64_t last_scan_frame = 1 << 30;
-    /* Don't locate pointers again if this is the same frame */
     if (last_scan_frame != context->framecount) {
         locatePointers();
         last_scan_frame = context->framecount;
+        map_loaded = false;
     }
+    return scanner.save(path);
+}
 
-    beginResetModel();
+bool PointerScanModel::loadMap(const std::string& path)
+{
+    map_loaded = scanner.load(path);
+    if (map_loaded)
+        last_scan_frame = context->framecount;
+    else
+        last_scan_frame = 1ULL << 30;
+    return map_loaded;
+}
 
-    max_level = ml;
-    pointer_chains.clear();
-    int offsets[10];
+bool PointerScanModel::saveChains(const std::string& path)
+{
+    return PointerScanner::saveChains(path, pointer_chains, chain_files);
+}
+
+bool PointerScanModel::validateChains(uintptr_t addr, const std::string& path)
+{
+    std::vector<FileChain> file_chains;
+    if (!PointerScanner::loadChains(path, file_chains))
+        return false;
 
-    // std::cout << "max offset " << max_offset << std::endl;
+    beginResetModel();
 
-    recursiveFind(addr, 0, offsets, max_offset);
+    max_level = 0;
+    for (const FileChain& chain : file_chains)
+        max_level = std::max(max_level, static_cast<int>(chain.offsets.size()));
+    scanner.validateChains(addr, file_chains, pointer_chains, chain_files);
 
     endResetModel();
+    return true;
 }
 
-void PointerScanModel::recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset)
+std::string PointerScanModel::getFileAndOffset(uintptr_t addr, off_t &offset) const
 {
-    /* Search inside static data */
-    auto iter = static_pointer_map.lower_bound(addr - max_offset);
-    while ((iter != static_pointer_map.end()) && (iter->first <= addr)) {
-        offsets[level] = addr - iter->first;
-        uintptr_t base_address = iter->second;
-        // std::cout << "Found static chain with last offset " << std::dec << offsets[level] << " and base address " << std::hex << base_address << std::endl;
-        std::vector<int> offset_vec(offsets, offsets + level + 1);
-        pointer_chains.push_back(std::make_pair(base_address,offset_vec));
-        iter++;
-    }
-
-    /* Stop if we reached the last level */
-    if (level == (max_level-1))
-        return;
-
-    /* Search inside dynamic data */
-    iter = pointer_map.lower_bound(addr - max_offset);
-    while ((iter != pointer_map.end()) && (iter->first <= addr)) {
-        offsets[level] = addr - iter->first;
-        uintptr_t base_address = iter->second;
-        // std::cout << "Found chain with offset " << std::dec << offsets[level] << " and base address " << std::hex << base_address << std::endl;
-        recursiveFind(base_address, level+1, offsets, max_offset);
-        iter++;
-    }
+    return BaseAddresses::getFileAndOffset(chain_files, addr, offset);
 }
 
 int PointerScanModel::rowCount(const QModelIndex & /*parent*/) const
@@ -185,7 +132,7 @@ QVariant PointerScanModel::data(const QModelIndex &index, int role) const
         if (index.column() == 0) {
             /* Get file and offset */
             off_t offset;
-            std::string file = BaseAddresses::getFileAndOffset(chain.first, offset);
+            std::string file = getFileAndOffset(chain.first, offset);
             if (offset >= 0)
                 return QString("%1+0x%2").arg(file.c_str()).arg(offset, 0, 16);
             else
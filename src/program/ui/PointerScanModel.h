@@ -22,13 +22,12 @@
 
 #include <QtCore/QAbstractTableModel>
 #include <vector>
-#include <map>
-// #include <pair>
+#include <string>
 #include <memory>
 #include <sys/types.h>
 #include <stdint.h>
 
-#include "../ramsearch/MemSection.h"
+#include "../ramsearch/PointerScanner.h"
 
 /* Forward declaration */
 struct Context;
@@ -39,14 +38,11 @@ class PointerScanModel : public QAbstractTableModel {
 public:
     PointerScanModel(Context* c, QObject *parent = Q_NULLPTR);
 
-    /* Map of pointers (key) and addresses (value) */
-    std::multimap<uintptr_t,uintptr_t> pointer_map;
-
-    /* Map of pointers (key) and addresses (value) that are in a static area */
-    std::multimap<uintptr_t,uintptr_t> static_pointer_map;
+    /* Map of all pointers of the game memory */
+    PointerScanner scanner;
 
     /* Results of pointer scan */
-    std::vector<std::pair<uintptr_t, std::vector<int>>> pointer_chains;
+    std::vector<PointerChain> pointer_chains;
 
     /* Max size of pointer chain */
     int max_level = 5;
@@ -60,14 +56,30 @@ public:
      */
     void findPointerChain(uintptr_t addr, int ml, int max_offset);
 
+    /* Save the map of pointers, or load a map that is used for the
+     * following searches until the game advances */
+    bool saveMap(const std::string& path);
+    bool loadMap(const std::string& path);
+
+    /* Save the results as files and offsets, or load saved results and only
+     * keep the ones that still end with the specified address */
+    bool saveChains(const std::string& path);
+    bool validateChains(uintptr_t addr, const std::string& path);
+
+    /* Get the file and offset of a base address of the results */
+    std::string getFileAndOffset(uintptr_t addr, off_t &offset) const;
+
 private:
     Context *context;
 
-    /* File mapping sections */
-    std::vector<MemSection> file_mapping_sections;
+    /* Frame count when the map of pointers was built */
+    uint64_t last_scan_frame = 1ULL << 30;
+
+    /* The map of pointers was loaded from a file */
+    bool map_loaded = false;
 
-    /* Recursive call for the pointer chain search */
-    void recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset);
+    /* Files of the game when the results were found */
+    BaseAddresses::AddressTable chain_files;
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
@@ -26,6 +26,7 @@
 #include <QtWidgets/QFormLayout>
 #include <QtWidgets/QHeaderView>
 #include <QtWidgets/QMessageBox>
+#include <QtWidgets/QFileDialog>
 
 #include "PointerScanWindow.h"
 #include "PointerScanModel.h"
@@ -36,7 +37,6 @@
 #include "../ramsearch/CompareOperations.h"
 #include "../ramsearch/IRamWatchDetailed.h"
 #include "../ramsearch/RamWatchDetailed.h"
-#include "../ramsearch/BaseAddresses.h"
 
 PointerScanWindow::PointerScanWindow(Context* c, QWidget *parent) : QDialog(parent), context(c)
 {
@@ -94,15 +94,37 @@ PointerScanWindow::PointerScanWindow(Context* c, QWidget *parent) : QDialog(pare
     QPushButton *addButton = new QPushButton(tr("Add Watch"));
     connect(addButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotAdd);
 
+    QPushButton *saveMapButton = new QPushButton(tr("Save Map..."));
+    connect(saveMapButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotSaveMap);
+
+    QPushButton *loadMapButton = new QPushButton(tr("Load Map..."));
+    connect(loadMapButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotLoadMap);
+
     QDialogButtonBox *buttonBox = new QDialogButtonBox();
     buttonBox->addButton(searchButton, QDialogButtonBox::ActionRole);
     buttonBox->addButton(addButton, QDialogButtonBox::ActionRole);
 
+    QPushButton *saveResultsButton = new QPushButton(tr("Save Results..."));
+    connect(saveResultsButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotSaveResults);
+
+    QPushButton *validateResultsButton = new QPushButton(tr("Validate Results..."));
+    connect(validateResultsButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotValidateResults);
+
+    QDialogButtonBox *mapButtonBox = new QDialogButtonBox();
+    mapButtonBox->addButton(saveMapButton, QDialogButtonBox::ActionRole);
+    mapButtonBox->addButton(loadMapButton, QDialogButtonBox::ActionRole);
+
+    QDialogButtonBox *resultsButtonBox = new QDialogButtonBox();
+    resultsButtonBox->addButton(saveResultsButton, QDialogButtonBox::ActionRole);
+    resultsButtonBox->addButton(validateResultsButton, QDialogButtonBox::ActionRole);
+
     /* Create the options layout */
     QVBoxLayout *optionLayout = new QVBoxLayout;
     optionLayout->addLayout(formLayout);
     optionLayout->addStretch(1);
     optionLayout->addWidget(buttonBox);
+    optionLayout->addWidget(mapButtonBox);
+    optionLayout->addWidget(resultsButtonBox);
 
     QHBoxLayout *mainLayout = new QHBoxLayout;
 
@@ -161,10 +183,72 @@ void PointerScanWindow::slotAdd()
 
         watch->isPointer = true;
         watch->base_address = chain.first;
-        watch->base_file = BaseAddresses::getFileAndOffset(chain.first, watch->base_file_offset);
+        watch->base_file = pointerScanModel->getFileAndOffset(chain.first, watch->base_file_offset);
         watch->pointer_offsets = chain.second;
         std::reverse(watch->pointer_offsets.begin(), watch->pointer_offsets.end());
         mw->ramWatchWindow->editWindow->fill(watch);
         mw->ramWatchWindow->slotAdd();
     }
 }
+
+void PointerScanWindow::slotSaveMap()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Choose a pointer map file"), context->gamepath.c_str(), tr("pointer map files (*.ptm)"));
+    if (filename.isNull())
+        return;
+
+    scanCount->hide();
+    searchProgress->show();
+
+    bool ok = pointerScanModel->saveMap(filename.toStdString());
+
+    searchProgress->hide();
+    scanCount->show();
+
+    if (!ok)
+        QMessageBox::critical(nullptr, "Error", QString("Could not save the pointer map to %1").arg(filename));
+}
+
+void PointerScanWindow::slotLoadMap()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Choose a pointer map file"), context->gamepath.c_str(), tr("pointer map files (*.ptm)"));
+    if (filename.isNull())
+        return;
+
+    if (!pointerScanModel->loadMap(filename.toStdString()))
+        QMessageBox::critical(nullptr, "Error", QString("Could not load the pointer map %1").arg(filename));
+}
+
+void PointerScanWindow::slotSaveResults()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Choose a pointer chain file"), context->gamepath.c_str(), tr("pointer chain files (*.ptc)"));
+    if (filename.isNull())
+        return;
+
+    if (!pointerScanModel->saveChains(filename.toStdString()))
+        QMessageBox::critical(nullptr, "Error", QString("Could not save the pointer chains to %1").arg(filename));
+}
+
+void PointerScanWindow::slotValidateResults()
+{
+    bool ok;
+    uintptr_t addr = addressInput->text().toULong(&ok, 16);
+
+    if (!ok) {
+        QMessageBox::critical(nullptr, "Error", QString("You must enter the current address to validate the pointer chains"));
+        return;
+    }
+
+    QString filename = QFileDialog::getOpenFileName(this, tr("Choose a pointer chain file"), context->gamepath.c_str(), tr("pointer chain files (*.ptc)"));
+    if (filename.isNull())
+        return;
+
+    if (!pointerScanModel->validateChains(addr, filename.toStdString())) {
+        QMessageBox::critical(nullptr, "Error", QString("Could not load the pointer chains %1").arg(filename));
+        return;
+    }
+
+    /* Update address count */
+    scanCount->show();
+    scanCount->setText(QString("%1 results").arg(pointerScanModel->pointer_chains.size()));
+}
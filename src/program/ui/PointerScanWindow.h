@@ -57,6 +57,10 @@ private:
 private slots:
     void slotSearch();
     void slotAdd();
+    void slotSaveMap();
+    void slotLoadMap();
+    void slotSaveResults();
+    void slotValidateResults();
 
 };
 
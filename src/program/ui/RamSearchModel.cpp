@@ -87,6 +87,19 @@ uint64_t RamSearchModel::scanSize()
     return memscanner.scan_size();
 }
 
+bool RamSearchModel::useSoftDirty()
+{
+    if (context->config.sc.savestate_settings != savestate_settings) {
+        savestate_settings = context->config.sc.savestate_settings;
+        MemScanner::invalidate_dirty_tracking();
+    }
+
+    /* Savestates clear the soft-dirty bits when they use them, so the
+     * scanner cannot rely on them in that case */
+    return context->is_soft_dirty &&
+        !(context->config.sc.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_SKIP_UNCHANGED));
+}
+
 void RamSearchModel::newWatches(int mem_flags, int type, CompareType ct, CompareOperator co, double cv, double dv)
 {
     compare_type = ct;
@@ -96,6 +109,8 @@ void RamSearchModel::newWatches(int mem_flags, int type, CompareType ct, Compare
 
     beginResetModel();
 
+    memscanner.memory_budget = static_cast<uint64_t>(context->config.ramsearch_memory_budget) * 1024 * 1024;
+    memscanner.soft_dirty = useSoftDirty();
     memscanner.first_scan(context->game_pid, mem_flags, type, ct, co, cv, dv);
 
     endResetModel();
@@ -105,6 +120,8 @@ void RamSearchModel::searchWatches(CompareType ct, CompareOperator co, double cv
 {
     beginResetModel();
 
+    memscanner.memory_budget = static_cast<uint64_t>(context->config.ramsearch_memory_budget) * 1024 * 1024;
+    memscanner.soft_dirty = useSoftDirty();
     memscanner.scan(false, ct, co, cv, dv);
 
     endResetModel();
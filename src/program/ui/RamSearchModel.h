@@ -80,6 +80,12 @@ public:
 private:
     Context *context;
 
+    /* Returns if the scanner can track written pages with soft-dirty bits */
+    bool useSoftDirty();
+
+    /* Savestate settings of the last scan, to detect a change */
+    int savestate_settings = -1;
+
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
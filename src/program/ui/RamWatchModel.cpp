@@ -186,5 +186,7 @@ void RamWatchModel::loadSettings(QSettings& watchSettings)
 
 void RamWatchModel::update()
 {
+    /* Read all watches at once */
+    IRamWatchDetailed::update_all(ramwatches);
     emit dataChanged(index(0,0), index(rowCount()-1,1), QVector<int>(Qt::DisplayRole));
 }
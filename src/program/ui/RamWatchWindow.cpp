@@ -109,6 +109,10 @@ void RamWatchWindow::slotGet(std::string &watch)
 {
     static unsigned int index = 0;
 
+    /* Read the values of the current frame for all watches */
+    if (index == 0)
+        IRamWatchDetailed::update_all(ramWatchModel->ramwatches);
+
     if (index >= ramWatchModel->ramwatches.size()) {
         /* We sent all watches, returning NULL */
         watch = "";
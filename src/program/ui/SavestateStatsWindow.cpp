@@ -0,0 +1,190 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtWidgets/QDialogButtonBox>
+#include <QtWidgets/QVBoxLayout>
+#include <QtWidgets/QHeaderView>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QFile>
+
+#include "SavestateStatsWindow.h"
+#include "../Context.h"
+
+/* Columns of the area table, with the corresponding statistics */
+static const char* const columnNames[] = {"Address", "Size", "Name", "Time (ms)", "Zero check (ms)", "Codec (ms)", "Bytes", "Full", "Compressed", "Zero", "No page", "Base", "Stored"};
+static const char* const columnKeys[] = {"address", "size", "name", "time", "zero_time", "codec_time", "bytes", "full", "compressed", "zero", "no_page", "base", "stored"};
+#define COLUMN_COUNT (sizeof(columnKeys) / sizeof(columnKeys[0]))
+
+/* Table item that sorts numerically */
+class NumberItem : public QTableWidgetItem {
+public:
+    NumberItem(const QString &text, double v) : QTableWidgetItem(text), value(v) {}
+
+    bool operator<(const QTableWidgetItem &other) const override {
+        return value < static_cast<const NumberItem&>(other).value;
+    }
+
+private:
+    double value;
+};
+
+SavestateStatsWindow::SavestateStatsWindow(Context* c, QWidget *parent) : QDialog(parent), context(c)
+{
+    setWindowTitle("Savestate Statistics");
+
+    summaryLabel = new QLabel(tr("No savestate statistics yet. Start collecting, then save or load a state."));
+    summaryLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+    /* Table */
+    areaTable = new QTableWidget(0, COLUMN_COUNT, this);
+    QStringList headers;
+    for (unsigned int col = 0; col < COLUMN_COUNT; col++)
+        headers << tr(columnNames[col]);
+    areaTable->setHorizontalHeaderLabels(headers);
+    areaTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    areaTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    areaTable->setShowGrid(false);
+    areaTable->setAlternatingRowColors(true);
+    areaTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    areaTable->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
+    areaTable->horizontalHeader()->setHighlightSections(false);
+    areaTable->verticalHeader()->setDefaultSectionSize(areaTable->verticalHeader()->minimumSectionSize());
+    areaTable->verticalHeader()->hide();
+    areaTable->setSortingEnabled(true);
+
+    /* Buttons */
+    bool collecting = context->config.sc.savestate_settings & SharedConfig::SS_STATS;
+    startButton = new QPushButton(collecting?tr("Stop Collecting"):tr("Start Collecting"));
+    connect(startButton, &QAbstractButton::clicked, this, &SavestateStatsWindow::slotStart);
+
+    QPushButton *exportButton = new QPushButton(tr("Export JSON..."));
+    connect(exportButton, &QAbstractButton::clicked, this, &SavestateStatsWindow::slotExport);
+
+    QPushButton *clearButton = new QPushButton(tr("Clear"));
+    connect(clearButton, &QAbstractButton::clicked, this, &SavestateStatsWindow::slotClear);
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox();
+    buttonBox->addButton(startButton, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(exportButton, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(clearButton, QDialogButtonBox::ActionRole);
+
+    /* Layout */
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+
+    mainLayout->addWidget(summaryLabel);
+    mainLayout->addWidget(areaTable, 1);
+    mainLayout->addWidget(buttonBox);
+
+    setLayout(mainLayout);
+}
+
+void SavestateStatsWindow::addStats(QJsonObject stats)
+{
+    history.append(stats);
+
+    /* Summary of the operation */
+    QJsonObject pages = stats["pages"].toObject();
+    QString summary = QString("%1 of state %2 in %3 ms (suspend %4 ms, memory layout %5 ms, zero check %6 ms, codec %7 ms)\n")
+        .arg(stats["operation"].toString() == "save" ? tr("Save") : tr("Load"))
+        .arg(stats["slot"].toInt())
+        .arg(stats["total_time"].toDouble() * 1000, 0, 'f', 1)
+        .arg(stats["suspend_time"].toDouble() * 1000, 0, 'f', 1)
+        .arg(stats["maps_time"].toDouble() * 1000, 0, 'f', 1)
+        .arg(stats["zero_time"].toDouble() * 1000, 0, 'f', 1)
+        .arg(stats["codec_time"].toDouble() * 1000, 0, 'f', 1);
+    summary += QString("Pages: %1 full, %2 compressed, %3 zero, %4 not mapped, %5 from base, %6 stored")
+        .arg(pages["full"].toDouble(), 0, 'f', 0)
+        .arg(pages["compressed"].toDouble(), 0, 'f', 0)
+        .arg(pages["zero"].toDouble(), 0, 'f', 0)
+        .arg(pages["no_page"].toDouble(), 0, 'f', 0)
+        .arg(pages["base"].toDouble(), 0, 'f', 0)
+        .arg(pages["stored"].toDouble(), 0, 'f', 0);
+    if (stats.contains("compression_ratio")) {
+        summary += QString("\n%1 MB written, compression ratio %2")
+            .arg(stats["bytes"].toDouble() / (1024 * 1024), 0, 'f', 1)
+            .arg(stats["compression_ratio"].toDouble(), 0, 'f', 3);
+    }
+    if (stats["dropped_areas"].toInt() > 0) {
+        summary += QString("\n%1 areas are only counted in the totals").arg(stats["dropped_areas"].toInt());
+    }
+    summaryLabel->setText(summary);
+
+    /* Breakdown of each area */
+    QJsonArray areas = stats["areas"].toArray();
+    areaTable->setSortingEnabled(false);
+    areaTable->setRowCount(areas.size());
+    for (int row = 0; row < areas.size(); row++) {
+        QJsonObject area = areas[row].toObject();
+        QJsonObject area_pages = area["pages"].toObject();
+        for (unsigned int col = 0; col < COLUMN_COUNT; col++) {
+            QString key = columnKeys[col];
+            QTableWidgetItem *item;
+            if ((key == "address") || (key == "name")) {
+                item = new QTableWidgetItem(area[key].toString());
+            }
+            else if (key.endsWith("time")) {
+                double value = area[key].toDouble() * 1000;
+                item = new NumberItem(QString::number(value, 'f', 2), value);
+            }
+            else {
+                double value = area.contains(key) ? area[key].toDouble() : area_pages[key].toDouble();
+                item = new NumberItem(QString::number(value, 'f', 0), value);
+            }
+            areaTable->setItem(row, col, item);
+        }
+    }
+    areaTable->setSortingEnabled(true);
+    areaTable->sortByColumn(3, Qt::DescendingOrder);
+}
+
+void SavestateStatsWindow::slotStart()
+{
+    context->config.sc.savestate_settings ^= SharedConfig::SS_STATS;
+    context->config.sc_modified = true;
+    bool collecting = context->config.sc.savestate_settings & SharedConfig::SS_STATS;
+    startButton->setText(collecting?tr("Stop Collecting"):tr("Start Collecting"));
+}
+
+void SavestateStatsWindow::slotExport()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export savestate statistics"), QString(), tr("JSON files (*.json)"));
+    if (filename.isNull())
+        return;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        QMessageBox::warning(this, "Error", QString("Could not write to %1").arg(filename));
+        return;
+    }
+    file.write(QJsonDocument(history).toJson());
+}
+
+void SavestateStatsWindow::slotClear()
+{
+    history = QJsonArray();
+    areaTable->setRowCount(0);
+    summaryLabel->clear();
+}
+
+QSize SavestateStatsWindow::sizeHint() const
+{
+    return QSize(900, 600);
+}
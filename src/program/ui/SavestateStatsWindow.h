@@ -0,0 +1,61 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SAVESTATESTATSWINDOW_H_INCLUDED
+#define LIBTAS_SAVESTATESTATSWINDOW_H_INCLUDED
+
+#include <QtWidgets/QDialog>
+#include <QtWidgets/QTableWidget>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QPushButton>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+
+/* Forward declaration */
+struct Context;
+
+/* Show the statistics of each savestate save and load, with a breakdown of
+ * every memory area, and export them as JSON. */
+class SavestateStatsWindow : public QDialog {
+    Q_OBJECT
+
+public:
+    SavestateStatsWindow(Context *c, QWidget *parent = Q_NULLPTR);
+
+    QSize sizeHint() const override;
+
+public slots:
+    void addStats(QJsonObject stats);
+
+private:
+    Context *context;
+    QLabel *summaryLabel;
+    QTableWidget *areaTable;
+    QPushButton *startButton;
+
+    /* All received statistics */
+    QJsonArray history;
+
+private slots:
+    void slotStart();
+    void slotExport();
+    void slotClear();
+};
+
+#endif
@@ -27,6 +27,7 @@
 #include "MoviePane.h"
 #include "../../Context.h"
 #include "tooltip/ToolTipComboBox.h"
+#include "tooltip/ToolTipCheckBox.h"
 
 MoviePane::MoviePane(Context* c) : context(c)
 {
@@ -71,6 +72,9 @@ void MoviePane::initLayout()
 
     generalLayout->addRow(new QLabel(tr("On Movie End:")), endChoice);
 
+    textInputsBox = new ToolTipCheckBox(tr("Store inputs as text"));
+    generalLayout->addRow(textInputsBox);
+
     QVBoxLayout* const mainLayout = new QVBoxLayout;
     mainLayout->addWidget(generalBox);
     mainLayout->addWidget(autosaveBox);
@@ -86,6 +90,7 @@ void MoviePane::initSignals()
     connect(autosaveFrames, QOverload<int>::of(&QSpinBox::valueChanged), this, &MoviePane::saveConfig);
     connect(autosaveCount, QOverload<int>::of(&QSpinBox::valueChanged), this, &MoviePane::saveConfig);
     connect(endChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &MoviePane::saveConfig);    
+    connect(textInputsBox, &QCheckBox::toggled, this, &MoviePane::saveConfig);
 }
 
 void MoviePane::initToolTips()
@@ -96,6 +101,13 @@ void MoviePane::initToolTips()
     "<b>Keep Reading:</b> Stay in playback mode, and send blank inputs on each frame."
     "A blank input is defined as all bool inputs set to false, all value inputs set to 0.<br><br>"
     "<b>Switch to Writing:</b> Switch to writing mode.");
+
+    textInputsBox->setTitle("Store inputs as text");
+    textInputsBox->setDescription("Inputs are always stored in a binary format "
+    "inside the movie file, which is fast to load and save. When checked, "
+    "inputs are also stored as text, which is slower for long movies, but "
+    "can be read and edited by other programs and by older versions of libTAS.<br><br>"
+    "If the text inputs were modified, they are used instead of the binary inputs.");
 }
 
 
@@ -121,6 +133,8 @@ void MoviePane::loadConfig()
 
     int index = endChoice->findData(context->config.on_movie_end);
     if (index != -1) endChoice->setCurrentIndex(index);
+
+    textInputsBox->setChecked(context->config.movie_text_inputs);
 }
 
 void MoviePane::saveConfig()
@@ -131,6 +145,7 @@ void MoviePane::saveConfig()
     context->config.autosave_count = autosaveCount->value();
 
     context->config.on_movie_end = endChoice->itemData(endChoice->currentIndex()).toInt();
+    context->config.movie_text_inputs = textInputsBox->isChecked();
     context->config.sc_modified = true;
 }
 
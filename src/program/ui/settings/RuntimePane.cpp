@@ -31,6 +31,7 @@
 #include "tooltip/ToolTipComboBox.h"
 #include "tooltip/ToolTipCheckBox.h"
 #include "tooltip/ToolTipGroupBox.h"
+#include "tooltip/ToolTipSpinBox.h"
 
 RuntimePane::RuntimePane(Context* c) : context(c)
 {
@@ -95,6 +96,13 @@ void RuntimePane::initLayout()
     stateCompressedBox = new ToolTipCheckBox(tr("Compressed savestates"));
     stateUnmappedBox = new ToolTipCheckBox(tr("Skip unmapped pages"));
     stateForkBox = new ToolTipCheckBox(tr("Fork to save states"));
+    stateDedupBox = new ToolTipCheckBox(tr("Share identical pages in RAM"));
+    stateSkipUnchangedBox = new ToolTipCheckBox(tr("Only restore modified pages"));
+    if (!context->is_soft_dirty) {
+        stateSkipUnchangedBox->setEnabled(false);
+        context->config.sc.savestate_settings &= ~SharedConfig::SS_SKIP_UNCHANGED;
+    }
+    stateLazyBox = new ToolTipCheckBox(tr("Load states on demand"));
 
     savestateLayout->addWidget(stateIncrementalBox, 0, 0);
     savestateLayout->addWidget(stateRamBox, 0, 1);
@@ -102,6 +110,32 @@ void RuntimePane::initLayout()
     savestateLayout->addWidget(stateCompressedBox, 1, 1);
     savestateLayout->addWidget(stateUnmappedBox, 2, 0);
     savestateLayout->addWidget(stateForkBox, 2, 1);
+    savestateLayout->addWidget(stateDedupBox, 3, 0);
+    savestateLayout->addWidget(stateSkipUnchangedBox, 3, 1);
+    savestateLayout->addWidget(stateLazyBox, 4, 0);
+
+    QFormLayout* stateBlockLayout = new QFormLayout;
+    stateBlockLayout->setFormAlignment(Qt::AlignLeft | Qt::AlignTop);
+    stateBlockLayout->setFieldGrowthPolicy(QFormLayout::AllNonFixedFieldsGrow);
+
+    stateBlockChoice = new ToolTipComboBox();
+    stateBlockChoice->addItem(tr("4 KB (single page)"), 1);
+    stateBlockChoice->addItem(tr("64 KB"), 16);
+    stateBlockChoice->addItem(tr("256 KB"), 64);
+
+    stateCodecChoice = new ToolTipComboBox();
+    stateCodecChoice->addItem(tr("lz4"), SharedConfig::CODEC_LZ4);
+    stateCodecChoice->addItem(tr("lz4hc"), SharedConfig::CODEC_LZ4HC);
+    stateCodecChoice->addItem(tr("zstd"), SharedConfig::CODEC_ZSTD);
+
+    stateCodecLevel = new ToolTipSpinBox();
+    stateCodecLevel->setRange(0, 22);
+    stateCodecLevel->setSpecialValueText(tr("Default"));
+
+    stateBlockLayout->addRow(new QLabel(tr("Compression codec:")), stateCodecChoice);
+    stateBlockLayout->addRow(new QLabel(tr("Compression level:")), stateCodecLevel);
+    stateBlockLayout->addRow(new QLabel(tr("Compression block size:")), stateBlockChoice);
+    savestateLayout->addLayout(stateBlockLayout, 5, 0, 1, 2);
 
     timingBox = new QGroupBox(tr("Timing"));
     QVBoxLayout* timingMainLayout = new QVBoxLayout;
@@ -197,6 +231,12 @@ void RuntimePane::initSignals()
     connect(stateCompressedBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(stateUnmappedBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(stateForkBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateDedupBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateSkipUnchangedBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateLazyBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateBlockChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &RuntimePane::saveConfig);
+    connect(stateCodecChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &RuntimePane::saveConfig);
+    connect(stateCodecLevel, QOverload<int>::of(&QSpinBox::valueChanged), this, &RuntimePane::saveConfig);
 
     connect(trackingTimeBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(trackingGettimeofdayBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
@@ -268,9 +308,58 @@ void RuntimePane::initToolTips()
     stateForkBox->setDescription("Fork the game process when saving a state, "
     "so that the forked process is doing the saving, and you can resume the game "
     "almost instantly without altering the state that is being saved, thanks to "
-    "Linux copy-on-write magic. Useful for games that take a long time to save."
+    "Linux copy-on-write magic. Useful for games that take a long time to save. "
+    "Several states can be saved at the same time, and each state is only "
+    "replaced when its saving has finished. Forked processes always save "
+    "complete states, even with incremental savestates."
     "<br><br><em>If unsure, leave this unchecked</em>");
 
+    stateDedupBox->setDescription("Store each distinct memory page only once, "
+    "and share it between all savestates. This requires <em>Store savestates in RAM</em>, "
+    "and greatly lowers memory usage when keeping many similar savestates. "
+    "Shared pages are not compressed, and this option has no effect when "
+    "forking to save states."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateSkipUnchangedBox->setDescription("When loading a state, only restore the "
+    "memory pages that were modified since the last time this state was saved or "
+    "loaded, using the soft-dirty bit of the kernel. This makes reloading the same "
+    "state repeatedly much faster on games using a lot of memory. "
+    "Only available if your kernel supports soft-dirty."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateLazyBox->setDescription("When loading a state, large memory areas are "
+    "not restored immediately. Their pages are restored when the game first "
+    "accesses them, while a background thread restores the remaining pages. "
+    "This makes loading states faster on games using a lot of memory. "
+    "It requires userfaultfd, which may need to be allowed for users with "
+    "<em>sysctl vm.unprivileged_userfaultfd=1</em>, otherwise states are fully loaded. "
+    "Its memory is reserved when the game starts, so it is slower if enabled later."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateCodecChoice->setTitle("Compression codec");
+    stateCodecChoice->setDescription("Codec used to compress savestates. lz4 is "
+    "the fastest, lz4hc produces smaller states that load as fast as lz4 but take "
+    "longer to save, and zstd gives the smallest states. Codecs that were not "
+    "available when building libTAS fall back to lz4. The memory of the codec "
+    "is reserved when the game starts, so a codec or a level that needs more "
+    "memory falls back to lz4 or to a lower level until the game is restarted. "
+    "Use the codec benchmark in the Tools menu to compare them on the current game."
+    "<br><br><em>If unsure, leave this to 'lz4'</em>");
+
+    stateCodecLevel->setTitle("Compression level");
+    stateCodecLevel->setDescription("Compression level of the codec. Higher "
+    "levels give smaller savestates but are slower to save. For lz4, this is the "
+    "acceleration factor instead, so higher values are faster but give bigger "
+    "savestates."
+    "<br><br><em>If unsure, leave this to 'Default'</em>");
+
+    stateBlockChoice->setTitle("Compression block size");
+    stateBlockChoice->setDescription("Consecutive memory pages are compressed "
+    "together in blocks of this size, which gives better compression and faster "
+    "state saving and loading on big games. Only used with compressed savestates."
+    "<br><br><em>If unsure, leave this to '4 KB (single page)'</em>");
+
     trackingBox->setDescription("By checking a specific function, time will advance "
     "a bit when too many calls of that function have been made from the main thread. "
     "This prevents softlocks when a game wait in a loop for time to advance.<br><br>"
@@ -372,6 +461,19 @@ void RuntimePane::loadConfig()
     stateCompressedBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_COMPRESSED);
     stateUnmappedBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_PRESENT);
     stateForkBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_FORK);
+    stateDedupBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_DEDUP);
+    stateSkipUnchangedBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_SKIP_UNCHANGED);
+    stateLazyBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_LAZY);
+
+    index = stateBlockChoice->findData(context->config.sc.savestate_block_pages);
+    if (index >= 0)
+        stateBlockChoice->setCurrentIndex(index);
+
+    index = stateCodecChoice->findData(context->config.sc.savestate_codec);
+    if (index >= 0)
+        stateCodecChoice->setCurrentIndex(index);
+
+    stateCodecLevel->setValue(context->config.sc.savestate_codec_level);
 
     trackingTimeBox->setChecked(context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_TIME] != -1);
     trackingGettimeofdayBox->setChecked(context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_GETTIMEOFDAY] != -1);
@@ -416,6 +518,12 @@ void RuntimePane::saveConfig()
     context->config.sc.savestate_settings |= stateCompressedBox->isChecked() ? SharedConfig::SS_COMPRESSED : 0;
     context->config.sc.savestate_settings |= stateUnmappedBox->isChecked() ? SharedConfig::SS_PRESENT : 0;
     context->config.sc.savestate_settings |= stateForkBox->isChecked() ? SharedConfig::SS_FORK : 0;
+    context->config.sc.savestate_settings |= stateDedupBox->isChecked() ? SharedConfig::SS_DEDUP : 0;
+    context->config.sc.savestate_settings |= stateSkipUnchangedBox->isChecked() ? SharedConfig::SS_SKIP_UNCHANGED : 0;
+    context->config.sc.savestate_settings |= stateLazyBox->isChecked() ? SharedConfig::SS_LAZY : 0;
+    context->config.sc.savestate_block_pages = stateBlockChoice->currentData().toInt();
+    context->config.sc.savestate_codec = stateCodecChoice->currentData().toInt();
+    context->config.sc.savestate_codec_level = stateCodecLevel->value();
 
     context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_TIME] = trackingTimeBox->isChecked() ? 100 : -1;
     context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_GETTIMEOFDAY] = trackingGettimeofdayBox->isChecked() ? 100 : -1;
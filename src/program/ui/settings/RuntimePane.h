@@ -28,6 +28,7 @@ class QCheckBox;
 class ToolTipComboBox;
 class ToolTipCheckBox;
 class ToolTipGroupBox;
+class ToolTipSpinBox;
 class QGroupBox;
 
 class RuntimePane : public QWidget {
@@ -62,6 +63,12 @@ private:
     ToolTipCheckBox* stateCompressedBox;
     ToolTipCheckBox* stateUnmappedBox;
     ToolTipCheckBox* stateForkBox;
+    ToolTipCheckBox* stateDedupBox;
+    ToolTipCheckBox* stateSkipUnchangedBox;
+    ToolTipCheckBox* stateLazyBox;
+    ToolTipComboBox* stateBlockChoice;
+    ToolTipComboBox* stateCodecChoice;
+    ToolTipSpinBox* stateCodecLevel;
 
     ToolTipGroupBox* trackingBox;
 
@@ -0,0 +1,216 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AllInputsEncoder.h"
+#include "sockethelpers.h"
+
+#ifdef SOCKET_LOG
+#include "lcf.h"
+#include "../library/logging.h"
+#else
+#include <iostream>
+#endif
+
+/* Get the fields of the inputs as 32-bit values */
+static void getFields(const AllInputs& ai, uint32_t* fields)
+{
+    int f = 0;
+    for (int i=0; i<AllInputs::MAXKEYS; i++)
+        fields[f++] = ai.keyboard[i];
+
+    fields[f++] = ai.pointer_x;
+    fields[f++] = ai.pointer_y;
+    fields[f++] = ai.pointer_mode;
+    fields[f++] = ai.pointer_mask;
+
+    for (int j=0; j<AllInputs::MAXJOYS; j++)
+        for (int a=0; a<AllInputs::MAXAXES; a++)
+            fields[f++] = static_cast<uint16_t>(ai.controller_axes[j][a]);
+
+    for (int j=0; j<AllInputs::MAXJOYS; j++)
+        fields[f++] = ai.controller_buttons[j];
+
+    fields[f++] = ai.flags;
+    fields[f++] = ai.framerate_den;
+    fields[f++] = ai.framerate_num;
+    fields[f++] = ai.realtime_sec;
+    fields[f++] = ai.realtime_nsec;
+}
+
+/* Set the fields of the inputs from 32-bit values */
+static void setFields(AllInputs& ai, const uint32_t* fields)
+{
+    int f = 0;
+    for (int i=0; i<AllInputs::MAXKEYS; i++)
+        ai.keyboard[i] = fields[f++];
+
+    ai.pointer_x = fields[f++];
+    ai.pointer_y = fields[f++];
+    ai.pointer_mode = fields[f++];
+    ai.pointer_mask = fields[f++];
+
+    for (int j=0; j<AllInputs::MAXJOYS; j++)
+        for (int a=0; a<AllInputs::MAXAXES; a++)
+            ai.controller_axes[j][a] = static_cast<short>(fields[f++]);
+
+    for (int j=0; j<AllInputs::MAXJOYS; j++)
+        ai.controller_buttons[j] = fields[f++];
+
+    ai.flags = fields[f++];
+    ai.framerate_den = fields[f++];
+    ai.framerate_num = fields[f++];
+    ai.realtime_sec = fields[f++];
+    ai.realtime_nsec = fields[f++];
+}
+
+static void writeVarint(uint8_t*& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        *out++ = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(v);
+}
+
+/* Read a varint, returns false if it goes past the end */
+static bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; (in < end) && (shift < 64); shift += 7) {
+        uint8_t b = *in++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+void AllInputsEncoder::reset()
+{
+    last.emptyInputs();
+}
+
+unsigned int AllInputsEncoder::encode(const AllInputs& ai, uint8_t* data)
+{
+    uint32_t fields[FIELD_COUNT];
+    uint32_t last_fields[FIELD_COUNT];
+    getFields(ai, fields);
+    getFields(last, last_fields);
+
+    uint64_t mask = 0;
+    for (int f=0; f<FIELD_COUNT; f++)
+        if (fields[f] != last_fields[f])
+            mask |= 1ull << f;
+
+    if (mask == 0)
+        return 0;
+
+    uint8_t* out = data;
+    writeVarint(out, mask);
+    for (int f=0; f<FIELD_COUNT; f++) {
+        if (mask & (1ull << f)) {
+            /* Zigzag encoding of the signed difference */
+            int32_t delta = static_cast<int32_t>(fields[f] - last_fields[f]);
+            writeVarint(out, (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+        }
+    }
+
+    last = ai;
+    return out - data;
+}
+
+bool AllInputsEncoder::decode(const uint8_t* data, unsigned int size, AllInputs& ai)
+{
+    if (size == 0) {
+        ai = last;
+        return true;
+    }
+
+    uint32_t fields[FIELD_COUNT];
+    getFields(last, fields);
+
+    const uint8_t* end = data + size;
+    uint64_t mask;
+    if (!readVarint(data, end, mask) || (mask >> FIELD_COUNT))
+        return false;
+
+    for (int f=0; f<FIELD_COUNT; f++) {
+        if (mask & (1ull << f)) {
+            uint64_t zigzag;
+            if (!readVarint(data, end, zigzag))
+                return false;
+            uint32_t delta = static_cast<uint32_t>(zigzag >> 1) ^ -static_cast<uint32_t>(zigzag & 1);
+            fields[f] += delta;
+        }
+    }
+
+    if (data != end)
+        return false;
+
+    setFields(last, fields);
+    ai = last;
+    return true;
+}
+
+void AllInputsEncoder::send(int message, const AllInputs& ai)
+{
+    sendMessage(message);
+
+    if (!enabled) {
+        sendData(&ai, sizeof(AllInputs));
+        return;
+    }
+
+    uint8_t data[MAX_SIZE];
+    uint16_t size = encode(ai, data);
+    sendData(&size, sizeof(uint16_t));
+    if (size)
+        sendData(data, size);
+}
+
+void AllInputsEncoder::receive(AllInputs& ai)
+{
+    if (!enabled) {
+        receiveData(&ai, sizeof(AllInputs));
+        return;
+    }
+
+    uint16_t size;
+    receiveData(&size, sizeof(uint16_t));
+
+    uint8_t data[MAX_SIZE];
+    if (size > MAX_SIZE) {
+#ifdef SOCKET_LOG
+        libtas::debuglogstdio(LCF_SOCKET | LCF_ERROR, "Compact inputs of size %u are too large", size);
+#else
+        std::cerr << "Compact inputs of size " << size << " are too large" << std::endl;
+#endif
+        return;
+    }
+    if (size)
+        receiveData(data, size);
+
+    if (!decode(data, size, ai)) {
+#ifdef SOCKET_LOG
+        libtas::debuglogstdio(LCF_SOCKET | LCF_ERROR, "Could not decode compact inputs");
+#else
+        std::cerr << "Could not decode compact inputs" << std::endl;
+#endif
+    }
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_ALLINPUTSENCODER_H_INCLUDED
+#define LIBTAS_ALLINPUTSENCODER_H_INCLUDED
+
+#include "AllInputs.h"
+#include <stdint.h>
+
+/* Compact encoding of the inputs that are sent to the game every frame.
+ *
+ * Inputs are encoded relative to the previous inputs sent with the same
+ * encoder: a bitmask of the fields that changed, followed by the difference
+ * of each changed field as a zigzag varint. Inputs equal to the previous ones
+ * are encoded with a size of zero. Both sides must reset their encoder at the
+ * same time, when the game starts and when a state is loaded.
+ *
+ * The encoding is used only if both the program and the library support the
+ * same version, which is negotiated during initialization. Otherwise the whole
+ * AllInputs struct is sent. */
+class AllInputsEncoder {
+    public:
+        /* Version of the encoding */
+        static const int VERSION = 1;
+
+        /* Number of encoded fields of AllInputs */
+        static const int FIELD_COUNT = AllInputs::MAXKEYS + 4 +
+            AllInputs::MAXJOYS * AllInputs::MAXAXES + AllInputs::MAXJOYS + 5;
+
+        /* Maximum size of encoded inputs: the bitmask and one 32-bit varint
+         * per field */
+        static const int MAX_SIZE = 10 + FIELD_COUNT * 5;
+
+        /* If the compact encoding was negotiated */
+        bool enabled;
+
+        /* Set the previous inputs to empty inputs. There is no constructor,
+         * so that global encoders of the library are not initialized after
+         * the library constructor, and this must be called before use. */
+        void reset();
+
+        /* Encode inputs into data, which must hold MAX_SIZE bytes.
+         * Returns the encoded size, which is zero if the inputs did not change */
+        unsigned int encode(const AllInputs& ai, uint8_t* data);
+
+        /* Decode inputs of the specified size.
+         * Returns false if the data is invalid */
+        bool decode(const uint8_t* data, unsigned int size, AllInputs& ai);
+
+        /* Send a message followed by the inputs */
+        void send(int message, const AllInputs& ai);
+
+        /* Receive the inputs following a message */
+        void receive(AllInputs& ai);
+
+    private:
+        /* Previous inputs */
+        AllInputs last;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMORYMIRROR_H_INCLUDED
+#define LIBTAS_MEMORYMIRROR_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Layout of the memory mirror, a memfd created by the game and mapped by the
+ * program. It holds a copy of the game memory pages that the program reads
+ * often (ram watches, lua), so that the program can read them with plain
+ * loads instead of syscalls while the game waits at the frame boundary.
+ *
+ * The mirror starts with a header, followed by the copied pages in the same
+ * order as the page addresses of the header.
+ */
+#define MIRROR_MAX_PAGES 1024
+#define MIRROR_PAGE_SIZE 4096
+
+struct MirrorHeader {
+    /* Number of mirrored pages */
+    uint32_t count;
+
+    /* If each page could be copied */
+    uint8_t valid[MIRROR_MAX_PAGES];
+
+    /* Address of each mirrored page */
+    uint64_t addresses[MIRROR_MAX_PAGES];
+};
+
+#define MIRROR_HEADER_SIZE (((sizeof(MirrorHeader) + MIRROR_PAGE_SIZE - 1) / MIRROR_PAGE_SIZE) * MIRROR_PAGE_SIZE)
+#define MIRROR_SIZE (MIRROR_HEADER_SIZE + static_cast<size_t>(MIRROR_MAX_PAGES) * MIRROR_PAGE_SIZE)
+
+#endif
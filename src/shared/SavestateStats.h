@@ -0,0 +1,90 @@
+/*
+    Copyright 2015-2020 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SAVESTATESTATS_H_INCLUDED
+#define LIBTAS_SAVESTATESTATS_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * Statistics of a savestate save or load, collected by the game when
+ * SharedConfig::SS_STATS is set, and sent to the program followed by the
+ * statistics of each saved memory area.
+ */
+struct SavestateStats {
+    enum Operation {
+        SAVE,
+        LOAD,
+    };
+
+    /* Page flags, with the same values as the flags of the savestate pagemap */
+    enum PageFlag {
+        NONE,
+        NO_PAGE,
+        ZERO_PAGE,
+        FULL_PAGE,
+        BASE_PAGE,
+        COMPRESSED_PAGE,
+        COMPRESSED_BLOCK_START,
+        COMPRESSED_BLOCK,
+        STORED_PAGE,
+        FLAG_COUNT
+    };
+
+    struct Area {
+        uint64_t addr;
+        uint64_t size;
+        char name[128];
+
+        /* Number of pages of each flag */
+        uint64_t pages[FLAG_COUNT];
+
+        /* Bytes written in the pages file (saving only) */
+        uint64_t bytes;
+
+        /* Time spent on the area, and inside it to check for zero pages and
+         * to (de)compress pages. Compression is performed by several threads,
+         * so its time can be larger than the area time. */
+        double time;
+        double zero_time;
+        double codec_time;
+    };
+
+    int operation;
+    int slot;
+
+    /* Number of areas following this struct */
+    int area_count;
+
+    /* Areas that did not fit in the statistics, but are in the totals */
+    int dropped_areas;
+
+    /* Time with the game threads suspended, and its breakdown */
+    double total_time;
+    double suspend_time;
+    double maps_time; /* Parsing and preparing the memory layout */
+
+    /* Sums over all areas */
+    uint64_t pages[FLAG_COUNT];
+    uint64_t bytes;
+    double zero_time;
+    double codec_time;
+};
+
+#endif
@@ -271,11 +271,34 @@ struct __attribute__((packed, aligned(8))) SharedConfig {
         SS_COMPRESSED = 0x08, /* Compress savestates */
         SS_PRESENT = 0x10, /* Skip unmapped pages */
         SS_FORK = 0x20, /* Use a forked process to save the state */
+        SS_DEDUP = 0x40, /* Share identical pages between savestates in RAM */
+        SS_SKIP_UNCHANGED = 0x80, /* Only restore pages modified since the last save or load of the same state */
+        SS_LAZY = 0x100, /* Restore large memory areas on demand after loading a state */
+        SS_STATS = 0x200, /* Collect statistics of each savestate and send them to the program */
     };
 
     /* Savestate settings */
     int savestate_settings = SS_COMPRESSED;
 
+    /* Number of consecutive pages compressed together in savestates, up to
+     * 64 pages. A value of 1 compresses each page individually */
+    int savestate_block_pages = 1;
+
+    /* An enum indicating the codec used to compress savestates */
+    enum SaveStateCodec
+    {
+        CODEC_LZ4 = 0, /* Fast lz4 compression */
+        CODEC_LZ4HC = 1, /* Slower lz4 compression with a better ratio */
+        CODEC_ZSTD = 2, /* zstd compression */
+    };
+
+    /* Codec used to compress savestates */
+    int savestate_codec = CODEC_LZ4;
+
+    /* Compression level of the savestate codec, or 0 for the default level.
+     * For lz4, this is the acceleration factor */
+    int savestate_codec_level = 0;
+
     /* Stacktrace hash to advance time */
     uint64_t busy_loop_hash = 0;
 
@@ -42,14 +42,15 @@ enum {
 
     /*
      * Send all inputs to the game
-     * Argument: AllInputs
+     * Argument: AllInputs, or uint16_t (size) then uint8_t[size] if the
+     * compact encoding is used (see AllInputsEncoder.h)
      */
     MSGN_ALL_INPUTS,
 
     /*
      * Send all inputs to the game during a frame boundary, so that it can
      * display the inputs in the HUD
-     * Argument: AllInputs
+     * Argument: same as MSGN_ALL_INPUTS
      */
     MSGN_PREVIEW_INPUTS,
 
@@ -311,6 +312,54 @@ enum {
      */
     MSGB_SYMBOL_ADDRESS,
 
+    /*
+     * Ask the game to compare savestate codecs on the current savestate
+     * Argument: none
+     */
+    MSGN_SAVESTATE_BENCHMARK,
+
+    /*
+     * Send the result of the savestate codec benchmark
+     * Argument: size_t (string length) then char[len]
+     */
+    MSGB_SAVESTATE_BENCHMARK,
+
+    /*
+     * Send the statistics of the last savestate save or load
+     * Argument: SavestateStats then SavestateStats::Area[area_count]
+     */
+    MSGB_SAVESTATE_STATS,
+
+    /*
+     * During init, send the file descriptor of the memory mirror (see
+     * MemoryMirror.h), or -1 if it could not be created. As a reply to
+     * MSGN_MEMORY_MIRROR, send the number of mirrored pages.
+     * Argument: int
+     */
+    MSGB_MEMORY_MIRROR,
+
+    /*
+     * Send the list of game memory pages to copy into the memory mirror at
+     * each frame boundary and after loading a state. An empty list stops
+     * the mirror.
+     * Argument: int (count) then uint64_t[count]
+     */
+    MSGN_MEMORY_MIRROR,
+
+    /*
+     * During init, send the version of the compact encoding of inputs that
+     * the library supports
+     * Argument: int
+     */
+    MSGB_COMPACT_INPUTS,
+
+    /*
+     * During init, tell the game that inputs will be sent with the compact
+     * encoding of the specified version
+     * Argument: int
+     */
+    MSGN_COMPACT_INPUTS,
+
 };
 
 #endif
@@ -49,6 +49,10 @@ static int socket_fd = 0;
 
 static std::mutex mutex;
 
+/* Data stored until the next flush, if buffering */
+static bool buffering = false;
+static std::vector<char> send_buffer;
+
 int removeSocket(void) {
     int ret = unlink(SOCKET_FILENAME);
     if ((ret == -1) && (errno != ENOENT))
@@ -163,8 +167,30 @@ void unlockSocket(void)
     mutex.unlock();
 }
 
+void bufferSocket(void)
+{
+    buffering = true;
+}
+
+int flushSocket(void)
+{
+    buffering = false;
+    if (send_buffer.empty())
+        return 0;
+
+    int ret = sendData(send_buffer.data(), send_buffer.size());
+    send_buffer.clear();
+    return ret;
+}
+
 int sendData(const void* elem, unsigned int size)
 {
+    if (buffering) {
+        const char* data = static_cast<const char*>(elem);
+        send_buffer.insert(send_buffer.end(), data, data + size);
+        return size;
+    }
+
 #ifdef SOCKET_LOG
     libtas::debuglogstdio(LCF_SOCKET, "Send socket data of size %u", size);
 #endif
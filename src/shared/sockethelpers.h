@@ -42,6 +42,15 @@ void lockSocket(void);
 /* Unlock access to socket */
 void unlockSocket(void);
 
+/* Store the data sent over the socket instead of sending it, until
+ * flushSocket() is called, so that several messages are sent in a single
+ * write.
+ */
+void bufferSocket(void);
+
+/* Send the data stored since bufferSocket() was called */
+int flushSocket(void);
+
 /* Send data over the socket. Data is stored at the beginning of
  * pointer elem, and has the specified size in bytes.
  */
@@ -0,0 +1,289 @@
+/* Benchmark of the RAM search, running the scanner over a memory image
+ * instead of a game process. The image is either a synthetic heap, or a
+ * savestate (pagemap and pages files) that was saved without compression
+ * and without incremental savestates.
+ *
+ * For each value type, compare operator and thread count, it reports the
+ * speed of a first scan against a value, and of a scan against the
+ * previous values following an unknown value first scan. The number of
+ * results must not depend on the thread count, so it also works as a test
+ * of the scan logic.
+ *
+ * Can be compiled from the source directory with:
+ *   moc src/program/ramsearch/MemScanner.h -o moc_MemScanner.cpp
+ *   g++ -std=c++11 -O2 -pthread -fPIC -o ramsearchbench utils/ramsearchbench.cpp moc_MemScanner.cpp \
+ *       src/program/ramsearch/{MemScanner,MemScannerThread,MemScanPool,MemScanStore,CompareOperations,MemAccess,MemLayout,MemSection,MemDirtyPages}.cpp \
+ *       `pkg-config --libs --cflags Qt5Core`
+ *
+ * Usage: ramsearchbench [-s size_in_MB] [-d zero|random|mixed] [-t threads,...] [state.pm state.p]
+ */
+
+#include "../src/program/ramsearch/MemScanner.h"
+#include "../src/program/ramsearch/MemAccess.h"
+#include "../src/program/ramsearch/TypeIndex.h"
+#include "../src/library/checkpoint/MemArea.h"
+#include "../src/library/checkpoint/StateHeader.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Address of the synthetic image, as in a 64-bit heap */
+#define SYNTHETIC_ADDRESS 0x55d000000000ull
+
+/* Memory image: each area has its own buffer */
+struct Image {
+    std::vector<MemAccess::ImageArea> areas;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<MemSection> sections;
+    uint64_t size = 0;
+
+    void add(uintptr_t addr, std::vector<uint8_t>&& buffer, bool writable)
+    {
+        MemSection section;
+        section.addr = addr;
+        section.endaddr = addr + buffer.size();
+        section.size = buffer.size();
+        section.readflag = true;
+        section.writeflag = writable;
+        section.execflag = false;
+        section.sharedflag = false;
+        section.offset = 0;
+        section.inode = 0;
+        section.type = writable ? MemSection::MemHeap : MemSection::MemAnonymousMappingRO;
+        sections.push_back(section);
+
+        size += buffer.size();
+        buffers.push_back(std::move(buffer));
+        areas.push_back({addr, buffers.back().size(), buffers.back().data()});
+    }
+};
+
+/* Fill a synthetic heap. The mixed distribution looks like game memory: a
+ * lot of zero pages, small integers, floats, pointers and random data. */
+static void buildSynthetic(Image& image, uint64_t size, const std::string& distribution)
+{
+    std::mt19937_64 rng(0);
+    std::vector<uint8_t> buffer(size);
+
+    for (uint64_t p = 0; p < size; p += 4096) {
+        int kind;
+        if (distribution == "zero")
+            kind = 0;
+        else if (distribution == "random")
+            kind = 4;
+        else
+            kind = rng() % 5;
+
+        uint8_t* page = &buffer[p];
+        switch (kind) {
+            case 0:
+                break;
+            case 1:
+                for (int i = 0; i < 4096; i += 4) {
+                    int32_t v = rng() % 256;
+                    memcpy(page + i, &v, 4);
+                }
+                break;
+            case 2:
+                for (int i = 0; i < 4096; i += 4) {
+                    float v = static_cast<float>(static_cast<int64_t>(rng() % 2000000) - 1000000) / 1000;
+                    memcpy(page + i, &v, 4);
+                }
+                break;
+            case 3:
+                for (int i = 0; i < 4096; i += 8) {
+                    uint64_t v = SYNTHETIC_ADDRESS + (rng() % size);
+                    memcpy(page + i, &v, 8);
+                }
+                break;
+            default:
+                for (int i = 0; i < 4096; i += 8) {
+                    uint64_t v = rng();
+                    memcpy(page + i, &v, 8);
+                }
+                break;
+        }
+    }
+
+    image.add(SYNTHETIC_ADDRESS, std::move(buffer), true);
+}
+
+/* Load the memory of an uncompressed savestate */
+static bool loadSavestate(Image& image, const std::string& pagemap_path, const std::string& pages_path)
+{
+    std::ifstream pagemap(pagemap_path, std::ios::binary);
+    std::ifstream pages(pages_path, std::ios::binary);
+    if (!pagemap || !pages) {
+        std::cerr << "Could not open savestate " << pagemap_path << std::endl;
+        return false;
+    }
+
+    libtas::StateHeader header;
+    pagemap.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    while (true) {
+        libtas::Area area;
+        pagemap.read(reinterpret_cast<char*>(&area), sizeof(area));
+        if (!pagemap) {
+            std::cerr << "Savestate " << pagemap_path << " is truncated" << std::endl;
+            return false;
+        }
+        if (!area.addr)
+            break;
+        if (area.skip)
+            continue;
+
+        std::vector<char> flags(area.size / 4096);
+        pagemap.read(flags.data(), flags.size());
+
+        std::vector<uint8_t> buffer(area.size);
+        off_t offset = area.page_offset;
+        for (size_t p = 0; p < flags.size(); p++) {
+            switch (flags[p]) {
+                case libtas::Area::NONE:
+                case libtas::Area::NO_PAGE:
+                case libtas::Area::ZERO_PAGE:
+                    break;
+                case libtas::Area::FULL_PAGE:
+                    pages.seekg(offset);
+                    pages.read(reinterpret_cast<char*>(&buffer[p * 4096]), 4096);
+                    offset += 4096;
+                    break;
+                default:
+                    std::cerr << "Savestate " << pagemap_path << " contains compressed or incremental pages, which are not supported" << std::endl;
+                    return false;
+            }
+        }
+
+        if (!(area.prot & PROT_READ))
+            continue;
+
+        image.add(reinterpret_cast<uintptr_t>(area.addr), std::move(buffer), area.prot & PROT_WRITE);
+    }
+
+    return true;
+}
+
+static const char* type_names[] = {"u8", "s8", "u16", "s16", "u32", "s32", "u64", "s64", "f32", "f64"};
+static const char* operator_names[] = {"==", "!=", "<", ">", "<=", ">=", "~"};
+
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t size = 256;
+    std::string distribution = "mixed";
+    std::vector<int> thread_counts;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                size = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'd':
+                distribution = optarg;
+                break;
+            case 't': {
+                std::istringstream iss(optarg);
+                std::string count;
+                while (std::getline(iss, count, ','))
+                    thread_counts.push_back(std::atoi(count.c_str()));
+                break;
+            }
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-s size_in_MB] [-d zero|random|mixed] [-t threads,...] [state.pm state.p]" << std::endl;
+                return 1;
+        }
+    }
+
+    if (thread_counts.empty()) {
+        int count = std::thread::hardware_concurrency();
+        for (int t = 1; t < count; t *= 2)
+            thread_counts.push_back(t);
+        thread_counts.push_back(count > 0 ? count : 1);
+    }
+
+    Image image;
+    if ((argc - optind) >= 2) {
+        if (!loadSavestate(image, argv[optind], argv[optind+1]))
+            return 1;
+    }
+    else {
+        buildSynthetic(image, size * 1024 * 1024, distribution);
+    }
+
+    if (image.size == 0) {
+        std::cerr << "Empty memory image" << std::endl;
+        return 1;
+    }
+
+    MemAccess::initImage(image.areas);
+
+    char scan_dir[] = "/tmp/ramsearchbenchXXXXXX";
+    if (!mkdtemp(scan_dir)) {
+        std::cerr << "Could not create a scan directory" << std::endl;
+        return 1;
+    }
+    MemScanner::init(scan_dir);
+
+    std::cout << "Image of " << image.size / (1024*1024) << " MB in " << image.areas.size() << " areas" << std::endl;
+    std::cout << "type op  threads   value GB/s   previous GB/s   results" << std::endl;
+
+    double gb = static_cast<double>(image.size) / (1024*1024*1024);
+    int errors = 0;
+
+    for (int type = RamUnsignedChar; type <= RamDouble; type++) {
+        for (int op = static_cast<int>(CompareOperator::Equal); op <= static_cast<int>(CompareOperator::Greater); op++) {
+            CompareOperator compare_operator = static_cast<CompareOperator>(op);
+            uint64_t reference_count = 0;
+
+            for (size_t t = 0; t < thread_counts.size(); t++) {
+                MemScanner scanner;
+                scanner.thread_count = thread_counts[t];
+
+                auto start = std::chrono::steady_clock::now();
+                scanner.first_scan(image.sections, type, CompareType::Value, compare_operator, 0, 0);
+                double value_time = elapsed(start);
+                uint64_t count = scanner.scan_count();
+
+                scanner.first_scan(image.sections, type, CompareType::Previous, compare_operator, 0, 0);
+                start = std::chrono::steady_clock::now();
+                scanner.scan(false, CompareType::Previous, compare_operator, 0, 0);
+                double previous_time = elapsed(start);
+
+                std::cout << std::setw(4) << type_names[type] << " " << std::setw(2) << operator_names[op]
+                          << std::setw(9) << thread_counts[t]
+                          << std::fixed << std::setprecision(2)
+                          << std::setw(13) << gb / value_time
+                          << std::setw(16) << gb / previous_time
+                          << std::setw(10) << count << std::endl;
+
+                if (t == 0) {
+                    reference_count = count;
+                }
+                else if (count != reference_count) {
+                    std::cerr << "error: " << count << " results with " << thread_counts[t] << " threads instead of " << reference_count << std::endl;
+                    errors++;
+                }
+            }
+        }
+    }
+
+    rmdir(scan_dir);
+    return errors ? 1 : 0;
+}